@@ -0,0 +1,338 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "audio_capture.h"
+#include "capture_hal.h"
+#include "profiler.h"
+#include "test_source.h"
+#include "dsp_chain.h"
+#include "audio_tap.h"
+#include "audio_meter.h"
+#include "pcm_decim.h"
+#include "sync_map.h"
+
+#if defined(__arm__)
+#include "cycle_counter.h"
+#define CYCLES()  cycles_now()
+#else
+#define CYCLES()  0u
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* BUFFERS                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/* Circular DMA targets: per lane, two halves of one block each */
+static volatile uint16_t dma_buf[AUDIO_CAPTURE_LANES * 2 * AUDIO_CAPTURE_MAX_HALF_HWORDS]
+    __attribute__((aligned(4)));
+
+/* Wire-format PCM between the DMA ISR and SOF */
+AUDIO_RING_STORAGE(ring_storage, AUDIO_CAPTURE_RING_BYTES);
+static struct audio_ring ring;
+
+/* One converted block, staged for the ring write */
+static uint8_t block[AUDIO_CAPTURE_MAX_BLOCK_BYTES]
+    __attribute__((aligned(4)));
+
+/* Active format, fixed between start and stop */
+static struct audio_stream_cfg cur;
+static uint32_t half_hwords;
+static uint32_t in_frames;       /* per block at the capture rate */
+
+static uint32_t blocks_captured;
+static uint32_t pack_cycles_last;
+static uint32_t pack_cycles_max;
+static uint32_t over_budget;
+static uint32_t start_failures;
+
+/* Survives restarts: the host may set volume while the stream is idle */
+static struct audio_gain gain = AUDIO_GAIN_INIT;
+
+#if AUDIO_MIC_PDM
+static struct pdm_decim pdm_state;
+#endif
+
+#if AUDIO_NUM_CONVERTED
+static struct pcm_decim decim_state[AUDIO_NUM_CHANNELS];
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* PRODUCER (DMA ISR)                                                         */
+/* -------------------------------------------------------------------------- */
+
+#if AUDIO_MIC_PDM
+static void convert_half(uint32_t half, uint8_t *dst)
+{
+    int16_t pcm[AUDIO_CAPTURE_MAX_BLOCK_SAMPLES];
+    const volatile uint16_t *src = &dma_buf[half * half_hwords];
+    uint32_t n = in_frames;
+
+    pdm_decim_process(&pdm_state, (const uint16_t *)src, pcm, n);
+
+    for (uint32_t i = 0; i < n; i++) {
+        dst[2 * i + 0] = (uint8_t)(pcm[i] & 0xFF);
+        dst[2 * i + 1] = (uint8_t)((uint16_t)pcm[i] >> 8);
+    }
+}
+#else
+/*
+ * I2S Philips, 32-bit slots. Each mic drives its slot with 24-bit
+ * MSB-first data: the first half-word of a slot holds bits 23..8, the
+ * top byte of the second holds bits 7..0. As little-endian words one
+ * I2S frame is { L_lo << 16 | L_hi, R_lo << 16 | R_hi }.
+ */
+
+/* DMA words per I2S frame */
+#define WORDS_PER_FRAME  (AUDIO_CAPTURE_HWORDS_PER_FRAME / 2)
+
+/* First word of the given half of one lane */
+static const volatile uint32_t *lane_half(uint32_t lane, uint32_t half)
+{
+    return (const volatile uint32_t *)
+        &dma_buf[(2 * lane + half) * half_hwords];
+}
+
+/* 16-bit, one word per L/R pair: L_hi | R_hi << 16 */
+static void pack16(uint32_t half, uint32_t *dst)
+{
+    uint32_t n = in_frames;
+
+#if AUDIO_NUM_CHANNELS == 1
+    /* Mono: two consecutive samples per word */
+    const volatile uint32_t *src = lane_half(0, half);
+
+    for (uint32_t i = 0; i + 1 < n; i += 2) {
+        *dst++ = (src[0] & 0xFFFF) | (src[WORDS_PER_FRAME] << 16);
+        src += 2 * WORDS_PER_FRAME;
+    }
+    if (n & 1) {
+        *(uint16_t *)dst = (uint16_t)src[0];
+    }
+#else
+    for (uint32_t lane = 0; lane < AUDIO_CAPTURE_LANES; lane++) {
+        const volatile uint32_t *src = lane_half(lane, half);
+        uint32_t *out = dst + lane;
+
+        for (uint32_t i = 0; i < n; i++) {
+            *out = (src[0] & 0xFFFF) | (src[1] << 16);
+            src += WORDS_PER_FRAME;
+            out += AUDIO_CAPTURE_LANES;
+        }
+    }
+#endif
+}
+
+/* 24-bit, three bytes per channel */
+static void pack24(uint32_t half, uint8_t *dst)
+{
+    uint32_t n      = in_frames;
+    uint32_t stride = cur.frame_bytes;
+
+    for (uint32_t lane = 0; lane < AUDIO_CAPTURE_LANES; lane++) {
+        const volatile uint32_t *src = lane_half(lane, half);
+        uint8_t *out = dst + lane * 2 * 3;
+
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint32_t ch = 0; ch < 2 && 2 * lane + ch < AUDIO_NUM_CHANNELS; ch++) {
+                uint32_t w = src[ch];
+                out[3 * ch + 0] = (uint8_t)(w >> 24);
+                out[3 * ch + 1] = (uint8_t)(w & 0xFF);
+                out[3 * ch + 2] = (uint8_t)(w >> 8);
+            }
+            src += WORDS_PER_FRAME;
+            out += stride;
+        }
+    }
+}
+
+/* 24-in-32, one left-justified word per channel: bits 23..0 << 8 */
+static void pack32(uint32_t half, uint32_t *dst)
+{
+    uint32_t n = in_frames;
+
+    for (uint32_t lane = 0; lane < AUDIO_CAPTURE_LANES; lane++) {
+        const volatile uint32_t *src = lane_half(lane, half);
+        uint32_t *out = dst + lane * 2;
+
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint32_t ch = 0; ch < 2 && 2 * lane + ch < AUDIO_NUM_CHANNELS; ch++) {
+                uint32_t w = src[ch];
+                out[ch] = ((w << 16) | (w >> 16)) & 0xFFFFFF00u;
+            }
+            src += WORDS_PER_FRAME;
+            out += AUDIO_NUM_CHANNELS;
+        }
+    }
+}
+
+static void convert_half(uint32_t half, uint8_t *dst)
+{
+    switch (cur.subframe_bytes) {
+    case 4:
+        pack32(half, (uint32_t *)dst);
+        break;
+    case 3:
+        pack24(half, dst);
+        break;
+    default:
+        pack16(half, (uint32_t *)dst);
+        break;
+    }
+}
+#endif
+
+#if AUDIO_NUM_CONVERTED
+/* Capture rate -> streamed rate, per channel, in place in the block */
+static void decimate(uint8_t *dst)
+{
+    uint32_t t0 = CYCLES();
+
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        int16_t *pcm = (int16_t *)dst + ch;
+        pcm_decim_process(&decim_state[ch], pcm, pcm, in_frames,
+                          AUDIO_NUM_CHANNELS);
+    }
+    prof_record(PROF_STAGE_DECIM, CYCLES() - t0);
+}
+#endif
+
+/* Each lane's DMA half as captured, for the diagnostic tap */
+static void tap_raw(uint32_t half)
+{
+    for (uint32_t lane = 0; lane < AUDIO_CAPTURE_LANES; lane++) {
+        audio_tap_block(TAP_REC_RAW, (uint8_t)lane,
+                        (const void *)&dma_buf[(2 * lane + half) * half_hwords],
+                        half_hwords * 2);
+    }
+}
+
+/* Half-words the DMA has written into the half after the completed one */
+static uint32_t dma_part(uint32_t half)
+{
+    uint32_t next = (half & 1) ? 0 : half_hwords;
+
+    return (capture_hal_position() + 2 * half_hwords - next) % (2 * half_hwords);
+}
+
+void audio_capture_dma_event(uint32_t half, uint32_t t)
+{
+    uint32_t t0    = CYCLES();
+    uint32_t bytes = (uint32_t)cur.samples_per_frame * cur.frame_bytes;
+
+    sync_map_capture_begin(t, dma_part(half));
+
+    audio_tap_begin(&cur);
+
+    if (test_source_fill(block, cur.samples_per_frame, &cur)) {
+        prof_record(PROF_STAGE_TEST_SOURCE, CYCLES() - t0);
+        audio_tap_block(TAP_REC_CONVERTED, 0, block, bytes);
+    } else {
+        tap_raw(half & 1);
+        convert_half(half & 1, block);
+#if AUDIO_NUM_CONVERTED
+        if (cur.capture_hz != cur.rate_hz) {
+            decimate(block);
+        }
+#endif
+        audio_tap_block(TAP_REC_CONVERTED, 0, block, bytes);
+
+        uint32_t t1 = CYCLES();
+        dsp_chain_process(block, cur.samples_per_frame, &cur);
+        audio_tap_block(TAP_REC_DSP, 0, block, bytes);
+        audio_gain_apply(&gain, block, cur.samples_per_frame, &cur);
+        prof_record(PROF_STAGE_DSP, CYCLES() - t1);
+    }
+    audio_tap_block(TAP_REC_OUTPUT, 0, block, bytes);
+    audio_meter_block(block, &cur);
+
+    uint32_t dt = CYCLES() - t0;
+    pack_cycles_last = dt;
+    if (dt > pack_cycles_max) {
+        pack_cycles_max = dt;
+    }
+    if (dt > AUDIO_CAPTURE_BUDGET_CYCLES) {
+        over_budget++;
+    }
+
+    /* A full ring counts as an overrun and drops this block */
+    bool stored = audio_ring_write(&ring, block, bytes);
+    blocks_captured++;
+    sync_map_capture_end(blocks_captured * cur.samples_per_frame, stored);
+}
+
+struct audio_ring *audio_capture_ring(void)
+{
+    return &ring;
+}
+
+uint32_t audio_capture_fill_samples(void)
+{
+    uint32_t partial = capture_hal_position() % half_hwords;
+
+    /* Frames in the DMA half are at the capture rate */
+    return audio_ring_fill(&ring) / cur.frame_bytes +
+           partial / AUDIO_CAPTURE_HWORDS_PER_FRAME * cur.rate_hz / cur.capture_hz;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONTROL                                                                    */
+/* -------------------------------------------------------------------------- */
+
+void audio_capture_start(const struct audio_stream_cfg *cfg)
+{
+    /*
+     * Runs from the USB ISR, which preempts the DMA ISR: mask and stop
+     * the DMA before any of the producer's state or the ring is reset.
+     */
+    capture_hal_stop();
+
+    cur         = *cfg;
+    in_frames   = cur.capture_hz / 1000;
+    half_hwords = in_frames * AUDIO_CAPTURE_HWORDS_PER_FRAME;
+
+    audio_ring_init(&ring, ring_storage, sizeof(ring_storage));
+    blocks_captured  = 0;
+    pack_cycles_last = 0;
+    pack_cycles_max  = 0;
+    over_budget      = 0;
+#if AUDIO_MIC_PDM
+    pdm_decim_init(&pdm_state);
+#endif
+#if AUDIO_NUM_CONVERTED
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        (void)pcm_decim_init(&decim_state[ch], cur.rate_hz);
+    }
+#endif
+    test_source_restart();
+    dsp_chain_start(&cur);
+    sync_map_start(&cur);
+
+    if (!capture_hal_start(dma_buf, 2 * half_hwords, cur.capture_hz)) {
+        start_failures++;
+    }
+}
+
+void audio_capture_stop(void)
+{
+    capture_hal_stop();
+    sync_map_stop();
+}
+
+void audio_capture_set_gain(uint32_t ch, int32_t gain_q16)
+{
+    audio_gain_set_channel(&gain, ch, gain_q16);
+}
+
+void audio_capture_get_stats(struct audio_capture_stats *st, int reset)
+{
+    st->blocks           = blocks_captured;
+    st->pack_cycles_last = pack_cycles_last;
+    st->pack_cycles_max  = pack_cycles_max;
+    st->over_budget      = over_budget;
+    st->start_failures   = start_failures;
+    audio_ring_get_stats(&ring, &st->ring);
+
+    if (reset) {
+        pack_cycles_max = 0;
+    }
+}
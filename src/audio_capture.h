@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "audio_ring.h"
+
+#include "usb_audio_uac1.h"
+#include "audio_format.h"
+#include "pdm_decim.h"
+#include "audio_gain.h"
+
+/*
+ * Microphone capture: I2S DMA double buffer -> sample ring.
+ *
+ * The DMA half/full-transfer interrupt converts the completed half into
+ * little-endian PCM and pushes it into an SPSC ring. The SOF callback
+ * pulls whole packets from the ring; no per-sample work happens on the
+ * USB path and neither side ever blocks the other.
+ *
+ * For format rows with a capture rate (audio_format.h) the mics and the
+ * DMA run at that rate and each converted block is decimated to the
+ * streamed rate (pcm_decim.h) before anything downstream sees it.
+ *
+ * A test source (test_source.h) can stand in for the converted mic data.
+ * Each converted block runs through the front-end DSP chain (dsp_chain.h)
+ * and then the Feature Unit gain, in place, ramped across the block when
+ * the gain changes. The diagnostic tap (audio_tap.h) can copy out the raw
+ * DMA half or the block after any of these steps, and the finished
+ * block is handed to the level meters (audio_meter.h).
+ *
+ * Arrays capture one L/R mic pair per I2S lane. Every lane has its own
+ * circular buffer in dma_buf, all clocked by lane 0, and the conversion
+ * interleaves them into channel order 0..n-1 (lane k = channels 2k, 2k+1).
+ */
+
+/* I2S lanes: one per mic pair */
+#define AUDIO_CAPTURE_LANES  ((AUDIO_NUM_CHANNELS + 1) / 2)
+
+/* Largest 1 ms block */
+#define AUDIO_CAPTURE_MAX_BLOCK_SAMPLES  AUDIO_MAX_SAMPLES_PER_FRAME
+
+#if AUDIO_MIC_PDM
+/* 64 PDM bits per output sample at 3.072 MHz */
+#define AUDIO_CAPTURE_HWORDS_PER_FRAME  PDM_HWORDS_PER_OUTPUT
+#else
+/* One I2S frame = two 32-bit slots (L/R) = four DMA half-words */
+#define AUDIO_CAPTURE_HWORDS_PER_FRAME  4
+#endif
+
+/* DMA half-words per half buffer (one block) at the highest rate */
+#define AUDIO_CAPTURE_MAX_HALF_HWORDS \
+    (AUDIO_CAPTURE_MAX_BLOCK_SAMPLES * AUDIO_CAPTURE_HWORDS_PER_FRAME)
+
+/* Largest converted block in bytes */
+#define AUDIO_CAPTURE_MAX_BLOCK_BYTES \
+    (AUDIO_CAPTURE_MAX_BLOCK_SAMPLES * AUDIO_MAX_FRAME_BYTES)
+
+/*
+ * Bytes buffered between the DMA ISR and the IN endpoint (2^n), at least
+ * six blocks: the fill set point, packets held back for re-sending
+ * (audio_stream.h) and a block in flight
+ */
+#if AUDIO_CAPTURE_MAX_BLOCK_BYTES * 6 > 4096
+#define AUDIO_CAPTURE_RING_BYTES      8192
+#elif AUDIO_CAPTURE_MAX_BLOCK_BYTES * 6 > 2048
+#define AUDIO_CAPTURE_RING_BYTES      4096
+#else
+#define AUDIO_CAPTURE_RING_BYTES      2048
+#endif
+
+/* Per-block conversion + gain budget: 5 % of a 1 ms frame at 96 MHz */
+#define AUDIO_CAPTURE_BUDGET_CYCLES   4800
+
+struct audio_capture_stats {
+    uint32_t blocks;             /* blocks produced by the DMA ISR */
+    uint32_t pack_cycles_last;   /* DMA half -> scaled PCM, core cycles */
+    uint32_t pack_cycles_max;
+    uint32_t over_budget;        /* blocks above AUDIO_CAPTURE_BUDGET_CYCLES */
+    uint32_t start_failures;     /* I2S clock did not lock, capture stopped */
+    struct audio_ring_stats ring;
+};
+
+/*
+ * (Re)start capture for cfg's rates and sample width; empties the ring.
+ * If the I2S clock does not come up capture stays stopped (counted in
+ * start_failures) and the ring stays empty.
+ */
+void audio_capture_start(const struct audio_stream_cfg *cfg);
+void audio_capture_stop(void);
+
+/* Feature Unit gain (Q16) of channel ch (0-based), ramped in from the next block */
+void audio_capture_set_gain(uint32_t ch, int32_t gain_q16);
+
+/*
+ * Called by the HAL from the DMA ISR: half = 0 (HT) or 1 (TC),
+ * t = sof_timer_now() when the interrupt was taken.
+ */
+void audio_capture_dma_event(uint32_t half, uint32_t t);
+
+/* Consumer side (SOF): ring of wire-format PCM */
+struct audio_ring *audio_capture_ring(void);
+
+/* Samples buffered: ring contents plus the DMA half in progress */
+uint32_t audio_capture_fill_samples(void);
+
+/* Snapshot counters; reset clears pack_cycles_max */
+void audio_capture_get_stats(struct audio_capture_stats *st, int reset);
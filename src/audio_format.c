@@ -0,0 +1,67 @@
+#include <stddef.h>
+
+#include "audio_format.h"
+#include "pcm_decim.h"
+
+#define AUDIO_FORMAT_ENTRY(alt, bytes, bits, capture, ...)               \
+    { alt, bytes, bits, AUDIO_NARG(__VA_ARGS__), capture, { __VA_ARGS__ } },
+
+const struct audio_format audio_formats[AUDIO_NUM_FORMATS] = {
+    AUDIO_FORMAT_TABLE(AUDIO_FORMAT_ENTRY)
+};
+
+/* Every row must fit the buffers sized by the AUDIO_MAX_* limits */
+#define AUDIO_FORMAT_CHECK(alt, bytes, bits, capture, ...)                \
+    _Static_assert(AUDIO_LAST(__VA_ARGS__) <= AUDIO_MAX_SAMPLE_RATE_HZ,  \
+                   "alt " #alt " rate above AUDIO_MAX_SAMPLE_RATE_HZ");  \
+    _Static_assert((bytes) <= AUDIO_MAX_BYTES_PER_SAMPLE,                 \
+                   "alt " #alt " wider than AUDIO_MAX_BYTES_PER_SAMPLE"); \
+    _Static_assert(AUDIO_FORMAT_MAX_PACKET(bytes, AUDIO_LAST(__VA_ARGS__))  \
+                   <= AUDIO_FS_ISO_MAX_PACKET,                           \
+                   "alt " #alt " exceeds the full-speed iso packet size"); \
+    _Static_assert((capture) == 0 ||                                      \
+                   ((capture) == PCM_DECIM_IN_HZ && (bytes) == 2 &&       \
+                    AUDIO_NUM_CHANNELS <= 2),                             \
+                   "alt " #alt " capture rate the converter cannot take"); \
+    _Static_assert(!AUDIO_HEADSET || (capture) == AUDIO_SPK_RATE_HZ ||     \
+                   ((capture) == 0 && AUDIO_NARG(__VA_ARGS__) == 1 &&     \
+                    AUDIO_LAST(__VA_ARGS__) == AUDIO_SPK_RATE_HZ),        \
+                   "alt " #alt " would move PLLI2S off the speaker rate");
+AUDIO_FORMAT_TABLE(AUDIO_FORMAT_CHECK)
+
+const struct audio_format *audio_format_for_alt(uint8_t alt)
+{
+    for (unsigned i = 0; i < AUDIO_NUM_FORMATS; i++) {
+        if (audio_formats[i].alt == alt) {
+            return &audio_formats[i];
+        }
+    }
+    return NULL;
+}
+
+bool audio_format_has_rate(const struct audio_format *fmt, uint32_t rate_hz)
+{
+    for (unsigned i = 0; i < fmt->num_rates; i++) {
+        if (fmt->rates[i] == rate_hz) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void audio_format_make_cfg(const struct audio_format *fmt, uint32_t rate_hz,
+                           struct audio_stream_cfg *cfg)
+{
+    if (!audio_format_has_rate(fmt, rate_hz)) {
+        /* Prefer the project default rate, else the row's highest */
+        rate_hz = audio_format_has_rate(fmt, AUDIO_SAMPLE_RATE_HZ) ?
+                  AUDIO_SAMPLE_RATE_HZ : fmt->rates[fmt->num_rates - 1];
+    }
+
+    cfg->rate_hz           = rate_hz;
+    cfg->subframe_bytes    = fmt->subframe_bytes;
+    cfg->bits              = fmt->bits;
+    cfg->samples_per_frame = (uint16_t)(rate_hz / 1000);
+    cfg->frame_bytes       = (uint16_t)(AUDIO_NUM_CHANNELS * fmt->subframe_bytes);
+    cfg->capture_hz        = fmt->capture_hz ? fmt->capture_hz : rate_hz;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "usb_audio_uac1.h"
+
+/*
+ * Streaming format table: the single source for the AS alternate
+ * settings, their Type I format descriptors, endpoint sizes and the
+ * sampling-frequency control.
+ *
+ *   X(alt, subframe bytes, bit resolution, capture, rates... (ascending))
+ *
+ * Up to AUDIO_MAX_RATES discrete rates per row. Under UAC2 the rates
+ * belong to the clock source rather than the alt setting, so every row
+ * lists the same set; 24-bit comes both in 32- and 24-bit subslots.
+ *
+ * capture 0 runs the mics at the streamed rate. A non-zero capture keeps
+ * them at that rate and converts each block down on the device
+ * (pcm_decim.h, 16-bit only): this is how PDM mics, which only run at
+ * 48 kHz, get the voice rates, and how 24 kHz, which the I2S clock tree
+ * cannot produce, is offered at all. Mono and stereo only: filtering
+ * every channel of an array would not fit the DMA ISR budget.
+ *
+ * Headset builds (AUDIO_HEADSET) keep the mics at 48 kHz as well: they
+ * share PLLI2S with the speaker, which only plays 48 kHz, so the lower
+ * rates all come from the converter and there are no 24-bit alts.
+ */
+#if AUDIO_UAC2 && AUDIO_MIC_PDM
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 48000, 16000, 24000, 32000, 48000)
+#elif AUDIO_UAC2 && AUDIO_NUM_CHANNELS == 8
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 0, 16000, 32000, 48000)
+#elif AUDIO_UAC2 && AUDIO_NUM_CHANNELS == 4
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 0, 16000, 32000, 48000)             \
+    X(2, 4, 24, 0, 16000, 32000, 48000)             \
+    X(3, 3, 24, 0, 16000, 32000, 48000)
+#elif AUDIO_UAC2
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 0, 16000, 32000, 48000, 96000)      \
+    X(2, 4, 24, 0, 16000, 32000, 48000, 96000)      \
+    X(3, 3, 24, 0, 16000, 32000, 48000, 96000)
+#elif AUDIO_MIC_PDM || AUDIO_HEADSET
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 0, 48000)                           \
+    X(2, 2, 16, 48000, 16000, 24000, 32000)
+#elif AUDIO_NUM_CHANNELS == 8
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 0, 16000, 32000, 48000)
+#elif AUDIO_NUM_CHANNELS == 4
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 0, 16000, 32000, 48000)             \
+    X(2, 3, 24, 0, 48000)
+#else
+#define AUDIO_FORMAT_TABLE(X)                       \
+    X(1, 2, 16, 0, 16000, 32000, 48000)             \
+    X(2, 3, 24, 0, 48000, 96000)                    \
+    X(3, 2, 16, 48000, 16000, 24000, 32000)
+#endif
+
+#define AUDIO_MAX_RATES  4
+
+/* -------------------------------------------------------------------------- */
+/* Variadic helpers (1..AUDIO_MAX_RATES arguments)                            */
+/* -------------------------------------------------------------------------- */
+#define AUDIO_CAT_(a, b)        a##b
+#define AUDIO_CAT(a, b)         AUDIO_CAT_(a, b)
+
+#define AUDIO_NARG_(a, b, c, d, n, ...)  n
+#define AUDIO_NARG(...)         AUDIO_NARG_(__VA_ARGS__, 4, 3, 2, 1, 0)
+
+#define AUDIO_LAST_1(a)             a
+#define AUDIO_LAST_2(a, b)          b
+#define AUDIO_LAST_3(a, b, c)       c
+#define AUDIO_LAST_4(a, b, c, d)    d
+#define AUDIO_LAST(...) \
+    AUDIO_CAT(AUDIO_LAST_, AUDIO_NARG(__VA_ARGS__))(__VA_ARGS__)
+
+/* tSamFreq: 3 bytes little-endian */
+#define AUDIO_SAMFREQ(f)  ((f) & 0xFF), (((f) >> 8) & 0xFF), (((f) >> 16) & 0xFF)
+
+#define AUDIO_SAMFREQS_1(a)          AUDIO_SAMFREQ(a)
+#define AUDIO_SAMFREQS_2(a, b)       AUDIO_SAMFREQ(a), AUDIO_SAMFREQS_1(b)
+#define AUDIO_SAMFREQS_3(a, b, c)    AUDIO_SAMFREQ(a), AUDIO_SAMFREQS_2(b, c)
+#define AUDIO_SAMFREQS_4(a, b, c, d) AUDIO_SAMFREQ(a), AUDIO_SAMFREQS_3(b, c, d)
+#define AUDIO_SAMFREQS(...) \
+    AUDIO_CAT(AUDIO_SAMFREQS_, AUDIO_NARG(__VA_ARGS__))(__VA_ARGS__)
+
+/* Full-speed isochronous payload limit */
+#define AUDIO_FS_ISO_MAX_PACKET  1023
+
+/* wMaxPacketSize for a row: one extra sample for rate matching */
+#define AUDIO_FORMAT_MAX_PACKET(bytes, max_hz) \
+    (((max_hz) / 1000 + 1) * AUDIO_NUM_CHANNELS * (bytes))
+
+#define AUDIO_FORMAT_COUNT_(alt, bytes, bits, capture, ...)  + 1
+#define AUDIO_NUM_FORMATS  (0 AUDIO_FORMAT_TABLE(AUDIO_FORMAT_COUNT_))
+
+/* Rows that convert from a capture rate, usable in #if */
+#define AUDIO_FORMAT_CONVERTS_(alt, bytes, bits, capture, ...)  + ((capture) != 0)
+#define AUDIO_NUM_CONVERTED  (0 AUDIO_FORMAT_TABLE(AUDIO_FORMAT_CONVERTS_))
+
+/* -------------------------------------------------------------------------- */
+/* Runtime view                                                               */
+/* -------------------------------------------------------------------------- */
+
+struct audio_format {
+    uint8_t  alt;
+    uint8_t  subframe_bytes;
+    uint8_t  bits;
+    uint8_t  num_rates;
+    uint32_t capture_hz;         /* 0: mics run at the streamed rate */
+    uint32_t rates[AUDIO_MAX_RATES];
+};
+
+/* Active stream parameters, derived from a format row and a rate */
+struct audio_stream_cfg {
+    uint32_t rate_hz;
+    uint8_t  subframe_bytes;
+    uint8_t  bits;
+    uint16_t samples_per_frame;  /* nominal, rate / 1000 */
+    uint16_t frame_bytes;        /* channels * subframe bytes */
+    uint32_t capture_hz;         /* mic rate; above rate_hz = converted */
+};
+
+extern const struct audio_format audio_formats[AUDIO_NUM_FORMATS];
+
+/* Row for an alternate setting, NULL for alt 0 / unknown */
+const struct audio_format *audio_format_for_alt(uint8_t alt);
+
+bool audio_format_has_rate(const struct audio_format *fmt, uint32_t rate_hz);
+
+/* rate_hz if the row supports it, else the row's default */
+void audio_format_make_cfg(const struct audio_format *fmt, uint32_t rate_hz,
+                           struct audio_stream_cfg *cfg);
@@ -0,0 +1,199 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "audio_gain.h"
+#include "dsp_intrinsics.h"
+
+#define INT24_MAX  ((1 << 23) - 1)
+#define INT24_MIN  (-(1 << 23))
+
+/* -------------------------------------------------------------------------- */
+/* TABLES                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* 10^(dB/20) in Q16, AUDIO_GAIN_MIN_DB..AUDIO_GAIN_MAX_DB in 1 dB steps */
+static const int32_t gain_q16_db[AUDIO_GAIN_MAX_DB - AUDIO_GAIN_MIN_DB + 1] = {
+       261,    293,    328,    369,    414,    464,    521,    584,
+       655,    735,    825,    926,   1039,   1165,   1308,   1467,
+      1646,   1847,   2072,   2325,   2609,   2927,   3285,   3685,
+      4135,   4640,   5206,   5841,   6554,   7353,   8250,   9257,
+     10387,  11654,  13076,  14672,  16462,  18471,  20724,  23253,
+     26090,  29274,  32846,  36854,  41350,  46396,  52057,  58409,
+     65536,  73533,  82505,  92572, 103868, 116541, 130762, 146717,
+    164619, 184706, 207243, 232531, 260904,
+};
+
+_Static_assert(sizeof(gain_q16_db) / sizeof(gain_q16_db[0]) ==
+               AUDIO_GAIN_MAX_DB - AUDIO_GAIN_MIN_DB + 1,
+               "gain table out of sync with the volume range");
+
+/* -------------------------------------------------------------------------- */
+/* CONTROL                                                                    */
+/* -------------------------------------------------------------------------- */
+
+void audio_gain_set(struct audio_gain *g, int32_t gain_q16)
+{
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        audio_gain_set_channel(g, ch, gain_q16);
+    }
+}
+
+void audio_gain_set_channel(struct audio_gain *g, uint32_t ch, int32_t gain_q16)
+{
+    if (ch < AUDIO_NUM_CHANNELS) {
+        __atomic_store_n(&g->target_q16[ch], gain_q16, __ATOMIC_RELAXED);
+    }
+}
+
+int16_t audio_gain_volume_clamp(int16_t volume)
+{
+    if (volume <= AUDIO_GAIN_VOL_MIN) {
+        return AUDIO_GAIN_VOL_MIN;
+    }
+    if (volume >= AUDIO_GAIN_VOL_MAX) {
+        return AUDIO_GAIN_VOL_MAX;
+    }
+
+    int32_t db = (volume + (volume >= 0 ? 128 : -128)) / 256;
+    return (int16_t)(db * 256);
+}
+
+int32_t audio_gain_from_volume(int16_t volume)
+{
+    if (volume == USB_AUDIO_VOLUME_SILENCE) {
+        return 0;
+    }
+
+    return gain_q16_db[audio_gain_volume_clamp(volume) / 256 - AUDIO_GAIN_MIN_DB];
+}
+
+/* -------------------------------------------------------------------------- */
+/* KERNELS: g[ch] is the gain of the first frame, d[ch] the per-frame step    */
+/* -------------------------------------------------------------------------- */
+
+/* Two Q15 lanes, each scaled by its own Q16 gain and saturated */
+static inline uint32_t scale_q15x2(uint32_t w, int32_t g_lo, int32_t g_hi)
+{
+    return dsp_pack16x2(dsp_sat16(dsp_smulwb(g_lo, w)),
+                        dsp_sat16(dsp_smulwt(g_hi, w)));
+}
+
+static void step(int32_t *g, const int32_t *d)
+{
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        g[ch] += d[ch];
+    }
+}
+
+static void gain16(uint32_t *w, uint32_t frames, int32_t *g, const int32_t *d)
+{
+#if AUDIO_NUM_CHANNELS == 1
+    /* Mono: consecutive frames share a word */
+    for (uint32_t i = 0; i + 1 < frames; i += 2) {
+        *w = scale_q15x2(*w, g[0], g[0] + d[0]);
+        w++;
+        g[0] += 2 * d[0];
+    }
+    if (frames & 1) {
+        uint16_t *h = (uint16_t *)w;
+        *h = (uint16_t)dsp_sat16(dsp_smulwb(g[0], *h));
+    }
+#else
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t k = 0; k < AUDIO_NUM_CHANNELS / 2; k++) {
+            *w = scale_q15x2(*w, g[2 * k], g[2 * k + 1]);
+            w++;
+        }
+        step(g, d);
+    }
+#endif
+}
+
+static int32_t sat24(int32_t x)
+{
+    if (x > INT24_MAX) {
+        return INT24_MAX;
+    }
+    if (x < INT24_MIN) {
+        return INT24_MIN;
+    }
+    return x;
+}
+
+static void gain24(uint8_t *p, uint32_t frames, int32_t *g, const int32_t *d)
+{
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            int32_t s = (int32_t)(((uint32_t)p[0] << 8) |
+                                  ((uint32_t)p[1] << 16) |
+                                  ((uint32_t)p[2] << 24)) >> 8;
+            int32_t y = sat24((int32_t)(((int64_t)s * g[ch]) >> 16));
+
+            p[0] = (uint8_t)(y & 0xFF);
+            p[1] = (uint8_t)((y >> 8) & 0xFF);
+            p[2] = (uint8_t)((y >> 16) & 0xFF);
+            p += 3;
+        }
+        step(g, d);
+    }
+}
+
+/* 24-in-32: left-justified words, the low byte stays zero */
+static void gain32(uint32_t *w, uint32_t frames, int32_t *g, const int32_t *d)
+{
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            int32_t s = (int32_t)*w >> 8;
+            int32_t y = sat24((int32_t)(((int64_t)s * g[ch]) >> 16));
+
+            *w++ = (uint32_t)y << 8;
+        }
+        step(g, d);
+    }
+}
+
+void audio_gain_apply(struct audio_gain *g, uint8_t *pcm, uint32_t frames,
+                      const struct audio_stream_cfg *cfg)
+{
+    int32_t target[AUDIO_NUM_CHANNELS];
+    bool    unity = true, muted = true;
+
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        int32_t cur = g->cur_q16[ch];
+
+        target[ch] = __atomic_load_n(&g->target_q16[ch], __ATOMIC_RELAXED);
+        unity = unity && cur == target[ch] && cur == AUDIO_GAIN_UNITY;
+        muted = muted && cur == 0 && target[ch] == 0;
+    }
+
+    if (frames == 0 || unity) {
+        return;
+    }
+
+    if (muted) {
+        memset(pcm, 0, frames * cfg->frame_bytes);
+        return;
+    }
+
+    /* Linear ramps: the last frame of the block lands on each target */
+    int32_t gf[AUDIO_NUM_CHANNELS], d[AUDIO_NUM_CHANNELS];
+
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        d[ch]  = (target[ch] - g->cur_q16[ch]) / (int32_t)frames;
+        gf[ch] = g->cur_q16[ch] + d[ch];
+    }
+
+    switch (cfg->subframe_bytes) {
+    case 4:
+        gain32((uint32_t *)pcm, frames, gf, d);
+        break;
+    case 3:
+        gain24(pcm, frames, gf, d);
+        break;
+    default:
+        gain16((uint32_t *)pcm, frames, gf, d);
+        break;
+    }
+
+    memcpy(g->cur_q16, target, sizeof(target));
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "audio_format.h"
+
+/*
+ * Capture gain (Feature Unit mute / volume), applied in-block to the
+ * wire-format PCM before it enters the ring.
+ *
+ * Gain is Q16 (65536 = 0 dB), one per channel. 16-bit blocks are scaled
+ * two samples per word with SMULWB/SMULWT + SSAT and repacked with PKHBT;
+ * 24-bit blocks, packed or 24-in-32, go sample by sample. A new target is
+ * reached by a linear ramp across one block (1 ms), each channel on its
+ * own, so volume steps and mute do not click.
+ */
+
+#define AUDIO_GAIN_UNITY        65536
+
+/* Volume range offered to the host, 1/256 dB */
+#define AUDIO_GAIN_MIN_DB       (-48)
+#define AUDIO_GAIN_MAX_DB       12
+#define AUDIO_GAIN_VOL_MIN      ((int16_t)(AUDIO_GAIN_MIN_DB * 256))
+#define AUDIO_GAIN_VOL_MAX      ((int16_t)(AUDIO_GAIN_MAX_DB * 256))
+#define AUDIO_GAIN_VOL_RES      ((int16_t)256)
+
+struct audio_gain {
+    int32_t cur_q16[AUDIO_NUM_CHANNELS];     /* gain at the end of the last block */
+    int32_t target_q16[AUDIO_NUM_CHANNELS];  /* written by the control path */
+};
+
+#define AUDIO_GAIN_UNITY_1  AUDIO_GAIN_UNITY
+#define AUDIO_GAIN_UNITY_2  AUDIO_GAIN_UNITY_1, AUDIO_GAIN_UNITY_1
+#define AUDIO_GAIN_UNITY_4  AUDIO_GAIN_UNITY_2, AUDIO_GAIN_UNITY_2
+#define AUDIO_GAIN_UNITY_8  AUDIO_GAIN_UNITY_4, AUDIO_GAIN_UNITY_4
+#define AUDIO_GAIN_UNITY_ALL  AUDIO_CAT(AUDIO_GAIN_UNITY_, AUDIO_NUM_CHANNELS)
+
+#define AUDIO_GAIN_INIT  { { AUDIO_GAIN_UNITY_ALL }, { AUDIO_GAIN_UNITY_ALL } }
+
+/* Control side: new target for every channel, picked up at the next block */
+void audio_gain_set(struct audio_gain *g, int32_t gain_q16);
+
+/* The same for channel ch alone (0-based) */
+void audio_gain_set_channel(struct audio_gain *g, uint32_t ch, int32_t gain_q16);
+
+/* UAC volume clamped to the offered range and rounded to 1 dB */
+int16_t audio_gain_volume_clamp(int16_t volume);
+
+/* UAC volume (1/256 dB, or USB_AUDIO_VOLUME_SILENCE) -> Q16 gain */
+int32_t audio_gain_from_volume(int16_t volume);
+
+/* Scale frames of interleaved wire-format PCM in place */
+void audio_gain_apply(struct audio_gain *g, uint8_t *pcm, uint32_t frames,
+                      const struct audio_stream_cfg *cfg);
@@ -0,0 +1,647 @@
+#include <string.h>
+
+#include "audio_meter.h"
+#include "audio_ring.h"
+#include "audio_capture.h"
+#include "dsp_intrinsics.h"
+#include "profiler.h"
+
+#if defined(__arm__)
+#include "cycle_counter.h"
+#define CYCLES()  cycles_now()
+#else
+#define CYCLES()  0u
+#endif
+
+#define LOAD_ACQ(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+_Static_assert(AUDIO_NUM_CHANNELS <= METER_MAX_CHANNELS, "too many channels to meter");
+_Static_assert(METER_FFT_SIZE == 256, "tables below are for 256 points");
+
+#define FFT_N        METER_FFT_SIZE
+#define FFT_STAGES   4                  /* log4(FFT_N) */
+#define Q23_BITS     23
+
+/* 10 * log10(2) / 256, Q24: log2 (Q16) -> dB (Q8) */
+#define DB_PER_LOG2_Q24  197283
+/* log2(1.5), Q16: band power of a full-scale Hann-windowed tone */
+#define LOG2_1P5_Q16     38336
+
+/* A transform is collected, then advanced one slice per run */
+enum fft_state {
+    FFT_COLLECT = 0,
+    FFT_WINDOW,
+    FFT_STAGE0,
+    FFT_BANDS = FFT_STAGE0 + FFT_STAGES,
+};
+
+/* Ahead of each block in the ring */
+struct block_hdr {
+    uint32_t rate_hz;
+    uint16_t frames;
+    uint8_t  subframe_bytes;
+    uint8_t  channels;
+};
+
+struct meter_results {
+    uint32_t rate_hz;
+    uint16_t window_ms;
+    uint8_t  channels;
+    uint32_t level_windows;
+    uint32_t spectra;
+    int16_t  peak[METER_MAX_CHANNELS];
+    int16_t  rms[METER_MAX_CHANNELS];
+    int16_t  band[METER_MAX_CHANNELS][METER_NUM_BANDS];
+};
+
+/* -------------------------------------------------------------------------- */
+/* TABLES                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* sin(2 * pi * k / 256), Q15, k = 0 .. 64 */
+static const int16_t quarter_sine[FFT_N / 4 + 1] = {
+        0,   804,  1608,  2411,  3212,  4011,  4808,  5602,
+     6393,  7180,  7962,  8740,  9512, 10279, 11039, 11793,
+    12540, 13279, 14010, 14733, 15447, 16151, 16846, 17531,
+    18205, 18868, 19520, 20160, 20788, 21403, 22006, 22595,
+    23170, 23732, 24279, 24812, 25330, 25833, 26320, 26791,
+    27246, 27684, 28106, 28511, 28899, 29269, 29622, 29957,
+    30274, 30572, 30853, 31114, 31357, 31581, 31786, 31972,
+    32138, 32286, 32413, 32522, 32610, 32679, 32729, 32758,
+    32767,
+};
+
+/* log2(1 + i / 32), Q16, i = 0 .. 32 */
+static const int32_t log2_frac[33] = {
+        0,  2909,  5732,  8473, 11136, 13727, 16248, 18704,
+    21098, 23433, 25711, 27936, 30109, 32234, 34312, 36346,
+    38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207,
+    52911, 54584, 56229, 57845, 59434, 60997, 62534, 64047,
+    65536,
+};
+
+/*
+ * Band edges in FFT bins: log spaced from bin 1 to Nyquist, at least one
+ * bin wide (187.5 Hz bins at 48 kHz)
+ */
+static const uint8_t band_edges[METER_NUM_BANDS + 1] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 11, 15, 21, 28, 38, 52, 70, 95, 128,
+};
+
+/* Filled on first configure: integer only, no libm */
+static uint32_t twiddle[3 * FFT_N / 4];     /* W^m = cos | -sin << 16 */
+static int16_t  hann[FFT_N];
+static uint8_t  band_of_bin[FFT_N / 2];     /* 0xFF: not in any band */
+
+/* -------------------------------------------------------------------------- */
+/* STATE                                                                      */
+/* -------------------------------------------------------------------------- */
+
+AUDIO_RING_STORAGE(ring_storage, AUDIO_METER_RING_BYTES);
+static struct audio_ring ring;
+
+/* Written by the control side, picked up per block / per run */
+static volatile uint8_t  req_mask;
+static volatile uint16_t req_window = AUDIO_METER_DEFAULT_WINDOW_MS;
+
+/* Producer */
+static uint32_t drops;
+
+/* Consumer: format of the blocks being analysed, applied config */
+static struct block_hdr fmt;
+static uint8_t  mask;
+static uint16_t window_ms = AUDIO_METER_DEFAULT_WINDOW_MS;
+
+static uint8_t staged[AUDIO_CAPTURE_MAX_BLOCK_BYTES] __attribute__((aligned(4)));
+
+/* Consumer: level window in progress */
+static uint32_t lvl_peak[METER_MAX_CHANNELS];
+static uint64_t lvl_sumsq[METER_MAX_CHANNELS];
+static uint32_t lvl_samples;
+static uint16_t lvl_blocks;
+
+/* Consumer: transform in progress */
+static enum fft_state fft_state;
+static uint8_t  fft_ch;
+static uint16_t fft_fill;
+static uint8_t  fft_shift;
+static int32_t  fft_in[FFT_N];              /* Q23 samples of fft_ch */
+static uint32_t fft_buf[FFT_N];             /* Q15 complex: re | im << 16 */
+
+/* Written by the consumer, read by snapshots from the USB interrupt */
+static struct meter_results results[2] = {
+    { .window_ms = AUDIO_METER_DEFAULT_WINDOW_MS },
+    { .window_ms = AUDIO_METER_DEFAULT_WINDOW_MS },
+};
+static uint8_t pub;
+
+/* -------------------------------------------------------------------------- */
+/* HELPERS                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/* sin(2 * pi * k / FFT_N), Q15 */
+static int32_t sin_q15(uint32_t k)
+{
+    uint32_t r = k % (FFT_N / 4);
+
+    switch ((k / (FFT_N / 4)) & 3) {
+    case 0:  return quarter_sine[r];
+    case 1:  return quarter_sine[FFT_N / 4 - r];
+    case 2:  return -quarter_sine[r];
+    default: return -quarter_sine[FFT_N / 4 - r];
+    }
+}
+
+static int32_t cos_q15(uint32_t k)
+{
+    return sin_q15(k + FFT_N / 4);
+}
+
+static void init_tables(void)
+{
+    for (uint32_t m = 0; m < 3 * FFT_N / 4; m++) {
+        twiddle[m] = dsp_pack16x2(cos_q15(m), -sin_q15(m));
+    }
+    for (uint32_t n = 0; n < FFT_N; n++) {
+        hann[n] = (int16_t)((INT16_MAX - cos_q15(n) + 1) >> 1);
+    }
+
+    memset(band_of_bin, 0xFF, sizeof(band_of_bin));
+    for (uint32_t b = 0; b < METER_NUM_BANDS; b++) {
+        for (uint32_t k = band_edges[b]; k < band_edges[b + 1] && k < FFT_N / 2; k++) {
+            band_of_bin[k] = (uint8_t)b;
+        }
+    }
+}
+
+/* log2(x), Q16, x > 0; within 2e-4 of exact */
+static int32_t log2_q16(uint64_t x)
+{
+    uint32_t msb = 63u - (uint32_t)__builtin_clzll(x);
+    uint32_t f;
+
+    if (msb >= 16) {
+        f = (uint32_t)(x >> (msb - 16)) & 0xFFFF;
+    } else {
+        f = (uint32_t)(x << (16 - msb)) & 0xFFFF;
+    }
+
+    uint32_t i = f >> 11;
+    uint32_t t = f & 0x7FF;
+    int32_t  lo = log2_frac[i];
+    int32_t  hi = log2_frac[i + 1];
+
+    return (int32_t)(msb << 16) + lo + (((hi - lo) * (int32_t)t) >> 11);
+}
+
+/* 10 * log10(power / 2^(ref / 65536)) in 1/256 dB */
+static int16_t db_q8(uint64_t power, int32_t ref_log2_q16)
+{
+    if (power == 0) {
+        return METER_DB_FLOOR;
+    }
+
+    int64_t db = ((int64_t)(log2_q16(power) - ref_log2_q16) * DB_PER_LOG2_Q24 +
+                  (1 << 23)) >> 24;
+
+    if (db > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (db <= METER_DB_FLOOR) {
+        return METER_DB_FLOOR + 1;
+    }
+    return (int16_t)db;
+}
+
+/* One little-endian sample of the given container width as Q23 */
+static int32_t sample_q23(const uint8_t *p, uint32_t subframe_bytes)
+{
+    switch (subframe_bytes) {
+    case 4:
+        return (int32_t)((uint32_t)p[1] | ((uint32_t)p[2] << 8) |
+                         ((uint32_t)p[3] << 16) | ((uint32_t)p[3] & 0x80 ? 0xFF000000u : 0));
+    case 3:
+        return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                         ((uint32_t)p[2] << 16) | ((uint32_t)p[2] & 0x80 ? 0xFF000000u : 0));
+    default:
+        return (int16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8)) * 256;
+    }
+}
+
+/* Copy of the published results, to modify and publish */
+static struct meter_results *begin_update(void)
+{
+    struct meter_results *w = &results[pub ^ 1];
+
+    *w = results[pub];
+    return w;
+}
+
+static void end_update(void)
+{
+    STORE_REL(&pub, pub ^ 1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* LEVELS                                                                     */
+/* -------------------------------------------------------------------------- */
+
+static void levels_reset(void)
+{
+    memset(lvl_peak, 0, sizeof(lvl_peak));
+    memset(lvl_sumsq, 0, sizeof(lvl_sumsq));
+    lvl_samples = 0;
+    lvl_blocks  = 0;
+}
+
+static void levels_block(uint32_t frames)
+{
+    uint32_t stride = (uint32_t)fmt.channels * fmt.subframe_bytes;
+
+    for (uint32_t ch = 0; ch < fmt.channels; ch++) {
+        const uint8_t *p = staged + ch * fmt.subframe_bytes;
+        uint32_t peak = lvl_peak[ch];
+        uint64_t sum  = lvl_sumsq[ch];
+
+        for (uint32_t i = 0; i < frames; i++) {
+            int32_t  s = sample_q23(p, fmt.subframe_bytes);
+            uint32_t a = (uint32_t)(s < 0 ? -s : s);
+
+            if (a > peak) {
+                peak = a;
+            }
+            sum += (uint64_t)((int64_t)s * s);
+            p += stride;
+        }
+        lvl_peak[ch]  = peak;
+        lvl_sumsq[ch] = sum;
+    }
+    lvl_samples += frames;
+
+    if (++lvl_blocks < window_ms) {
+        return;
+    }
+
+    struct meter_results *r = begin_update();
+    int32_t full_scale = (2 * Q23_BITS) << 16;
+
+    for (uint32_t ch = 0; ch < fmt.channels; ch++) {
+        r->peak[ch] = db_q8((uint64_t)lvl_peak[ch] * lvl_peak[ch], full_scale);
+        r->rms[ch]  = db_q8(lvl_sumsq[ch], full_scale + log2_q16(lvl_samples));
+    }
+    r->level_windows++;
+    end_update();
+
+    levels_reset();
+}
+
+/* -------------------------------------------------------------------------- */
+/* SPECTRUM                                                                   */
+/* -------------------------------------------------------------------------- */
+
+static void spectrum_reset(void)
+{
+    fft_state = FFT_COLLECT;
+    fft_fill  = 0;
+}
+
+/* Take fft_ch's samples until a transform's worth is in */
+static void spectrum_collect(uint32_t frames)
+{
+    uint32_t stride = (uint32_t)fmt.channels * fmt.subframe_bytes;
+    const uint8_t *p = staged + fft_ch * fmt.subframe_bytes;
+
+    for (uint32_t i = 0; i < frames && fft_fill < FFT_N; i++) {
+        fft_in[fft_fill++] = sample_q23(p, fmt.subframe_bytes);
+        p += stride;
+    }
+    if (fft_fill == FFT_N) {
+        fft_state = FFT_WINDOW;
+    }
+}
+
+/* Normalise to the peak, Hann window, load as complex Q15 */
+static void fft_window(void)
+{
+    uint32_t peak = 0;
+
+    for (uint32_t n = 0; n < FFT_N; n++) {
+        int32_t  s = fft_in[n];
+        uint32_t a = (uint32_t)(s < 0 ? -s : s);
+
+        if (a > peak) {
+            peak = a;
+        }
+    }
+
+    /* Shift that brings the peak to just below 2^23 */
+    int32_t sh = peak ? __builtin_clz(peak) - (32 - Q23_BITS) : 0;
+    if (sh < 0) {
+        sh = 0;
+    }
+    fft_shift = (uint8_t)sh;
+
+    for (uint32_t n = 0; n < FFT_N; n++) {
+        int64_t v = (int64_t)fft_in[n] * ((int32_t)1 << sh) * hann[n];
+
+        fft_buf[n] = (uint32_t)(uint16_t)(int16_t)((v + (1 << 22)) >> Q23_BITS);
+    }
+}
+
+static uint32_t round4_pack(int32_t re, int32_t im)
+{
+    return dsp_pack16x2((re + 2) >> 2, (im + 2) >> 2);
+}
+
+/* x * w, both Q15 complex */
+static uint32_t cmul_q15(uint32_t x, uint32_t w)
+{
+    int32_t re = (dsp_smusd(x, w) + (1 << 14)) >> 15;
+    int32_t im = (dsp_smuadx(x, w) + (1 << 14)) >> 15;
+
+    return dsp_pack16x2(dsp_sat16(re), dsp_sat16(im));
+}
+
+#define RE(x)  ((int32_t)(int16_t)((x) & 0xFFFF))
+#define IM(x)  ((int32_t)(int16_t)((x) >> 16))
+
+/*
+ * One radix-4 decimation-in-frequency stage in place, scaled by 1/4 so
+ * nothing can overflow; after all FFT_STAGES the spectrum is in base-4
+ * digit-reversed order and scaled by 1/FFT_N.
+ */
+static void fft_stage(uint32_t stage)
+{
+    uint32_t span = FFT_N >> (2 * stage);
+    uint32_t q    = span / 4;
+    uint32_t step = 1u << (2 * stage);      /* twiddle stride, FFT_N / span */
+
+    for (uint32_t g = 0; g < FFT_N; g += span) {
+        uint32_t *x = &fft_buf[g];
+
+        for (uint32_t j = 0; j < q; j++) {
+            uint32_t a = x[j], b = x[j + q], c = x[j + 2 * q], d = x[j + 3 * q];
+
+            int32_t t0r = RE(a) + RE(c), t0i = IM(a) + IM(c);
+            int32_t t1r = RE(a) - RE(c), t1i = IM(a) - IM(c);
+            int32_t t2r = RE(b) + RE(d), t2i = IM(b) + IM(d);
+            int32_t t3r = RE(b) - RE(d), t3i = IM(b) - IM(d);
+
+            uint32_t y0 = round4_pack(t0r + t2r, t0i + t2i);
+            uint32_t y1 = round4_pack(t1r + t3i, t1i - t3r);    /* t1 - j t3 */
+            uint32_t y2 = round4_pack(t0r - t2r, t0i - t2i);
+            uint32_t y3 = round4_pack(t1r - t3i, t1i + t3r);    /* t1 + j t3 */
+
+            x[j] = y0;
+            if (j == 0) {
+                x[q]     = y1;
+                x[2 * q] = y2;
+                x[3 * q] = y3;
+            } else {
+                x[j + q]     = cmul_q15(y1, twiddle[j * step]);
+                x[j + 2 * q] = cmul_q15(y2, twiddle[2 * j * step]);
+                x[j + 3 * q] = cmul_q15(y3, twiddle[3 * j * step]);
+            }
+        }
+    }
+}
+
+/* Bin powers summed per band, published for fft_ch */
+static void fft_bands(void)
+{
+    uint64_t power[METER_NUM_BANDS] = { 0 };
+
+    for (uint32_t p = 0; p < FFT_N; p++) {
+        /* Four base-4 digits reversed */
+        uint32_t k = ((p & 0x03) << 6) | ((p & 0x0C) << 2) |
+                     ((p & 0x30) >> 2) | ((p & 0xC0) >> 6);
+
+        if (k >= FFT_N / 2 || band_of_bin[k] == 0xFF) {
+            continue;
+        }
+        int32_t re = RE(fft_buf[p]), im = IM(fft_buf[p]);
+        power[band_of_bin[k]] += (uint32_t)(re * re) + (uint32_t)(im * im);
+    }
+
+    /*
+     * A full-scale tone normalised by fft_shift peaks at 2^(13 + shift)
+     * after the 1/N scaling and the Hann coherent gain of 1/2; its three
+     * main bins carry 1.5 times that squared.
+     */
+    struct meter_results *r = begin_update();
+    int32_t ref = LOG2_1P5_Q16 + ((26 + 2 * (int32_t)fft_shift) << 16);
+
+    for (uint32_t b = 0; b < METER_NUM_BANDS; b++) {
+        r->band[fft_ch][b] = db_q8(power[b], ref);
+    }
+    r->spectra++;
+    end_update();
+
+    fft_ch = (uint8_t)((fft_ch + 1) % fmt.channels);
+    spectrum_reset();
+}
+
+/* One slice of the transform in progress */
+static void spectrum_slice(void)
+{
+    switch (fft_state) {
+    case FFT_COLLECT:
+        return;
+    case FFT_WINDOW:
+        fft_window();
+        break;
+    case FFT_BANDS:
+        fft_bands();
+        return;
+    default:
+        fft_stage(fft_state - FFT_STAGE0);
+        break;
+    }
+    fft_state++;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONSUMER (thread mode)                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* New stream format: start over, nothing measured yet */
+static void restart(const struct block_hdr *h)
+{
+    fmt    = *h;
+    fft_ch = 0;
+    levels_reset();
+    spectrum_reset();
+
+    struct meter_results *r = begin_update();
+    r->rate_hz  = h->rate_hz;
+    r->channels = h->channels;
+    for (uint32_t ch = 0; ch < METER_MAX_CHANNELS; ch++) {
+        r->peak[ch] = METER_DB_FLOOR;
+        r->rms[ch]  = METER_DB_FLOOR;
+        for (uint32_t b = 0; b < METER_NUM_BANDS; b++) {
+            r->band[ch][b] = METER_DB_FLOOR;
+        }
+    }
+    end_update();
+}
+
+static void apply_config(void)
+{
+    uint8_t  m = req_mask;
+    uint16_t w = req_window;
+
+    if (w != window_ms || !(m & AUDIO_METER_LEVELS)) {
+        levels_reset();
+    }
+    if (w != window_ms) {
+        window_ms = w;
+
+        struct meter_results *r = begin_update();
+        r->window_ms = w;
+        end_update();
+    }
+    if (!(m & AUDIO_METER_SPECTRUM)) {
+        spectrum_reset();
+    }
+    mask = m;
+}
+
+void audio_meter_run(void)
+{
+    uint32_t t0   = CYCLES();
+    bool     busy = fft_state != FFT_COLLECT;
+    struct block_hdr h;
+
+    apply_config();
+
+    /*
+     * The producer preempts this and writes a header and its block in one
+     * go, so a header in the ring always has its data behind it.
+     */
+    while (audio_ring_fill(&ring) >= sizeof(h)) {
+        (void)audio_ring_read(&ring, &h, sizeof(h));
+        (void)audio_ring_read(&ring, staged,
+                              (uint32_t)h.frames * h.channels * h.subframe_bytes);
+        busy = true;
+
+        if (memcmp(&h, &fmt, sizeof(h)) != 0) {
+            restart(&h);
+        }
+        if (mask & AUDIO_METER_LEVELS) {
+            levels_block(h.frames);
+        }
+        if ((mask & AUDIO_METER_SPECTRUM) && fft_state == FFT_COLLECT) {
+            spectrum_collect(h.frames);
+        }
+    }
+
+    if (!busy) {
+        return;
+    }
+    spectrum_slice();
+    prof_record(PROF_STAGE_METER, CYCLES() - t0);
+}
+
+bool audio_meter_pending(void)
+{
+    return ring.buf && (audio_ring_fill(&ring) || fft_state != FFT_COLLECT);
+}
+
+/* -------------------------------------------------------------------------- */
+/* PRODUCER (capture DMA ISR)                                                 */
+/* -------------------------------------------------------------------------- */
+
+void audio_meter_block(const void *pcm, const struct audio_stream_cfg *cfg)
+{
+    struct block_hdr h;
+
+    if (!req_mask) {
+        return;
+    }
+
+    h.rate_hz        = cfg->rate_hz;
+    h.frames         = cfg->samples_per_frame;
+    h.subframe_bytes = cfg->subframe_bytes;
+    h.channels       = (uint8_t)(cfg->frame_bytes / cfg->subframe_bytes);
+
+    uint32_t bytes = (uint32_t)h.frames * cfg->frame_bytes;
+
+    /* Whole blocks only: the analysis needs every sample of a window */
+    if (bytes > AUDIO_CAPTURE_MAX_BLOCK_BYTES ||
+        audio_ring_space(&ring) < sizeof(h) + bytes) {
+        drops++;
+        return;
+    }
+    (void)audio_ring_write(&ring, &h, sizeof(h));
+    (void)audio_ring_write(&ring, pcm, bytes);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONTROL                                                                    */
+/* -------------------------------------------------------------------------- */
+
+bool audio_meter_configure(uint32_t m, uint16_t window)
+{
+    if ((m & ~AUDIO_METER_ALL) || window > AUDIO_METER_MAX_WINDOW_MS) {
+        return false;
+    }
+
+    /* Nothing runs until the first configure, so set up here */
+    if (!ring.buf) {
+        init_tables();
+        audio_ring_init(&ring, ring_storage, sizeof(ring_storage));
+    }
+
+    req_window = window ? window : AUDIO_METER_DEFAULT_WINDOW_MS;
+    req_mask   = (uint8_t)m;
+    return true;
+}
+
+static uint8_t *put16(uint8_t *p, uint32_t v)
+{
+    *p++ = (uint8_t)(v & 0xFF);
+    *p++ = (uint8_t)((v >> 8) & 0xFF);
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p = put16(p, v);
+    return put16(p, v >> 16);
+}
+
+uint32_t audio_meter_snapshot(uint8_t *dst, uint32_t cap)
+{
+    const struct meter_results *r = &results[LOAD_ACQ(&pub)];
+    uint8_t *p = dst;
+
+    if (cap < METER_BLOB_SIZE) {
+        return 0;
+    }
+
+    p = put32(p, METER_BLOB_MAGIC);
+    p = put16(p, METER_BLOB_VERSION);
+    *p++ = r->channels;
+    *p++ = METER_NUM_BANDS;
+    p = put32(p, r->rate_hz);
+    p = put16(p, FFT_N);
+    p = put16(p, r->window_ms);
+    p = put32(p, r->level_windows);
+    p = put32(p, r->spectra);
+    p = put32(p, drops);
+
+    memset(p, 0, METER_BLOB_EDGES_SIZE);
+    memcpy(p, band_edges, sizeof(band_edges));
+    p += METER_BLOB_EDGES_SIZE;
+
+    for (uint32_t ch = 0; ch < r->channels; ch++) {
+        p = put16(p, (uint16_t)r->peak[ch]);
+        p = put16(p, (uint16_t)r->rms[ch]);
+        for (uint32_t b = 0; b < METER_NUM_BANDS; b++) {
+            p = put16(p, (uint16_t)r->band[ch][b]);
+        }
+    }
+
+    return (uint32_t)(p - dst);
+}
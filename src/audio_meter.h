@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_format.h"
+#include "meter_blob.h"
+
+/*
+ * Level meters and a coarse spectrum of the captured audio, read by the
+ * host as a meter blob (meter_blob.h).
+ *
+ * The capture DMA ISR only copies each finished 1 ms block (after the
+ * Feature Unit gain, as streamed) into an SPSC ring. Everything else runs
+ * in thread mode from audio_meter_run(), which the firmware posts once per
+ * SOF, so the analysis never competes with the capture or SOF deadlines:
+ *
+ *   meters    per-channel peak and mean square over window_ms, in dBFS
+ *   spectrum  256-point radix-4 Q15 FFT of one channel at a time, round
+ *             robin: 256 consecutive samples are collected, then each run
+ *             does one slice (window, four radix-4 stages, band powers),
+ *             so a transform spreads over six runs. The input is
+ *             normalised to its peak first, so quiet signals keep the
+ *             full 16-bit resolution.
+ *
+ * Results are published into a double buffer; a snapshot from the USB
+ * interrupt always sees one complete set. With metering off, the capture
+ * ISR pays one compare per block.
+ */
+
+/* Analysis enables for audio_meter_configure() */
+#define AUDIO_METER_LEVELS    (1u << 0)
+#define AUDIO_METER_SPECTRUM  (1u << 1)
+#define AUDIO_METER_ALL       (AUDIO_METER_LEVELS | AUDIO_METER_SPECTRUM)
+
+#define AUDIO_METER_DEFAULT_WINDOW_MS  100
+#define AUDIO_METER_MAX_WINDOW_MS      1000
+
+/* Blocks queued for the analysis task: two of the largest (2^n) */
+#define AUDIO_METER_RING_BYTES  8192
+
+/*
+ * Control side: analysis mask (AUDIO_METER_*) and level window in ms
+ * (0 = default). Applied at the next block; false for an unknown bit or a
+ * window above AUDIO_METER_MAX_WINDOW_MS.
+ */
+bool audio_meter_configure(uint32_t mask, uint16_t window_ms);
+
+/* Producer (capture DMA ISR): one finished block of cfg */
+void audio_meter_block(const void *pcm, const struct audio_stream_cfg *cfg);
+
+/* Thread mode: consume queued blocks and advance the spectrum one slice */
+void audio_meter_run(void);
+
+/* True while audio_meter_run() has something to do */
+bool audio_meter_pending(void);
+
+/* Serialise the latest results as a meter blob; returns bytes written */
+uint32_t audio_meter_snapshot(uint8_t *dst, uint32_t cap);
@@ -0,0 +1,121 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "audio_playback.h"
+#include "audio_ring.h"
+#include "fb_ctrl.h"
+#include "playback_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* BUFFERS                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/* Circular DMA source: two halves of one block each, wire format */
+static volatile uint16_t dma_buf[2 * AUDIO_PLAYBACK_HALF_HWORDS]
+    __attribute__((aligned(4)));
+
+/* Wire-format PCM between the OUT callback and the DMA ISR */
+AUDIO_RING_STORAGE(ring_storage, AUDIO_PLAYBACK_RING_BYTES);
+static struct audio_ring ring;
+
+static struct fb_ctrl fb;
+
+/* DMA ISR only: the ring has reached the target since the last underrun */
+static bool primed;
+
+static struct audio_playback_stats stats;
+
+/* -------------------------------------------------------------------------- */
+/* PRODUCER (USB OUT)                                                         */
+/* -------------------------------------------------------------------------- */
+
+void audio_playback_rx(const uint8_t *pkt, uint32_t len)
+{
+    /* Whole frames only; a torn one would swap L and R from here on */
+    len -= len % AUDIO_SPK_FRAME_BYTES;
+
+    stats.packets++;
+    if (len && !audio_ring_write(&ring, pkt, len)) {
+        stats.overruns++;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONSUMER (DMA ISR)                                                         */
+/* -------------------------------------------------------------------------- */
+
+void audio_playback_dma_event(uint32_t half, uint32_t t)
+{
+    void *dst = (void *)&dma_buf[half * AUDIO_PLAYBACK_HALF_HWORDS];
+
+    fb_ctrl_audio(&fb, t, AUDIO_PLAYBACK_BLOCK_SAMPLES);
+
+    if (!primed && audio_ring_fill(&ring) >=
+                   AUDIO_PLAYBACK_TARGET_SAMPLES * AUDIO_SPK_FRAME_BYTES) {
+        primed = true;
+    }
+
+    if (!primed || !audio_ring_read(&ring, dst, AUDIO_PLAYBACK_BLOCK_BYTES)) {
+        if (primed) {
+            stats.underruns++;
+            primed = false;
+        }
+        memset(dst, 0, AUDIO_PLAYBACK_BLOCK_BYTES);
+        stats.silent++;
+    }
+    stats.blocks++;
+}
+
+/* -------------------------------------------------------------------------- */
+/* FEEDBACK (SOF)                                                             */
+/* -------------------------------------------------------------------------- */
+
+uint32_t audio_playback_fill_samples(void)
+{
+    uint32_t pos = playback_hal_position() % AUDIO_PLAYBACK_HALF_HWORDS;
+
+    return audio_ring_fill(&ring) / AUDIO_SPK_FRAME_BYTES +
+           (AUDIO_PLAYBACK_HALF_HWORDS - pos) / AUDIO_SPK_CHANNELS;
+}
+
+uint32_t audio_playback_sof(uint32_t sof_tick)
+{
+    stats.feedback_q14 = fb_ctrl_sof(&fb, sof_tick, audio_playback_fill_samples());
+    return stats.feedback_q14;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONTROL                                                                    */
+/* -------------------------------------------------------------------------- */
+
+void audio_playback_start(void)
+{
+    uint32_t start_failures = stats.start_failures;
+
+    playback_hal_stop();
+
+    audio_ring_init(&ring, ring_storage, sizeof(ring_storage));
+    fb_ctrl_init(&fb, AUDIO_SPK_SAMPLES_PER_FRAME, AUDIO_PLAYBACK_TARGET_SAMPLES);
+    primed = false;
+    memset(&stats, 0, sizeof(stats));
+    stats.feedback_q14   = fb.value_q14;
+    stats.start_failures = start_failures;
+
+    for (uint32_t i = 0; i < 2 * AUDIO_PLAYBACK_HALF_HWORDS; i++) {
+        dma_buf[i] = 0;
+    }
+
+    if (!playback_hal_start(dma_buf, 2 * AUDIO_PLAYBACK_HALF_HWORDS)) {
+        stats.start_failures++;
+    }
+}
+
+void audio_playback_stop(void)
+{
+    playback_hal_stop();
+}
+
+void audio_playback_get_stats(struct audio_playback_stats *st)
+{
+    *st = stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "usb_audio_uac1.h"
+
+/*
+ * Headset speaker (AUDIO_HEADSET): USB OUT packets -> sample ring -> I2S
+ * TX DMA double buffer.
+ *
+ * The OUT callback appends each packet to an SPSC ring as it arrives.
+ * The DMA half/full-transfer interrupt refills the half that just went
+ * out with the next 1 ms block from the ring; the wire format (16-bit
+ * little-endian L/R) is what I2S transmits, so this is a plain copy.
+ *
+ * Playback starts once the ring holds AUDIO_PLAYBACK_TARGET_BLOCKS_X2 / 2
+ * blocks and plays silence until then, and again after an underrun until
+ * it has re-primed. The host's rate follows the feedback endpoint
+ * (fb_ctrl.h), which keeps the fill centred on that same target.
+ */
+
+/* One 1 ms block: 48 stereo frames */
+#define AUDIO_PLAYBACK_BLOCK_SAMPLES  AUDIO_SPK_SAMPLES_PER_FRAME
+#define AUDIO_PLAYBACK_BLOCK_BYTES \
+    (AUDIO_PLAYBACK_BLOCK_SAMPLES * AUDIO_SPK_FRAME_BYTES)
+
+/* DMA half-words per half buffer: one per 16-bit channel slot */
+#define AUDIO_PLAYBACK_HALF_HWORDS \
+    (AUDIO_PLAYBACK_BLOCK_SAMPLES * AUDIO_SPK_CHANNELS)
+
+/*
+ * Fill set point, in half blocks, of the ring plus what is left of the
+ * half being played. At the worst phase of packet arrival against the
+ * DMA event the ring holds two blocks when a refill is due, one more
+ * than it needs: 1 ms of host jitter.
+ */
+#define AUDIO_PLAYBACK_TARGET_BLOCKS_X2  5
+#define AUDIO_PLAYBACK_TARGET_SAMPLES \
+    (AUDIO_PLAYBACK_TARGET_BLOCKS_X2 * AUDIO_PLAYBACK_BLOCK_SAMPLES / 2)
+
+/* Bytes buffered between the OUT callback and the DMA ISR (2^n) */
+#define AUDIO_PLAYBACK_RING_BYTES  2048
+
+struct audio_playback_stats {
+    uint32_t packets;        /* OUT packets received */
+    uint32_t overruns;       /* of which dropped, ring full */
+    uint32_t blocks;         /* DMA halves refilled */
+    uint32_t silent;         /* of which silence: priming or underrun */
+    uint32_t underruns;      /* ring ran dry while playing */
+    uint32_t feedback_q14;   /* last feedback value, 10.14 */
+    uint32_t start_failures; /* I2S clock did not lock (kept across starts) */
+};
+
+/* Alt 1 selected: empty the ring and start the DMA on silence */
+void audio_playback_start(void);
+void audio_playback_stop(void);
+
+/* OUT endpoint: one received packet of len bytes */
+void audio_playback_rx(const uint8_t *pkt, uint32_t len);
+
+/*
+ * DMA ISR: half 0 (half-transfer) or 1 (transfer-complete) has been
+ * sent, t = sof_timer_now() when the interrupt was taken.
+ */
+void audio_playback_dma_event(uint32_t half, uint32_t t);
+
+/* SOF callback, sof_tick = sof_timer_last_sof(): next feedback value */
+uint32_t audio_playback_sof(uint32_t sof_tick);
+
+/* Samples per channel in the ring plus the rest of the half being played */
+uint32_t audio_playback_fill_samples(void);
+
+void audio_playback_get_stats(struct audio_playback_stats *st);
@@ -0,0 +1,370 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "usb_audio_uac2.h"
+#include "audio_requests.h"
+#include "audio_format.h"
+#include "audio_stream.h"
+#include "audio_capture.h"
+#include "audio_gain.h"
+
+#define REQ_DIR_IN  0x80
+
+static uint32_t requested_rate = AUDIO_SAMPLE_RATE_HZ;
+
+/* Feature Unit state as the host last set it: [0] master, [1..n] channels */
+static bool    fu_mute[AUDIO_NUM_CHANNELS + 1];
+static int16_t fu_volume[AUDIO_NUM_CHANNELS + 1];   /* 1/256 dB, 0 = unity */
+
+uint32_t audio_req_sampling_rate(void)
+{
+    return requested_rate;
+}
+
+static uint32_t get_le(const uint8_t *p, unsigned n)
+{
+    uint32_t v = 0;
+
+    while (n--) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+static void put_le(uint8_t *p, uint32_t v, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++, v >>= 8) {
+        p[i] = (uint8_t)(v & 0xFF);
+    }
+}
+
+/* GET reply of size bytes, cut to what the host asked for */
+static enum audio_req_result reply(uint8_t *buf, uint16_t *len,
+                                   const uint8_t *src, uint16_t size)
+{
+    if (*len > size) {
+        *len = size;
+    }
+    memcpy(buf, src, *len);
+    return AUDIO_REQ_HANDLED;
+}
+
+/* -------------------------------------------------------------------------- */
+/* SHARED: SAMPLING RATE                                                      */
+/* -------------------------------------------------------------------------- */
+
+/* Any alt setting offers this rate */
+static bool rate_supported(uint32_t rate_hz)
+{
+    for (unsigned i = 0; i < AUDIO_NUM_FORMATS; i++) {
+        if (audio_format_has_rate(&audio_formats[i], rate_hz)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Validate against the active alt, or any alt while idle */
+static bool rate_set(uint32_t rate_hz)
+{
+    if (audio_stream_format()) {
+        if (!audio_stream_set_rate(rate_hz)) {
+            return false;
+        }
+    } else if (!rate_supported(rate_hz)) {
+        return false;
+    }
+
+    requested_rate = rate_hz;
+    return true;
+}
+
+static uint32_t rate_get(void)
+{
+    return audio_stream_format() ? audio_stream_cfg()->rate_hz : requested_rate;
+}
+
+/* -------------------------------------------------------------------------- */
+/* SHARED: FEATURE UNIT MUTE / VOLUME (master and each channel)              */
+/* -------------------------------------------------------------------------- */
+
+static int32_t fu_gain(uint8_t cn)
+{
+    return fu_mute[cn] ? 0 : audio_gain_from_volume(fu_volume[cn]);
+}
+
+/* Channel cn's gain is its own times the master's; cn 0 moves them all */
+static void fu_apply(uint8_t cn)
+{
+    int32_t master = fu_gain(0);
+
+    for (uint8_t ch = 1; ch <= AUDIO_NUM_CHANNELS; ch++) {
+        if (cn == 0 || cn == ch) {
+            audio_capture_set_gain(ch - 1u,
+                                   (int32_t)(((int64_t)master * fu_gain(ch)) >> 16));
+        }
+    }
+}
+
+static void fu_set_mute(uint8_t cn, bool mute)
+{
+    fu_mute[cn] = mute;
+    fu_apply(cn);
+}
+
+static void fu_set_volume(uint8_t cn, int16_t v)
+{
+    fu_volume[cn] = (v == USB_AUDIO_VOLUME_SILENCE) ? v : audio_gain_volume_clamp(v);
+    fu_apply(cn);
+}
+
+#if AUDIO_UAC2
+/* -------------------------------------------------------------------------- */
+/* UAC2: CLOCK SOURCE                                                         */
+/* -------------------------------------------------------------------------- */
+
+/* Ascending union of the table's rates; returns the count */
+static unsigned rate_list(uint32_t *out)
+{
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < AUDIO_NUM_FORMATS; i++) {
+        for (unsigned r = 0; r < audio_formats[i].num_rates; r++) {
+            uint32_t hz = audio_formats[i].rates[r];
+            unsigned k  = n;
+
+            while (k > 0 && out[k - 1] > hz) {
+                k--;
+            }
+            if (k > 0 && out[k - 1] == hz) {
+                continue;
+            }
+            memmove(&out[k + 1], &out[k], (n - k) * sizeof(out[0]));
+            out[k] = hz;
+            n++;
+        }
+    }
+    return n;
+}
+
+#define CLOCK_MAX_RATES  (AUDIO_NUM_FORMATS * AUDIO_MAX_RATES)
+
+static enum audio_req_result
+clock_request(const struct audio_req *req, uint8_t *buf, uint16_t *len)
+{
+    bool    in = req->bmRequestType & REQ_DIR_IN;
+    uint8_t cs = req->wValue >> 8;
+
+    if (cs == USB_AUDIO2_CS_SAM_FREQ && req->bRequest == USB_AUDIO2_REQ_CUR) {
+        uint8_t cur[4];
+
+        if (!in) {
+            return (*len >= 4 && rate_set(get_le(buf, 4))) ?
+                   AUDIO_REQ_HANDLED : AUDIO_REQ_STALL;
+        }
+        put_le(cur, rate_get(), 4);
+        return reply(buf, len, cur, sizeof(cur));
+    }
+
+    if (cs == USB_AUDIO2_CS_SAM_FREQ && req->bRequest == USB_AUDIO2_REQ_RANGE && in) {
+        uint8_t  range[USB_AUDIO2_RANGE_SIZE(CLOCK_MAX_RATES, 4)];
+        uint32_t rates[CLOCK_MAX_RATES];
+        unsigned n = rate_list(rates);
+
+        /* Discrete rates: one subrange each, MIN = MAX, RES = 0 */
+        put_le(range, n, 2);
+        for (unsigned i = 0; i < n; i++) {
+            uint8_t *sub = &range[2 + 12 * i];
+            put_le(sub + 0, rates[i], 4);
+            put_le(sub + 4, rates[i], 4);
+            put_le(sub + 8, 0, 4);
+        }
+        return reply(buf, len, range, (uint16_t)USB_AUDIO2_RANGE_SIZE(n, 4));
+    }
+
+    if (cs == USB_AUDIO2_CS_CLOCK_VALID && req->bRequest == USB_AUDIO2_REQ_CUR && in) {
+        static const uint8_t valid = 1;
+        return reply(buf, len, &valid, 1);
+    }
+
+    return AUDIO_REQ_STALL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* UAC2: FEATURE UNIT                                                         */
+/* -------------------------------------------------------------------------- */
+
+static enum audio_req_result
+fu_request(const struct audio_req *req, uint8_t cn, uint8_t *buf, uint16_t *len)
+{
+    bool    in = req->bmRequestType & REQ_DIR_IN;
+    uint8_t v[USB_AUDIO2_RANGE_SIZE(1, 2)];
+
+    switch (((req->wValue >> 8) << 8) | req->bRequest) {
+    case (USB_AUDIO_FU_CS_MUTE << 8) | USB_AUDIO2_REQ_CUR:
+        if (!in) {
+            if (*len < 1) {
+                return AUDIO_REQ_STALL;
+            }
+            fu_set_mute(cn, buf[0] != 0);
+            return AUDIO_REQ_HANDLED;
+        }
+        v[0] = fu_mute[cn];
+        return reply(buf, len, v, 1);
+
+    case (USB_AUDIO_FU_CS_VOLUME << 8) | USB_AUDIO2_REQ_CUR:
+        if (!in) {
+            if (*len < 2) {
+                return AUDIO_REQ_STALL;
+            }
+            fu_set_volume(cn, (int16_t)get_le(buf, 2));
+            return AUDIO_REQ_HANDLED;
+        }
+        put_le(v, (uint16_t)fu_volume[cn], 2);
+        return reply(buf, len, v, 2);
+
+    case (USB_AUDIO_FU_CS_VOLUME << 8) | USB_AUDIO2_REQ_RANGE:
+        if (!in) {
+            return AUDIO_REQ_STALL;
+        }
+        put_le(v + 0, 1, 2);
+        put_le(v + 2, (uint16_t)AUDIO_GAIN_VOL_MIN, 2);
+        put_le(v + 4, (uint16_t)AUDIO_GAIN_VOL_MAX, 2);
+        put_le(v + 6, (uint16_t)AUDIO_GAIN_VOL_RES, 2);
+        return reply(buf, len, v, sizeof(v));
+
+    default:
+        return AUDIO_REQ_STALL;
+    }
+}
+
+enum audio_req_result audio_req_endpoint(const struct audio_req *req,
+                                         uint8_t *buf, uint16_t *len)
+{
+    /* UAC2 moved the rate to the clock source; no endpoint controls */
+    (void)req;
+    (void)buf;
+    (void)len;
+    return AUDIO_REQ_NEXT;
+}
+
+#else
+/* -------------------------------------------------------------------------- */
+/* UAC1: ENDPOINT SAMPLING FREQUENCY                                          */
+/* -------------------------------------------------------------------------- */
+
+enum audio_req_result audio_req_endpoint(const struct audio_req *req,
+                                         uint8_t *buf, uint16_t *len)
+{
+    uint8_t cur[3];
+
+    if ((req->wValue >> 8) != USB_AUDIO_EP_CS_SAMPLING_FREQ) {
+        return AUDIO_REQ_NEXT;
+    }
+
+    switch (req->bRequest) {
+    case USB_AUDIO_REQ_SET_CUR:
+        return (*len >= 3 && rate_set(get_le(buf, 3))) ?
+               AUDIO_REQ_HANDLED : AUDIO_REQ_STALL;
+
+    case USB_AUDIO_REQ_GET_CUR:
+        put_le(cur, rate_get(), 3);
+        return reply(buf, len, cur, sizeof(cur));
+
+    default:
+        return AUDIO_REQ_STALL;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* UAC1: FEATURE UNIT                                                         */
+/* -------------------------------------------------------------------------- */
+
+static enum audio_req_result
+fu_mute_request(const struct audio_req *req, uint8_t cn, uint8_t *buf, uint16_t *len)
+{
+    uint8_t cur;
+
+    switch (req->bRequest) {
+    case USB_AUDIO_REQ_SET_CUR:
+        if (*len < 1) {
+            return AUDIO_REQ_STALL;
+        }
+        fu_set_mute(cn, buf[0] != 0);
+        return AUDIO_REQ_HANDLED;
+
+    case USB_AUDIO_REQ_GET_CUR:
+        cur = fu_mute[cn];
+        return reply(buf, len, &cur, 1);
+
+    default:
+        return AUDIO_REQ_STALL;
+    }
+}
+
+static enum audio_req_result
+fu_volume_request(const struct audio_req *req, uint8_t cn, uint8_t *buf, uint16_t *len)
+{
+    int16_t v;
+    uint8_t le[2];
+
+    switch (req->bRequest) {
+    case USB_AUDIO_REQ_SET_CUR:
+        if (*len < 2) {
+            return AUDIO_REQ_STALL;
+        }
+        fu_set_volume(cn, (int16_t)get_le(buf, 2));
+        return AUDIO_REQ_HANDLED;
+
+    case USB_AUDIO_REQ_GET_CUR: v = fu_volume[cn];      break;
+    case USB_AUDIO_REQ_GET_MIN: v = AUDIO_GAIN_VOL_MIN; break;
+    case USB_AUDIO_REQ_GET_MAX: v = AUDIO_GAIN_VOL_MAX; break;
+    case USB_AUDIO_REQ_GET_RES: v = AUDIO_GAIN_VOL_RES; break;
+
+    default:
+        return AUDIO_REQ_STALL;
+    }
+
+    put_le(le, (uint16_t)v, 2);
+    return reply(buf, len, le, sizeof(le));
+}
+
+static enum audio_req_result
+fu_request(const struct audio_req *req, uint8_t cn, uint8_t *buf, uint16_t *len)
+{
+    switch (req->wValue >> 8) {
+    case USB_AUDIO_FU_CS_MUTE:
+        return fu_mute_request(req, cn, buf, len);
+    case USB_AUDIO_FU_CS_VOLUME:
+        return fu_volume_request(req, cn, buf, len);
+    default:
+        return AUDIO_REQ_STALL;
+    }
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* ENTITY DISPATCH                                                            */
+/* -------------------------------------------------------------------------- */
+
+enum audio_req_result audio_req_entity(const struct audio_req *req,
+                                       uint8_t entity, uint8_t *buf,
+                                       uint16_t *len)
+{
+    switch (entity) {
+    case AUDIO_FEATURE_UNIT_ID:
+        /* Master (0) and logical channels 1..n; no "all channels" (0xFF) */
+        if ((req->wValue & 0xFF) > AUDIO_NUM_CHANNELS) {
+            return AUDIO_REQ_STALL;
+        }
+        return fu_request(req, (uint8_t)(req->wValue & 0xFF), buf, len);
+
+#if AUDIO_UAC2
+    case AUDIO_CLOCK_SOURCE_ID:
+        return clock_request(req, buf, len);
+#endif
+
+    default:
+        return AUDIO_REQ_NEXT;
+    }
+}
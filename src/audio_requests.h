@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Audio class request semantics, UAC1 and UAC2, free of libopencm3: the
+ * USB glue (usb_audio_control.c) matches interface / endpoint numbers,
+ * hands over the setup fields and data stage, and maps the result back.
+ * The host build drives the same code with synthetic requests.
+ *
+ * Shared by both personalities: the sampling rate (checked against the
+ * format table, applied to a running stream) and the Feature Unit mute /
+ * volume, master and per channel, applied as capture gain: each channel
+ * gets its own gain times the master's. Only the wire layouts differ:
+ *
+ *            sampling rate                     FU volume
+ *   UAC1     endpoint SAM_FREQ CUR, 3 bytes    CUR / MIN / MAX / RES
+ *   UAC2     clock source SAM_FREQ CUR,        CUR, RANGE
+ *            4 bytes; RANGE of discrete rates
+ */
+
+enum audio_req_result {
+    AUDIO_REQ_NEXT = 0,     /* not ours, try the next handler */
+    AUDIO_REQ_HANDLED,
+    AUDIO_REQ_STALL,
+};
+
+/* The setup fields the class requests look at */
+struct audio_req {
+    uint8_t  bmRequestType;
+    uint8_t  bRequest;
+    uint16_t wValue;        /* control selector << 8 | channel */
+};
+
+/*
+ * Request to an AudioControl entity (wIndex high byte) or, under UAC1,
+ * to the streaming endpoint. buf is the data stage, *len its length:
+ * SET data on entry, GET replies written back and cut to *len.
+ */
+enum audio_req_result audio_req_entity(const struct audio_req *req,
+                                       uint8_t entity, uint8_t *buf,
+                                       uint16_t *len);
+enum audio_req_result audio_req_endpoint(const struct audio_req *req,
+                                         uint8_t *buf, uint16_t *len);
+
+/* Rate last requested by the host (applied when an alt is selected) */
+uint32_t audio_req_sampling_rate(void);
@@ -0,0 +1,255 @@
+#include <string.h>
+
+#include "audio_ring.h"
+
+/*
+ * Index publication. Acquire on the other side's index orders our data
+ * access after its last publish; release on our own index orders our
+ * data access before the other side can see it. On the M4 these are
+ * plain word loads/stores plus a DMB.
+ */
+#define LOAD_ACQ(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LOAD_RLX(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STORE_REL(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define STORE_RLX(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+void audio_ring_init(struct audio_ring *r, uint8_t *storage, uint32_t size)
+{
+    r->buf  = storage;
+    r->mask = size - 1;
+
+    STORE_RLX(&r->head, 0);
+    STORE_RLX(&r->tail, 0);
+    STORE_RLX(&r->overruns, 0);
+    STORE_RLX(&r->underruns, 0);
+    STORE_RLX(&r->high_water, 0);
+    STORE_RLX(&r->low_water, size);
+}
+
+void audio_ring_reset(struct audio_ring *r)
+{
+    STORE_REL(&r->tail, LOAD_ACQ(&r->head));
+}
+
+uint32_t audio_ring_fill(const struct audio_ring *r)
+{
+    return LOAD_ACQ(&r->head) - LOAD_ACQ(&r->tail);
+}
+
+uint32_t audio_ring_space(const struct audio_ring *r)
+{
+    return (r->mask + 1) - audio_ring_fill(r);
+}
+
+/* -------------------------------------------------------------------------- */
+/* PRODUCER                                                                   */
+/* -------------------------------------------------------------------------- */
+
+bool audio_ring_write(struct audio_ring *r, const void *src, uint32_t len)
+{
+    uint32_t head = LOAD_RLX(&r->head);
+    uint32_t tail = LOAD_ACQ(&r->tail);
+    uint32_t size = r->mask + 1;
+
+    if (len > size - (head - tail)) {
+        STORE_RLX(&r->overruns, LOAD_RLX(&r->overruns) + 1);
+        return false;
+    }
+
+    uint32_t off   = head & r->mask;
+    uint32_t first = size - off;
+
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(&r->buf[off], src, first);
+    memcpy(&r->buf[0], (const uint8_t *)src + first, len - first);
+
+    STORE_REL(&r->head, head + len);
+
+    uint32_t fill = head + len - tail;
+    if (fill > LOAD_RLX(&r->high_water)) {
+        STORE_RLX(&r->high_water, fill);
+    }
+
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONSUMER                                                                   */
+/* -------------------------------------------------------------------------- */
+
+/* Underrun check; on success *tail and *head describe the data to take */
+static bool consume_begin(struct audio_ring *r, uint32_t len,
+                          uint32_t *tail, uint32_t *head)
+{
+    *tail = LOAD_RLX(&r->tail);
+    *head = LOAD_ACQ(&r->head);
+
+    if (len > *head - *tail) {
+        STORE_RLX(&r->underruns, LOAD_RLX(&r->underruns) + 1);
+        return false;
+    }
+    return true;
+}
+
+static void consume_end(struct audio_ring *r, uint32_t len,
+                        uint32_t tail, uint32_t head)
+{
+    STORE_REL(&r->tail, tail + len);
+
+    uint32_t fill = head - tail - len;
+    if (fill < LOAD_RLX(&r->low_water)) {
+        STORE_RLX(&r->low_water, fill);
+    }
+}
+
+/* Bytes from tail up to the end of storage, capped at len */
+static uint32_t first_span(const struct audio_ring *r, uint32_t tail,
+                           uint32_t len)
+{
+    uint32_t first = (r->mask + 1) - (tail & r->mask);
+
+    return first > len ? len : first;
+}
+
+static void copy_bytes(const struct audio_ring *r, uint32_t tail, void *dst,
+                       uint32_t len)
+{
+    uint32_t first = first_span(r, tail, len);
+
+    memcpy(dst, &r->buf[tail & r->mask], first);
+    memcpy((uint8_t *)dst + first, &r->buf[0], len - first);
+}
+
+bool audio_ring_read(struct audio_ring *r, void *dst, uint32_t len)
+{
+    uint32_t tail, head;
+
+    if (!consume_begin(r, len, &tail, &head)) {
+        return false;
+    }
+
+    copy_bytes(r, tail, dst, len);
+    consume_end(r, len, tail, head);
+    return true;
+}
+
+bool audio_ring_peek(struct audio_ring *r, void *dst, uint32_t len)
+{
+    uint32_t tail, head;
+
+    if (!consume_begin(r, len, &tail, &head)) {
+        return false;
+    }
+
+    copy_bytes(r, tail, dst, len);
+    return true;
+}
+
+bool audio_ring_skip(struct audio_ring *r, uint32_t len)
+{
+    uint32_t tail, head;
+
+    if (!consume_begin(r, len, &tail, &head)) {
+        return false;
+    }
+
+    consume_end(r, len, tail, head);
+    return true;
+}
+
+bool audio_ring_has(struct audio_ring *r, uint32_t len)
+{
+    uint32_t tail, head;
+
+    return consume_begin(r, len, &tail, &head);
+}
+
+/* Little-endian word at any alignment: a single LDR on the M4 */
+static uint32_t load_word(const uint8_t *p)
+{
+    uint32_t w;
+
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+/* Up to 4 bytes from two places, zero-padded, as one word */
+static uint32_t join_word(const uint8_t *a, uint32_t na,
+                          const uint8_t *b, uint32_t nb)
+{
+    uint8_t tmp[4] = { 0, 0, 0, 0 };
+
+    memcpy(tmp, a, na);
+    memcpy(tmp + na, b, nb);
+    return load_word(tmp);
+}
+
+/* len bytes from tail as words into dst, see audio_ring_read_words() */
+static void copy_words(const struct audio_ring *r, uint32_t tail,
+                       volatile uint32_t *dst, uint32_t len)
+{
+    uint32_t       first = first_span(r, tail, len);
+    uint32_t       rest  = len - first;
+    const uint8_t *p     = &r->buf[tail & r->mask];
+    const uint8_t *q     = &r->buf[0];
+
+    for (; first >= 4; first -= 4, p += 4) {
+        *dst++ = load_word(p);
+    }
+
+    /* The word straddling the wrap, or the short last word */
+    if (first) {
+        uint32_t nb = 4 - first < rest ? 4 - first : rest;
+
+        *dst++ = join_word(p, first, q, nb);
+        q    += nb;
+        rest -= nb;
+    }
+
+    for (; rest >= 4; rest -= 4, q += 4) {
+        *dst++ = load_word(q);
+    }
+    if (rest) {
+        *dst = join_word(q, rest, q, 0);
+    }
+}
+
+bool audio_ring_read_words(struct audio_ring *r, volatile uint32_t *dst,
+                           uint32_t len)
+{
+    uint32_t tail, head;
+
+    if (!consume_begin(r, len, &tail, &head)) {
+        return false;
+    }
+
+    copy_words(r, tail, dst, len);
+    consume_end(r, len, tail, head);
+    return true;
+}
+
+bool audio_ring_peek_words(struct audio_ring *r, volatile uint32_t *dst,
+                           uint32_t len)
+{
+    uint32_t tail, head;
+
+    if (!consume_begin(r, len, &tail, &head)) {
+        return false;
+    }
+
+    copy_words(r, tail, dst, len);
+    return true;
+}
+
+void audio_ring_get_stats(const struct audio_ring *r,
+                          struct audio_ring_stats *st)
+{
+    st->fill       = audio_ring_fill(r);
+    st->high_water = LOAD_RLX(&r->high_water);
+    st->low_water  = LOAD_RLX(&r->low_water);
+    st->overruns   = LOAD_RLX(&r->overruns);
+    st->underruns  = LOAD_RLX(&r->underruns);
+}
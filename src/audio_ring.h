@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Lock-free single-producer / single-consumer byte ring.
+ *
+ * head is only written by the producer, tail only by the consumer; both
+ * are free-running and published with release stores, so the capture
+ * ISR and the SOF callback never need a critical section. Capacity must
+ * be a power of two. Each statistic has exactly one writer as well.
+ */
+
+/* Keep producer and consumer fields on separate lines where it matters */
+#if defined(__arm__)
+#define AUDIO_RING_LINE  4      /* Cortex-M4: no data cache */
+#else
+#define AUDIO_RING_LINE  64
+#endif
+
+struct audio_ring_stats {
+    uint32_t fill;         /* bytes currently queued */
+    uint32_t high_water;   /* max fill seen after a write */
+    uint32_t low_water;    /* min fill seen after a read */
+    uint32_t overruns;     /* writes rejected, not enough space */
+    uint32_t underruns;    /* reads rejected, not enough data */
+};
+
+struct audio_ring {
+    uint8_t  *buf;
+    uint32_t  mask;
+
+    /* Producer side */
+    uint32_t  head       __attribute__((aligned(AUDIO_RING_LINE)));
+    uint32_t  overruns;
+    uint32_t  high_water;
+
+    /* Consumer side */
+    uint32_t  tail       __attribute__((aligned(AUDIO_RING_LINE)));
+    uint32_t  underruns;
+    uint32_t  low_water;
+};
+
+/* Word-aligned static storage for a ring of size bytes (power of two) */
+#define AUDIO_RING_STORAGE(name, size)                                     \
+    _Static_assert(((size) & ((size) - 1)) == 0, "ring size not 2^n");     \
+    static uint8_t name[size] __attribute__((aligned(4)))
+
+void audio_ring_init(struct audio_ring *r, uint8_t *storage, uint32_t size);
+
+/* Consumer-side reset (producer must be stopped) */
+void audio_ring_reset(struct audio_ring *r);
+
+uint32_t audio_ring_fill(const struct audio_ring *r);
+uint32_t audio_ring_space(const struct audio_ring *r);
+
+/* Producer: copy len bytes in, all or nothing */
+bool audio_ring_write(struct audio_ring *r, const void *src, uint32_t len);
+
+/* Consumer: copy len bytes out, all or nothing */
+bool audio_ring_read(struct audio_ring *r, void *dst, uint32_t len);
+
+/*
+ * Consumer: true if len bytes can be read, counting an underrun if not.
+ * Only the consumer drains, so a following read of len cannot fail.
+ */
+bool audio_ring_has(struct audio_ring *r, uint32_t len);
+
+/*
+ * Consumer: take len bytes as little-endian 32-bit words, the last one
+ * zero-padded, into dst[0 .. (len + 3) / 4), straight from storage and
+ * across the wrap. dst may be a device FIFO window (usb_fifo.h).
+ */
+bool audio_ring_read_words(struct audio_ring *r, volatile uint32_t *dst,
+                           uint32_t len);
+
+/*
+ * Consumer: as audio_ring_read() / _read_words(), but the bytes stay in
+ * the ring until a later audio_ring_skip(), e.g. once they are known to
+ * have been sent.
+ */
+bool audio_ring_peek(struct audio_ring *r, void *dst, uint32_t len);
+bool audio_ring_peek_words(struct audio_ring *r, volatile uint32_t *dst,
+                           uint32_t len);
+
+/* Consumer: drop len bytes without copying */
+bool audio_ring_skip(struct audio_ring *r, uint32_t len);
+
+void audio_ring_get_stats(const struct audio_ring *r,
+                          struct audio_ring_stats *st);
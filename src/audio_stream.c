@@ -0,0 +1,368 @@
+#include <stddef.h>
+
+#include "usb_audio_uac1.h"
+#include "usb_descriptors.h"
+#include "audio_capture.h"
+#include "audio_stream.h"
+#include "rate_ctrl.h"
+#include "sof_timer.h"
+#include "cycle_counter.h"
+#include "profiler.h"
+#include "usb_fifo.h"
+#include "sync_map.h"
+#include "stream_power.h"
+
+/*
+ * Build with -DAUDIO_STREAM_STAGED=1 to copy each packet out of the ring
+ * into a staging buffer and send it from there, as before the zero-copy
+ * FIFO path; kept to compare packet-write cycles.
+ */
+#ifndef AUDIO_STREAM_STAGED
+#define AUDIO_STREAM_STAGED 0
+#endif
+
+static const struct audio_format *fmt_cur;
+static struct audio_stream_cfg cfg;
+static uint32_t target;
+
+static struct rate_ctrl rate;
+static bool primed;
+static bool live;           /* the host has had captured audio since the restart */
+static uint32_t t_restart;  /* sof_timer_now() at the restart */
+
+/* Samples the host has taken since the last restart, silence included */
+static uint32_t wire_samples;
+
+/* The packet on the endpoint, if any */
+static struct {
+    bool     armed;
+    bool     from_ring;     /* its bytes are still at the head of the ring */
+    uint16_t bytes;
+    uint16_t samples;
+    uint32_t frame;         /* 11-bit frame it is armed for */
+    uint32_t tries;         /* frames it has been armed for */
+} pkt;
+
+/* Frame number of the last SOF seen, for spotting missed ones */
+static uint32_t sof_frame;
+static bool     sof_seen;
+
+/* Sent while priming or after an underrun, keeps the iso stream running */
+static const uint8_t audio_silence[AUDIO_MAX_PACKET_SIZE];
+
+#if AUDIO_STREAM_STAGED
+static uint8_t pcm[AUDIO_MAX_PACKET_SIZE] __attribute__((aligned(4)));
+#endif
+
+static struct audio_stream_stats stats;
+
+/* Room for the set point plus a packet per retry, and the next block */
+_Static_assert(AUDIO_CAPTURE_RING_BYTES >=
+               (AUDIO_STREAM_TARGET_BLOCKS_X2 + 2 * AUDIO_STREAM_MAX_TRIES) *
+               AUDIO_CAPTURE_MAX_BLOCK_BYTES / 2,
+               "capture ring cannot hold the packets kept for re-sending");
+
+/* Frames from a to b on the 11-bit counter, -1024..1023 */
+static int32_t frame_diff(uint32_t a, uint32_t b)
+{
+    return (int32_t)((b - a + 1024) & 0x7FF) - 1024;
+}
+
+/* -------------------------------------------------------------------------- */
+/* PACKETS                                                                    */
+/* -------------------------------------------------------------------------- */
+
+enum arm_result {
+    ARM_OK,
+    ARM_UNDERRUN,   /* the ring holds less than pkt */
+    ARM_BUSY,       /* the endpoint still holds a packet */
+};
+
+/* Put pkt on the endpoint for frame; anything but ARM_OK arms nothing */
+static enum arm_result stream_arm(uint32_t frame)
+{
+    struct audio_ring *ring = audio_capture_ring();
+    uint32_t latency = sof_timer_since_sof();
+    uint32_t t0      = cycles_now();
+    int n;
+
+    if (!pkt.from_ring) {
+        n = usb_fifo_write_iso(EP_AUDIO_IN, audio_silence, pkt.bytes, frame);
+#if AUDIO_STREAM_STAGED
+    } else if (!audio_ring_peek(ring, pcm, pkt.bytes)) {
+        return ARM_UNDERRUN;
+    } else {
+        n = usb_fifo_write_iso(EP_AUDIO_IN, pcm, pkt.bytes, frame);
+#else
+    } else {
+        n = usb_fifo_peek_iso(EP_AUDIO_IN, ring, pkt.bytes, frame);
+#endif
+    }
+
+    if (n == USB_FIFO_UNDERRUN) {
+        return ARM_UNDERRUN;
+    }
+    if (n == 0) {
+        stats.busy++;
+        return ARM_BUSY;
+    }
+
+    prof_record(PROF_STAGE_PACKET_WRITE, cycles_now() - t0);
+    prof_record(PROF_STAGE_SOF_LATENCY, latency);
+
+    if (frame_diff(sof_timer_frame(), frame) <= 0) {
+        stats.late++;
+    }
+    pkt.armed = true;
+    pkt.frame = frame;
+    pkt.tries++;
+
+    stats.packets++;
+    if (!pkt.from_ring) {
+        stats.silent++;
+    }
+    stats.sof_latency_last = latency;
+    if (latency > stats.sof_latency_max) {
+        stats.sof_latency_max = latency;
+    }
+    return ARM_OK;
+}
+
+/* Decide the next packet and arm it for frame */
+static void stream_next(uint32_t frame)
+{
+    struct audio_ring *ring = audio_capture_ring();
+    uint32_t fill = audio_capture_fill_samples();
+    uint32_t n    = cfg.samples_per_frame;
+
+    pkt.from_ring = false;
+    pkt.tries     = 0;
+
+    /* Hold off until the ring reaches the set point, then track it */
+    if (!primed && fill >= target) {
+        rate_ctrl_init(&rate, cfg.samples_per_frame, target);
+        primed = true;
+    }
+    if (primed) {
+        n = rate_ctrl_next(&rate, fill);
+        pkt.from_ring = true;
+    }
+    pkt.samples = (uint16_t)n;
+    pkt.bytes   = (uint16_t)(n * cfg.frame_bytes);
+
+    if (pkt.from_ring) {
+        switch (stream_arm(frame)) {
+        case ARM_OK:
+            sync_map_packet(audio_ring_fill(ring) / cfg.frame_bytes,
+                            wire_samples);
+            return;
+        case ARM_BUSY:
+            /* Samples stay at the head of the ring for the next SOF */
+            return;
+        case ARM_UNDERRUN:
+            break;
+        }
+        primed        = false;
+        pkt.from_ring = false;
+    }
+    (void)stream_arm(frame);
+}
+
+/* The host took pkt: retire its samples */
+static void stream_sent(void)
+{
+    if (pkt.from_ring) {
+        (void)audio_ring_skip(audio_capture_ring(), pkt.bytes);
+        if (!live) {
+            live = true;
+            stream_power_live(sof_timer_now() - t_restart);
+        }
+    }
+    if (pkt.tries > 1) {
+        stats.recovered++;
+    }
+    wire_samples += pkt.samples;
+    pkt.armed = false;
+}
+
+/* Drop whatever the endpoint holds, counting a flush that timed out */
+static void stream_flush(void)
+{
+    if (!usb_fifo_flush(EP_AUDIO_IN)) {
+        stats.flush_timeouts++;
+    }
+}
+
+/* The frame after pkt's, or the current one if that has gone by */
+static uint32_t stream_next_frame(uint32_t now)
+{
+    uint32_t next = pkt.frame + 1;
+
+    return frame_diff(next, now) > 0 ? now : next;
+}
+
+/*
+ * pkt missed its frame: drop it from the FIFO and arm the same samples
+ * for frame, or give up on them after AUDIO_STREAM_MAX_TRIES.
+ */
+static void stream_retry(uint32_t frame)
+{
+    stream_flush();
+    stats.missed++;
+    pkt.armed = false;
+
+    if (pkt.tries < AUDIO_STREAM_MAX_TRIES) {
+        switch (stream_arm(frame)) {
+        case ARM_OK:
+            return;
+        case ARM_BUSY:
+            /* Not flushed: the next SOF offers the same samples again */
+            return;
+        case ARM_UNDERRUN:
+            break;
+        }
+    }
+
+    if (pkt.from_ring) {
+        stats.dropped += pkt.samples;
+        (void)audio_ring_skip(audio_capture_ring(), pkt.bytes);
+    }
+    stream_next(frame);
+}
+
+/* Apply cfg: restart capture, re-prime the ring, reset the controller */
+static void stream_restart(void)
+{
+    target = (uint32_t)cfg.samples_per_frame * AUDIO_STREAM_TARGET_BLOCKS_X2 / 2;
+    rate_ctrl_init(&rate, cfg.samples_per_frame, target);
+    primed       = false;
+    live         = false;
+    wire_samples = 0;
+    pkt.armed    = false;
+    sof_seen     = false;
+    stream_flush();
+
+    t_restart = sof_timer_now();
+    audio_capture_start(&cfg);
+}
+
+void audio_stream_start(const struct audio_format *fmt, uint32_t rate_hz)
+{
+    fmt_cur = fmt;
+    audio_format_make_cfg(fmt, rate_hz, &cfg);
+    stream_restart();
+}
+
+void audio_stream_stop(void)
+{
+    if (fmt_cur) {
+        audio_capture_stop();
+        stream_flush();
+    }
+    fmt_cur   = NULL;
+    pkt.armed = false;
+}
+
+bool audio_stream_set_rate(uint32_t rate_hz)
+{
+    if (!fmt_cur || !audio_format_has_rate(fmt_cur, rate_hz)) {
+        return false;
+    }
+
+    if (rate_hz != cfg.rate_hz) {
+        audio_format_make_cfg(fmt_cur, rate_hz, &cfg);
+        stream_restart();
+    }
+    return true;
+}
+
+const struct audio_format *audio_stream_format(void)
+{
+    return fmt_cur;
+}
+
+const struct audio_stream_cfg *audio_stream_cfg(void)
+{
+    return &cfg;
+}
+
+void audio_stream_sof(usbd_device *dev)
+{
+    (void)dev;
+
+    if (!fmt_cur) {
+        return;
+    }
+
+    uint32_t t0    = cycles_now();
+    uint32_t frame = sof_timer_frame();
+
+    if (sof_seen && frame_diff(sof_frame, frame) > 1) {
+        stats.sof_gaps += (uint32_t)frame_diff(sof_frame, frame) - 1;
+    }
+    sof_frame = frame;
+    sof_seen  = true;
+
+    sync_map_sof(sof_timer_last_sof(), frame);
+
+    /*
+     * Normally the packet for this frame was armed a frame ago and the
+     * next one goes on from the completion callback. Start the chain if
+     * nothing is armed, first dropping anything a timed-out flush left
+     * on the endpoint; re-arm a packet whose frame has passed without
+     * the incomplete-IN interrupt dealing with it.
+     */
+    if (!pkt.armed) {
+        if (usb_fifo_busy(EP_AUDIO_IN)) {
+            stream_flush();
+        }
+        stream_next(frame + 1);
+    } else if (frame_diff(pkt.frame, frame) > 0) {
+        if (usb_fifo_busy(EP_AUDIO_IN)) {
+            stream_retry(frame);
+        } else {
+            stream_sent();
+            stream_next(frame);
+        }
+    }
+
+    prof_record(PROF_STAGE_SOF, cycles_now() - t0);
+}
+
+void audio_stream_in_done(usbd_device *dev, uint8_t ep)
+{
+    (void)dev;
+    (void)ep;
+
+    if (!fmt_cur || !pkt.armed) {
+        return;
+    }
+
+    uint32_t next = stream_next_frame(sof_timer_frame());
+
+    stream_sent();
+    stream_next(next);
+}
+
+void audio_stream_incomplete(void)
+{
+    if (!fmt_cur || !pkt.armed) {
+        return;
+    }
+
+    /* End of frame: a packet armed for it (or before) was not taken */
+    uint32_t frame = sof_timer_frame();
+
+    if (frame_diff(pkt.frame, frame) >= 0 && usb_fifo_busy(EP_AUDIO_IN)) {
+        stream_retry(stream_next_frame(frame));
+    }
+}
+
+void audio_stream_get_stats(struct audio_stream_stats *st, int reset)
+{
+    *st = stats;
+
+    if (reset) {
+        stats.sof_latency_max = 0;
+    }
+}
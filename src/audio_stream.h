@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "usb_audio_uac1.h"
+#include "audio_format.h"
+
+/*
+ * Packetizer for the iso IN endpoint (asynchronous).
+ *
+ * Each packet pulls nominal +-1 samples from the capture ring, as
+ * decided by the rate controller, so the stream follows the audio clock
+ * rather than the host frame clock.
+ *
+ * Packets are armed a frame ahead, for the next frame's parity, from the
+ * IN-complete callback, so a late SOF interrupt no longer costs a frame.
+ * The SOF only starts the chain and repairs it. Ring data stays in the
+ * ring until the host has taken it: a packet that misses its frame
+ * (incomplete-IN at end of frame, or still pending at the next SOF) is
+ * flushed and the same samples re-armed for the next frame, up to
+ * AUDIO_STREAM_MAX_TRIES times, so a short upset costs latency rather
+ * than samples.
+ */
+
+/* Fill set point: two and a half 1 ms blocks */
+#define AUDIO_STREAM_TARGET_BLOCKS_X2  5
+
+/* Frames a packet is offered for before its samples are dropped */
+#define AUDIO_STREAM_MAX_TRIES  3
+
+/* Start streaming fmt (an alt setting row) at rate_hz, or its default */
+void audio_stream_start(const struct audio_format *fmt, uint32_t rate_hz);
+void audio_stream_stop(void);
+
+/* Switch rate without re-enumeration; false if fmt lacks it */
+bool audio_stream_set_rate(uint32_t rate_hz);
+
+/* Active row (NULL when stopped) and parameters */
+const struct audio_format *audio_stream_format(void);
+const struct audio_stream_cfg *audio_stream_cfg(void);
+
+/*
+ * Called from the SOF callback while a streaming alt is selected. dev is
+ * libopencm3's usbd_device, named by its struct tag so host builds of
+ * the control path can include this header.
+ */
+struct _usbd_device;
+void audio_stream_sof(struct _usbd_device *dev);
+
+/* Transfer complete on the iso IN endpoint (usbd_ep_setup callback) */
+void audio_stream_in_done(struct _usbd_device *dev, uint8_t ep);
+
+/* Incomplete iso IN interrupt (GINTSTS.IISOIXFR), at end of frame */
+void audio_stream_incomplete(void);
+
+struct audio_stream_stats {
+    uint32_t packets;             /* packets armed, re-arms included */
+    uint32_t silent;              /* of which silence (priming/underrun) */
+    uint32_t missed;              /* packets the host did not take in their frame */
+    uint32_t late;                /* armed after their frame's SOF */
+    uint32_t recovered;           /* sent on a later try */
+    uint32_t dropped;             /* ring samples given up after MAX_TRIES */
+    uint32_t busy;                /* not armed, the endpoint still held a packet */
+    uint32_t flush_timeouts;      /* endpoint not disabled or FIFO not flushed */
+    uint32_t sof_gaps;            /* SOF interrupts not seen */
+    uint32_t sof_latency_last;    /* last hardware SOF -> packet armed, TIM2 ticks */
+    uint32_t sof_latency_max;
+};
+
+void audio_stream_get_stats(struct audio_stream_stats *st, int reset);
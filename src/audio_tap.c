@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "audio_tap.h"
+#include "audio_capture.h"
+#include "audio_stream.h"
+#include "stream_power.h"
+
+AUDIO_RING_STORAGE(ring_storage, AUDIO_TAP_RING_BYTES);
+static struct audio_ring ring;
+
+/* Written by the control side, picked up by the producer per block */
+static volatile uint8_t  req_stage;
+static volatile uint16_t req_period;
+
+/* Producer state */
+static uint8_t  stage;
+static uint16_t period;
+static uint16_t since_telemetry;
+static uint16_t seq;
+static uint32_t drops;
+static uint8_t  last_format[TAP_FORMAT_SIZE];
+
+static void put16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+/* Header and payload, or neither; seq advances either way */
+static void put_record(uint8_t type, uint8_t lane, const void *data,
+                       uint32_t len)
+{
+    uint8_t hdr[TAP_HEADER_SIZE];
+
+    put16(hdr + 0, TAP_SYNC);
+    hdr[2] = type;
+    hdr[3] = lane;
+    put16(hdr + 4, seq++);
+    put16(hdr + 6, len);
+
+    /* Only this side fills the ring, so the space can only grow */
+    if (audio_ring_space(&ring) < TAP_HEADER_SIZE + len) {
+        drops++;
+        return;
+    }
+    (void)audio_ring_write(&ring, hdr, TAP_HEADER_SIZE);
+    (void)audio_ring_write(&ring, data, len);
+}
+
+static void put_telemetry(void)
+{
+    struct audio_capture_stats cs;
+    struct audio_stream_stats  ss;
+    struct audio_ring_stats    ts;
+    struct stream_power_stats  ps;
+    uint32_t v[TAP_TELEM_NUM_FIELDS];
+    uint8_t  rec[TAP_TELEMETRY_SIZE];
+
+    audio_capture_get_stats(&cs, 0);
+    audio_stream_get_stats(&ss, 0);
+    audio_ring_get_stats(&ring, &ts);
+    stream_power_get_stats(&ps);
+
+    v[TAP_TELEM_BLOCKS]           = cs.blocks;
+    v[TAP_TELEM_PACK_CYCLES_LAST] = cs.pack_cycles_last;
+    v[TAP_TELEM_PACK_CYCLES_MAX]  = cs.pack_cycles_max;
+    v[TAP_TELEM_OVER_BUDGET]      = cs.over_budget;
+    v[TAP_TELEM_RING_FILL]        = cs.ring.fill;
+    v[TAP_TELEM_RING_HIGH_WATER]  = cs.ring.high_water;
+    v[TAP_TELEM_RING_LOW_WATER]   = cs.ring.low_water;
+    v[TAP_TELEM_RING_OVERRUNS]    = cs.ring.overruns;
+    v[TAP_TELEM_RING_UNDERRUNS]   = cs.ring.underruns;
+    v[TAP_TELEM_PACKETS]          = ss.packets;
+    v[TAP_TELEM_SILENT]           = ss.silent;
+    v[TAP_TELEM_SOF_LATENCY_LAST] = ss.sof_latency_last;
+    v[TAP_TELEM_SOF_LATENCY_MAX]  = ss.sof_latency_max;
+    v[TAP_TELEM_TAP_DROPS]        = drops;
+    v[TAP_TELEM_TAP_HIGH_WATER]   = ts.high_water;
+    v[TAP_TELEM_ISO_MISSED]       = ss.missed;
+    v[TAP_TELEM_ISO_LATE]         = ss.late;
+    v[TAP_TELEM_ISO_RECOVERED]    = ss.recovered;
+    v[TAP_TELEM_ISO_DROPPED]      = ss.dropped;
+    v[TAP_TELEM_SOF_GAPS]         = ss.sof_gaps;
+    v[TAP_TELEM_FIRST_PACKET]     = ps.first_packet_last;
+    v[TAP_TELEM_SLOW_STARTS]      = ps.slow_starts;
+    v[TAP_TELEM_START_FAILURES]   = cs.start_failures;
+    v[TAP_TELEM_ISO_BUSY]         = ss.busy;
+    v[TAP_TELEM_ISO_FLUSH_TIMEOUTS] = ss.flush_timeouts;
+
+    for (unsigned i = 0; i < TAP_TELEM_NUM_FIELDS; i++) {
+        put32(&rec[4 * i], v[i]);
+    }
+    put_record(TAP_REC_TELEMETRY, 0, rec, sizeof(rec));
+}
+
+/* -------------------------------------------------------------------------- */
+/* PRODUCER (capture DMA ISR)                                                 */
+/* -------------------------------------------------------------------------- */
+
+void audio_tap_begin(const struct audio_stream_cfg *cfg)
+{
+    stage  = req_stage;
+    period = req_period;
+
+    if (stage) {
+        uint8_t fmt[TAP_FORMAT_SIZE];
+
+        put32(fmt, cfg->rate_hz);
+        fmt[4] = (uint8_t)(cfg->frame_bytes / cfg->subframe_bytes);
+        fmt[5] = cfg->subframe_bytes;
+        fmt[6] = cfg->bits;
+        fmt[7] = stage;
+
+        if (memcmp(fmt, last_format, sizeof(fmt)) != 0) {
+            memcpy(last_format, fmt, sizeof(fmt));
+            put_record(TAP_REC_FORMAT, 0, fmt, sizeof(fmt));
+        }
+    } else {
+        last_format[7] = 0;     /* FORMAT again when re-enabled */
+    }
+
+    if (period && ++since_telemetry >= period) {
+        since_telemetry = 0;
+        put_telemetry();
+    }
+}
+
+void audio_tap_block(uint8_t st, uint8_t lane, const void *data, uint32_t len)
+{
+    if (st != stage) {
+        return;
+    }
+    put_record(st, lane, data, len);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONTROL / CONSUMER                                                         */
+/* -------------------------------------------------------------------------- */
+
+bool audio_tap_select(uint8_t st, uint16_t telemetry_ms)
+{
+    if (st >= TAP_NUM_STAGES) {
+        return false;
+    }
+
+    /* The producer stays idle until the first select, so set up here */
+    if (!ring.buf) {
+        audio_ring_init(&ring, ring_storage, sizeof(ring_storage));
+    }
+
+    req_period = telemetry_ms;
+    req_stage  = st;
+    return true;
+}
+
+struct audio_ring *audio_tap_ring(void)
+{
+    return &ring;
+}
+
+uint32_t audio_tap_drops(void)
+{
+    return drops;
+}
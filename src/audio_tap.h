@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_ring.h"
+#include "audio_format.h"
+#include "tap_stream.h"
+
+/*
+ * Diagnostic tap: copies of one capture pipeline stage plus periodic
+ * telemetry, framed as tap stream records (tap_stream.h) in an SPSC ring.
+ *
+ * The capture DMA ISR is the only producer: it opens each block with
+ * audio_tap_begin() and offers every stage of it; the selected one is
+ * kept. The consumer is the vendor bulk endpoint feeder
+ * (usb_tap.c), which runs in thread mode and sends whatever has queued.
+ * With the tap off, each offer is a compare and return.
+ */
+
+/* Tap ring: about 20 ms of a single raw lane at 48 kHz (2^n) */
+#define AUDIO_TAP_RING_BYTES  8192
+
+/*
+ * Control side: stage to tap (a TAP_REC_RAW .. TAP_REC_OUTPUT type, or 0
+ * for none) and telemetry period in 1 ms blocks (0 = none). Applied at
+ * the next block; false for an unknown stage.
+ */
+bool audio_tap_select(uint8_t stage, uint16_t telemetry_ms);
+
+/* Producer: start of a block of cfg; FORMAT on change, TELEMETRY when due */
+void audio_tap_begin(const struct audio_stream_cfg *cfg);
+
+/* Producer: one block of stage, lane 0 except for TAP_REC_RAW */
+void audio_tap_block(uint8_t stage, uint8_t lane, const void *data,
+                     uint32_t len);
+
+/* Consumer side: the framed stream */
+struct audio_ring *audio_tap_ring(void);
+
+/* Records dropped because the ring was full */
+uint32_t audio_tap_drops(void);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hardware seam for the microphone capture path.
+ *
+ * The firmware implementation (capture_hal_stm32.c) drives SPI2/I2S2 with
+ * DMA1 Stream 3 in circular mode, plus one slave I2S per extra mic pair.
+ * A host build can provide its own implementation that fills the buffer
+ * synthetically and calls audio_capture_dma_event() in place of the
+ * half/full-transfer interrupts.
+ */
+
+/*
+ * Start circular capture into buf: AUDIO_CAPTURE_LANES consecutive lane
+ * buffers of count half-words each (two halves). Only lane 0 raises the
+ * half/full-transfer events; the other lanes share its clock. false if
+ * the I2S clock did not come up: nothing is started.
+ */
+bool capture_hal_start(volatile uint16_t *buf, uint32_t count, uint32_t rate_hz);
+
+/*
+ * Stop the I2S peripheral and its DMA stream, waiting (bounded) for the
+ * stream to disable; a no-op when not running
+ */
+void capture_hal_stop(void);
+
+/*
+ * Stop, then gate the lanes' SPI and DMA clocks and switch PLLI2S off
+ * for a stream going idle (stream_power.h); capture_hal_start() brings
+ * them back. Only once capture or the headset speaker has run, and
+ * while the speaker is not playing: it shares PLLI2S and DMA1.
+ */
+void capture_hal_sleep(void);
+
+/*
+ * Run PLLI2S at the setting for rate_hz (32-bit frames), leaving it
+ * untouched if it is already there. For other I2S users of the same
+ * clock, the headset speaker (playback_hal.h). false if it did not lock.
+ */
+bool capture_hal_clock(uint32_t rate_hz);
+
+/* Half-words written so far in the current pass over lane 0 */
+uint32_t capture_hal_position(void);
@@ -0,0 +1,321 @@
+#include <stdbool.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+
+#include "capture_hal.h"
+#include "audio_capture.h"
+#include "sof_timer.h"
+#include "irq_prio.h"
+#include "cycle_counter.h"
+#include "profiler.h"
+
+/*
+ * SPI2/I2S2 master receive, I2S Philips, 32-bit frames, from a digital
+ * MEMS mic (INMP441 / ICS-43434 class). SPI2_RX is DMA1 Stream 3, Ch 0.
+ *
+ * Pins (AF5): PB12 = WS, PB13 = CK, PB15 = SD
+ *
+ * Mic arrays add one slave-receive I2S per further L/R pair. Their WS/CK
+ * pins are wired to PB12/PB13 so every lane samples on the master's
+ * clock; only the master's DMA stream interrupts.
+ *
+ *   lane  I2S   DMA            WS     CK     SD
+ *   0     I2S2  DMA1 S3 Ch0    PB12   PB13   PB15    (AF5, master)
+ *   1     I2S3  DMA1 S0 Ch0    PA15   PB3    PB5     (AF6)
+ *   2     I2S1  DMA2 S2 Ch3    PA4    PA5    PA7     (AF5)
+ *   3     I2S5  DMA2 S3 Ch2    PB1    PB0    PA10    (AF6)
+ *
+ * With AUDIO_MIC_PDM the same clock runs 16-bit frames at 96 kHz, so CK
+ * is a 3.072 MHz PDM clock and SD carries the raw 1-bit stream.
+ */
+
+#define CAPTURE_DMA         DMA1
+#define CAPTURE_DMA_STREAM  DMA_STREAM3
+#define CAPTURE_DMA_IRQ     NVIC_DMA1_STREAM3_IRQ
+
+struct i2s_pins {
+    uint32_t port;
+    uint16_t pins;
+    uint8_t  af;
+};
+
+struct i2s_lane {
+    uint32_t           spi;
+    enum rcc_periph_clken spi_clk;
+    enum rcc_periph_rst   spi_rst;
+    uint32_t           dma;
+    enum rcc_periph_clken dma_clk;
+    uint8_t            stream;
+    uint32_t           channel;
+    struct i2s_pins    gpio[2];
+};
+
+static const struct i2s_lane lanes[AUDIO_CAPTURE_LANES] = {
+    { SPI2, RCC_SPI2, RST_SPI2, DMA1, RCC_DMA1, DMA_STREAM3, DMA_SxCR_CHSEL_0,
+      { { GPIOB, GPIO12 | GPIO13 | GPIO15, GPIO_AF5 }, { 0, 0, 0 } } },
+#if AUDIO_CAPTURE_LANES > 1
+    { SPI3, RCC_SPI3, RST_SPI3, DMA1, RCC_DMA1, DMA_STREAM0, DMA_SxCR_CHSEL_0,
+      { { GPIOA, GPIO15, GPIO_AF6 }, { GPIOB, GPIO3 | GPIO5, GPIO_AF6 } } },
+#endif
+#if AUDIO_CAPTURE_LANES > 2
+    { SPI1, RCC_SPI1, RST_SPI1, DMA2, RCC_DMA2, DMA_STREAM2, DMA_SxCR_CHSEL_3,
+      { { GPIOA, GPIO4 | GPIO5 | GPIO7, GPIO_AF5 }, { 0, 0, 0 } } },
+    { SPI5, RCC_SPI5, RST_SPI5, DMA2, RCC_DMA2, DMA_STREAM3, DMA_SxCR_CHSEL_2,
+      { { GPIOB, GPIO0 | GPIO1, GPIO_AF6 }, { GPIOA, GPIO10, GPIO_AF6 } } },
+#endif
+};
+
+/* F411 has a dedicated PLLI2SM divider in bits [5:0] */
+#ifndef RCC_PLLI2SCFGR_PLLI2SM_SHIFT
+#define RCC_PLLI2SCFGR_PLLI2SM_SHIFT 0
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* CLOCK: 25 MHz HSE / PLLI2SM 25 = 1 MHz -> PLLI2S N / R = I2SCLK            */
+/* Fs = I2SCLK / (64 * (2 * DIV + ODD)), 32-bit frames                        */
+/* PDM: same settings give 16-bit frames at 2 * Fs, CK = 64 * Fs              */
+/* -------------------------------------------------------------------------- */
+#define PLLI2S_M   25
+
+struct i2s_clock {
+    uint32_t rate_hz;
+    uint16_t plln;
+    uint8_t  pllr;
+    uint8_t  div;
+    uint8_t  odd;
+};
+
+static const struct i2s_clock i2s_clocks[] = {
+    { 16000, 384, 5, 37, 1 },   /* 76.8 MHz, exact */
+    { 32000, 256, 5, 12, 1 },   /* 51.2 MHz, exact */
+    { 48000, 384, 5, 12, 1 },   /* 76.8 MHz, exact */
+    { 96000, 424, 3, 11, 1 },   /* 141.3 MHz, +151 ppm (rate matched) */
+};
+
+static const struct i2s_clock *i2s_clock_for(uint32_t rate_hz)
+{
+    for (unsigned i = 0; i < sizeof(i2s_clocks) / sizeof(i2s_clocks[0]); i++) {
+        if (i2s_clocks[i].rate_hz == rate_hz) {
+            return &i2s_clocks[i];
+        }
+    }
+    return &i2s_clocks[2];     /* 48 kHz */
+}
+
+static uint32_t dma_count;
+
+/* Lanes set up and clocked, since the last stop */
+static bool running;
+
+/*
+ * PLLI2S lock timeout, core cycles: 1 ms, several times the data sheet's
+ * worst case. Reached from the USB ISR, so a PLL that never locks must
+ * fail the start rather than hang the stack.
+ */
+#define PLLI2S_LOCK_CYCLES  (PROF_CLOCK_HZ / 1000u)
+
+/*
+ * A disabled DMA stream finishes its current beat before EN reads 0:
+ * a few bus cycles. 10 us, then the stream is given up on.
+ */
+#define DMA_STOP_CYCLES     (PROF_CLOCK_HZ / 100000u)
+
+/* false if PLLI2S did not lock: left off */
+static bool i2s_clock_setup(const struct i2s_clock *clk)
+{
+    uint32_t cfg = (PLLI2S_M << RCC_PLLI2SCFGR_PLLI2SM_SHIFT) |
+                   ((uint32_t)clk->plln << RCC_PLLI2SCFGR_PLLI2SN_SHIFT) |
+                   ((uint32_t)clk->pllr << RCC_PLLI2SCFGR_PLLI2SR_SHIFT);
+
+    /* Already running there: the headset speaker may be playing from it */
+    if ((RCC_CR & RCC_CR_PLLI2SRDY) && RCC_PLLI2SCFGR == cfg) {
+        return true;
+    }
+
+    RCC_CR &= ~RCC_CR_PLLI2SON;
+
+    RCC_PLLI2SCFGR = cfg;
+
+    RCC_CR |= RCC_CR_PLLI2SON;
+
+    uint32_t t0 = cycles_now();
+
+    while (!(RCC_CR & RCC_CR_PLLI2SRDY)) {
+        if (cycles_now() - t0 > PLLI2S_LOCK_CYCLES) {
+            RCC_CR &= ~RCC_CR_PLLI2SON;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void i2s_gpio_setup(const struct i2s_lane *l)
+{
+    for (unsigned i = 0; i < 2; i++) {
+        const struct i2s_pins *p = &l->gpio[i];
+
+        if (!p->pins) {
+            continue;
+        }
+
+        rcc_periph_clock_enable(p->port == GPIOA ? RCC_GPIOA : RCC_GPIOB);
+        gpio_mode_setup(p->port, GPIO_MODE_AF, GPIO_PUPD_NONE, p->pins);
+        gpio_set_af(p->port, p->af, p->pins);
+    }
+}
+
+static void i2s_dma_setup(const struct i2s_lane *l, volatile uint16_t *buf,
+                          uint32_t count)
+{
+    rcc_periph_clock_enable(l->dma_clk);
+
+    dma_stream_reset(l->dma, l->stream);
+    dma_channel_select(l->dma, l->stream, l->channel);
+    dma_set_transfer_mode(l->dma, l->stream, DMA_SxCR_DIR_PERIPHERAL_TO_MEM);
+    dma_set_priority(l->dma, l->stream, DMA_SxCR_PL_VERY_HIGH);
+    dma_set_peripheral_size(l->dma, l->stream, DMA_SxCR_PSIZE_16BIT);
+    dma_set_memory_size(l->dma, l->stream, DMA_SxCR_MSIZE_16BIT);
+    dma_enable_memory_increment_mode(l->dma, l->stream);
+    dma_enable_circular_mode(l->dma, l->stream);
+
+    dma_set_peripheral_address(l->dma, l->stream, (uint32_t)&SPI_DR(l->spi));
+    dma_set_memory_address(l->dma, l->stream, (uint32_t)buf);
+    dma_set_number_of_data(l->dma, l->stream, (uint16_t)count);
+
+    dma_enable_stream(l->dma, l->stream);
+}
+
+static void i2s_lane_setup(const struct i2s_lane *l, const struct i2s_clock *clk,
+                           volatile uint16_t *buf, uint32_t count, bool master)
+{
+    i2s_gpio_setup(l);
+
+    rcc_periph_clock_enable(l->spi_clk);
+    rcc_periph_reset_pulse(l->spi_rst);
+
+    if (master) {
+        SPI_I2SPR(l->spi) = clk->div | (clk->odd ? SPI_I2SPR_ODD : 0);
+    }
+    SPI_I2SCFGR(l->spi) = SPI_I2SCFGR_I2SMOD |
+        ((master ? SPI_I2SCFGR_I2SCFG_MASTER_RECEIVE :
+                   SPI_I2SCFGR_I2SCFG_SLAVE_RECEIVE) << SPI_I2SCFGR_I2SCFG_LSB) |
+        (SPI_I2SCFGR_I2SSTD_I2S_PHILIPS << SPI_I2SCFGR_I2SSTD_LSB) |
+#if AUDIO_MIC_PDM
+        (SPI_I2SCFGR_DATLEN_16BIT << SPI_I2SCFGR_DATLEN_LSB);
+#else
+        (SPI_I2SCFGR_DATLEN_32BIT << SPI_I2SCFGR_DATLEN_LSB) |
+        SPI_I2SCFGR_CHLEN;
+#endif
+
+    SPI_CR2(l->spi) |= SPI_CR2_RXDMAEN;
+    i2s_dma_setup(l, buf, count);
+}
+
+/* -------------------------------------------------------------------------- */
+/* HAL API                                                                    */
+/* -------------------------------------------------------------------------- */
+
+bool capture_hal_start(volatile uint16_t *buf, uint32_t count, uint32_t rate_hz)
+{
+    const struct i2s_clock *clk = i2s_clock_for(rate_hz);
+
+    dma_count = count;
+
+    /* Restart cleanly if the format changed while running */
+    capture_hal_stop();
+    if (!i2s_clock_setup(clk)) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < AUDIO_CAPTURE_LANES; i++) {
+        i2s_lane_setup(&lanes[i], clk, buf + i * count, count, i == 0);
+    }
+
+    dma_enable_half_transfer_interrupt(CAPTURE_DMA, CAPTURE_DMA_STREAM);
+    dma_enable_transfer_complete_interrupt(CAPTURE_DMA, CAPTURE_DMA_STREAM);
+    nvic_set_priority(CAPTURE_DMA_IRQ, IRQ_PRIO_CAPTURE_DMA);
+    nvic_enable_irq(CAPTURE_DMA_IRQ);
+    running = true;
+
+    /* Slaves first, so they are waiting when the master starts CK/WS */
+    for (unsigned i = AUDIO_CAPTURE_LANES; i-- > 0;) {
+        SPI_I2SCFGR(lanes[i].spi) |= SPI_I2SCFGR_I2SE;
+    }
+    return true;
+}
+
+bool capture_hal_clock(uint32_t rate_hz)
+{
+    return i2s_clock_setup(i2s_clock_for(rate_hz));
+}
+
+void capture_hal_stop(void)
+{
+    /* Nothing to do, and the lanes' clocks may be gated */
+    if (!running) {
+        return;
+    }
+    running = false;
+
+    for (unsigned i = 0; i < AUDIO_CAPTURE_LANES; i++) {
+        const struct i2s_lane *l = &lanes[i];
+
+        SPI_I2SCFGR(l->spi) &= ~SPI_I2SCFGR_I2SE;
+        dma_disable_stream(l->dma, l->stream);
+        SPI_CR2(l->spi) &= ~SPI_CR2_RXDMAEN;
+    }
+    nvic_disable_irq(CAPTURE_DMA_IRQ);
+
+    /* Reprogrammed or clock-gated next: let each stream finish its beat */
+    for (unsigned i = 0; i < AUDIO_CAPTURE_LANES; i++) {
+        const struct i2s_lane *l = &lanes[i];
+        uint32_t t0 = cycles_now();
+
+        while ((DMA_SCR(l->dma, l->stream) & DMA_SxCR_EN) &&
+               cycles_now() - t0 < DMA_STOP_CYCLES) {
+        }
+    }
+}
+
+void capture_hal_sleep(void)
+{
+    capture_hal_stop();
+
+    for (unsigned i = 0; i < AUDIO_CAPTURE_LANES; i++) {
+        rcc_periph_clock_disable(lanes[i].spi_clk);
+        rcc_periph_clock_disable(lanes[i].dma_clk);
+    }
+    RCC_CR &= ~RCC_CR_PLLI2SON;
+}
+
+uint32_t capture_hal_position(void)
+{
+    return dma_count - DMA_SxNDTR(CAPTURE_DMA, CAPTURE_DMA_STREAM);
+}
+
+/* -------------------------------------------------------------------------- */
+/* DMA ISR: half-transfer = first half ready, transfer-complete = second      */
+/* -------------------------------------------------------------------------- */
+void dma1_stream3_isr(void);
+
+void dma1_stream3_isr(void)
+{
+    uint32_t t  = sof_timer_now();
+    uint32_t t0 = cycles_now();
+
+    if (dma_get_interrupt_flag(CAPTURE_DMA, CAPTURE_DMA_STREAM, DMA_HTIF)) {
+        dma_clear_interrupt_flags(CAPTURE_DMA, CAPTURE_DMA_STREAM, DMA_HTIF);
+        audio_capture_dma_event(0, t);
+    }
+
+    if (dma_get_interrupt_flag(CAPTURE_DMA, CAPTURE_DMA_STREAM, DMA_TCIF)) {
+        dma_clear_interrupt_flags(CAPTURE_DMA, CAPTURE_DMA_STREAM, DMA_TCIF);
+        audio_capture_dma_event(1, t);
+    }
+
+    prof_record(PROF_STAGE_CAPTURE_ISR, cycles_now() - t0);
+}
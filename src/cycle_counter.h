@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <libopencm3/cm3/dwt.h>
+
+/* DWT CYCCNT, core clock cycles (96 MHz); enable with dwt_enable_cycle_counter() */
+static inline uint32_t cycles_now(void)
+{
+    return DWT_CYCCNT;
+}
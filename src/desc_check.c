@@ -0,0 +1,466 @@
+/*
+ * Host validator for the audio configuration descriptor, UAC1 or UAC2
+ * (taken from the AC header's bcdADC).
+ *
+ *   desc_check [-r rate] [file]     reads a descriptor from file or stdin
+ *
+ * Fetch the full configuration descriptor with a standard GET_DESCRIPTOR,
+ * e.g. from Python/pyusb:
+ *   dev.ctrl_transfer(0x80, 0x06, 0x0200, 0, 1024)
+ *
+ * Checks lengths and wTotalLength fields, the terminal / unit / clock
+ * links, the IAD (UAC2), per-alt formats and that each iso endpoint
+ * carries the largest packet its format needs. UAC2 alts carry no rates,
+ * so -r gives the highest one to size against (default 48000).
+ *
+ * An AS interface links to a streaming output terminal (device to host,
+ * IN data) or a streaming input terminal (host to device, OUT data, e.g.
+ * a headset speaker); an explicit feedback endpoint next to OUT data must
+ * be an iso IN carrying the 3-byte full-speed 10.14 value.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_CONFIGURATION      0x02
+#define DT_INTERFACE          0x04
+#define DT_ENDPOINT           0x05
+#define DT_IAD                0x0B
+#define DT_CS_INTERFACE       0x24
+#define DT_CS_ENDPOINT        0x25
+
+#define CLASS_AUDIO           0x01
+#define SUBCLASS_AC           0x01
+#define SUBCLASS_AS           0x02
+
+#define AC_HEADER             0x01
+#define AC_INPUT_TERMINAL     0x02
+#define AC_OUTPUT_TERMINAL    0x03
+#define AC_FEATURE_UNIT       0x06
+#define AC_CLOCK_SOURCE       0x0A
+#define AS_GENERAL            0x01
+#define AS_FORMAT_TYPE        0x02
+
+#define TERMINAL_STREAMING    0x0101
+#define FS_ISO_MAX_PACKET     1023
+#define FS_FEEDBACK_SIZE      3
+
+#define EP_DIR_IN             0x80
+#define EP_USAGE_FEEDBACK     0x10
+
+#define MAX_ENTITIES          16
+
+struct entity {
+    uint8_t  id;
+    uint8_t  subtype;
+    uint8_t  source;      /* bSourceID, 0 if none */
+    uint8_t  clock;       /* bCSourceID (UAC2 terminals), 0 if none */
+    uint16_t type;        /* terminal type */
+    uint8_t  channels;    /* input terminal */
+};
+
+struct check {
+    unsigned errors;
+    unsigned uac;         /* 1 or 2, 0 until the AC header */
+    uint32_t max_rate;    /* -r, UAC2 */
+
+    int      ac_iface;
+    int      iad_first, iad_count;
+    uint8_t  ac_protocol;
+
+    struct entity ent[MAX_ENTITIES];
+    unsigned n_ent;
+    unsigned ac_cs_len;   /* sum of CS_INTERFACE bytes after the AC iface */
+    unsigned ac_total;    /* AC header wTotalLength */
+
+    /* Current interface / AS alt */
+    int      iface, alt;
+    uint8_t  subclass, protocol;
+    uint8_t  as_link, as_channels, subframe, bits;
+    uint8_t  as_out;      /* linked to an input terminal: host -> device */
+    uint32_t as_max_hz;   /* UAC1: highest discrete rate */
+};
+
+static unsigned get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get24(const uint8_t *p)
+{
+    return get16(p) | ((uint32_t)p[2] << 16);
+}
+
+static void fail(struct check *c, const char *what, unsigned off)
+{
+    printf("  error @%u: %s\n", off, what);
+    c->errors++;
+}
+
+static const struct entity *find(const struct check *c, uint8_t id)
+{
+    for (unsigned i = 0; i < c->n_ent; i++) {
+        if (c->ent[i].id == id) {
+            return &c->ent[i];
+        }
+    }
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* AUDIOCONTROL                                                               */
+/* -------------------------------------------------------------------------- */
+
+static void ac_entity(struct check *c, const uint8_t *d, unsigned off)
+{
+    struct entity e = { d[3], d[2], 0, 0, 0, 0 };
+    unsigned len = d[0];
+    unsigned v2  = c->uac == 2;
+
+    switch (d[2]) {
+    case AC_INPUT_TERMINAL:
+        if (len != (v2 ? 17u : 12u)) {
+            fail(c, "input terminal length", off);
+            return;
+        }
+        e.type     = (uint16_t)get16(d + 4);
+        e.clock    = v2 ? d[7] : 0;
+        e.channels = v2 ? d[8] : d[7];
+        break;
+    case AC_OUTPUT_TERMINAL:
+        if (len != (v2 ? 12u : 9u)) {
+            fail(c, "output terminal length", off);
+            return;
+        }
+        e.type   = (uint16_t)get16(d + 4);
+        e.source = d[7];
+        e.clock  = v2 ? d[8] : 0;
+        break;
+    case AC_FEATURE_UNIT:
+        e.source = d[4];
+        break;
+    case AC_CLOCK_SOURCE:
+        if (!v2 || len != 8) {
+            fail(c, "clock source outside UAC2 or bad length", off);
+            return;
+        }
+        break;
+    default:
+        return;
+    }
+
+    if (find(c, e.id)) {
+        fail(c, "duplicate entity ID", off);
+    } else if (c->n_ent < MAX_ENTITIES) {
+        c->ent[c->n_ent++] = e;
+    }
+}
+
+static void ac_header(struct check *c, const uint8_t *d, unsigned off)
+{
+    unsigned bcd = get16(d + 3);
+
+    c->uac = bcd >= 0x0200 ? 2 : 1;
+    if (c->uac == 2) {
+        if (d[0] != 9) {
+            fail(c, "UAC2 AC header length", off);
+        }
+        c->ac_total = get16(d + 6);
+    } else {
+        if (d[0] != 8 + d[7]) {
+            fail(c, "UAC1 AC header length vs bInCollection", off);
+        }
+        c->ac_total = get16(d + 5);
+    }
+}
+
+/* Feature unit length depends on the channel count of its source */
+static void ac_finish(struct check *c, const uint8_t *cfg, unsigned len)
+{
+    if (c->ac_total != c->ac_cs_len) {
+        fail(c, "AC header wTotalLength does not match its descriptors", 0);
+    }
+
+    for (unsigned i = 0; i < c->n_ent; i++) {
+        const struct entity *e = &c->ent[i];
+
+        if (e->source && !find(c, e->source)) {
+            fail(c, "bSourceID names no entity", 0);
+        }
+        if (c->uac == 2 && (e->subtype == AC_INPUT_TERMINAL ||
+                            e->subtype == AC_OUTPUT_TERMINAL)) {
+            const struct entity *clk = find(c, e->clock);
+            if (!clk || clk->subtype != AC_CLOCK_SOURCE) {
+                fail(c, "terminal bCSourceID names no clock source", 0);
+            }
+        }
+    }
+
+    /* Second pass for FU sizes now that terminals are known */
+    for (unsigned off = 0; off + 2 < len; off += cfg[off] ? cfg[off] : len) {
+        const uint8_t *d = cfg + off;
+
+        if (d[1] != DT_CS_INTERFACE || d[2] != AC_FEATURE_UNIT) {
+            continue;
+        }
+        const struct entity *src = find(c, d[4]);
+        unsigned ch  = src ? src->channels : 0;
+        unsigned exp = c->uac == 2 ? 6 + (ch + 1) * 4 : 7 + (ch + 1) * d[5];
+        if (src && d[0] != exp) {
+            fail(c, "feature unit length vs source channels", off);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* AUDIOSTREAMING                                                             */
+/* -------------------------------------------------------------------------- */
+
+static void as_descriptor(struct check *c, const uint8_t *d, unsigned off)
+{
+    unsigned v2 = c->uac == 2;
+
+    if (d[2] == AS_GENERAL) {
+        if (d[0] != (v2 ? 16u : 7u)) {
+            fail(c, "AS general length", off);
+            return;
+        }
+        c->as_link     = d[3];
+        c->as_channels = v2 ? d[10] : 0;
+
+        const struct entity *t = find(c, c->as_link);
+        if (!t || t->type != TERMINAL_STREAMING ||
+            (t->subtype != AC_OUTPUT_TERMINAL && t->subtype != AC_INPUT_TERMINAL)) {
+            fail(c, "bTerminalLink is not a USB streaming terminal", off);
+        }
+        c->as_out = t && t->subtype == AC_INPUT_TERMINAL;
+        if (v2 && !(d[6] & 1)) {
+            fail(c, "bmFormats lacks PCM", off);
+        }
+    } else if (d[2] == AS_FORMAT_TYPE) {
+        if (v2) {
+            if (d[0] != 6) {
+                fail(c, "UAC2 format type I length", off);
+                return;
+            }
+            c->subframe = d[4];
+            c->bits     = d[5];
+        } else {
+            unsigned n = d[7];
+            if (n == 0 || d[0] != 8 + 3 * n) {
+                fail(c, "UAC1 format type I: need discrete rates", off);
+                return;
+            }
+            c->as_channels = d[4];
+            c->subframe    = d[5];
+            c->bits        = d[6];
+            c->as_max_hz   = 0;
+            for (unsigned i = 0; i < n; i++) {
+                uint32_t hz = get24(d + 8 + 3 * i);
+                if (hz > c->as_max_hz) {
+                    c->as_max_hz = hz;
+                }
+            }
+        }
+        if (c->subframe < 1 || c->subframe > 4 || c->bits > 8 * c->subframe) {
+            fail(c, "bit resolution does not fit the subframe", off);
+        }
+    }
+}
+
+/* Input terminal at the head of the chain the current alt links to */
+static const struct entity *as_chain_input(const struct check *c)
+{
+    const struct entity *e = find(c, c->as_link);
+
+    for (unsigned hops = 0; e && e->subtype != AC_INPUT_TERMINAL; hops++) {
+        if (hops > MAX_ENTITIES) {
+            return NULL;
+        }
+        e = e->source ? find(c, e->source) : NULL;
+    }
+    return e;
+}
+
+static void as_feedback_endpoint(struct check *c, const uint8_t *d, unsigned off)
+{
+    unsigned mps = get16(d + 4) & 0x7FF;
+
+    if (!c->as_out) {
+        fail(c, "feedback endpoint on an IN stream", off);
+    }
+    if (!(d[2] & EP_DIR_IN)) {
+        fail(c, "feedback endpoint is not IN", off);
+    }
+    if (mps < FS_FEEDBACK_SIZE) {
+        fail(c, "feedback wMaxPacketSize below the 10.14 value", off);
+    }
+
+    printf("  alt %d: feedback endpoint 0x%02X, max packet %u\n", c->alt, d[2], mps);
+}
+
+static void as_endpoint(struct check *c, const uint8_t *d, unsigned off)
+{
+    unsigned mps  = get16(d + 4) & 0x7FF;
+    unsigned fb   = c->as_channels * c->subframe;
+    uint32_t hz   = c->uac == 2 ? c->max_rate : c->as_max_hz;
+    unsigned need = (unsigned)(hz / 1000 + 1) * fb;
+
+    if ((d[3] & 0x03) != 0x01) {
+        fail(c, "streaming endpoint is not isochronous", off);
+    }
+    if ((d[3] & 0x30) == EP_USAGE_FEEDBACK) {
+        as_feedback_endpoint(c, d, off);
+        return;
+    }
+    if (((d[2] & EP_DIR_IN) == 0) != c->as_out) {
+        fail(c, "endpoint direction differs from the terminal link", off);
+    }
+    if (mps > FS_ISO_MAX_PACKET) {
+        fail(c, "wMaxPacketSize above the full-speed iso limit", off);
+    }
+    if (!fb || mps < need) {
+        fail(c, "wMaxPacketSize too small for the format", off);
+    }
+
+    const struct entity *it = as_chain_input(c);
+    if (it && it->channels != c->as_channels) {
+        fail(c, "AS channel count differs from the input terminal", off);
+    }
+
+    printf("  alt %d: %s %u ch, %u-bit in %u bytes, max packet %u (%u needed at %u Hz)\n",
+           c->alt, c->as_out ? "OUT" : "IN", c->as_channels, c->bits, c->subframe,
+           mps, need, (unsigned)hz);
+}
+
+/* -------------------------------------------------------------------------- */
+/* WALK                                                                       */
+/* -------------------------------------------------------------------------- */
+
+static void check_config(struct check *c, const uint8_t *cfg, unsigned len)
+{
+    int prev_iad = 0;
+
+    if (len < 9 || cfg[1] != DT_CONFIGURATION) {
+        fail(c, "not a configuration descriptor", 0);
+        return;
+    }
+    if (get16(cfg + 2) != len) {
+        fail(c, "wTotalLength does not match the data", 2);
+    }
+
+    for (unsigned off = 0; off < len; ) {
+        const uint8_t *d = cfg + off;
+
+        if (d[0] < 2 || off + d[0] > len) {
+            fail(c, "descriptor overruns the configuration", off);
+            return;
+        }
+
+        switch (d[1]) {
+        case DT_IAD:
+            c->iad_first = d[2];
+            c->iad_count = d[3];
+            if (d[4] != CLASS_AUDIO || d[6] != 0x20) {
+                fail(c, "IAD is not a UAC2 audio function", off);
+            }
+            break;
+
+        case DT_INTERFACE:
+            c->iface    = d[2];
+            c->alt      = d[3];
+            c->subclass = d[5] == CLASS_AUDIO ? d[6] : 0;
+            c->protocol = d[7];
+            if (c->subclass == SUBCLASS_AC) {
+                c->ac_iface    = c->iface;
+                c->ac_protocol = c->protocol;
+                if (!prev_iad) {
+                    c->iad_first = -1;
+                }
+            }
+            break;
+
+        case DT_CS_INTERFACE:
+            if (c->subclass == SUBCLASS_AC) {
+                c->ac_cs_len += d[0];
+                if (d[2] == AC_HEADER) {
+                    ac_header(c, d, off);
+                } else {
+                    ac_entity(c, d, off);
+                }
+            } else if (c->subclass == SUBCLASS_AS) {
+                as_descriptor(c, d, off);
+            }
+            break;
+
+        case DT_ENDPOINT:
+            if (c->subclass == SUBCLASS_AS) {
+                as_endpoint(c, d, off);
+            }
+            break;
+
+        case DT_CS_ENDPOINT:
+            if (c->subclass == SUBCLASS_AS && d[0] != (c->uac == 2 ? 8 : 7)) {
+                fail(c, "class-specific endpoint length", off);
+            }
+            break;
+        }
+
+        if (d[1] == DT_INTERFACE && c->subclass == SUBCLASS_AS &&
+            c->protocol != c->ac_protocol) {
+            fail(c, "AS interface protocol differs from AC", off);
+        }
+
+        prev_iad = d[1] == DT_IAD;
+        off += d[0];
+    }
+
+    if (c->ac_iface < 0 || !c->uac) {
+        fail(c, "no AudioControl interface with a header", 0);
+        return;
+    }
+    ac_finish(c, cfg, len);
+
+    if (c->uac == 2) {
+        if (c->ac_protocol != 0x20) {
+            fail(c, "UAC2 AC interface protocol is not IP_VERSION_02_00", 0);
+        }
+        if (c->iad_first != c->ac_iface || c->iad_count < 2) {
+            fail(c, "UAC2 needs an IAD right before the AC interface covering AC + AS", 0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t cfg[4096];
+    struct check c;
+    FILE *f = stdin;
+
+    memset(&c, 0, sizeof(c));
+    c.max_rate  = 48000;
+    c.ac_iface  = -1;
+    c.iad_first = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            c.max_rate = (uint32_t)atoi(argv[++i]);
+        } else if (!(f = fopen(argv[i], "rb"))) {
+            perror(argv[i]);
+            return 2;
+        }
+    }
+
+    unsigned len = (unsigned)fread(cfg, 1, sizeof(cfg), f);
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    check_config(&c, cfg, len);
+
+    printf("UAC%u configuration, %u bytes: %u error%s\n",
+           c.uac, len, c.errors, c.errors == 1 ? "" : "s");
+    return c.errors ? 1 : 0;
+}
@@ -0,0 +1,492 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dsp_chain.h"
+
+#ifndef M_PI
+#define M_PI       3.14159265358979323846
+#endif
+#ifndef M_SQRT1_2
+#define M_SQRT1_2  0.70710678118654752440
+#endif
+
+#define Q16_ONE      65536
+#define Q23_MAX      ((1 << 23) - 1)
+#define Q23_MIN      (-(1 << 23))
+#define HPF_COEF_SHIFT  30
+#define HPF_COEF_MASK   ((INT64_C(1) << HPF_COEF_SHIFT) - 1)
+
+/* Block length the per-block time constants are derived for */
+#define BLOCK_MS     1.0
+
+/* Envelopes and smoothed gains carry this many extra fractional bits */
+#define SMOOTH_FRAC  8
+
+/* Per-block smoothing coefficients */
+#define COEF_SHIFT   24
+#define COEF_ONE     (1 << COEF_SHIFT)
+
+#define DSP_CHAIN_DEFAULTS {    \
+    .hpf_hz          = 40,      \
+                                \
+    .gate_open_db    = -60,     \
+    .gate_close_db   = -66,     \
+    .gate_floor_db   = -30,     \
+    .gate_attack_ms  = 2,       \
+    .gate_release_ms = 150,     \
+                                \
+    .agc_target_db   = -12,     \
+    .agc_min_gain_db = -12,     \
+    .agc_max_gain_db = 24,      \
+    .agc_attack_ms   = 10,      \
+    .agc_release_ms  = 1000,    \
+}
+
+const struct dsp_chain_config dsp_chain_default_config = DSP_CHAIN_DEFAULTS;
+
+static uint32_t enabled = DSP_CHAIN_DEFAULT_MASK;
+
+/* Q23 working copy of one block, interleaved */
+static int32_t work[AUDIO_MAX_SAMPLES_PER_FRAME * AUDIO_NUM_CHANNELS];
+
+/* -------------------------------------------------------------------------- */
+/* COEFFICIENTS                                                               */
+/* -------------------------------------------------------------------------- */
+
+/* Every rate a format row streams at (audio_format.h) */
+#define DSP_CHAIN_RATES  5
+
+struct hpf_coefs {
+    uint32_t rate_hz;
+    int32_t  b0, b1, b2, a1, a2;  /* Q30, a0 = 1 */
+};
+
+struct dsp_coefs {
+    struct hpf_coefs hpf[DSP_CHAIN_RATES];
+
+    int32_t gate_open_q23, gate_close_q23;
+    int32_t gate_floor_q16;
+    int32_t gate_attack, gate_release;  /* Q24 per-block coefficients */
+
+    int32_t agc_target_q23;
+    int32_t agc_min_q16, agc_max_q16;
+    int32_t agc_attack, agc_release;
+};
+
+static const uint32_t dsp_rates[DSP_CHAIN_RATES] = {
+    16000, 24000, 32000, 48000, 96000,
+};
+
+/*
+ * DSP_CHAIN_DEFAULTS, as dsp_chain_configure() derives them (test_dsp
+ * checks they match bit for bit). Streams start from whichever set is
+ * current with integer work only: they are (re)started from the USB ISR.
+ */
+static const struct dsp_coefs default_coefs = {
+    .hpf = {
+        { 16000, 1061881538, -2123763076, 1061881538, -2123632067, 1050152262 },
+        { 24000, 1065820340, -2131640680, 1065820340, -2131582238, 1057957296 },
+        { 32000, 1067795215, -2135590430, 1067795215, -2135557497, 1061881540 },
+        { 48000, 1069773750, -2139547500, 1069773750, -2139532835, 1065820340 },
+        { 96000, 1071755951, -2143511902, 1071755951, -2143508228, 1069773750 },
+    },
+    .gate_open_q23  = 8389,
+    .gate_close_q23 = 4204,
+    .gate_floor_q16 = 2072,
+    .gate_attack    = 6601320,
+    .gate_release   = 111476,
+    .agc_target_q23 = 2107123,
+    .agc_min_q16    = 16462,
+    .agc_max_q16    = 1038676,
+    .agc_attack     = 1596563,
+    .agc_release    = 16769,
+};
+
+/* dsp_chain_configure() derives into the one not in use */
+static struct dsp_coefs derived[2];
+static unsigned derived_next;
+static const struct dsp_coefs *coefs = &default_coefs;
+
+/* Derivation (dsp_chain_configure() only: double and libm are fine here) */
+
+static int32_t db_to_q16(double db)
+{
+    return (int32_t)(pow(10.0, db / 20.0) * Q16_ONE + 0.5);
+}
+
+static int32_t db_to_q23(double db)
+{
+    return (int32_t)(pow(10.0, db / 20.0) * Q23_MAX + 0.5);
+}
+
+/*
+ * One-pole smoothing factor per block for a time constant, Q24: a 1 s
+ * release is ~65 in Q16, too coarse to land on the right gain
+ */
+static int32_t ms_to_coef(uint16_t ms)
+{
+    if (ms == 0) {
+        return COEF_ONE;
+    }
+    return (int32_t)((1.0 - exp(-BLOCK_MS / ms)) * COEF_ONE + 0.5);
+}
+
+/* v moves towards target by coef; both carry SMOOTH_FRAC extra bits */
+static int64_t smooth(int64_t v, int64_t target, int32_t coef)
+{
+    return v + (((target - v) * coef) >> COEF_SHIFT);
+}
+
+#define SMOOTH(x)    ((int64_t)(x) << SMOOTH_FRAC)
+#define UNSMOOTH(x)  ((int32_t)((x) >> SMOOTH_FRAC))
+
+/* Largest magnitude in the block, all channels */
+static int32_t block_peak(const int32_t *x, uint32_t n)
+{
+    int32_t peak = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        int32_t a = x[i] < 0 ? -x[i] : x[i];
+        if (a > peak) {
+            peak = a;
+        }
+    }
+    return peak;
+}
+
+/* Scale frames by a gain ramping linearly from g0 to g1 (smoothed Q16) */
+static void gain_ramp(int32_t *x, uint32_t frames, int64_t g0, int64_t g1)
+{
+    if (g0 == SMOOTH(Q16_ONE) && g1 == SMOOTH(Q16_ONE)) {
+        return;
+    }
+
+    /* Gains are capped well below 2^(31 - 16 - SMOOTH_FRAC) */
+    int32_t d = (int32_t)((g1 - g0) / (int32_t)frames);
+    int32_t g = (int32_t)g0 + d;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            *x = (int32_t)(((int64_t)*x * g) >> (16 + SMOOTH_FRAC));
+            x++;
+        }
+        g += d;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* STAGE: DC-BLOCKING HIGH-PASS                                               */
+/* -------------------------------------------------------------------------- */
+
+struct hpf_chan {
+    int32_t x1, x2, y1, y2;
+    int32_t e1, e2;           /* truncation errors of the last two outputs */
+};
+
+static struct {
+    int32_t b0, b1, b2, a1, a2;   /* Q30, a0 = 1 */
+    struct hpf_chan ch[AUDIO_NUM_CHANNELS];
+} hpf;
+
+static void hpf_derive(struct hpf_coefs *c, uint32_t hz, uint32_t rate_hz)
+{
+    /* RBJ cookbook high-pass, Q = 1/sqrt(2) */
+    double w0    = 2.0 * M_PI * hz / rate_hz;
+    double cosw  = cos(w0);
+    double alpha = sin(w0) / (2.0 * M_SQRT1_2);
+    double scale = (double)(1 << HPF_COEF_SHIFT) / (1.0 + alpha);
+
+    c->rate_hz = rate_hz;
+    c->b0 = (int32_t)lrint((1.0 + cosw) / 2.0 * scale);
+    c->b1 = -2 * c->b0;
+    c->b2 = c->b0;
+    c->a1 = (int32_t)lrint(-2.0 * cosw * scale);
+    c->a2 = (int32_t)lrint((1.0 - alpha) * scale);
+}
+
+static void hpf_start(const struct dsp_coefs *k, const struct audio_stream_cfg *cfg)
+{
+    /* A rate without a row passes through */
+    hpf.b0 = 1 << HPF_COEF_SHIFT;
+    hpf.b1 = hpf.b2 = hpf.a1 = hpf.a2 = 0;
+
+    for (unsigned i = 0; i < DSP_CHAIN_RATES; i++) {
+        const struct hpf_coefs *c = &k->hpf[i];
+
+        if (c->rate_hz == cfg->rate_hz) {
+            hpf.b0 = c->b0;
+            hpf.b1 = c->b1;
+            hpf.b2 = c->b2;
+            hpf.a1 = c->a1;
+            hpf.a2 = c->a2;
+        }
+    }
+
+    memset(hpf.ch, 0, sizeof(hpf.ch));
+}
+
+static void hpf_process(int32_t *x, uint32_t frames)
+{
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        struct hpf_chan s = hpf.ch[ch];
+        int32_t *p = x + ch;
+
+        for (uint32_t i = 0; i < frames; i++) {
+            int32_t in  = *p;
+            int64_t acc = (int64_t)hpf.b0 * in + (int64_t)hpf.b1 * s.x1 +
+                          (int64_t)hpf.b2 * s.x2 - (int64_t)hpf.a1 * s.y1 -
+                          (int64_t)hpf.a2 * s.y2 + 2 * (int64_t)s.e1 - s.e2;
+            int32_t out = (int32_t)(acc >> HPF_COEF_SHIFT);
+
+            s.e2 = s.e1;
+            s.e1 = (int32_t)(acc & HPF_COEF_MASK);  /* bits the shift dropped */
+            s.x2 = s.x1;
+            s.x1 = in;
+            s.y2 = s.y1;
+            s.y1 = out;
+
+            *p = out;
+            p += AUDIO_NUM_CHANNELS;
+        }
+        hpf.ch[ch] = s;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* STAGE: NOISE GATE                                                          */
+/* -------------------------------------------------------------------------- */
+
+static struct {
+    int32_t open_q23, close_q23;
+    int32_t floor_q16;
+    int32_t attack, release;  /* Q24 per-block coefficients */
+    int64_t env;              /* Q23 peak envelope, smoothed */
+    int64_t gain;             /* Q16, smoothed, at the end of the last block */
+    bool    open;
+} gate;
+
+static void gate_start(const struct dsp_coefs *k, const struct audio_stream_cfg *cfg)
+{
+    (void)cfg;
+
+    gate.open_q23  = k->gate_open_q23;
+    gate.close_q23 = k->gate_close_q23;
+    gate.floor_q16 = k->gate_floor_q16;
+    gate.attack    = k->gate_attack;
+    gate.release   = k->gate_release;
+    gate.env       = 0;
+    gate.gain      = SMOOTH(Q16_ONE);
+    gate.open      = true;
+}
+
+static void gate_process(int32_t *x, uint32_t frames)
+{
+    int32_t peak = block_peak(x, frames * AUDIO_NUM_CHANNELS);
+
+    /* Envelope: fast up, slow down */
+    gate.env = smooth(gate.env, SMOOTH(peak),
+                      SMOOTH(peak) > gate.env ? gate.attack : gate.release);
+
+    int32_t env = UNSMOOTH(gate.env);
+    if (gate.open && env < gate.close_q23) {
+        gate.open = false;
+    } else if (!gate.open && env > gate.open_q23) {
+        gate.open = true;
+    }
+
+    int32_t target = gate.open ? Q16_ONE : gate.floor_q16;
+    int64_t g = smooth(gate.gain, SMOOTH(target),
+                       gate.open ? gate.attack : gate.release);
+
+    gain_ramp(x, frames, gate.gain, g);
+    gate.gain = g;
+}
+
+/* -------------------------------------------------------------------------- */
+/* STAGE: AGC                                                                 */
+/* -------------------------------------------------------------------------- */
+
+static struct {
+    int32_t target_q23;
+    int32_t min_q16, max_q16;
+    int32_t attack, release;  /* Q24 per-block coefficients */
+    int64_t env;              /* Q23 peak envelope before AGC gain, smoothed */
+    int64_t gain;             /* Q16, smoothed, at the end of the last block */
+} agc;
+
+static void agc_start(const struct dsp_coefs *k, const struct audio_stream_cfg *cfg)
+{
+    (void)cfg;
+
+    agc.target_q23 = k->agc_target_q23;
+    agc.min_q16    = k->agc_min_q16;
+    agc.max_q16    = k->agc_max_q16;
+    agc.attack     = k->agc_attack;
+    agc.release    = k->agc_release;
+    agc.env        = 0;
+    agc.gain       = SMOOTH(Q16_ONE);
+}
+
+static void agc_process(int32_t *x, uint32_t frames)
+{
+    int32_t peak = block_peak(x, frames * AUDIO_NUM_CHANNELS);
+    int64_t g    = agc.gain;
+
+    agc.env = smooth(agc.env, SMOOTH(peak),
+                     SMOOTH(peak) > agc.env ? agc.attack : agc.release);
+
+    /* Do not pull the noise floor up while the gate has it muted */
+    bool hold = (enabled & DSP_STAGE_BIT(DSP_STAGE_GATE)) && !gate.open;
+
+    if (!hold) {
+        /* target / env in Q16 plus SMOOTH_FRAC */
+        int64_t want = agc.env > 0 ?
+            ((int64_t)agc.target_q23 << (16 + 2 * SMOOTH_FRAC)) / agc.env :
+            SMOOTH(agc.max_q16);
+
+        if (want > SMOOTH(agc.max_q16)) {
+            want = SMOOTH(agc.max_q16);
+        } else if (want < SMOOTH(agc.min_q16)) {
+            want = SMOOTH(agc.min_q16);
+        }
+        g = smooth(g, want, want < g ? agc.attack : agc.release);
+    }
+
+    gain_ramp(x, frames, agc.gain, g);
+    agc.gain = g;
+}
+
+/* -------------------------------------------------------------------------- */
+/* PIPELINE                                                                   */
+/* -------------------------------------------------------------------------- */
+
+struct dsp_stage {
+    void (*start)(const struct dsp_coefs *k, const struct audio_stream_cfg *cfg);
+    void (*process)(int32_t *x, uint32_t frames);
+};
+
+static const struct dsp_stage stages[DSP_NUM_STAGES] = {
+    [DSP_STAGE_HPF]  = { hpf_start,  hpf_process  },
+    [DSP_STAGE_GATE] = { gate_start, gate_process },
+    [DSP_STAGE_AGC]  = { agc_start,  agc_process  },
+};
+
+void dsp_chain_configure(const struct dsp_chain_config *cfg)
+{
+    struct dsp_coefs *k = &derived[derived_next];
+
+    for (unsigned i = 0; i < DSP_CHAIN_RATES; i++) {
+        hpf_derive(&k->hpf[i], cfg->hpf_hz, dsp_rates[i]);
+    }
+
+    k->gate_open_q23  = db_to_q23(cfg->gate_open_db);
+    k->gate_close_q23 = db_to_q23(cfg->gate_close_db);
+    k->gate_floor_q16 = db_to_q16(cfg->gate_floor_db);
+    k->gate_attack    = ms_to_coef(cfg->gate_attack_ms);
+    k->gate_release   = ms_to_coef(cfg->gate_release_ms);
+
+    k->agc_target_q23 = db_to_q23(cfg->agc_target_db);
+    k->agc_min_q16    = db_to_q16(cfg->agc_min_gain_db);
+    k->agc_max_q16    = db_to_q16(cfg->agc_max_gain_db);
+    k->agc_attack     = ms_to_coef(cfg->agc_attack_ms);
+    k->agc_release    = ms_to_coef(cfg->agc_release_ms);
+
+    __atomic_store_n(&coefs, k, __ATOMIC_RELEASE);
+    derived_next ^= 1;
+}
+
+bool dsp_chain_coefs_default(void)
+{
+    const struct dsp_coefs *k = __atomic_load_n(&coefs, __ATOMIC_ACQUIRE);
+
+    return memcmp(k, &default_coefs, sizeof(default_coefs)) == 0;
+}
+
+void dsp_chain_set_enabled(uint32_t mask)
+{
+    __atomic_store_n(&enabled, mask & DSP_CHAIN_ALL_STAGES, __ATOMIC_RELAXED);
+}
+
+uint32_t dsp_chain_enabled(void)
+{
+    return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+void dsp_chain_start(const struct audio_stream_cfg *cfg)
+{
+    const struct dsp_coefs *k = __atomic_load_n(&coefs, __ATOMIC_ACQUIRE);
+
+    for (unsigned i = 0; i < DSP_NUM_STAGES; i++) {
+        stages[i].start(k, cfg);
+    }
+}
+
+static void unpack(const uint8_t *pcm, uint32_t n, uint32_t bytes)
+{
+    if (bytes == 4) {
+        const int32_t *s = (const int32_t *)pcm;
+        for (uint32_t i = 0; i < n; i++) {
+            work[i] = s[i] >> 8;
+        }
+    } else if (bytes == 3) {
+        for (uint32_t i = 0; i < n; i++, pcm += 3) {
+            work[i] = (int32_t)(((uint32_t)pcm[0] << 8) |
+                                ((uint32_t)pcm[1] << 16) |
+                                ((uint32_t)pcm[2] << 24)) >> 8;
+        }
+    } else {
+        const int16_t *s = (const int16_t *)pcm;
+        for (uint32_t i = 0; i < n; i++) {
+            work[i] = s[i] * 256;
+        }
+    }
+}
+
+static int32_t sat_q23(int32_t v)
+{
+    return v > Q23_MAX ? Q23_MAX : (v < Q23_MIN ? Q23_MIN : v);
+}
+
+static void pack(uint8_t *pcm, uint32_t n, uint32_t bytes)
+{
+    if (bytes == 4) {
+        uint32_t *d = (uint32_t *)pcm;
+        for (uint32_t i = 0; i < n; i++) {
+            d[i] = (uint32_t)sat_q23(work[i]) << 8;
+        }
+    } else if (bytes == 3) {
+        for (uint32_t i = 0; i < n; i++, pcm += 3) {
+            int32_t v = sat_q23(work[i]);
+            pcm[0] = (uint8_t)(v & 0xFF);
+            pcm[1] = (uint8_t)((v >> 8) & 0xFF);
+            pcm[2] = (uint8_t)((v >> 16) & 0xFF);
+        }
+    } else {
+        int16_t *d = (int16_t *)pcm;
+        for (uint32_t i = 0; i < n; i++) {
+            d[i] = (int16_t)(sat_q23(work[i] + 128) >> 8);
+        }
+    }
+}
+
+void dsp_chain_process(uint8_t *pcm, uint32_t frames,
+                       const struct audio_stream_cfg *cfg)
+{
+    uint32_t mask = dsp_chain_enabled();
+    uint32_t n    = frames * AUDIO_NUM_CHANNELS;
+
+    if (!mask || frames == 0) {
+        return;
+    }
+
+    unpack(pcm, n, cfg->subframe_bytes);
+
+    for (unsigned i = 0; i < DSP_NUM_STAGES; i++) {
+        if (mask & DSP_STAGE_BIT(i)) {
+            stages[i].process(work, frames);
+        }
+    }
+
+    pack(pcm, n, cfg->subframe_bytes);
+}
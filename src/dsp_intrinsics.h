@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Cortex-M4 DSP extension wrappers with portable C fallbacks.
+ *
+ * The fallbacks produce the same bits as the instructions, so a host
+ * build of any kernel using these gives bit-exact results against the
+ * firmware.
+ */
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#define DSP_HAVE_SIMD 1
+#else
+#define DSP_HAVE_SIMD 0
+#endif
+
+/* acc + x.lo * y.lo + x.hi * y.hi (signed 16x16, 32-bit wrap) */
+static inline uint32_t dsp_smlad(uint32_t x, uint32_t y, uint32_t acc)
+{
+#if DSP_HAVE_SIMD
+    __asm__ ("smlad %0, %1, %2, %3" : "=r" (acc) : "r" (x), "r" (y), "r" (acc));
+    return acc;
+#else
+    int32_t lo = (int32_t)(int16_t)(x & 0xFFFF) * (int16_t)(y & 0xFFFF);
+    int32_t hi = (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+    return acc + (uint32_t)lo + (uint32_t)hi;
+#endif
+}
+
+/* acc + x.lo * y.lo + x.hi * y.hi (signed 16x16, 64-bit accumulate) */
+static inline int64_t dsp_smlald(uint32_t x, uint32_t y, int64_t acc)
+{
+#if DSP_HAVE_SIMD
+    uint32_t lo = (uint32_t)acc;
+    uint32_t hi = (uint32_t)((uint64_t)acc >> 32);
+    __asm__ ("smlald %0, %1, %2, %3" : "+r" (lo), "+r" (hi) : "r" (x), "r" (y));
+    return (int64_t)(((uint64_t)hi << 32) | lo);
+#else
+    int32_t lo = (int32_t)(int16_t)(x & 0xFFFF) * (int16_t)(y & 0xFFFF);
+    int32_t hi = (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+    return acc + lo + hi;
+#endif
+}
+
+/* acc + x.lo * y.hi + x.hi * y.lo (signed 16x16, 64-bit accumulate) */
+static inline int64_t dsp_smlaldx(uint32_t x, uint32_t y, int64_t acc)
+{
+#if DSP_HAVE_SIMD
+    uint32_t lo = (uint32_t)acc;
+    uint32_t hi = (uint32_t)((uint64_t)acc >> 32);
+    __asm__ ("smlaldx %0, %1, %2, %3" : "+r" (lo), "+r" (hi) : "r" (x), "r" (y));
+    return (int64_t)(((uint64_t)hi << 32) | lo);
+#else
+    int32_t a = (int32_t)(int16_t)(x & 0xFFFF) * (int16_t)(y >> 16);
+    int32_t b = (int32_t)(int16_t)(x >> 16) * (int16_t)(y & 0xFFFF);
+    return acc + a + b;
+#endif
+}
+
+/* x.lo * y.lo - x.hi * y.hi (signed 16x16, 32-bit wrap) */
+static inline int32_t dsp_smusd(uint32_t x, uint32_t y)
+{
+#if DSP_HAVE_SIMD
+    int32_t r;
+    __asm__ ("smusd %0, %1, %2" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+#else
+    int32_t lo = (int32_t)(int16_t)(x & 0xFFFF) * (int16_t)(y & 0xFFFF);
+    int32_t hi = (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+    return (int32_t)((uint32_t)lo - (uint32_t)hi);
+#endif
+}
+
+/* x.lo * y.hi + x.hi * y.lo (signed 16x16, 32-bit wrap) */
+static inline int32_t dsp_smuadx(uint32_t x, uint32_t y)
+{
+#if DSP_HAVE_SIMD
+    int32_t r;
+    __asm__ ("smuadx %0, %1, %2" : "=r" (r) : "r" (x), "r" (y));
+    return r;
+#else
+    int32_t a = (int32_t)(int16_t)(x & 0xFFFF) * (int16_t)(y >> 16);
+    int32_t b = (int32_t)(int16_t)(x >> 16) * (int16_t)(y & 0xFFFF);
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+#endif
+}
+
+/* Saturate to signed 16 bits */
+static inline int32_t dsp_sat16(int32_t x)
+{
+#if DSP_HAVE_SIMD
+    __asm__ ("ssat %0, #16, %1" : "=r" (x) : "r" (x));
+    return x;
+#else
+    if (x > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (x < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return x;
+#endif
+}
+
+/* Two packed Q15 lanes from an aligned int16 pair, low lane = p[0] */
+static inline uint32_t dsp_load_q15x2(const int16_t *p)
+{
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+/* (a * x.lo) >> 16, signed 32x16 -> top 32 bits of 48 */
+static inline int32_t dsp_smulwb(int32_t a, uint32_t x)
+{
+#if DSP_HAVE_SIMD
+    int32_t r;
+    __asm__ ("smulwb %0, %1, %2" : "=r" (r) : "r" (a), "r" (x));
+    return r;
+#else
+    return (int32_t)(((int64_t)a * (int16_t)(x & 0xFFFF)) >> 16);
+#endif
+}
+
+/* (a * x.hi) >> 16, signed 32x16 -> top 32 bits of 48 */
+static inline int32_t dsp_smulwt(int32_t a, uint32_t x)
+{
+#if DSP_HAVE_SIMD
+    int32_t r;
+    __asm__ ("smulwt %0, %1, %2" : "=r" (r) : "r" (a), "r" (x));
+    return r;
+#else
+    return (int32_t)(((int64_t)a * (int16_t)(x >> 16)) >> 16);
+#endif
+}
+
+/* Pack two 16-bit lanes: lo.lo | hi.lo << 16 */
+static inline uint32_t dsp_pack16x2(int32_t lo, int32_t hi)
+{
+#if DSP_HAVE_SIMD
+    uint32_t r;
+    __asm__ ("pkhbt %0, %1, %2, lsl #16" : "=r" (r) : "r" (lo), "r" (hi));
+    return r;
+#else
+    return ((uint32_t)lo & 0xFFFF) | ((uint32_t)hi << 16);
+#endif
+}
@@ -0,0 +1,129 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "fb_ctrl.h"
+
+#define LOAD_ACQ(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LOAD_RLX(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STORE_REL(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define STORE_RLX(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+void fb_ctrl_init(struct fb_ctrl *fb, uint32_t nominal, uint32_t target)
+{
+    memset(fb, 0, sizeof(*fb));
+
+    fb->nominal_q14 = nominal << 14;
+    fb->meas_q14    = fb->nominal_q14;
+    fb->value_q14   = fb->nominal_q14;
+    fb->target_q16  = (int32_t)(target << 16);
+    fb->filt_q16    = fb->target_q16;
+}
+
+void fb_ctrl_audio(struct fb_ctrl *fb, uint32_t t, uint32_t n)
+{
+    uint32_t seq = LOAD_RLX(&fb->aud_seq);
+
+    STORE_RLX(&fb->aud_seq, seq + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    STORE_RLX(&fb->aud_t, t);
+    STORE_RLX(&fb->aud_total, LOAD_RLX(&fb->aud_total) + n);
+
+    STORE_REL(&fb->aud_seq, seq + 2);
+}
+
+/* Consistent (tick, total) pair, false if the audio side is mid-update */
+static bool audio_snapshot(struct fb_ctrl *fb, uint32_t *t, uint32_t *total)
+{
+    uint32_t seq = LOAD_ACQ(&fb->aud_seq);
+
+    if (seq & 1) {
+        return false;
+    }
+    *t     = LOAD_RLX(&fb->aud_t);
+    *total = LOAD_RLX(&fb->aud_total);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return LOAD_RLX(&fb->aud_seq) == seq;
+}
+
+/* Close the window at this SOF; returns false if nothing usable was seen */
+static bool measure(struct fb_ctrl *fb, uint32_t t, uint32_t aud_t,
+                    uint32_t aud_total, uint32_t *meas_q14)
+{
+    uint32_t d_sof = t - fb->win_sof_t;
+    uint32_t d_t   = aud_t - fb->win_aud_t;
+    uint32_t d_n   = aud_total - fb->win_aud_total;
+
+    if (d_t == 0 || d_n == 0) {
+        return false;
+    }
+
+    /* d_n << 14 is < 2^28 and d_sof < 2^24 for a 128 ms window */
+    uint64_t num = ((uint64_t)d_n << 14) * d_sof;
+    uint64_t den = (uint64_t)d_t * fb->frames;
+    uint32_t m   = (uint32_t)((num + den / 2) / den);
+
+    if (m > fb->nominal_q14 + FB_CTRL_LIMIT_Q14 ||
+        m < fb->nominal_q14 - FB_CTRL_LIMIT_Q14) {
+        return false;
+    }
+    *meas_q14 = m;
+    return true;
+}
+
+uint32_t fb_ctrl_sof(struct fb_ctrl *fb, uint32_t t, uint32_t fill)
+{
+    uint32_t aud_t, aud_total;
+
+    if (fb->started) {
+        fb->frames++;
+    }
+
+    if (fb->frames >= FB_CTRL_WINDOW || !fb->started) {
+        if (audio_snapshot(fb, &aud_t, &aud_total)) {
+            uint32_t m;
+
+            if (fb->started && measure(fb, t, aud_t, aud_total, &m)) {
+                if (fb->measured) {
+                    fb->meas_q14 += ((int32_t)(m - fb->meas_q14)) /
+                                    (1 << FB_CTRL_MEAS_SHIFT);
+                } else {
+                    fb->meas_q14 = m;
+                    fb->measured = 1;
+                }
+            }
+
+            fb->win_sof_t     = t;
+            fb->win_aud_t     = aud_t;
+            fb->win_aud_total = aud_total;
+            fb->frames        = 0;
+            fb->started       = 1;
+        }
+    }
+
+    int32_t fill_q16 = (int32_t)(fill << 16);
+
+    fb->filt_q16 += (fill_q16 - fb->filt_q16) / (1 << FB_CTRL_FILT_SHIFT);
+
+    int32_t corr = (fb->target_q16 - fb->filt_q16) /
+                   (1 << (FB_CTRL_GAIN_SHIFT + 2));
+    if (corr > FB_CTRL_CORR_MAX_Q14) {
+        corr = FB_CTRL_CORR_MAX_Q14;
+    } else if (corr < -FB_CTRL_CORR_MAX_Q14) {
+        corr = -FB_CTRL_CORR_MAX_Q14;
+    }
+
+    int32_t v  = (int32_t)fb->meas_q14 + corr;
+    int32_t lo = (int32_t)(fb->nominal_q14 - FB_CTRL_LIMIT_Q14);
+    int32_t hi = (int32_t)(fb->nominal_q14 + FB_CTRL_LIMIT_Q14);
+
+    if (v < lo) {
+        v = lo;
+    } else if (v > hi) {
+        v = hi;
+    }
+
+    fb->value_q14 = (uint32_t)v;
+    return fb->value_q14;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Asynchronous OUT rate feedback (speaker path, AUDIO_HEADSET).
+ *
+ * The host sends whatever rate the feedback endpoint reports, as 10.14
+ * fixed-point samples per 1 ms frame. The value is measured, not
+ * guessed: playback DMA events (audio clock) and SOFs (host clock) are
+ * both timestamped on TIM2 (sof_timer.h), and over a window of
+ * FB_CTRL_WINDOW frames
+ *
+ *   meas = samples played / ticks they took * ticks per frame
+ *
+ * so TIM2's own crystal error cancels out. A measurement more than
+ * FB_CTRL_LIMIT_Q14 from nominal is dropped (playback stalled or
+ * restarted inside the window); the rest are smoothed by
+ * 2^FB_CTRL_MEAS_SHIFT.
+ *
+ * Timestamp jitter and the rounding of each report leave a small
+ * residual rate error that the buffer would integrate, so a
+ * proportional term on the smoothed output-buffer fill pulls it back to
+ * the set point:
+ *
+ *   filt += (fill - filt) / 2^FB_CTRL_FILT_SHIFT
+ *   fb    = meas + (target - filt) / 2^FB_CTRL_GAIN_SHIFT   (clamped)
+ *
+ * A sample of fill error moves the rate by 1/512 sample per frame, the
+ * correction is clamped to FB_CTRL_CORR_MAX_Q14 and the report to
+ * nominal +- FB_CTRL_LIMIT_Q14.
+ *
+ * fb_ctrl_audio() runs in the playback DMA ISR and fb_ctrl_sof() in the
+ * USB ISR, which preempts it: the audio side publishes its timestamp and
+ * sample count under a sequence counter, and a SOF that lands mid-update
+ * just closes its window on a later frame.
+ */
+
+#define FB_CTRL_WINDOW_LOG2   7        /* 128 frames */
+#define FB_CTRL_WINDOW        (1u << FB_CTRL_WINDOW_LOG2)
+#define FB_CTRL_MEAS_SHIFT    2
+#define FB_CTRL_FILT_SHIFT    4
+#define FB_CTRL_GAIN_SHIFT    9
+#define FB_CTRL_CORR_MAX_Q14  (1 << 11)   /* 1/8 sample per frame */
+#define FB_CTRL_LIMIT_Q14     (1 << 12)   /* 1/4 sample per frame */
+
+struct fb_ctrl {
+    /* Audio side, written by fb_ctrl_audio() only */
+    uint32_t aud_seq;       /* odd while an update is in progress */
+    uint32_t aud_t;         /* TIM2 tick of the latest event */
+    uint32_t aud_total;     /* samples played up to that event */
+
+    /* SOF side */
+    uint32_t nominal_q14;
+    uint32_t meas_q14;      /* smoothed measurement, 10.14 */
+    uint32_t value_q14;     /* last value reported */
+    int32_t  target_q16;    /* fill set point */
+    int32_t  filt_q16;      /* smoothed fill */
+    uint32_t frames;        /* SOFs in the current window */
+    uint32_t win_sof_t;     /* window start: SOF tick, */
+    uint32_t win_aud_t;     /* latest audio event then */
+    uint32_t win_aud_total;
+    uint8_t  started;       /* a window is open */
+    uint8_t  measured;      /* meas_q14 holds a measurement */
+};
+
+/* nominal samples per frame; target = fill set point in samples */
+void fb_ctrl_init(struct fb_ctrl *fb, uint32_t nominal, uint32_t target);
+
+/* Playback DMA ISR: n samples per channel went out, event taken at tick t */
+void fb_ctrl_audio(struct fb_ctrl *fb, uint32_t t, uint32_t n);
+
+/* SOF at tick t with fill samples buffered; returns the 10.14 report */
+uint32_t fb_ctrl_sof(struct fb_ctrl *fb, uint32_t t, uint32_t fill);
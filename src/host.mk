@@ -0,0 +1,204 @@
+# Host (x86-64 Linux) build of the hardware-independent audio path.
+#
+#   make -f host.mk            -> bin-host/libaudio_host.a, prof_decode, stream_check,
+#                                 desc_check, tap_decode, meter_decode,
+#                                 sync_decode
+#   make -f host.mk SAN=1      -> same, built with ASan/UBSan
+#   make -f host.mk check      -> builds and runs the host tests once
+#   make -f host.mk test       -> check in every configuration (HOST_VARIANTS),
+#                                 each in its own HOST_BUILD_DIR/<variant>
+#   make -f host.mk soak       -> test_rate over SOAK_HOURS of simulated time
+#                                 per mic drift (minutes of real time)
+#   make -f host.mk bench      -> host benchmarks (host/bench.c); BENCH=<filter>
+#                                 runs only the rows whose name contains it
+#
+# Only sources that do not touch libopencm3 belong here. Capture is built
+# without capture_hal_stm32.c: a host harness supplies capture_hal_*() and
+# feeds audio_capture_dma_event() from a synthetic DMA source; playback
+# likewise needs playback_hal_*() and drives audio_playback_dma_event(). The class
+# requests (audio_requests.c) and the tap telemetry (audio_tap.c) expect
+# audio_stream_format(), _cfg(), _set_rate() and _get_stats() from the
+# harness in the same way; the stream power states (stream_power.c) take
+# audio_stream_start() / _stop(), power_hal_*(), capture_hal_sleep() and
+# sof_timer_now() from it too. Pass CFLAGS=-DAUDIO_UAC2=1
+# for the UAC2 personality.
+#
+# The tests are that harness (host/): libopencm3 headers for the parts of
+# it the firmware uses (host/include, nothing else sees them), a register
+# and time model, synthetic capture / playback / power HALs and a USB bus
+# driving usbd callbacks frame by frame. The USB side of the firmware
+# (usb_*.c, audio_stream.c) is built against it unchanged, and main.c and
+# the *_hal_stm32.c files are syntax-checked against the same headers.
+# A test is host/test_<name>.c listed in HOST_TESTS; check runs them all.
+
+HOST_CC        ?= cc
+HOST_AR        ?= ar
+HOST_BUILD_DIR ?= bin-host
+HOST_LIB        = $(HOST_BUILD_DIR)/libaudio_host.a
+HOST_TOOLS      = $(HOST_BUILD_DIR)/prof_decode $(HOST_BUILD_DIR)/stream_check
+HOST_TOOLS     += $(HOST_BUILD_DIR)/desc_check $(HOST_BUILD_DIR)/tap_decode
+HOST_TOOLS     += $(HOST_BUILD_DIR)/meter_decode $(HOST_BUILD_DIR)/sync_decode
+
+HOST_CFILES  = audio_capture.c audio_ring.c rate_ctrl.c
+HOST_CFILES += audio_format.c audio_requests.c pdm_decim.c pcm_decim.c audio_gain.c profiler.c
+HOST_CFILES += test_source.c dsp_chain.c audio_tap.c audio_meter.c
+HOST_CFILES += audio_playback.c fb_ctrl.c sync_map.c stream_power.c
+
+HOST_FW_LIB     = $(HOST_BUILD_DIR)/libfw_host.a
+HOST_TESTS      = desc capture pdm rate gain prof dsp wire clock meter decim feedback sync recover power idle signal tap
+HOST_TEST_BINS  = $(HOST_TESTS:%=$(HOST_BUILD_DIR)/test_%)
+HOST_BENCH      = $(HOST_BUILD_DIR)/bench
+HOST_TSAN_TESTS = $(HOST_BUILD_DIR)/tsan/test_ring
+HOST_STAGED     = $(HOST_BUILD_DIR)/staged/test_wire
+
+HOST_VARIANTS   = uac1 ch2 ch4 ch8 pdm headset uac2 uac2-ch2 uac2-ch8 uac2-pdm polled
+VARIANT_uac1     =
+VARIANT_ch2      = -DAUDIO_NUM_CHANNELS=2
+VARIANT_ch4      = -DAUDIO_NUM_CHANNELS=4
+VARIANT_ch8      = -DAUDIO_NUM_CHANNELS=8
+VARIANT_pdm      = -DAUDIO_MIC_PDM=1
+VARIANT_headset  = -DAUDIO_HEADSET=1 -DAUDIO_NUM_CHANNELS=2
+VARIANT_uac2     = -DAUDIO_UAC2=1
+VARIANT_uac2-ch2 = -DAUDIO_UAC2=1 -DAUDIO_NUM_CHANNELS=2
+VARIANT_uac2-ch8 = -DAUDIO_UAC2=1 -DAUDIO_NUM_CHANNELS=8
+VARIANT_uac2-pdm = -DAUDIO_UAC2=1 -DAUDIO_MIC_PDM=1
+VARIANT_polled   = -DUSB_POLLED=1
+
+HOST_FW_CFILES  = usb_descriptors.c usb_audio_control.c usb_vendor.c usb_tap.c
+HOST_FW_CFILES += usb_fifo.c usb_speaker.c audio_stream.c sof_timer.c task_queue.c
+HOST_FW_CFILES += host/host_hw.c host/host_usb.c host/host_capture.c
+HOST_FW_CFILES += host/host_playback.c host/host_power.c host/host_board.c
+HOST_FW_CFILES += host/host_test.c
+
+HOST_SYNTAX_CFILES = main.c capture_hal_stm32.c playback_hal_stm32.c power_hal_stm32.c
+
+HOST_CFLAGS  = -O2 -std=c99 -g
+HOST_CFLAGS += -Wall -Wextra -Wundef -Wshadow -Wredundant-decls
+HOST_CFLAGS += -Wstrict-prototypes -Wmissing-prototypes
+HOST_CFLAGS += -I.
+ifeq ($(SAN),1)
+HOST_CFLAGS += -fsanitize=address,undefined -fno-omit-frame-pointer
+endif
+
+HOST_OBJS    = $(HOST_CFILES:%.c=$(HOST_BUILD_DIR)/%.o)
+HOST_FW_OBJS = $(HOST_FW_CFILES:%.c=$(HOST_BUILD_DIR)/%.o)
+HOST_TB_OBJS = $(HOST_TESTS:%=$(HOST_BUILD_DIR)/host/test_%.o) $(HOST_BUILD_DIR)/host/bench.o
+
+HOST_HARNESS_CFLAGS = -Ihost/include -Ihost
+$(HOST_FW_OBJS) $(HOST_TB_OBJS): HOST_CFLAGS += $(HOST_HARNESS_CFLAGS)
+
+# Two-thread tests, built from source with ThreadSanitizer instead of SAN
+HOST_TSAN_CFLAGS = $(filter-out -fsanitize=%,$(HOST_CFLAGS)) $(HOST_HARNESS_CFLAGS)
+HOST_TSAN_CFLAGS += -fsanitize=thread -pthread
+
+all: $(HOST_LIB) $(HOST_TOOLS)
+
+$(HOST_BUILD_DIR)/%.o: %.c
+	@printf "  HOSTCC\t$<\n"
+	@mkdir -p $(dir $@)
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -MD -o $@ -c $<
+
+$(HOST_LIB): $(HOST_OBJS)
+	@printf "  AR\t$@\n"
+	$(HOST_AR) rcs $@ $^
+
+$(HOST_FW_LIB): $(HOST_FW_OBJS)
+	@printf "  AR\t$@\n"
+	$(HOST_AR) rcs $@ $^
+
+$(HOST_BUILD_DIR)/test_%: $(HOST_BUILD_DIR)/host/test_%.o $(HOST_FW_LIB) $(HOST_LIB)
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $< \
+		-Wl,--start-group $(HOST_FW_LIB) $(HOST_LIB) -Wl,--end-group -lm
+
+$(HOST_BUILD_DIR)/tsan/test_ring: host/test_ring.c audio_ring.c host/host_test.c
+	@printf "  HOSTLD\t$@\n"
+	@mkdir -p $(dir $@)
+	$(HOST_CC) $(HOST_TSAN_CFLAGS) $(CFLAGS) -o $@ $^
+
+# test_wire again with the staged packet path; ahead of the archive, its
+# audio_stream.o is the one linked
+$(HOST_BUILD_DIR)/staged/audio_stream.o: audio_stream.c
+	@printf "  HOSTCC\t$< (staged)\n"
+	@mkdir -p $(dir $@)
+	$(HOST_CC) $(HOST_CFLAGS) $(HOST_HARNESS_CFLAGS) $(CFLAGS) -DAUDIO_STREAM_STAGED=1 -MD -o $@ -c $<
+
+$(HOST_STAGED): $(HOST_BUILD_DIR)/host/test_wire.o $(HOST_BUILD_DIR)/staged/audio_stream.o $(HOST_FW_LIB) $(HOST_LIB)
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $(filter %.o,$^) \
+		-Wl,--start-group $(HOST_FW_LIB) $(HOST_LIB) -Wl,--end-group -lm
+
+$(HOST_BENCH): $(HOST_BUILD_DIR)/host/bench.o $(HOST_FW_LIB) $(HOST_LIB)
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $< \
+		-Wl,--start-group $(HOST_FW_LIB) $(HOST_LIB) -Wl,--end-group -lm
+
+$(HOST_BUILD_DIR)/prof_decode: $(HOST_BUILD_DIR)/prof_decode.o
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $^
+
+$(HOST_BUILD_DIR)/stream_check: $(HOST_BUILD_DIR)/stream_check.o
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $^ -lm
+
+$(HOST_BUILD_DIR)/desc_check: $(HOST_BUILD_DIR)/desc_check.o
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $^
+
+$(HOST_BUILD_DIR)/tap_decode: $(HOST_BUILD_DIR)/tap_decode.o
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $^
+
+$(HOST_BUILD_DIR)/meter_decode: $(HOST_BUILD_DIR)/meter_decode.o
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $^
+
+$(HOST_BUILD_DIR)/sync_decode: $(HOST_BUILD_DIR)/sync_decode.o
+	@printf "  HOSTLD\t$@\n"
+	$(HOST_CC) $(HOST_CFLAGS) $(CFLAGS) -o $@ $^
+
+# Firmware-only sources: compile against the host headers, nothing more
+# (their DMA addresses are 32-bit casts of pointers)
+syntax:
+	@printf "  SYNTAX\t$(HOST_SYNTAX_CFILES)\n"
+	@for f in $(HOST_SYNTAX_CFILES); do \
+		$(HOST_CC) $(HOST_CFLAGS) $(HOST_HARNESS_CFLAGS) $(CFLAGS) \
+			-Wno-pointer-to-int-cast -fsyntax-only $$f || exit 1; \
+	done
+
+check: all $(HOST_TEST_BINS) $(HOST_TSAN_TESTS) $(HOST_STAGED) syntax
+	$(HOST_BUILD_DIR)/test_desc $(HOST_BUILD_DIR)/config.bin $(HOST_BUILD_DIR)/config.rate
+	$(HOST_BUILD_DIR)/desc_check -r $$(cat $(HOST_BUILD_DIR)/config.rate) $(HOST_BUILD_DIR)/config.bin
+	$(HOST_BUILD_DIR)/test_prof $(HOST_BUILD_DIR)/prof_decode $(HOST_BUILD_DIR)/prof.bin
+	$(HOST_BUILD_DIR)/test_signal $(HOST_BUILD_DIR)/stream_check $(HOST_BUILD_DIR)/signal.bin
+	@for t in $(filter-out desc prof signal wire,$(HOST_TESTS)); do \
+		$(HOST_BUILD_DIR)/test_$$t || exit 1; \
+	done
+	$(HOST_BUILD_DIR)/test_wire $(HOST_BUILD_DIR)/wire.bin
+	$(HOST_STAGED) $(HOST_BUILD_DIR)/wire-staged.bin
+	cmp $(HOST_BUILD_DIR)/wire.bin $(HOST_BUILD_DIR)/wire-staged.bin
+	@for t in $(HOST_TSAN_TESTS); do \
+		TSAN_OPTIONS=halt_on_error=1 $$t || exit 1; \
+	done
+
+test: $(HOST_VARIANTS:%=test-%)
+
+test-%:
+	@printf "  TEST\t$*\n"
+	@$(MAKE) --no-print-directory -f host.mk HOST_BUILD_DIR=$(HOST_BUILD_DIR)/$* \
+		CFLAGS="$(CFLAGS) $(VARIANT_$*)" check
+
+SOAK_HOURS ?= 2
+
+soak: $(HOST_BUILD_DIR)/test_rate
+	$(HOST_BUILD_DIR)/test_rate $(SOAK_HOURS)
+
+bench: $(HOST_BENCH)
+	$(HOST_BENCH) $(BENCH)
+
+clean:
+	rm -rf $(HOST_BUILD_DIR)
+
+.PHONY: all clean syntax check test soak bench
+-include $(HOST_OBJS:.o=.d) $(HOST_FW_OBJS:.o=.d) $(HOST_TB_OBJS:.o=.d) $(HOST_TOOLS:=.d)
+-include $(HOST_BUILD_DIR)/staged/audio_stream.d
@@ -0,0 +1,505 @@
+/*
+ * Host benchmarks of the per-block audio work.
+ *
+ *   bench [filter]     runs the rows whose name contains filter (default all)
+ *
+ * Each row times its step over at least BENCH_MIN_NS of wall time after a
+ * warm-up and prints ns per step and per sample frame. Host numbers only
+ * rank changes against each other; the firmware's budgets are in core
+ * cycles (profiler.h) and come from the board.
+ *
+ *   pack/<alt>/<rate>  one DMA half through audio_capture_dma_event(),
+ *                      DSP stages off, ring drained after each
+ *   dsp/<alt>/<rate>   dsp_chain_process() over one block, all stages on
+ *   hpf/<alt>/<rate>, gate/<alt>/<rate>, agc/<alt>/<rate>
+ *                      the same with only that stage on
+ *   pdm/opt, pdm/ref   pdm_decim_process() and its portable reference over
+ *                      a 48-sample block of a busy bitstream
+ *   decim/<rate>/opt, decim/<rate>/ref
+ *                      pcm_decim_process() and its portable reference over
+ *                      one 48 kHz block of noise to 16, 24 or 32 kHz
+ *   gain/<bytes>/steady, gain/<bytes>/ramp
+ *                      audio_gain_apply() over a 48-frame block of 2-, 3-
+ *                      or 4-byte subframes at -6 dB, or ramping between
+ *                      -6 dB and +6 dB every block
+ *   meter/levels/<alt>/<rate>, meter/all/<alt>/<rate>
+ *                      audio_meter_block() and one audio_meter_run() per
+ *                      block of busy audio: level meters only, or with the
+ *                      spectrum collecting and transforming a slice per run
+ *   nco/<bytes>, sinf/<bytes>
+ *                      a 48-frame block of the 1 kHz test sine in 2-, 3- or
+ *                      4-byte subframes: test_source_fill()'s LUT NCO, and
+ *                      the same block from sinf() per frame for scale
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_capture.h"
+#include "audio_format.h"
+#include "audio_gain.h"
+#include "audio_meter.h"
+#include "audio_ring.h"
+#include "dsp_chain.h"
+#include "pcm_decim.h"
+#include "pdm_decim.h"
+#include "test_source.h"
+#include "host_hw.h"
+#include "host_capture.h"
+
+#define BENCH_MIN_NS     50000000ull
+#define BENCH_WARMUP     64
+
+static const char *filter;
+
+static uint64_t ns_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int wanted(const char *name)
+{
+    return !filter || strstr(name, filter);
+}
+
+/* Time step() until BENCH_MIN_NS have passed; frames per step for the rate */
+static void bench_run(const char *name, void (*step)(void), uint32_t frames)
+{
+    uint64_t n = 0, t0, t;
+
+    for (int i = 0; i < BENCH_WARMUP; i++) {
+        step();
+    }
+
+    t0 = ns_now();
+    do {
+        for (int i = 0; i < 64; i++) {
+            step();
+        }
+        n += 64;
+        t = ns_now();
+    } while (t - t0 < BENCH_MIN_NS);
+
+    double per_step = (double)(t - t0) / (double)n;
+
+    printf("  BENCH\t%-24s %9.1f ns/step %7.2f ns/frame\n",
+           name, per_step, frames ? per_step / frames : 0.0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CAPTURE PACKING                                                            */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t pack_half;
+static uint32_t pack_bytes;
+
+static int32_t pack_source(uint32_t ch, uint64_t n)
+{
+    return (int32_t)((n * 2654435761u + ch * 40503u) & 0xFFFFFF) - 0x800000;
+}
+
+static void pack_step(void)
+{
+    audio_capture_dma_event(pack_half, 0);
+    pack_half ^= 1;
+    audio_ring_skip(audio_capture_ring(), pack_bytes);
+}
+
+static void bench_pack(void)
+{
+    dsp_chain_set_enabled(0);
+    host_capture_set_source(pack_source);
+
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        const struct audio_format *fmt = audio_format_for_alt(alt);
+
+        for (uint32_t r = 0; r < fmt->num_rates; r++) {
+            struct audio_stream_cfg cfg;
+            char name[48];
+
+            snprintf(name, sizeof(name), "pack/%u/%u", alt, fmt->rates[r]);
+            if (!wanted(name)) {
+                continue;
+            }
+
+            audio_format_make_cfg(fmt, fmt->rates[r], &cfg);
+            audio_capture_start(&cfg);
+
+            /* Real samples in both halves, then convert them over and over */
+            host_capture_fire();
+            host_capture_fire();
+            audio_ring_reset(audio_capture_ring());
+
+            pack_half  = 0;
+            pack_bytes = cfg.samples_per_frame * cfg.frame_bytes;
+            bench_run(name, pack_step, cfg.samples_per_frame);
+            audio_capture_stop();
+        }
+    }
+    host_capture_set_source(NULL);
+}
+
+/* -------------------------------------------------------------------------- */
+/* DSP CHAIN                                                                  */
+/* -------------------------------------------------------------------------- */
+
+static struct audio_stream_cfg dsp_cfg;
+static uint8_t dsp_block[AUDIO_CAPTURE_MAX_BLOCK_BYTES];
+static uint8_t dsp_input[AUDIO_CAPTURE_MAX_BLOCK_BYTES];
+
+/* The chain runs in place: start every step from the same input */
+static void dsp_step(void)
+{
+    memcpy(dsp_block, dsp_input, sizeof(dsp_block));
+    dsp_chain_process(dsp_block, dsp_cfg.samples_per_frame, &dsp_cfg);
+}
+
+static const struct {
+    const char *name;
+    uint32_t    mask;
+} dsp_rows[] = {
+    { "dsp",  DSP_CHAIN_ALL_STAGES },
+    { "hpf",  DSP_STAGE_BIT(DSP_STAGE_HPF) },
+    { "gate", DSP_STAGE_BIT(DSP_STAGE_GATE) },
+    { "agc",  DSP_STAGE_BIT(DSP_STAGE_AGC) },
+};
+
+static void bench_dsp(void)
+{
+    uint32_t x = 1;
+
+    for (size_t i = 0; i < sizeof(dsp_input); i++) {
+        x = x * 1664525u + 1013904223u;
+        dsp_input[i] = (uint8_t)(x >> 24);
+    }
+
+    dsp_chain_configure(&dsp_chain_default_config);
+
+    for (size_t row = 0; row < sizeof(dsp_rows) / sizeof(dsp_rows[0]); row++) {
+        dsp_chain_set_enabled(dsp_rows[row].mask);
+
+        for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+            const struct audio_format *fmt = audio_format_for_alt(alt);
+
+            for (uint32_t r = 0; r < fmt->num_rates; r++) {
+                char name[48];
+
+                snprintf(name, sizeof(name), "%s/%u/%u",
+                         dsp_rows[row].name, alt, fmt->rates[r]);
+                if (!wanted(name)) {
+                    continue;
+                }
+
+                audio_format_make_cfg(fmt, fmt->rates[r], &dsp_cfg);
+                dsp_chain_start(&dsp_cfg);
+                bench_run(name, dsp_step, dsp_cfg.samples_per_frame);
+            }
+        }
+    }
+    dsp_chain_set_enabled(DSP_CHAIN_DEFAULT_MASK);
+}
+
+/* -------------------------------------------------------------------------- */
+/* PDM DECIMATOR                                                              */
+/* -------------------------------------------------------------------------- */
+
+static struct pdm_decim pdm_state;
+static uint16_t pdm_in[PDM_DECIM_MAX_OUT * PDM_HWORDS_PER_OUTPUT];
+static int16_t  pdm_out[PDM_DECIM_MAX_OUT];
+
+static void pdm_opt_step(void)
+{
+    pdm_decim_process(&pdm_state, pdm_in, pdm_out, PDM_DECIM_MAX_OUT);
+}
+
+static void pdm_ref_step(void)
+{
+    pdm_decim_process_ref(&pdm_state, pdm_in, pdm_out, PDM_DECIM_MAX_OUT);
+}
+
+static void bench_pdm(void)
+{
+    uint32_t x = 1;
+
+    for (size_t i = 0; i < sizeof(pdm_in) / sizeof(pdm_in[0]); i++) {
+        x = x * 1664525u + 1013904223u;
+        pdm_in[i] = (uint16_t)(x >> 16);
+    }
+
+    if (wanted("pdm/opt")) {
+        pdm_decim_init(&pdm_state);
+        bench_run("pdm/opt", pdm_opt_step, PDM_DECIM_MAX_OUT);
+    }
+    if (wanted("pdm/ref")) {
+        pdm_decim_init(&pdm_state);
+        bench_run("pdm/ref", pdm_ref_step, PDM_DECIM_MAX_OUT);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* RATE CONVERTER                                                             */
+/* -------------------------------------------------------------------------- */
+
+static struct pcm_decim decim_state;
+static int16_t decim_in[PCM_DECIM_MAX_IN];
+static int16_t decim_out[PCM_DECIM_MAX_IN];
+
+static void decim_opt_step(void)
+{
+    pcm_decim_process(&decim_state, decim_in, decim_out, PCM_DECIM_MAX_IN, 1);
+}
+
+static void decim_ref_step(void)
+{
+    pcm_decim_process_ref(&decim_state, decim_in, decim_out, PCM_DECIM_MAX_IN, 1);
+}
+
+static void bench_decim(void)
+{
+    static const uint32_t rates[] = { 16000, 24000, 32000 };
+    uint32_t x = 1;
+
+    for (size_t i = 0; i < PCM_DECIM_MAX_IN; i++) {
+        x = x * 1664525u + 1013904223u;
+        decim_in[i] = (int16_t)(x >> 16);
+    }
+
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        for (int ref = 0; ref < 2; ref++) {
+            char name[48];
+
+            snprintf(name, sizeof(name), "decim/%u/%s", rates[r], ref ? "ref" : "opt");
+            if (!wanted(name)) {
+                continue;
+            }
+
+            pcm_decim_init(&decim_state, rates[r]);
+            bench_run(name, ref ? decim_ref_step : decim_opt_step, rates[r] / 1000);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* GAIN                                                                       */
+/* -------------------------------------------------------------------------- */
+
+#define GAIN_FRAMES  48
+
+static struct audio_stream_cfg gain_cfg;
+static struct audio_gain gain_state;
+static int32_t gain_targets[2];
+static uint32_t gain_turn;
+static uint8_t gain_block[GAIN_FRAMES * AUDIO_NUM_CHANNELS * 4] __attribute__((aligned(4)));
+
+/* In place: the values drift, the kernel does the same work on any of them */
+static void gain_step(void)
+{
+    audio_gain_set(&gain_state, gain_targets[gain_turn]);
+    gain_turn ^= 1;
+    audio_gain_apply(&gain_state, gain_block, GAIN_FRAMES, &gain_cfg);
+}
+
+static void bench_gain(void)
+{
+    static const uint8_t sizes[] = { 2, 3, 4 };
+    uint32_t x = 1;
+
+    for (size_t i = 0; i < sizeof(gain_block); i++) {
+        x = x * 1664525u + 1013904223u;
+        gain_block[i] = (uint8_t)(x >> 24);
+    }
+
+    for (size_t s = 0; s < sizeof(sizes); s++) {
+        char name[48];
+
+        gain_cfg = (struct audio_stream_cfg){
+            .rate_hz           = GAIN_FRAMES * 1000,
+            .subframe_bytes    = sizes[s],
+            .bits              = sizes[s] == 2 ? 16 : 24,
+            .samples_per_frame = GAIN_FRAMES,
+            .frame_bytes       = (uint16_t)(AUDIO_NUM_CHANNELS * sizes[s]),
+            .capture_hz        = GAIN_FRAMES * 1000,
+        };
+
+        for (int ramp = 0; ramp < 2; ramp++) {
+            snprintf(name, sizeof(name), "gain/%u/%s", sizes[s],
+                     ramp ? "ramp" : "steady");
+            if (!wanted(name)) {
+                continue;
+            }
+
+            gain_targets[0] = audio_gain_from_volume(-6 * 256);
+            gain_targets[1] = ramp ? audio_gain_from_volume(6 * 256) : gain_targets[0];
+            for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+                gain_state.cur_q16[ch] = gain_targets[0];
+            }
+            gain_turn = 0;
+            bench_run(name, gain_step, GAIN_FRAMES);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* METER                                                                      */
+/* -------------------------------------------------------------------------- */
+
+static struct audio_stream_cfg meter_cfg;
+static uint8_t meter_input[AUDIO_CAPTURE_MAX_BLOCK_BYTES];
+
+/* As the capture ISR and the SOF task would, once per block */
+static void meter_step(void)
+{
+    audio_meter_block(meter_input, &meter_cfg);
+    audio_meter_run();
+}
+
+static const struct {
+    const char *name;
+    uint32_t    mask;
+} meter_rows[] = {
+    { "meter/levels", AUDIO_METER_LEVELS },
+    { "meter/all",    AUDIO_METER_ALL },
+};
+
+static void bench_meter(void)
+{
+    uint32_t x = 1;
+
+    for (size_t i = 0; i < sizeof(meter_input); i++) {
+        x = x * 1664525u + 1013904223u;
+        meter_input[i] = (uint8_t)(x >> 24);
+    }
+
+    for (size_t row = 0; row < sizeof(meter_rows) / sizeof(meter_rows[0]); row++) {
+        for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+            const struct audio_format *fmt = audio_format_for_alt(alt);
+
+            for (uint32_t r = 0; r < fmt->num_rates; r++) {
+                char name[48];
+
+                snprintf(name, sizeof(name), "%s/%u/%u",
+                         meter_rows[row].name, alt, fmt->rates[r]);
+                if (!wanted(name)) {
+                    continue;
+                }
+
+                audio_format_make_cfg(fmt, fmt->rates[r], &meter_cfg);
+                (void)audio_meter_configure(meter_rows[row].mask, 0);
+                bench_run(name, meter_step, meter_cfg.samples_per_frame);
+            }
+        }
+    }
+    (void)audio_meter_configure(0, 0);
+    audio_meter_run();
+}
+
+/* -------------------------------------------------------------------------- */
+/* TEST SIGNAL                                                                */
+/* -------------------------------------------------------------------------- */
+
+#define NCO_FRAMES  48
+#define NCO_PI      3.14159265f
+
+static struct audio_stream_cfg nco_cfg;
+static uint8_t nco_block[NCO_FRAMES * AUDIO_NUM_CHANNELS * 4];
+static float   sinf_phase;
+
+static void nco_step(void)
+{
+    (void)test_source_fill(nco_block, NCO_FRAMES, &nco_cfg);
+}
+
+/* The same block as test_source_fill() lays it out, each frame from sinf() */
+static void sinf_step(void)
+{
+    const float w = 2.0f * NCO_PI * TEST_SRC_DEFAULT_HZ / (NCO_FRAMES * 1000);
+    uint32_t bytes = nco_cfg.subframe_bytes;
+    uint8_t *p = nco_block;
+
+    for (uint32_t i = 0; i < NCO_FRAMES; i++) {
+        int32_t v = (int32_t)lrintf(sinf(sinf_phase) * 0.891251f *
+                                    (nco_cfg.bits == 16 ? 32767.0f : 8388607.0f));
+
+        sinf_phase += w;
+        if (sinf_phase > NCO_PI) {
+            sinf_phase -= 2.0f * NCO_PI;
+        }
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            if (bytes == 4) {
+                *p++ = 0;
+            }
+            p[0] = (uint8_t)v;
+            p[1] = (uint8_t)(v >> 8);
+            if (bytes >= 3) {
+                p[2] = (uint8_t)(v >> 16);
+            }
+            p += bytes >= 3 ? 3 : 2;
+        }
+    }
+}
+
+static void bench_signal(void)
+{
+    static const uint8_t sizes[] = { 2, 3, 4 };
+
+    (void)test_source_select(TEST_SRC_SINE, 0);
+    test_source_restart();
+
+    for (size_t s = 0; s < sizeof(sizes); s++) {
+        char name[48];
+
+        nco_cfg = (struct audio_stream_cfg){
+            .rate_hz           = NCO_FRAMES * 1000,
+            .subframe_bytes    = sizes[s],
+            .bits              = sizes[s] == 2 ? 16 : 24,
+            .samples_per_frame = NCO_FRAMES,
+            .frame_bytes       = (uint16_t)(AUDIO_NUM_CHANNELS * sizes[s]),
+            .capture_hz        = NCO_FRAMES * 1000,
+        };
+
+        snprintf(name, sizeof(name), "nco/%u", sizes[s]);
+        if (wanted(name)) {
+            bench_run(name, nco_step, NCO_FRAMES);
+        }
+        snprintf(name, sizeof(name), "sinf/%u", sizes[s]);
+        if (wanted(name)) {
+            bench_run(name, sinf_step, NCO_FRAMES);
+        }
+    }
+    (void)test_source_select(TEST_SRC_OFF, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* MAIN                                                                       */
+/* -------------------------------------------------------------------------- */
+
+static void (*const benches[])(void) = {
+    bench_pack,
+    bench_dsp,
+    bench_pdm,
+    bench_decim,
+    bench_gain,
+    bench_meter,
+    bench_signal,
+};
+
+int main(int argc, char **argv)
+{
+    filter = argc > 1 ? argv[1] : NULL;
+
+    host_hw_reset();
+    host_capture_reset();
+
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        benches[i]();
+    }
+    return 0;
+}
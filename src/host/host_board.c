@@ -0,0 +1,95 @@
+#include <stddef.h>
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/usbstd.h>
+
+#include "usb_descriptors.h"
+#include "audio_stream.h"
+#include "stream_power.h"
+#include "power_hal.h"
+#include "task_queue.h"
+#include "cycle_counter.h"
+#include "sof_timer.h"
+#include "host_board.h"
+
+/* As main.c */
+#ifndef USB_POLLED
+#define USB_POLLED 0
+#endif
+
+static uint8_t control_buffer[USB_CONTROL_BUFFER_BYTES];
+
+/* Where the loop started waiting: host_hw_now(), and CYCCNT */
+static uint64_t wait_t;
+static uint32_t wait_cycles;
+
+/* main.c's loop, once per step the harness runs it */
+static void board_loop(void)
+{
+    uint64_t now = host_hw_now();
+
+    if (now >= wait_t && now - wait_t <= HOST_HW_TICKS_PER_MS / HOST_USB_STEPS) {
+        task_idle_account(cycles_now() - wait_cycles);
+    }
+#if USB_POLLED
+    host_usb_poll();
+    task_run_pending();
+#else
+    task_run_pending();
+    task_idle_wait();
+#endif
+    wait_t      = now;
+    wait_cycles = cycles_now();
+}
+
+void host_board_init(void)
+{
+    usbd_device *dev;
+
+    host_hw_reset();
+    host_usb_reset();
+    host_capture_reset();
+    host_playback_reset();
+
+    power_hal_init();
+    dwt_enable_cycle_counter();
+    sof_timer_init();
+
+    usb_set_unique_serial();
+    stream_power_init();
+
+    dev = usbd_init(&otgfs_usb_driver, &dev_descriptor, &config_descriptor,
+                    usb_strings, 3, control_buffer, sizeof(control_buffer));
+    usbd_register_set_config_callback(dev, usb_set_config);
+    usbd_register_suspend_callback(dev, usb_suspend);
+    usbd_register_resume_callback(dev, usb_resume);
+    usbd_register_reset_callback(dev, usb_reset);
+
+    host_usb_set_incomplete(audio_stream_incomplete);
+    host_usb_set_polled(USB_POLLED);
+    host_usb_set_thread(board_loop);
+    wait_t = UINT64_MAX;
+}
+
+bool host_board_enumerate(void)
+{
+    host_usb_bus_reset();
+    return host_usb_control(USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_DEVICE,
+                            USB_REQ_SET_ADDRESS, 1, 0, NULL, 0) >= 0 &&
+           host_usb_control(USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_DEVICE,
+                            USB_REQ_SET_CONFIGURATION, 1, 0, NULL, 0) >= 0;
+}
+
+bool host_board_set_interface(uint16_t iface, uint16_t alt)
+{
+    return host_usb_control(USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_INTERFACE,
+                            USB_REQ_SET_INTERFACE, alt, iface, NULL, 0) >= 0;
+}
+
+void host_board_run(uint32_t frames)
+{
+    while (frames--) {
+        host_usb_frame(NULL);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "host_hw.h"
+#include "host_usb.h"
+#include "host_capture.h"
+#include "host_playback.h"
+#include "host_power.h"
+
+/*
+ * main.c on the host: the same bring-up order and the same usbd_init()
+ * arguments and callbacks, with the OTG interrupt and the thread-mode loop
+ * run by host_usb_frame() instead of the NVIC and the idle wait. The
+ * firmware keeps its state in statics, so each test process brings the
+ * board up once.
+ *
+ * The loop is main.c's for the build, interrupt-driven or USB_POLLED.
+ * Simulated code takes no time, so from one step to the next the loop
+ * waits: in WFI, or polling and finding nothing. The board counts that
+ * wait as idle time (task_queue.h) unless interrupts were held off for it.
+ */
+
+void host_board_init(void);
+
+/* Bus reset, SET_ADDRESS and SET_CONFIGURATION 1: false on a stall */
+bool host_board_enumerate(void);
+
+/* SET_INTERFACE iface alt: false on a stall */
+bool host_board_set_interface(uint16_t iface, uint16_t alt);
+
+/* Run n default frames */
+void host_board_run(uint32_t frames);
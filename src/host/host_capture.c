@@ -0,0 +1,202 @@
+#include <math.h>
+#include <stddef.h>
+
+#include <libopencm3/stm32/rcc.h>
+
+#include "capture_hal.h"
+#include "audio_capture.h"
+#include "sof_timer.h"
+#include "host_hw.h"
+#include "host_capture.h"
+
+static host_capture_source source;
+static double ppm;
+static uint32_t latency_max;
+
+static volatile uint16_t *dma_buf;
+static uint32_t dma_count;      /* half-words per lane, both halves */
+static double   hwords_per_tick;
+static uint64_t t_start;
+static uint64_t done;           /* halves completed since the start */
+static int32_t  pdm_integ[AUDIO_CAPTURE_LANES];
+
+static struct host_capture_stats stats;
+
+void host_capture_set_source(host_capture_source fn)
+{
+    source = fn;
+}
+
+void host_capture_set_ppm(double p)
+{
+    ppm = p;
+}
+
+void host_capture_set_latency(uint32_t max_ticks)
+{
+    latency_max = max_ticks;
+}
+
+void host_capture_get_stats(struct host_capture_stats *st)
+{
+    *st = stats;
+    st->gated = !(RCC_CR & RCC_CR_PLLI2SON);
+}
+
+void host_capture_reset(void)
+{
+    source      = NULL;
+    ppm         = 0;
+    latency_max = 0;
+    stats       = (struct host_capture_stats){ 0 };
+}
+
+static int32_t sample(uint32_t ch, uint64_t n)
+{
+    return source && ch < AUDIO_NUM_CHANNELS ? source(ch, n) : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* DMA                                                                        */
+/* -------------------------------------------------------------------------- */
+
+#if AUDIO_MIC_PDM
+/* 64 bits per frame, MSB first, density following the sample */
+static void fill_frame(volatile uint16_t *dst, uint32_t lane, uint64_t n)
+{
+    int32_t x = sample(2 * lane, n);
+
+    for (uint32_t h = 0; h < AUDIO_CAPTURE_HWORDS_PER_FRAME; h++) {
+        uint16_t bits = 0;
+
+        for (uint32_t b = 0; b < 16; b++) {
+            int32_t y = pdm_integ[lane] >= 0 ? (1 << 23) : -(1 << 23);
+
+            pdm_integ[lane] += x - y;
+            bits = (uint16_t)(bits << 1 | (y > 0));
+        }
+        dst[h] = bits;
+    }
+}
+#else
+/* Two 32-bit Philips slots: bits 23..8, then 7..0 in the top byte */
+static void fill_frame(volatile uint16_t *dst, uint32_t lane, uint64_t n)
+{
+    for (uint32_t ch = 0; ch < 2; ch++) {
+        uint32_t s = (uint32_t)sample(2 * lane + ch, n);
+
+        dst[2 * ch + 0] = (uint16_t)(s >> 8);
+        dst[2 * ch + 1] = (uint16_t)((s & 0xFF) << 8);
+    }
+}
+#endif
+
+static uint32_t half_hwords(void)
+{
+    return dma_count / 2;
+}
+
+uint64_t host_capture_due(void)
+{
+    if (!stats.running) {
+        return UINT64_MAX;
+    }
+    /* Hashed from the event count, so every run sees the same latencies */
+    uint64_t h = (done + 1) * 0x9E3779B97F4A7C15ull;
+
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 29;
+
+    return t_start + h % (latency_max + 1) + (uint64_t)ceil((double)(done + 1) * half_hwords() /
+                                           hwords_per_tick);
+}
+
+void host_capture_fire(void)
+{
+    uint32_t half   = (uint32_t)(done & 1);
+    uint32_t frames = half_hwords() / AUDIO_CAPTURE_HWORDS_PER_FRAME;
+
+    for (uint32_t lane = 0; lane < AUDIO_CAPTURE_LANES; lane++) {
+        volatile uint16_t *dst = dma_buf + lane * dma_count + half * half_hwords();
+
+        for (uint32_t i = 0; i < frames; i++) {
+            fill_frame(dst + i * AUDIO_CAPTURE_HWORDS_PER_FRAME, lane,
+                       stats.frames + i);
+        }
+    }
+    stats.frames += frames;
+    stats.events++;
+    done++;
+
+    audio_capture_dma_event(half, sof_timer_now());
+}
+
+/* -------------------------------------------------------------------------- */
+/* CAPTURE HAL                                                                */
+/* -------------------------------------------------------------------------- */
+
+bool capture_hal_clock(uint32_t rate_hz)
+{
+    (void)rate_hz;
+
+    RCC_CR |= RCC_CR_PLLI2SON;
+    return (RCC_CR & RCC_CR_PLLI2SRDY) != 0;
+}
+
+bool capture_hal_start(volatile uint16_t *buf, uint32_t count, uint32_t rate_hz)
+{
+    capture_hal_stop();
+    if (!capture_hal_clock(rate_hz)) {
+        stats.start_failures++;
+        return false;
+    }
+
+    dma_buf   = buf;
+    dma_count = count;
+    hwords_per_tick = (double)rate_hz * (1.0 + ppm * 1e-6) *
+                      AUDIO_CAPTURE_HWORDS_PER_FRAME / SOF_TIMER_HZ;
+    t_start = host_hw_now();
+    done    = 0;
+    for (uint32_t lane = 0; lane < AUDIO_CAPTURE_LANES; lane++) {
+        pdm_integ[lane] = 0;
+    }
+
+    stats.running = true;
+    stats.rate_hz = rate_hz;
+    stats.frames  = 0;
+    stats.t_start = t_start;
+    stats.starts++;
+    return true;
+}
+
+void capture_hal_stop(void)
+{
+    stats.running = false;
+}
+
+void capture_hal_sleep(void)
+{
+    capture_hal_stop();
+
+    stats.sleeps++;
+    if (!(RCC_CR & RCC_CR_PLLI2SON)) {
+        stats.sleeps_gated++;
+    }
+    RCC_CR &= ~RCC_CR_PLLI2SON;
+}
+
+uint32_t capture_hal_position(void)
+{
+    if (!stats.running) {
+        return 0;
+    }
+
+    /* Never behind the last event, whatever the rounding */
+    uint64_t pos = (uint64_t)((double)(host_hw_now() - t_start) * hwords_per_tick);
+
+    if (pos < done * half_hwords()) {
+        pos = done * half_hwords();
+    }
+    return (uint32_t)(pos % dma_count);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host capture_hal_*() (capture_hal.h): a synthetic DMA that fills each
+ * lane's halves from a sample source at the capture rate and calls
+ * audio_capture_dma_event() as a half completes, in simulated time
+ * (host_hw.h). I2S builds get the 24-bit samples in Philips slots, PDM
+ * builds a first-order sigma-delta bitstream of them. The clock goes
+ * through the RCC model: PLLI2S on, wait for the lock.
+ */
+
+/* 24-bit sample of channel ch at frame n of the capture rate */
+typedef int32_t (*host_capture_source)(uint32_t ch, uint64_t n);
+
+/* NULL: silence */
+void host_capture_set_source(host_capture_source fn);
+
+/* Mic clock against nominal, parts per million (sampled at the next start) */
+void host_capture_set_ppm(double ppm);
+
+/*
+ * DMA interrupt latency: each event is taken up to max_ticks after its
+ * half completes, a different amount each time (0: on time)
+ */
+void host_capture_set_latency(uint32_t max_ticks);
+
+struct host_capture_stats {
+    bool     running;
+    bool     gated;         /* PLLI2S off */
+    uint32_t rate_hz;       /* of the last start */
+    uint32_t starts;
+    uint32_t start_failures;
+    uint32_t sleeps;
+    uint32_t sleeps_gated;  /* capture_hal_sleep() with the clock already off */
+    uint32_t events;        /* half/full-transfer events */
+    uint64_t frames;        /* since the last start */
+    uint64_t t_start;       /* host_hw_now() at the last start: frame 0 */
+};
+
+void host_capture_get_stats(struct host_capture_stats *st);
+
+void host_capture_reset(void);
+
+/* host_hw_run(): time of the next DMA event (UINT64_MAX if none), fire it */
+uint64_t host_capture_due(void);
+void host_capture_fire(void);
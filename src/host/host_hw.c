@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/desig.h>
+#include <libopencm3/usb/dwc/otg_fs.h>
+
+#include "host_hw.h"
+#include "host_capture.h"
+#include "host_playback.h"
+
+/* Bits usb_fifo.c defines locally */
+#define DIEPCTL_SEVNFRM   (1u << 28)
+#define DIEPCTL_SODDFRM   (1u << 29)
+#define DIEPINT_EPDISD    (1u << 1)
+#define DIEPINT_INEPNE    (1u << 6)
+#define DIEPTSIZ_PKTCNT_MASK  (0x3FFu << 19)
+#define DIEPTSIZ_XFRSIZ_MASK  0x7FFFFu
+#define DIEPCTL_MPSIZ_MASK    0x7FFu
+
+#define HOST_HW_IN_EPS    4
+
+/* -------------------------------------------------------------------------- */
+/* REGISTER FILE                                                              */
+/* -------------------------------------------------------------------------- */
+
+struct region {
+    uint32_t base;
+    uint32_t bytes;
+    uint32_t *words;
+};
+
+/* Core registers, then the four FIFO windows */
+static uint32_t otg_regs[(HOST_HW_FIFO_BYTES + HOST_HW_IN_EPS * HOST_HW_FIFO_BYTES) / 4];
+static uint32_t tim2_regs[0x400 / 4];
+static uint32_t rcc_regs[0x400 / 4];
+static uint32_t dwt_regs[0x100 / 4];
+
+static const struct region regions[] = {
+    { USB_OTG_FS_BASE, sizeof(otg_regs),  otg_regs  },
+    { TIM2,            sizeof(tim2_regs), tim2_regs },
+    { RCC_BASE,        sizeof(rcc_regs),  rcc_regs  },
+    { DWT_BASE,        sizeof(dwt_regs),  dwt_regs  },
+};
+
+/* -------------------------------------------------------------------------- */
+/* TIME                                                                       */
+/* -------------------------------------------------------------------------- */
+
+static uint64_t now;
+static uint32_t clock_div = 1;
+static uint64_t timer_base_now;     /* now at the last divider change */
+static uint32_t timer_base;         /* timer value then */
+
+uint64_t host_hw_now(void)
+{
+    return now;
+}
+
+uint32_t host_hw_timer(void)
+{
+    return timer_base + (uint32_t)((now - timer_base_now) / clock_div);
+}
+
+void host_hw_set_clock_div(uint32_t div)
+{
+    timer_base     = host_hw_timer();
+    timer_base_now = now;
+    clock_div      = div ? div : 1;
+}
+
+void host_hw_run(uint64_t t)
+{
+    for (;;) {
+        uint64_t cap = host_capture_due();
+        uint64_t pb  = host_playback_due();
+        uint64_t due = cap < pb ? cap : pb;
+
+        if (due > t) {
+            break;
+        }
+        if (due > now) {
+            now = due;
+        }
+        if (cap <= pb) {
+            host_capture_fire();
+        } else {
+            host_playback_fire();
+        }
+    }
+    if (t > now) {
+        now = t;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* OTG_FS IN ENDPOINTS                                                        */
+/* -------------------------------------------------------------------------- */
+
+static struct {
+    int      parity;        /* frame parity latched by SEVNFRM/SODDFRM, -1 none */
+    bool     nak;
+    int32_t  disable_in;    /* accesses until EPDIS completes, -1 idle */
+    uint32_t sent;          /* bytes of the armed transfer already taken */
+} in_ep[HOST_HW_IN_EPS];
+
+static uint32_t stuck_permille;
+static bool plli2s_locks = true;
+
+void host_hw_set_stuck_disables(uint32_t permille)
+{
+    stuck_permille = permille;
+}
+
+void host_hw_set_plli2s_locks(bool locks)
+{
+    plli2s_locks = locks;
+}
+
+/* Deterministic, independent of the tests' own random streams */
+static uint32_t stuck_rand(void)
+{
+    static uint32_t x = 2463534242u;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/*
+ * Act on what the firmware wrote since the last access: the write-only
+ * DIEPCTL bits, a pending disable, the flush and the PLLI2S lock. TIM2
+ * and CYCCNT are refreshed so every read sees the current time.
+ */
+static void settle(void)
+{
+    for (unsigned ep = 0; ep < HOST_HW_IN_EPS; ep++) {
+        volatile uint32_t *ctl = &OTG_FS_DIEPCTL(ep);
+        volatile uint32_t *itr = &OTG_FS_DIEPINT(ep);
+        uint32_t c = *ctl;
+
+        if (c & DIEPCTL_SEVNFRM) {
+            in_ep[ep].parity = 0;
+        }
+        if (c & DIEPCTL_SODDFRM) {
+            in_ep[ep].parity = 1;
+        }
+        /* NAK takes effect at once: INEPNE, cleared by writing 1 */
+        if ((c & OTG_DIEPCTL0_SNAK) && !(c & OTG_DIEPCTL0_EPDIS)) {
+            *itr = DIEPINT_INEPNE;
+        }
+        if (c & OTG_DIEPCTL0_SNAK) {
+            in_ep[ep].nak = true;
+        }
+        /* Every arming clears NAK: a new transfer, none of it taken */
+        if (c & OTG_DIEPCTL0_CNAK) {
+            in_ep[ep].nak  = false;
+            in_ep[ep].sent = 0;
+        }
+        if ((c & OTG_DIEPCTL0_EPDIS) && in_ep[ep].disable_in < 0) {
+            in_ep[ep].disable_in = stuck_rand() % 1000 < stuck_permille ?
+                                   HOST_HW_STUCK_ACCESSES : 0;
+        }
+        if ((c & OTG_DIEPCTL0_EPDIS) && in_ep[ep].disable_in-- == 0) {
+            c    &= ~(OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_EPDIS);
+            *itr |= DIEPINT_EPDISD;
+        }
+        *ctl = c & ~(DIEPCTL_SEVNFRM | DIEPCTL_SODDFRM |
+                     OTG_DIEPCTL0_SNAK | OTG_DIEPCTL0_CNAK);
+    }
+    OTG_FS_GRSTCTL &= ~OTG_GRSTCTL_TXFFLSH;
+
+    if ((RCC_CR & RCC_CR_PLLI2SON) && plli2s_locks) {
+        RCC_CR |= RCC_CR_PLLI2SRDY;
+    } else {
+        RCC_CR &= ~RCC_CR_PLLI2SRDY;
+    }
+
+    TIM_CNT(TIM2) = host_hw_timer();
+    DWT_CYCCNT    = host_hw_timer();
+}
+
+/* Storage behind MMIO32(addr), without acting on anything */
+static volatile uint32_t *reg(uint32_t addr)
+{
+    for (unsigned i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        const struct region *r = &regions[i];
+
+        if (addr - r->base < r->bytes) {
+            return &r->words[(addr - r->base) / 4];
+        }
+    }
+    fprintf(stderr, "host_hw: access to unmodelled register 0x%08x\n",
+            (unsigned)addr);
+    abort();
+}
+
+volatile uint32_t *host_mmio32(uint32_t addr)
+{
+    static bool busy;
+
+    /* settle() goes through MMIO32 itself */
+    if (!busy) {
+        busy = true;
+        settle();
+        busy = false;
+    }
+    return reg(addr);
+}
+
+bool host_hw_in_ready(uint8_t ep, uint32_t frame, bool iso)
+{
+    ep &= 0x7F;
+    settle();
+
+    if (!(OTG_FS_DIEPTSIZ(ep) & DIEPTSIZ_PKTCNT_MASK) ||
+        !(OTG_FS_DIEPCTL(ep) & OTG_DIEPCTL0_EPENA) || in_ep[ep].nak) {
+        return false;
+    }
+    return !iso || in_ep[ep].parity == (int)(frame & 1);
+}
+
+uint16_t host_hw_in_take(uint8_t ep, uint8_t *buf)
+{
+    uint32_t len;
+
+    ep &= 0x7F;
+    len = OTG_FS_DIEPTSIZ(ep) & DIEPTSIZ_XFRSIZ_MASK;
+    if (len > HOST_HW_FIFO_BYTES) {
+        len = HOST_HW_FIFO_BYTES;
+    }
+    memcpy(buf, (const uint32_t *)&OTG_FS_FIFO(ep), len);
+
+    OTG_FS_DIEPTSIZ(ep) = 0;
+    OTG_FS_DIEPCTL(ep) &= ~OTG_DIEPCTL0_EPENA;
+    return (uint16_t)len;
+}
+
+uint16_t host_hw_in_take_packet(uint8_t ep, uint8_t *buf, bool *done)
+{
+    uint32_t siz, len, pkts;
+
+    ep &= 0x7F;
+    siz  = OTG_FS_DIEPTSIZ(ep);
+    pkts = (siz & DIEPTSIZ_PKTCNT_MASK) >> 19;
+    len  = siz & DIEPTSIZ_XFRSIZ_MASK;
+    if (pkts > 1 && len > (OTG_FS_DIEPCTL(ep) & DIEPCTL_MPSIZ_MASK)) {
+        len = OTG_FS_DIEPCTL(ep) & DIEPCTL_MPSIZ_MASK;
+    }
+    if (in_ep[ep].sent + len > HOST_HW_FIFO_BYTES) {
+        len = HOST_HW_FIFO_BYTES - in_ep[ep].sent;
+    }
+    memcpy(buf, (const uint8_t *)&OTG_FS_FIFO(ep) + in_ep[ep].sent, len);
+    in_ep[ep].sent += len;
+
+    *done = pkts <= 1;
+    if (*done) {
+        OTG_FS_DIEPTSIZ(ep) = 0;
+        OTG_FS_DIEPCTL(ep) &= ~OTG_DIEPCTL0_EPENA;
+    } else {
+        OTG_FS_DIEPTSIZ(ep) = (siz & ~(DIEPTSIZ_PKTCNT_MASK | DIEPTSIZ_XFRSIZ_MASK)) |
+                              (pkts - 1) << 19 | ((siz & DIEPTSIZ_XFRSIZ_MASK) - len);
+    }
+    return (uint16_t)len;
+}
+
+void host_hw_reset(void)
+{
+    memset(otg_regs, 0, sizeof(otg_regs));
+    memset(tim2_regs, 0, sizeof(tim2_regs));
+    memset(rcc_regs, 0, sizeof(rcc_regs));
+    memset(dwt_regs, 0, sizeof(dwt_regs));
+
+    for (unsigned ep = 0; ep < HOST_HW_IN_EPS; ep++) {
+        in_ep[ep].parity     = -1;
+        in_ep[ep].nak        = false;
+        in_ep[ep].disable_in = -1;
+        in_ep[ep].sent       = 0;
+    }
+    now            = 0;
+    clock_div      = 1;
+    timer_base     = 0;
+    timer_base_now = 0;
+    stuck_permille = 0;
+    plli2s_locks   = true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* LIBOPENCM3 FUNCTIONS                                                       */
+/* -------------------------------------------------------------------------- */
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken)
+{
+    (void)clken;
+}
+
+void rcc_periph_clock_disable(enum rcc_periph_clken clken)
+{
+    (void)clken;
+}
+
+void timer_set_prescaler(uint32_t timer_peripheral, uint32_t value)
+{
+    (void)timer_peripheral;
+    (void)value;
+}
+
+void timer_set_period(uint32_t timer_peripheral, uint32_t period)
+{
+    (void)timer_peripheral;
+    (void)period;
+}
+
+void timer_set_option(uint32_t timer_peripheral, uint32_t option)
+{
+    (void)timer_peripheral;
+    (void)option;
+}
+
+void timer_slave_set_trigger(uint32_t timer_peripheral, uint8_t trigger)
+{
+    (void)timer_peripheral;
+    (void)trigger;
+}
+
+void timer_ic_set_input(uint32_t timer_peripheral, enum tim_ic_id ic,
+                        enum tim_ic_input in)
+{
+    (void)timer_peripheral;
+    (void)ic;
+    (void)in;
+}
+
+void timer_ic_enable(uint32_t timer_peripheral, enum tim_ic_id ic)
+{
+    (void)timer_peripheral;
+    (void)ic;
+}
+
+void timer_enable_counter(uint32_t timer_peripheral)
+{
+    (void)timer_peripheral;
+}
+
+void timer_disable_counter(uint32_t timer_peripheral)
+{
+    (void)timer_peripheral;
+}
+
+bool dwt_enable_cycle_counter(void)
+{
+    return true;
+}
+
+uint32_t dwt_read_cycle_counter(void)
+{
+    return DWT_CYCCNT;
+}
+
+void desig_get_unique_id(uint32_t *result)
+{
+    result[0] = 0x00330021u;
+    result[1] = 0x3133510Au;
+    result[2] = 0x35383730u;
+}
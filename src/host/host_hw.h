@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host model of the STM32F411 peripherals the firmware touches directly
+ * (host/include/libopencm3 routes every MMIO32() access here).
+ *
+ * Time is simulated: host_hw_now() counts nominal 96 MHz ticks and only
+ * moves when the harness runs it forward. TIM2 CNT and DWT CYCCNT follow
+ * it, at a quarter of the rate while POWER_LOW divides HCLK. Capture and
+ * playback DMA events (host_capture.h, host_playback.h) fire at their
+ * due times as host_hw_run() passes them.
+ *
+ * The OTG_FS core is a register file plus the behaviour the firmware
+ * relies on: the even/odd frame latch of iso IN endpoints, SNAK raising
+ * INEPNE, EPDIS disabling the endpoint and raising EPDISD, and the TX
+ * FIFO flush completing. Each FIFO window is plain memory that the
+ * harness reads packets back from (host_usb.h).
+ */
+
+/* Nominal ticks per 1 ms frame */
+#define HOST_HW_TICKS_PER_MS  96000u
+
+void host_hw_reset(void);
+
+/* Simulated time since reset, nominal ticks */
+uint64_t host_hw_now(void);
+
+/* TIM2 CNT / DWT CYCCNT at the current HCLK divider */
+uint32_t host_hw_timer(void);
+
+/* Run DMA events due up to t, then set the time to t (never backwards) */
+void host_hw_run(uint64_t t);
+
+/* HCLK divider, 1 at POWER_FULL (power_hal_set() on the host) */
+void host_hw_set_clock_div(uint32_t div);
+
+/*
+ * Permille of IN endpoint disables that take HOST_HW_STUCK_ACCESSES
+ * register accesses to complete instead of one: long enough for
+ * usb_fifo_flush() to time out.
+ */
+#define HOST_HW_STUCK_ACCESSES  300
+void host_hw_set_stuck_disables(uint32_t permille);
+
+/* Whether PLLI2S locks when switched on (default true) */
+void host_hw_set_plli2s_locks(bool locks);
+
+/*
+ * IN endpoint ep (0..3) holds a packet the host may take in frame: for
+ * an iso endpoint, one armed for that frame's parity
+ */
+bool host_hw_in_ready(uint8_t ep, uint32_t frame, bool iso);
+
+/* Bytes in one FIFO window, the largest transfer the model holds */
+#define HOST_HW_FIFO_BYTES  0x1000
+
+/* Take ep's transfer into buf (HOST_HW_FIFO_BYTES): returns its length */
+uint16_t host_hw_in_take(uint8_t ep, uint8_t *buf);
+
+/*
+ * Take the next max-packet-size packet of ep's transfer into buf, as a
+ * bulk IN transaction does: returns its length, with done set when it
+ * was the last one (the transfer is complete and the endpoint disabled)
+ */
+uint16_t host_hw_in_take_packet(uint8_t ep, uint8_t *buf, bool *done);
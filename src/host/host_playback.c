@@ -0,0 +1,103 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "playback_hal.h"
+#include "capture_hal.h"
+#include "audio_playback.h"
+#include "sof_timer.h"
+#include "host_hw.h"
+#include "host_playback.h"
+
+static host_playback_sink sink;
+static double ppm;
+
+static volatile uint16_t *dma_buf;
+static uint32_t dma_count;      /* half-words, both halves */
+static double   hwords_per_tick;
+static uint64_t t_start;
+static uint64_t done;           /* halves sent since the start */
+
+static struct host_playback_stats stats;
+
+void host_playback_set_sink(host_playback_sink fn)
+{
+    sink = fn;
+}
+
+void host_playback_set_ppm(double p)
+{
+    ppm = p;
+}
+
+void host_playback_get_stats(struct host_playback_stats *st)
+{
+    *st = stats;
+}
+
+void host_playback_reset(void)
+{
+    sink  = NULL;
+    ppm   = 0;
+    stats = (struct host_playback_stats){ 0 };
+}
+
+uint64_t host_playback_due(void)
+{
+    if (!stats.running) {
+        return UINT64_MAX;
+    }
+    return t_start + (uint64_t)ceil((double)(done + 1) * (dma_count / 2) /
+                                    hwords_per_tick);
+}
+
+void host_playback_fire(void)
+{
+    uint32_t half = (uint32_t)(done & 1);
+
+    if (sink) {
+        sink(dma_buf + half * (dma_count / 2), dma_count / 2);
+    }
+    stats.events++;
+    done++;
+
+    audio_playback_dma_event(half, sof_timer_now());
+}
+
+/* The speaker shares PLLI2S with the mics, as on the board */
+bool playback_hal_start(volatile uint16_t *buf, uint32_t count)
+{
+    playback_hal_stop();
+    if (!capture_hal_clock(AUDIO_SPK_RATE_HZ)) {
+        return false;
+    }
+
+    dma_buf   = buf;
+    dma_count = count;
+    hwords_per_tick = (double)AUDIO_SPK_RATE_HZ * (1.0 + ppm * 1e-6) *
+                      AUDIO_SPK_CHANNELS / SOF_TIMER_HZ;
+    t_start = host_hw_now();
+    done    = 0;
+
+    stats.running = true;
+    stats.starts++;
+    return true;
+}
+
+void playback_hal_stop(void)
+{
+    stats.running = false;
+}
+
+uint32_t playback_hal_position(void)
+{
+    if (!stats.running) {
+        return 0;
+    }
+
+    uint64_t pos = (uint64_t)((double)(host_hw_now() - t_start) * hwords_per_tick);
+
+    if (pos < done * (dma_count / 2)) {
+        pos = done * (dma_count / 2);
+    }
+    return (uint32_t)(pos % dma_count);
+}
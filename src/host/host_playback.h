@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host playback_hal_*() (playback_hal.h): a synthetic DMA draining the
+ * buffer at the speaker rate (plus ppm) in simulated time (host_hw.h),
+ * handing each half to a sink as it is sent and then calling
+ * audio_playback_dma_event() for the refill.
+ */
+
+/* hwords 16-bit slots (L/R interleaved) just sent */
+typedef void (*host_playback_sink)(const volatile uint16_t *half,
+                                   uint32_t hwords);
+
+/* NULL: discard */
+void host_playback_set_sink(host_playback_sink fn);
+
+/* DAC clock against nominal, parts per million (sampled at the next start) */
+void host_playback_set_ppm(double ppm);
+
+struct host_playback_stats {
+    bool     running;
+    uint32_t starts;
+    uint32_t events;
+};
+
+void host_playback_get_stats(struct host_playback_stats *st);
+
+void host_playback_reset(void);
+
+/* host_hw_run(): time of the next DMA event (UINT64_MAX if none), fire it */
+uint64_t host_playback_due(void);
+void host_playback_fire(void);
@@ -0,0 +1,43 @@
+#include <libopencm3/usb/dwc/otg_fs.h>
+
+#include "profiler.h"
+#include "host_hw.h"
+#include "host_power.h"
+
+#define LOW_DIV  4
+
+static struct host_power_stats stats;
+
+void host_power_get_stats(struct host_power_stats *st)
+{
+    *st = stats;
+    st->usb_suspended = (OTG_FS_PCGCCTL & OTG_PCGCCTL_STPPCLK) != 0;
+}
+
+void power_hal_init(void)
+{
+    stats = (struct host_power_stats){ .level = POWER_FULL };
+    host_hw_set_clock_div(1);
+    prof_set_clock_div(1);
+}
+
+void power_hal_set(enum power_level level)
+{
+    if (level == stats.level) {
+        return;
+    }
+
+    host_hw_set_clock_div(level == POWER_LOW ? LOW_DIV : 1);
+    prof_set_clock_div(level == POWER_LOW ? LOW_DIV : 1);
+    stats.level = level;
+    stats.changes++;
+}
+
+void power_hal_usb_suspend(bool suspended)
+{
+    if (suspended) {
+        OTG_FS_PCGCCTL |= OTG_PCGCCTL_STPPCLK;
+    } else {
+        OTG_FS_PCGCCTL &= ~OTG_PCGCCTL_STPPCLK;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "power_hal.h"
+
+/*
+ * Host power_hal_*() (power_hal.h): POWER_LOW divides the simulated HCLK
+ * by four (host_hw_set_clock_div()) and tells the profiler, as the
+ * firmware does; the PHY clock gate is a bit in the OTG model.
+ */
+
+struct host_power_stats {
+    enum power_level level;
+    bool     usb_suspended;
+    uint32_t changes;       /* level switches */
+};
+
+void host_power_get_stats(struct host_power_stats *st);
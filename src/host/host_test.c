@@ -0,0 +1,13 @@
+#include "host_test.h"
+
+unsigned host_test_failures;
+
+int host_test_result(const char *name)
+{
+    if (host_test_failures) {
+        printf("  FAIL\t%s (%u)\n", name, host_test_failures);
+        return 1;
+    }
+    printf("  PASS\t%s\n", name);
+    return 0;
+}
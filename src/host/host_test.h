@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdio.h>
+
+/*
+ * Checks for the host tests: a failed one is reported with its location
+ * and counted, and the test keeps going; main() returns host_test_result().
+ */
+
+extern unsigned host_test_failures;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            host_test_failures++;                                       \
+        }                                                               \
+    } while (0)
+
+#define CHECKF(cond, ...)                                               \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s: ",                \
+                    __FILE__, __LINE__, #cond);                         \
+            fprintf(stderr, __VA_ARGS__);                               \
+            fputc('\n', stderr);                                        \
+            host_test_failures++;                                       \
+        }                                                               \
+    } while (0)
+
+/* Prints the verdict under name; 0 if every check passed */
+int host_test_result(const char *name);
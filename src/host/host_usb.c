@@ -0,0 +1,825 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/dwc/otg_fs.h>
+
+#include "host_hw.h"
+#include "host_usb.h"
+
+/* As in libopencm3's usb_private.h */
+#define MAX_USER_CONTROL_CALLBACK     4
+#define MAX_USER_SET_CONFIG_CALLBACK  4
+#define USB_EPS                       4
+
+#define DIEPCTL_USBAEP  (1u << 15)
+#define DIEPCTL_EPTYP(t) ((uint32_t)(t) << 18)
+
+#define MIN(a, b)  ((a) < (b) ? (a) : (b))
+
+struct _usbd_driver {
+    const char *name;
+};
+
+const usbd_driver otgfs_usb_driver = { "otgfs (host model)" };
+
+struct host_ep {
+    usbd_endpoint_callback cb;
+    uint8_t  type;
+    uint16_t max_size;
+    bool     setup;
+};
+
+struct _usbd_device {
+    const struct usb_device_descriptor *desc;
+    const struct usb_config_descriptor *config;
+    const char * const *strings;
+    int       num_strings;
+    uint8_t  *ctrl_buf;
+    uint16_t  ctrl_buf_len;
+
+    uint8_t   current_address;
+    uint8_t   current_config;
+
+    struct {
+        usbd_control_callback cb;
+        uint8_t type;
+        uint8_t type_mask;
+    } user_control_callback[MAX_USER_CONTROL_CALLBACK];
+
+    usbd_set_config_callback     user_callback_set_config[MAX_USER_SET_CONFIG_CALLBACK];
+    usbd_set_altsetting_callback user_callback_set_altsetting;
+
+    void (*user_callback_reset)(void);
+    void (*user_callback_suspend)(void);
+    void (*user_callback_resume)(void);
+    void (*user_callback_sof)(void);
+
+    struct host_ep in[USB_EPS];
+    struct host_ep out[USB_EPS];
+};
+
+static usbd_device device;
+static bool        device_up;
+
+/* Bus state */
+static uint32_t frame_count;
+static uint64_t frame_start;
+static uint32_t bus_free;           /* byte times from the SOF the bus is busy to */
+static bool     pend_xfrc[USB_EPS];
+static bool     pend_rx;
+static uint8_t  rx_ep;
+static uint16_t rx_len;
+static uint8_t  rx_buf[1024];
+static uint8_t  in_buf[HOST_HW_FIFO_BYTES];
+static uint8_t  scratch[0x1000];
+
+static host_usb_packet_fn on_packet;
+static void (*incomplete_fn)(void);
+static void (*thread_fn)(void);
+static bool polled;
+
+void host_usb_on_packet(host_usb_packet_fn fn)
+{
+    on_packet = fn;
+}
+
+void host_usb_set_incomplete(void (*fn)(void))
+{
+    incomplete_fn = fn;
+}
+
+void host_usb_set_thread(void (*fn)(void))
+{
+    thread_fn = fn;
+}
+
+void host_usb_set_polled(bool p)
+{
+    polled = p;
+}
+
+usbd_device *host_usb_device(void)
+{
+    return device_up ? &device : NULL;
+}
+
+uint32_t host_usb_frame_count(void)
+{
+    return frame_count;
+}
+
+void host_usb_reset(void)
+{
+    memset(&device, 0, sizeof(device));
+    device_up     = false;
+    frame_count   = 0;
+    frame_start   = 0;
+    pend_rx       = false;
+    on_packet     = NULL;
+    incomplete_fn = NULL;
+    thread_fn     = NULL;
+    polled        = false;
+    memset(pend_xfrc, 0, sizeof(pend_xfrc));
+}
+
+/* -------------------------------------------------------------------------- */
+/* USBD API                                                                   */
+/* -------------------------------------------------------------------------- */
+
+usbd_device *usbd_init(const usbd_driver *driver,
+                       const struct usb_device_descriptor *dev,
+                       const struct usb_config_descriptor *conf,
+                       const char * const *strings, int num_strings,
+                       uint8_t *control_buffer,
+                       uint16_t control_buffer_size)
+{
+    (void)driver;
+
+    memset(&device, 0, sizeof(device));
+    device.desc         = dev;
+    device.config       = conf;
+    device.strings      = strings;
+    device.num_strings  = num_strings;
+    device.ctrl_buf     = control_buffer;
+    device.ctrl_buf_len = control_buffer_size;
+    device_up = true;
+    return &device;
+}
+
+void usbd_register_reset_callback(usbd_device *usbd_dev,
+                                  void (*callback)(void))
+{
+    usbd_dev->user_callback_reset = callback;
+}
+
+void usbd_register_suspend_callback(usbd_device *usbd_dev,
+                                    void (*callback)(void))
+{
+    usbd_dev->user_callback_suspend = callback;
+}
+
+void usbd_register_resume_callback(usbd_device *usbd_dev,
+                                   void (*callback)(void))
+{
+    usbd_dev->user_callback_resume = callback;
+}
+
+void usbd_register_sof_callback(usbd_device *usbd_dev, void (*callback)(void))
+{
+    usbd_dev->user_callback_sof = callback;
+}
+
+int usbd_register_control_callback(usbd_device *usbd_dev, uint8_t type,
+                                   uint8_t type_mask,
+                                   usbd_control_callback callback)
+{
+    for (int i = 0; i < MAX_USER_CONTROL_CALLBACK; i++) {
+        if (usbd_dev->user_control_callback[i].cb) {
+            continue;
+        }
+        usbd_dev->user_control_callback[i].type      = type;
+        usbd_dev->user_control_callback[i].type_mask = type_mask;
+        usbd_dev->user_control_callback[i].cb        = callback;
+        return 0;
+    }
+    return -1;
+}
+
+int usbd_register_set_config_callback(usbd_device *usbd_dev,
+                                      usbd_set_config_callback callback)
+{
+    for (int i = 0; i < MAX_USER_SET_CONFIG_CALLBACK; i++) {
+        if (usbd_dev->user_callback_set_config[i]) {
+            if (usbd_dev->user_callback_set_config[i] == callback) {
+                return 0;
+            }
+            continue;
+        }
+        usbd_dev->user_callback_set_config[i] = callback;
+        return 0;
+    }
+    return -1;
+}
+
+void usbd_register_set_altsetting_callback(usbd_device *usbd_dev,
+        usbd_set_altsetting_callback callback)
+{
+    usbd_dev->user_callback_set_altsetting = callback;
+}
+
+/* As the dwc driver: IN endpoints come up enabled and NAKing */
+void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+                   uint16_t max_size, usbd_endpoint_callback callback)
+{
+    uint8_t ep = addr & 0x7F;
+    struct host_ep *e = (addr & 0x80) ? &usbd_dev->in[ep] : &usbd_dev->out[ep];
+
+    e->cb       = callback;
+    e->type     = type & USB_ENDPOINT_ATTR_TYPE;
+    e->max_size = max_size;
+    e->setup    = true;
+
+    if (addr & 0x80) {
+        OTG_FS_DIEPTSIZ(ep) = max_size;
+        OTG_FS_DIEPCTL(ep) |= OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_SNAK |
+                              DIEPCTL_EPTYP(e->type) | DIEPCTL_USBAEP |
+                              max_size;
+    }
+}
+
+/* dwc_ep_write_packet() */
+uint16_t usbd_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
+                              const void *buf, uint16_t len)
+{
+    const uint8_t *p = buf;
+    volatile uint32_t *fifo;
+
+    (void)usbd_dev;
+    addr &= 0x7F;
+
+    if (OTG_FS_DIEPTSIZ(addr) & OTG_DIEPSIZ0_PKTCNT) {
+        return 0;
+    }
+    OTG_FS_DIEPTSIZ(addr) = OTG_DIEPSIZ0_PKTCNT | len;
+    OTG_FS_DIEPCTL(addr) |= OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_CNAK;
+
+    fifo = &OTG_FS_FIFO(addr);
+    for (uint32_t i = 0; i < len; i += 4) {
+        uint32_t w = 0;
+
+        memcpy(&w, p + i, MIN(4u, len - i));
+        *fifo++ = w;
+    }
+    return len;
+}
+
+uint16_t usbd_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
+                             void *buf, uint16_t len)
+{
+    uint16_t n = 0;
+
+    (void)usbd_dev;
+
+    if (pend_rx && rx_ep == (addr & 0x7F)) {
+        n = MIN(len, rx_len);
+        memcpy(buf, rx_buf, n);
+        pend_rx = false;
+    }
+    return n;
+}
+
+void usbd_ep_stall_set(usbd_device *usbd_dev, uint8_t addr, uint8_t stall)
+{
+    (void)usbd_dev;
+    (void)addr;
+    (void)stall;
+}
+
+void usbd_ep_nak_set(usbd_device *usbd_dev, uint8_t addr, uint8_t nak)
+{
+    (void)usbd_dev;
+    (void)addr;
+    (void)nak;
+}
+
+void usbd_disconnect(usbd_device *usbd_dev, bool disconnected)
+{
+    (void)usbd_dev;
+    (void)disconnected;
+}
+
+/* -------------------------------------------------------------------------- */
+/* INTERRUPTS                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/* dwc_poll(): OUT, IN complete, SOF */
+void usbd_poll(usbd_device *usbd_dev)
+{
+    if (pend_rx) {
+        struct host_ep *e = &usbd_dev->out[rx_ep];
+
+        if (e->cb) {
+            e->cb(usbd_dev, rx_ep);
+        }
+        pend_rx = false;
+    }
+
+    for (uint8_t ep = 0; ep < USB_EPS; ep++) {
+        if (pend_xfrc[ep]) {
+            pend_xfrc[ep] = false;
+            if (usbd_dev->in[ep].cb) {
+                usbd_dev->in[ep].cb(usbd_dev, ep);
+            }
+        }
+    }
+
+    if (OTG_FS_GINTSTS & OTG_GINTSTS_SOF) {
+        OTG_FS_GINTSTS &= ~OTG_GINTSTS_SOF;
+        if (usbd_dev->user_callback_sof) {
+            usbd_dev->user_callback_sof();
+        }
+    }
+}
+
+/* main.c: otg_fs_isr() */
+static void service(void)
+{
+    if (OTG_FS_GINTSTS & OTG_GINTSTS_IISOIXFR) {
+        OTG_FS_GINTSTS &= ~OTG_GINTSTS_IISOIXFR;
+        if (incomplete_fn) {
+            incomplete_fn();
+        }
+    }
+    if (device_up) {
+        usbd_poll(&device);
+    }
+}
+
+/* main.c: usb_poll_accounted()'s poll */
+void host_usb_poll(void)
+{
+    service();
+}
+
+/* -------------------------------------------------------------------------- */
+/* BUS                                                                        */
+/* -------------------------------------------------------------------------- */
+
+static bool ep_is_iso(const struct host_ep *e)
+{
+    return e->type == USB_ENDPOINT_ATTR_ISOCHRONOUS;
+}
+
+static bool ep_is_bulk(const struct host_ep *e)
+{
+    return e->type == USB_ENDPOINT_ATTR_BULK;
+}
+
+/*
+ * Byte times from the SOF to the periodic slot of endpoint addr, or to
+ * the end of them all for an address no iso endpoint has: as the host
+ * reserves them, each iso endpoint of the current alternate settings in
+ * descriptor order, wMaxPacketSize and the overhead
+ */
+static uint32_t periodic_slot(uint8_t addr)
+{
+    const struct usb_config_descriptor *cfg = device.config;
+    uint32_t at = 0;
+
+    if (!device.current_config) {
+        return 0;
+    }
+    for (int i = 0; i < cfg->bNumInterfaces; i++) {
+        const struct usb_interface *intf = &cfg->interface[i];
+        const struct usb_interface_descriptor *alt =
+            &intf->altsetting[intf->cur_altsetting ? *intf->cur_altsetting : 0];
+
+        for (int k = 0; k < alt->bNumEndpoints; k++) {
+            const struct usb_endpoint_descriptor *ep = &alt->endpoint[k];
+
+            if ((ep->bmAttributes & USB_ENDPOINT_ATTR_TYPE) !=
+                USB_ENDPOINT_ATTR_ISOCHRONOUS) {
+                continue;
+            }
+            if (ep->bEndpointAddress == addr) {
+                return at;
+            }
+            at += (ep->wMaxPacketSize & 0x7FF) + HOST_USB_ISO_OVERHEAD;
+        }
+    }
+    return at;
+}
+
+uint32_t host_usb_periodic_bytes(void)
+{
+    return device_up ? periodic_slot(0) : 0;
+}
+
+/* The periodic transfers, at the token's step */
+static void host_tokens(const struct host_usb_frame *f)
+{
+    for (uint8_t ep = 1; ep < USB_EPS; ep++) {
+        const struct host_ep *e = &device.in[ep];
+
+        if (!e->setup || ep_is_bulk(e) ||
+            !host_hw_in_ready(ep, frame_count, ep_is_iso(e))) {
+            continue;
+        }
+
+        struct host_usb_packet pkt = {
+            .ep    = (uint8_t)(0x80 | ep),
+            .frame = frame_count,
+            .t     = host_hw_now(),
+            .bus   = periodic_slot((uint8_t)(0x80 | ep)),
+            .data  = in_buf,
+        };
+        pkt.len = host_hw_in_take(ep, in_buf);
+        pend_xfrc[ep] = true;
+        if (on_packet) {
+            on_packet(&pkt);
+        }
+    }
+
+    if (f->out && device.out[f->out_ep & 0x7F].setup) {
+        rx_ep   = f->out_ep & 0x7F;
+        rx_len  = MIN(f->out_len, (uint16_t)sizeof(rx_buf));
+        memcpy(rx_buf, f->out, rx_len);
+        pend_rx = true;
+    }
+}
+
+/* Bulk IN packets the bus has time for by the end of step s */
+static void host_bulk(uint32_t s)
+{
+    uint32_t end = (HOST_USB_STEPS - 2) * HOST_USB_STEP_BYTES;
+
+    if (bus_free < s * HOST_USB_STEP_BYTES) {
+        bus_free = s * HOST_USB_STEP_BYTES;
+    }
+
+    for (uint8_t ep = 1; ep < USB_EPS; ep++) {
+        const struct host_ep *e = &device.in[ep];
+        uint32_t mps = OTG_FS_DIEPCTL(ep) & 0x7FF;
+        bool done = false;
+
+        if (!e->setup || !ep_is_bulk(e)) {
+            continue;
+        }
+        while (!done && bus_free < (s + 1) * HOST_USB_STEP_BYTES &&
+               bus_free + mps + HOST_USB_BULK_OVERHEAD <= end &&
+               host_hw_in_ready(ep, frame_count, false)) {
+            struct host_usb_packet pkt = {
+                .ep    = (uint8_t)(0x80 | ep),
+                .frame = frame_count,
+                .t     = host_hw_now(),
+                .bus   = bus_free,
+                .data  = in_buf,
+            };
+            pkt.len = host_hw_in_take_packet(ep, in_buf, &done);
+            bus_free += pkt.len + HOST_USB_BULK_OVERHEAD;
+            if (done) {
+                pend_xfrc[ep] = true;
+            }
+            if (on_packet) {
+                on_packet(&pkt);
+            }
+        }
+    }
+}
+
+/* An iso IN packet still armed for this frame will not be taken now */
+static void end_of_frame(void)
+{
+    for (uint8_t ep = 1; ep < USB_EPS; ep++) {
+        const struct host_ep *e = &device.in[ep];
+
+        if (e->setup && ep_is_iso(e) && host_hw_in_ready(ep, frame_count, true) &&
+            (OTG_FS_GINTMSK & OTG_GINTMSK_IISOIXFRM)) {
+            OTG_FS_GINTSTS |= OTG_GINTSTS_IISOIXFR;
+        }
+    }
+}
+
+void host_usb_frame(const struct host_usb_frame *f)
+{
+    static const struct host_usb_frame dflt = HOST_USB_FRAME_DEFAULT;
+
+    if (!f) {
+        f = &dflt;
+    }
+
+    for (uint32_t s = 0; s < HOST_USB_STEPS; s++) {
+        host_hw_run(frame_start + (uint64_t)s * HOST_HW_TICKS_PER_MS / HOST_USB_STEPS);
+
+        if (s == 0) {
+            bus_free      = host_usb_periodic_bytes();
+            OTG_FS_DSTS   = (frame_count & 0x3FFF) << 8;
+            TIM_CCR1(TIM2) = host_hw_timer();
+            if (!f->sof_lost) {
+                OTG_FS_GINTSTS |= OTG_GINTSTS_SOF;
+            }
+        }
+        if (s == f->token && device_up) {
+            host_tokens(f);
+        }
+        if (device_up) {
+            host_bulk(s);
+        }
+        if (s == HOST_USB_STEPS - 2 && device_up) {
+            end_of_frame();
+        }
+        if (s >= f->hold) {
+            if (!polled) {
+                service();
+            }
+            if (thread_fn) {
+                thread_fn();
+            }
+        }
+    }
+
+    frame_start += HOST_HW_TICKS_PER_MS;
+    frame_count++;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONTROL                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/* libopencm3's build_config_descriptor() */
+static uint16_t build_config_descriptor(uint8_t *buf, uint16_t len)
+{
+    const struct usb_config_descriptor *cfg = device.config;
+    uint8_t *start = buf;
+    uint16_t count, total = 0, totallen = 0;
+
+#define COPY(src, n)                                \
+    do {                                            \
+        count = MIN(len, (uint16_t)(n));            \
+        memcpy(buf, (src), count);                  \
+        buf += count; len -= count; total += count; \
+        totallen += (uint16_t)(n);                  \
+    } while (0)
+
+    COPY(cfg, cfg->bLength);
+    for (int i = 0; i < cfg->bNumInterfaces; i++) {
+        const struct usb_interface *intf = &cfg->interface[i];
+
+        if (intf->iface_assoc) {
+            COPY(intf->iface_assoc, intf->iface_assoc->bLength);
+        }
+        for (int j = 0; j < intf->num_altsetting; j++) {
+            const struct usb_interface_descriptor *alt = &intf->altsetting[j];
+
+            COPY(alt, alt->bLength);
+            if (alt->extra) {
+                COPY(alt->extra, alt->extralen);
+            }
+            for (int k = 0; k < alt->bNumEndpoints; k++) {
+                const struct usb_endpoint_descriptor *ep = &alt->endpoint[k];
+
+                COPY(ep, ep->bLength);
+                if (ep->extra) {
+                    COPY(ep->extra, ep->extralen);
+                }
+            }
+        }
+    }
+#undef COPY
+
+    if (total >= 4) {
+        start[2] = (uint8_t)totallen;
+        start[3] = (uint8_t)(totallen >> 8);
+    }
+    return total;
+}
+
+/* UTF-16LE string descriptor, index 0 being the language list */
+static uint16_t build_string_descriptor(uint8_t index, uint8_t *buf, uint16_t len)
+{
+    uint8_t d[2 + 2 * 126];
+    uint16_t n;
+
+    if (index == 0) {
+        d[2] = 0x09;
+        d[3] = 0x04;
+        n    = 4;
+    } else {
+        const char *s = device.strings[index - 1];
+
+        n = 2;
+        for (; *s && n < sizeof(d); s++) {
+            d[n++] = (uint8_t)*s;
+            d[n++] = 0;
+        }
+    }
+    d[0] = (uint8_t)n;
+    d[1] = USB_DT_STRING;
+    memcpy(buf, d, MIN(len, n));
+    return MIN(len, n);
+}
+
+static enum usbd_request_return_codes
+standard_device(struct usb_setup_data *req, uint8_t **buf, uint16_t *len)
+{
+    uint8_t type  = (uint8_t)(req->wValue >> 8);
+    uint8_t index = (uint8_t)req->wValue;
+
+    switch (req->bRequest) {
+    case USB_REQ_GET_DESCRIPTOR:
+        if (type == USB_DT_DEVICE) {
+            *buf = (uint8_t *)(uintptr_t)device.desc;
+            *len = MIN(*len, device.desc->bLength);
+            return USBD_REQ_HANDLED;
+        }
+        /*
+         * libopencm3 builds these straight into the control buffer for
+         * up to wLength bytes, without checking its size
+         */
+        if (type == USB_DT_CONFIGURATION && index == 0) {
+            *len = build_config_descriptor(scratch, MIN(*len, sizeof(scratch)));
+        } else if (type == USB_DT_STRING && index <= device.num_strings) {
+            *len = build_string_descriptor(index, scratch, MIN(*len, sizeof(scratch)));
+        } else {
+            return USBD_REQ_NOTSUPP;
+        }
+        if (*len > device.ctrl_buf_len) {
+            fprintf(stderr, "host_usb: descriptor 0x%04x: %u bytes overflow "
+                    "the %u-byte control buffer\n", req->wValue, *len,
+                    device.ctrl_buf_len);
+            abort();
+        }
+        memcpy(*buf, scratch, *len);
+        return USBD_REQ_HANDLED;
+
+    case USB_REQ_SET_ADDRESS:
+        device.current_address = (uint8_t)req->wValue;
+        return USBD_REQ_HANDLED;
+
+    case USB_REQ_SET_CONFIGURATION:
+        if (req->wValue > 1) {
+            return USBD_REQ_NOTSUPP;
+        }
+        if (req->wValue != device.current_config) {
+            for (int i = 0; i < device.config->bNumInterfaces; i++) {
+                if (device.config->interface[i].cur_altsetting) {
+                    *device.config->interface[i].cur_altsetting = 0;
+                }
+            }
+        }
+        device.current_config = (uint8_t)req->wValue;
+
+        /* ep_reset(): everything but EP0 comes down */
+        memset(&device.in[1], 0, sizeof(device.in) - sizeof(device.in[0]));
+        memset(&device.out[1], 0, sizeof(device.out) - sizeof(device.out[0]));
+
+        if (device.user_callback_set_config[0]) {
+            for (int i = 0; i < MAX_USER_CONTROL_CALLBACK; i++) {
+                device.user_control_callback[i].cb = NULL;
+            }
+            for (int i = 0; i < MAX_USER_SET_CONFIG_CALLBACK; i++) {
+                if (device.user_callback_set_config[i]) {
+                    device.user_callback_set_config[i](&device, req->wValue);
+                }
+            }
+        }
+        *len = 0;
+        return USBD_REQ_HANDLED;
+
+    case USB_REQ_GET_CONFIGURATION:
+        (*buf)[0] = device.current_config;
+        *len = MIN(*len, 1);
+        return USBD_REQ_HANDLED;
+
+    case USB_REQ_GET_STATUS:
+        (*buf)[0] = 0;
+        (*buf)[1] = 0;
+        *len = MIN(*len, 2);
+        return USBD_REQ_HANDLED;
+    }
+    return USBD_REQ_NOTSUPP;
+}
+
+static enum usbd_request_return_codes
+standard_interface(struct usb_setup_data *req, uint8_t **buf, uint16_t *len)
+{
+    const struct usb_interface *intf;
+
+    if (!device.current_config || req->wIndex >= device.config->bNumInterfaces) {
+        return USBD_REQ_NOTSUPP;
+    }
+    intf = &device.config->interface[req->wIndex];
+
+    switch (req->bRequest) {
+    case USB_REQ_SET_INTERFACE:
+        if (req->wValue >= intf->num_altsetting) {
+            return USBD_REQ_NOTSUPP;
+        }
+        if (intf->cur_altsetting) {
+            *intf->cur_altsetting = (uint8_t)req->wValue;
+        } else if (req->wValue > 0) {
+            return USBD_REQ_NOTSUPP;
+        }
+        if (device.user_callback_set_altsetting) {
+            device.user_callback_set_altsetting(&device, req->wIndex, req->wValue);
+        }
+        *len = 0;
+        return USBD_REQ_HANDLED;
+
+    case USB_REQ_GET_INTERFACE:
+        (*buf)[0] = intf->cur_altsetting ? *intf->cur_altsetting : 0;
+        *len = MIN(*len, 1);
+        return USBD_REQ_HANDLED;
+
+    case USB_REQ_GET_STATUS:
+        (*buf)[0] = 0;
+        (*buf)[1] = 0;
+        *len = MIN(*len, 2);
+        return USBD_REQ_HANDLED;
+    }
+    return USBD_REQ_NOTSUPP;
+}
+
+/* usb_control_request_dispatch(): user callbacks, then the standard ones */
+static enum usbd_request_return_codes
+dispatch(struct usb_setup_data *req, uint8_t **buf, uint16_t *len,
+         usbd_control_complete_callback *complete)
+{
+    for (int i = 0; i < MAX_USER_CONTROL_CALLBACK; i++) {
+        enum usbd_request_return_codes r;
+
+        if (!device.user_control_callback[i].cb) {
+            break;
+        }
+        if ((req->bmRequestType & device.user_control_callback[i].type_mask) !=
+            device.user_control_callback[i].type) {
+            continue;
+        }
+        r = device.user_control_callback[i].cb(&device, req, buf, len, complete);
+        if (r == USBD_REQ_HANDLED || r == USBD_REQ_NOTSUPP) {
+            return r;
+        }
+    }
+
+    if ((req->bmRequestType & USB_REQ_TYPE_TYPE) != USB_REQ_TYPE_STANDARD) {
+        return USBD_REQ_NOTSUPP;
+    }
+    switch (req->bmRequestType & USB_REQ_TYPE_RECIPIENT) {
+    case USB_REQ_TYPE_DEVICE:
+        return standard_device(req, buf, len);
+    case USB_REQ_TYPE_INTERFACE:
+        return standard_interface(req, buf, len);
+    case USB_REQ_TYPE_ENDPOINT:
+        *len = 0;
+        return USBD_REQ_HANDLED;
+    }
+    return USBD_REQ_NOTSUPP;
+}
+
+int host_usb_control(uint8_t type, uint8_t request, uint16_t value,
+                     uint16_t index, void *data, uint16_t length)
+{
+    struct usb_setup_data req = { type, request, value, index, length };
+    usbd_control_complete_callback complete = NULL;
+    uint8_t *buf = device.ctrl_buf;
+    uint16_t len = length;
+    bool in = (type & USB_REQ_TYPE_IN) != 0;
+
+    if (!device_up) {
+        return -1;
+    }
+    /* The OUT data stage lands in the control buffer */
+    if (!in && length) {
+        if (length > device.ctrl_buf_len) {
+            return -1;
+        }
+        memcpy(buf, data, length);
+    }
+
+    if (dispatch(&req, &buf, &len, &complete) != USBD_REQ_HANDLED) {
+        return -1;
+    }
+
+    if (in) {
+        len = MIN(len, length);
+        memcpy(data, buf, len);
+    } else {
+        len = length;
+    }
+    if (complete) {
+        complete(&device, &req);
+    }
+    return len;
+}
+
+void host_usb_bus_reset(void)
+{
+    if (!device_up) {
+        return;
+    }
+    device.current_address = 0;
+    device.current_config  = 0;
+    memset(&device.in[1], 0, sizeof(device.in) - sizeof(device.in[0]));
+    memset(&device.out[1], 0, sizeof(device.out) - sizeof(device.out[0]));
+    if (device.user_callback_reset) {
+        device.user_callback_reset();
+    }
+}
+
+void host_usb_bus_suspend(void)
+{
+    if (device_up && device.user_callback_suspend) {
+        device.user_callback_suspend();
+    }
+}
+
+void host_usb_bus_resume(void)
+{
+    if (device_up && device.user_callback_resume) {
+        device.user_callback_resume();
+    }
+}
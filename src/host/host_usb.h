@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libopencm3/usb/usbd.h>
+
+/*
+ * Host libopencm3 usbd (host/include/libopencm3/usb/usbd.h) and the bus
+ * around it.
+ *
+ * The device side is libopencm3's: descriptors and callbacks as given to
+ * usbd_init() and friends, control requests dispatched through the
+ * registered callbacks before the standard ones (SET_CONFIGURATION drops
+ * the control callbacks and calls the set-config ones, GET_DESCRIPTOR
+ * serialises the configuration the same way), and endpoint writes going
+ * through the OTG register model (host_hw.h) as in the dwc driver.
+ *
+ * The host side runs frame by frame in simulated time. Each frame is cut
+ * into HOST_USB_STEPS steps: the SOF at step 0 (latching TIM2 CCR1), the
+ * host's IN/OUT tokens at one step, and the end-of-frame check raising
+ * the incomplete iso IN interrupt two steps before the next SOF. Pending
+ * interrupts are serviced at every step unless held off, in the order of
+ * main.c's otg_fs_isr(): incomplete IN, then usbd_poll() (OUT, IN
+ * complete, SOF); thread-mode work runs after them. Polled builds take no
+ * interrupt: the thread-mode loop services the core with host_usb_poll().
+ *
+ * Bus time is counted in full-speed byte times from the SOF, a step's
+ * worth each step. As the host's schedule does, every frame starts with
+ * the periodic slots: each iso endpoint of the current alternate settings
+ * gets its wMaxPacketSize, whether it is used or not, and the device sees
+ * its token at the token step. Bulk IN endpoints get the rest of the frame
+ * up to the end-of-frame check, a max-size packet at a time while the bus
+ * has caught up with the step; a transfer's last packet ends the
+ * endpoint's turn until the next step.
+ */
+
+#define HOST_USB_STEPS     100
+#define HOST_USB_NO_TOKEN  UINT32_MAX
+
+/* 12 Mb/s; protocol overhead per transaction as USB 2.0 table 5-4 and 5-9 */
+#define HOST_USB_FRAME_BYTES    1500
+#define HOST_USB_STEP_BYTES     (HOST_USB_FRAME_BYTES / HOST_USB_STEPS)
+#define HOST_USB_ISO_OVERHEAD   9
+#define HOST_USB_BULK_OVERHEAD  13
+
+struct host_usb_frame {
+    uint32_t    token;      /* step of the host's tokens, or HOST_USB_NO_TOKEN */
+    uint32_t    hold;       /* interrupts held off until this step */
+    bool        sof_lost;   /* no SOF interrupt (the frame number moves on) */
+    const void *out;        /* OUT packet for out_ep at the token, if any */
+    uint16_t    out_len;
+    uint8_t     out_ep;
+};
+
+/* Token half way through, nothing held */
+#define HOST_USB_FRAME_DEFAULT  { HOST_USB_STEPS / 2, 0, false, NULL, 0, 0 }
+
+/* One IN transfer the host took: iso, or one packet of a bulk transfer */
+struct host_usb_packet {
+    uint8_t        ep;          /* with the direction bit */
+    uint32_t       frame;       /* host frame count, not wrapped */
+    uint64_t       t;           /* host_hw_now() at the token's step */
+    uint32_t       bus;         /* byte times from the SOF to the transaction */
+    uint16_t       len;
+    const uint8_t *data;
+};
+
+typedef void (*host_usb_packet_fn)(const struct host_usb_packet *pkt);
+
+/* Called for every IN transfer the host takes; NULL to stop */
+void host_usb_on_packet(host_usb_packet_fn fn);
+
+/* main.c's usb_iso_incomplete(), and its thread-mode loop */
+void host_usb_set_incomplete(void (*fn)(void));
+void host_usb_set_thread(void (*fn)(void));
+
+/* USB_POLLED: no OTG interrupt, the thread loop calls host_usb_poll() */
+void host_usb_set_polled(bool polled);
+void host_usb_poll(void);
+
+void host_usb_reset(void);
+
+/* The device usbd_init() returned, NULL before */
+usbd_device *host_usb_device(void);
+
+/* Run one frame; NULL for HOST_USB_FRAME_DEFAULT */
+void host_usb_frame(const struct host_usb_frame *f);
+
+/* Frames run so far (the SOF frame number before wrapping) */
+uint32_t host_usb_frame_count(void);
+
+/* Byte times the periodic slots take at the start of every frame */
+uint32_t host_usb_periodic_bytes(void);
+
+/*
+ * Control transfer: data is the OUT data stage or receives the IN one.
+ * Returns the bytes transferred, or -1 for a stall.
+ */
+int host_usb_control(uint8_t type, uint8_t request, uint16_t value,
+                     uint16_t index, void *data, uint16_t length);
+
+/* Bus reset (address and configuration 0), suspend, resume */
+void host_usb_bus_reset(void);
+void host_usb_bus_suspend(void);
+void host_usb_bus_resume(void);
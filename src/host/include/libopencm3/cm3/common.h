@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host stand-in for libopencm3's common.h: every MMIO32() access goes
+ * through the register model in host/host_hw.c, which keeps the bits the
+ * firmware polls (endpoint disable, FIFO flush, timers) moving.
+ */
+volatile uint32_t *host_mmio32(uint32_t addr);
+
+#define MMIO32(addr)  (*host_mmio32((uint32_t)(addr)))
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+/* One thread of execution on the host: masking is a no-op */
+static inline void cm_enable_interrupts(void)
+{
+}
+
+static inline void cm_disable_interrupts(void)
+{
+}
+
+static inline bool cm_is_masked_interrupts(void)
+{
+    return false;
+}
+
+static inline uint32_t cm_mask_interrupts(uint32_t mask)
+{
+    return mask;
+}
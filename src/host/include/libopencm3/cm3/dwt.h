@@ -0,0 +1,10 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define DWT_BASE    0xE0001000u
+#define DWT_CTRL    MMIO32(DWT_BASE + 0x00)
+#define DWT_CYCCNT  MMIO32(DWT_BASE + 0x04)
+
+bool dwt_enable_cycle_counter(void);
+uint32_t dwt_read_cycle_counter(void);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define NVIC_DMA1_STREAM0_IRQ  11
+#define NVIC_DMA1_STREAM3_IRQ  14
+#define NVIC_DMA1_STREAM4_IRQ  15
+#define NVIC_DMA1_STREAM5_IRQ  16
+#define NVIC_TIM2_IRQ          28
+#define NVIC_OTG_FS_IRQ        67
+
+void nvic_enable_irq(uint8_t irqn);
+void nvic_disable_irq(uint8_t irqn);
+void nvic_set_priority(uint8_t irqn, uint8_t priority);
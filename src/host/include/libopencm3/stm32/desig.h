@@ -0,0 +1,6 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+/* 96-bit unique device ID, least significant word first */
+void desig_get_unique_id(uint32_t *result);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define DMA1  0x40026000u
+#define DMA2  0x40026400u
+
+#define DMA_STREAM0  0
+#define DMA_STREAM2  2
+#define DMA_STREAM3  3
+#define DMA_STREAM4  4
+#define DMA_STREAM5  5
+
+#define DMA_SCR(port, n)    MMIO32((port) + 0x10 + 0x18 * (n))
+#define DMA_SxNDTR(port, n) MMIO32((port) + 0x14 + 0x18 * (n))
+
+#define DMA_SxCR_EN                     (1u << 0)
+#define DMA_SxCR_DIR_PERIPHERAL_TO_MEM  (0u << 6)
+#define DMA_SxCR_DIR_MEM_TO_PERIPHERAL  (1u << 6)
+#define DMA_SxCR_PSIZE_16BIT            (1u << 11)
+#define DMA_SxCR_MSIZE_16BIT            (1u << 13)
+#define DMA_SxCR_PL_HIGH                (2u << 16)
+#define DMA_SxCR_PL_VERY_HIGH           (3u << 16)
+#define DMA_SxCR_CHSEL_0                (0u << 25)
+#define DMA_SxCR_CHSEL_2                (2u << 25)
+#define DMA_SxCR_CHSEL_3                (3u << 25)
+
+#define DMA_TEIF  (1u << 3)
+#define DMA_HTIF  (1u << 4)
+#define DMA_TCIF  (1u << 5)
+
+void dma_stream_reset(uint32_t dma, uint8_t stream);
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t stream,
+                               uint32_t interrupts);
+bool dma_get_interrupt_flag(uint32_t dma, uint8_t stream, uint32_t interrupt);
+void dma_channel_select(uint32_t dma, uint8_t stream, uint32_t channel);
+void dma_set_transfer_mode(uint32_t dma, uint8_t stream, uint32_t direction);
+void dma_set_priority(uint32_t dma, uint8_t stream, uint32_t prio);
+void dma_set_memory_size(uint32_t dma, uint8_t stream, uint32_t mem_size);
+void dma_set_peripheral_size(uint32_t dma, uint8_t stream,
+                             uint32_t peripheral_size);
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t stream);
+void dma_enable_circular_mode(uint32_t dma, uint8_t stream);
+void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t stream);
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t stream);
+void dma_set_peripheral_address(uint32_t dma, uint8_t stream, uint32_t address);
+void dma_set_memory_address(uint32_t dma, uint8_t stream, uint32_t address);
+void dma_set_number_of_data(uint32_t dma, uint8_t stream, uint16_t number);
+void dma_enable_stream(uint32_t dma, uint8_t stream);
+void dma_disable_stream(uint32_t dma, uint8_t stream);
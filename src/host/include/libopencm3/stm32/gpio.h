@@ -0,0 +1,45 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define GPIOA  0x40020000u
+#define GPIOB  0x40020400u
+#define GPIOC  0x40020800u
+
+#define GPIO0   (1u << 0)
+#define GPIO1   (1u << 1)
+#define GPIO3   (1u << 3)
+#define GPIO4   (1u << 4)
+#define GPIO5   (1u << 5)
+#define GPIO7   (1u << 7)
+#define GPIO9   (1u << 9)
+#define GPIO10  (1u << 10)
+#define GPIO11  (1u << 11)
+#define GPIO12  (1u << 12)
+#define GPIO13  (1u << 13)
+#define GPIO14  (1u << 14)
+#define GPIO15  (1u << 15)
+
+#define GPIO_MODE_INPUT   0
+#define GPIO_MODE_OUTPUT  1
+#define GPIO_MODE_AF      2
+#define GPIO_MODE_ANALOG  3
+
+#define GPIO_PUPD_NONE    0
+
+#define GPIO_OTYPE_PP     0
+#define GPIO_OSPEED_50MHZ   2
+#define GPIO_OSPEED_100MHZ  3
+
+#define GPIO_AF5   5
+#define GPIO_AF6   6
+#define GPIO_AF10  10
+
+void gpio_mode_setup(uint32_t gpioport, uint8_t mode, uint8_t pull_up_down,
+                     uint16_t gpios);
+void gpio_set_output_options(uint32_t gpioport, uint8_t otype, uint8_t speed,
+                             uint16_t gpios);
+void gpio_set_af(uint32_t gpioport, uint8_t alt_func_num, uint16_t gpios);
+void gpio_set(uint32_t gpioport, uint16_t gpios);
+void gpio_clear(uint32_t gpioport, uint16_t gpios);
+void gpio_toggle(uint32_t gpioport, uint16_t gpios);
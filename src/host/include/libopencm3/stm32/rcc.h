@@ -0,0 +1,78 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define RCC_BASE        0x40023800u
+#define RCC_CR          MMIO32(RCC_BASE + 0x00)
+#define RCC_PLLI2SCFGR  MMIO32(RCC_BASE + 0x84)
+#define RCC_AHB1LPENR   MMIO32(RCC_BASE + 0x50)
+#define RCC_APB1LPENR   MMIO32(RCC_BASE + 0x60)
+
+#define RCC_CR_PLLI2SON   (1u << 26)
+#define RCC_CR_PLLI2SRDY  (1u << 27)
+
+#define RCC_PLLI2SCFGR_PLLI2SM_SHIFT  0
+#define RCC_PLLI2SCFGR_PLLI2SN_SHIFT  6
+#define RCC_PLLI2SCFGR_PLLI2SR_SHIFT  28
+
+#define RCC_CFGR_SW_HSE         1
+#define RCC_CFGR_SW_PLL         2
+#define RCC_CFGR_HPRE_NODIV     0
+#define RCC_CFGR_HPRE_DIV2      8
+#define RCC_CFGR_HPRE_DIV4      9
+
+struct rcc_clock_scale {
+    uint8_t  pllm;
+    uint16_t plln;
+    uint8_t  pllp;
+    uint8_t  pllq;
+    uint8_t  pllr;
+    uint8_t  pll_source;
+    uint32_t flash_config;
+    uint8_t  hpre;
+    uint8_t  ppre1;
+    uint8_t  ppre2;
+    int      voltage_scale;
+    uint32_t ahb_frequency;
+    uint32_t apb1_frequency;
+    uint32_t apb2_frequency;
+};
+
+enum rcc_clock_3v3 {
+    RCC_CLOCK_3V3_84MHZ,
+    RCC_CLOCK_3V3_96MHZ,
+    RCC_CLOCK_3V3_END,
+};
+
+extern const struct rcc_clock_scale rcc_hse_25mhz_3v3[RCC_CLOCK_3V3_END];
+extern uint32_t rcc_ahb_frequency;
+extern uint32_t rcc_apb1_frequency;
+extern uint32_t rcc_apb2_frequency;
+
+enum rcc_osc {
+    RCC_HSI,
+    RCC_HSE,
+    RCC_PLL,
+};
+
+enum rcc_periph_clken {
+    RCC_GPIOA, RCC_GPIOB, RCC_GPIOC,
+    RCC_DMA1, RCC_DMA2,
+    RCC_TIM2,
+    RCC_SPI1, RCC_SPI2, RCC_SPI3, RCC_SPI5,
+    RCC_OTGFS,
+};
+
+enum rcc_periph_rst {
+    RST_SPI1, RST_SPI2, RST_SPI3, RST_SPI5,
+    RST_OTGFS,
+};
+
+void rcc_clock_setup_pll(const struct rcc_clock_scale *clock);
+void rcc_osc_on(enum rcc_osc osc);
+void rcc_wait_for_osc_ready(enum rcc_osc osc);
+void rcc_set_sysclk_source(uint32_t clk);
+void rcc_set_hpre(uint32_t hpre);
+void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+void rcc_periph_clock_disable(enum rcc_periph_clken clken);
+void rcc_periph_reset_pulse(enum rcc_periph_rst rst);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define SPI2  0x40003800u
+#define SPI3  0x40003C00u
+#define SPI1  0x40013000u
+#define SPI5  0x40015000u
+
+#define SPI_CR2(spi)      MMIO32((spi) + 0x04)
+#define SPI_DR(spi)       MMIO32((spi) + 0x0C)
+#define SPI_I2SCFGR(spi)  MMIO32((spi) + 0x1C)
+#define SPI_I2SPR(spi)    MMIO32((spi) + 0x20)
+
+#define SPI_CR2_RXDMAEN   (1u << 0)
+#define SPI_CR2_TXDMAEN   (1u << 1)
+
+#define SPI_I2SCFGR_CHLEN                   (1u << 0)
+#define SPI_I2SCFGR_DATLEN_LSB              1
+#define SPI_I2SCFGR_DATLEN_16BIT            0x0
+#define SPI_I2SCFGR_DATLEN_24BIT            0x1
+#define SPI_I2SCFGR_DATLEN_32BIT            0x2
+#define SPI_I2SCFGR_CKPOL                   (1u << 3)
+#define SPI_I2SCFGR_I2SSTD_LSB              4
+#define SPI_I2SCFGR_I2SSTD_I2S_PHILIPS      0x0
+#define SPI_I2SCFGR_I2SSTD_PCM              0x3
+#define SPI_I2SCFGR_PCMSYNC                 (1u << 7)
+#define SPI_I2SCFGR_I2SCFG_LSB              8
+#define SPI_I2SCFGR_I2SCFG_SLAVE_TRANSMIT   0x0
+#define SPI_I2SCFGR_I2SCFG_SLAVE_RECEIVE    0x1
+#define SPI_I2SCFGR_I2SCFG_MASTER_TRANSMIT  0x2
+#define SPI_I2SCFGR_I2SCFG_MASTER_RECEIVE   0x3
+#define SPI_I2SCFGR_I2SE                    (1u << 10)
+#define SPI_I2SCFGR_I2SMOD                  (1u << 11)
+
+#define SPI_I2SPR_ODD    (1u << 8)
+#define SPI_I2SPR_MCKOE  (1u << 9)
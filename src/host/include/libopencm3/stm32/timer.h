@@ -0,0 +1,41 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define TIM2  0x40000000u
+#define TIM5  0x40000C00u
+
+#define TIM_SR(tim)    MMIO32((tim) + 0x10)
+#define TIM_CNT(tim)   MMIO32((tim) + 0x24)
+#define TIM_CCR1(tim)  MMIO32((tim) + 0x34)
+
+#define TIM_SR_CC1IF    (1u << 1)
+#define TIM_SR_CC1OF    (1u << 9)
+#define TIM_DIER_CC1IE  (1u << 1)
+
+#define TIM_SMCR_TS_ITR1             (0x1u << 4)
+#define TIM2_OR_ITR1_RMP_OTG_FS_SOF  (0x2u << 10)
+
+enum tim_ic_id {
+    TIM_IC1,
+    TIM_IC2,
+    TIM_IC3,
+    TIM_IC4,
+};
+
+enum tim_ic_input {
+    TIM_IC_OUT,
+    TIM_IC_IN_TI1,
+    TIM_IC_IN_TI2,
+    TIM_IC_IN_TRC,
+};
+
+void timer_set_prescaler(uint32_t timer_peripheral, uint32_t value);
+void timer_set_period(uint32_t timer_peripheral, uint32_t period);
+void timer_set_option(uint32_t timer_peripheral, uint32_t option);
+void timer_slave_set_trigger(uint32_t timer_peripheral, uint8_t trigger);
+void timer_ic_set_input(uint32_t timer_peripheral, enum tim_ic_id ic,
+                        enum tim_ic_input in);
+void timer_ic_enable(uint32_t timer_peripheral, enum tim_ic_id ic);
+void timer_enable_counter(uint32_t timer_peripheral);
+void timer_disable_counter(uint32_t timer_peripheral);
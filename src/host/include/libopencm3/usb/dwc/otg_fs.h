@@ -0,0 +1,37 @@
+#pragma once
+
+#include <libopencm3/cm3/common.h>
+
+#define USB_OTG_FS_BASE  0x50000000u
+
+#define OTG_FS_GRSTCTL     MMIO32(USB_OTG_FS_BASE + 0x010)
+#define OTG_FS_GINTSTS     MMIO32(USB_OTG_FS_BASE + 0x014)
+#define OTG_FS_GINTMSK     MMIO32(USB_OTG_FS_BASE + 0x018)
+#define OTG_FS_DSTS        MMIO32(USB_OTG_FS_BASE + 0x808)
+#define OTG_FS_DIEPCTL(x)  MMIO32(USB_OTG_FS_BASE + 0x900 + 0x20 * (x))
+#define OTG_FS_DIEPINT(x)  MMIO32(USB_OTG_FS_BASE + 0x908 + 0x20 * (x))
+#define OTG_FS_DIEPTSIZ(x) MMIO32(USB_OTG_FS_BASE + 0x910 + 0x20 * (x))
+#define OTG_FS_DTXFSTS(x)  MMIO32(USB_OTG_FS_BASE + 0x918 + 0x20 * (x))
+#define OTG_FS_PCGCCTL     MMIO32(USB_OTG_FS_BASE + 0xE00)
+#define OTG_FS_FIFO(x)     MMIO32(USB_OTG_FS_BASE + 0x1000 * ((x) + 1))
+
+#define OTG_GRSTCTL_TXFFLSH    (1u << 5)
+
+#define OTG_GINTSTS_SOF        (1u << 3)
+#define OTG_GINTSTS_USBSUSP    (1u << 11)
+#define OTG_GINTSTS_IISOIXFR   (1u << 20)
+#define OTG_GINTSTS_WKUPINT    (1u << 31)
+
+#define OTG_GINTMSK_SOFM       (1u << 3)
+#define OTG_GINTMSK_IISOIXFRM  (1u << 20)
+
+#define OTG_DSTS_FNSOF_MASK    (0x3FFFu << 8)
+
+#define OTG_DIEPCTL0_CNAK      (1u << 26)
+#define OTG_DIEPCTL0_SNAK      (1u << 27)
+#define OTG_DIEPCTL0_EPDIS     (1u << 30)
+#define OTG_DIEPCTL0_EPENA     (1u << 31)
+
+#define OTG_DIEPSIZ0_PKTCNT    (1u << 19)
+
+#define OTG_PCGCCTL_STPPCLK    (1u << 0)
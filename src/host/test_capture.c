@@ -0,0 +1,137 @@
+/*
+ * Capture DMA halves into the sample ring (audio_capture.h).
+ *
+ * The synthetic DMA (host_capture.h) runs each format row at each of its
+ * rates for CAPTURE_MS, with the ring drained every quarter frame and with
+ * the ISR held off for several halves at a time (host_hw_run() then fires
+ * every event it passed, in order, as a late ISR would find them). Every
+ * half must come out as exactly one block: blocks counted equal DMA
+ * events, no ring overruns, and the frames read equal blocks times the
+ * block size. Rows that stream the mic rate unconverted from I2S carry a
+ * per-channel counter, which must come out without a gap or a repeat.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "audio_capture.h"
+#include "audio_format.h"
+#include "audio_ring.h"
+#include "host_hw.h"
+#include "host_capture.h"
+#include "host_test.h"
+
+#define CAPTURE_MS   500
+#define LATE_EVERY   50     /* ms between late ISRs */
+#define LATE_MS      2      /* ... and how long they are held off */
+
+static int32_t counter(uint32_t ch, uint64_t n)
+{
+    /* 24-bit, low byte clear so 16-bit rows carry it whole */
+    return (int32_t)((((uint32_t)n + ch * 1000u) & 0xFFFFu) << 8) - 0x800000;
+}
+
+static int32_t subframe(const uint8_t *p, uint8_t bytes)
+{
+    uint32_t v = 0;
+
+    for (uint8_t i = 0; i < bytes; i++) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    /* Sign-extend from the container, then back to 24 bits */
+    v <<= 32 - 8 * bytes;
+    return (int32_t)v >> 8;
+}
+
+struct reader {
+    const struct audio_stream_cfg *cfg;
+    bool     exact;
+    uint64_t frames;
+    uint32_t gaps;
+};
+
+static void drain(struct reader *rd)
+{
+    struct audio_ring *ring = audio_capture_ring();
+    uint8_t frame[AUDIO_MAX_FRAME_BYTES];
+
+    while (audio_ring_read(ring, frame, rd->cfg->frame_bytes)) {
+        if (rd->exact) {
+            for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+                int32_t want = counter(ch, rd->frames);
+                int32_t got  = subframe(frame + ch * rd->cfg->subframe_bytes,
+                                        rd->cfg->subframe_bytes);
+
+                if (rd->cfg->subframe_bytes == 2) {
+                    want &= ~0xFF;
+                }
+                if (got != want && !rd->gaps++) {
+                    fprintf(stderr, "frame %llu ch %u: 0x%06x, want 0x%06x\n",
+                            (unsigned long long)rd->frames, ch,
+                            (unsigned)got & 0xFFFFFF, (unsigned)want & 0xFFFFFF);
+                }
+            }
+        }
+        rd->frames++;
+    }
+}
+
+static void run_row(const struct audio_format *fmt, uint32_t rate)
+{
+    struct audio_stream_cfg cfg;
+    struct audio_capture_stats cs;
+    struct host_capture_stats hs;
+    struct reader rd = { &cfg, false, 0, 0 };
+
+    audio_format_make_cfg(fmt, rate, &cfg);
+    rd.exact = !AUDIO_MIC_PDM && cfg.capture_hz == cfg.rate_hz;
+
+    host_hw_reset();
+    host_capture_reset();
+    host_capture_set_source(counter);
+    audio_capture_start(&cfg);
+
+    uint64_t t = 0;
+    for (uint32_t ms = 0; ms < CAPTURE_MS; ms++) {
+        if (ms % LATE_EVERY == LATE_EVERY - 1) {
+            t += LATE_MS * HOST_HW_TICKS_PER_MS;
+            host_hw_run(t);
+            drain(&rd);
+            ms += LATE_MS - 1;
+            continue;
+        }
+        for (uint32_t q = 0; q < 4; q++) {
+            t += HOST_HW_TICKS_PER_MS / 4;
+            host_hw_run(t);
+            drain(&rd);
+        }
+    }
+    audio_capture_stop();
+
+    audio_capture_get_stats(&cs, 0);
+    host_capture_get_stats(&hs);
+
+    CHECKF(hs.events >= CAPTURE_MS - 1, "alt %u %u Hz: %u DMA events",
+           fmt->alt, rate, hs.events);
+    CHECKF(cs.blocks == hs.events, "alt %u %u Hz: %u blocks for %u events",
+           fmt->alt, rate, cs.blocks, hs.events);
+    CHECKF(cs.ring.overruns == 0, "alt %u %u Hz: %u overruns",
+           fmt->alt, rate, cs.ring.overruns);
+    CHECKF(rd.frames == (uint64_t)cs.blocks * cfg.samples_per_frame,
+           "alt %u %u Hz: %llu frames from %u blocks", fmt->alt, rate,
+           (unsigned long long)rd.frames, cs.blocks);
+    CHECKF(rd.gaps == 0, "alt %u %u Hz: %u bad samples", fmt->alt, rate, rd.gaps);
+}
+
+int main(void)
+{
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        const struct audio_format *fmt = audio_format_for_alt(alt);
+
+        for (uint32_t r = 0; r < fmt->num_rates; r++) {
+            run_row(fmt, fmt->rates[r]);
+        }
+    }
+    return host_test_result("capture");
+}
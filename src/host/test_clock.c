@@ -0,0 +1,360 @@
+/*
+ * Sampling rate requests over the control pipe, UAC1 or UAC2 as built.
+ *
+ * UAC2 asks the Clock Source: SAM_FREQ RANGE must list the union of the
+ * format table's rates as discrete subranges, and the clock descriptor
+ * must offer SAM_FREQ read / write. UAC1 asks the streaming endpoint:
+ * each alt's Type I format descriptor must list that alt's rates and the
+ * class endpoint descriptor must offer the sampling frequency control.
+ *
+ * Against those offered rates: every one is taken by SET_CUR and read
+ * back by GET_CUR while idle, anything else (or a short data stage)
+ * stalls and leaves the rate alone. Then each alt streams at each of its
+ * rates, selected before the alt and switched while it runs, and the
+ * packets must carry that rate; a rate only other alts have stalls
+ * mid-stream and the stream keeps going as it was.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <libopencm3/usb/usbstd.h>
+
+#include "audio_format.h"
+#include "audio_stream.h"
+#include "usb_audio_uac2.h"
+#include "usb_descriptors.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define REQ_IN_DEVICE  (USB_REQ_TYPE_IN | USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_DEVICE)
+
+#if AUDIO_UAC2
+#define REQ_SET        (USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE)
+#define RATE_BYTES     4
+#else
+#define REQ_SET        (USB_REQ_TYPE_CLASS | USB_REQ_TYPE_ENDPOINT)
+#define RATE_BYTES     3
+#endif
+#define REQ_GET        (REQ_SET | USB_REQ_TYPE_IN)
+
+#define MAX_RATES      (AUDIO_NUM_FORMATS * AUDIO_MAX_RATES)
+#define STREAM_FRAMES  100
+#define STREAM_SETTLE  20
+
+static uint32_t offered[MAX_RATES];
+static unsigned num_offered;
+
+static uint8_t  config[1024];
+static uint16_t config_len;
+
+/* Samples per IN packet in the current stream_check(), past the settle */
+static uint32_t frames_run, pkt_min, pkt_max, pkts;
+static uint16_t frame_bytes;
+
+static uint32_t get_le(const uint8_t *p, unsigned n)
+{
+    uint32_t v = 0;
+
+    while (n--) {
+        v = v << 8 | p[n];
+    }
+    return v;
+}
+
+static void put_le(uint8_t *p, uint32_t v, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++, v >>= 8) {
+        p[i] = (uint8_t)v;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* REQUESTS                                                                   */
+/* -------------------------------------------------------------------------- */
+
+static int rate_request(uint8_t type, uint8_t request, uint8_t cs,
+                        uint8_t *data, uint16_t len)
+{
+#if AUDIO_UAC2
+    return host_usb_control(type, request, (uint16_t)(cs << 8),
+                            AUDIO_CLOCK_SOURCE_ID << 8 | IFACE_AUDIO_CONTROL,
+                            data, len);
+#else
+    return host_usb_control(type, request, (uint16_t)(cs << 8),
+                            EP_AUDIO_IN, data, len);
+#endif
+}
+
+#if AUDIO_UAC2
+#define SET_CUR  USB_AUDIO2_REQ_CUR
+#define GET_CUR  USB_AUDIO2_REQ_CUR
+#define SAM_FREQ USB_AUDIO2_CS_SAM_FREQ
+#else
+#define SET_CUR  USB_AUDIO_REQ_SET_CUR
+#define GET_CUR  USB_AUDIO_REQ_GET_CUR
+#define SAM_FREQ USB_AUDIO_EP_CS_SAMPLING_FREQ
+#endif
+
+/* SET_CUR with len bytes of data; false on a stall */
+static bool set_rate(uint32_t hz, uint16_t len)
+{
+    uint8_t d[4];
+
+    put_le(d, hz, sizeof(d));
+    return rate_request(REQ_SET, SET_CUR, SAM_FREQ, d, len) == len;
+}
+
+static uint32_t get_rate(void)
+{
+    uint8_t d[RATE_BYTES];
+    int n = rate_request(REQ_GET, GET_CUR, SAM_FREQ, d, sizeof(d));
+
+    CHECKF(n == RATE_BYTES, "GET_CUR sent %d bytes", n);
+    return n == RATE_BYTES ? get_le(d, RATE_BYTES) : 0;
+}
+
+static bool is_offered(uint32_t hz)
+{
+    for (unsigned i = 0; i < num_offered; i++) {
+        if (offered[i] == hz) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* -------------------------------------------------------------------------- */
+/* OFFERED RATES                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void fetch_config(void)
+{
+    int n = host_usb_control(REQ_IN_DEVICE, USB_REQ_GET_DESCRIPTOR,
+                             USB_DT_CONFIGURATION << 8, 0, config, sizeof(config));
+
+    CHECK(n > USB_DT_CONFIGURATION_SIZE);
+    config_len = n > 0 ? (uint16_t)n : 0;
+}
+
+static void add_offered(uint32_t hz)
+{
+    if (!is_offered(hz) && num_offered < MAX_RATES) {
+        offered[num_offered++] = hz;
+    }
+}
+
+#if AUDIO_UAC2
+static void find_offered(void)
+{
+    uint8_t  d[USB_AUDIO2_RANGE_SIZE(MAX_RATES, 4)];
+    bool     clock_rw = false;
+    uint32_t last = 0;
+
+    for (uint16_t at = 0; at + 2 <= config_len && config[at] >= 2; at += config[at]) {
+        const uint8_t *c = config + at;
+
+        if (c[1] == USB_AUDIO_DT_CS_INTERFACE && c[2] == USB_AUDIO2_SUBTYPE_AC_CLOCK_SOURCE &&
+            c[3] == AUDIO_CLOCK_SOURCE_ID) {
+            clock_rw = (c[5] & 3) == USB_AUDIO2_CTRL_RW;
+        }
+    }
+    CHECKF(clock_rw, "clock source %u does not offer SAM_FREQ read / write",
+           AUDIO_CLOCK_SOURCE_ID);
+
+    /* wNumSubRanges alone first, as hosts do, then the lot */
+    CHECK(rate_request(REQ_GET, USB_AUDIO2_REQ_RANGE, SAM_FREQ, d, 2) == 2);
+    unsigned n = get_le(d, 2);
+    int      len = rate_request(REQ_GET, USB_AUDIO2_REQ_RANGE, SAM_FREQ, d, sizeof(d));
+
+    CHECKF(n > 0 && len == (int)USB_AUDIO2_RANGE_SIZE(n, 4),
+           "RANGE: %u subranges in %d bytes", n, len);
+    for (unsigned i = 0; i < n && 2 + 12 * (i + 1) <= (unsigned)len; i++) {
+        const uint8_t *sub = d + 2 + 12 * i;
+        uint32_t hz = get_le(sub, 4);
+
+        CHECKF(get_le(sub + 4, 4) == hz && get_le(sub + 8, 4) == 0,
+               "subrange %u is not the single rate %u", i, hz);
+        CHECKF(hz > last, "subrange %u: %u after %u", i, hz, last);
+        last = hz;
+        add_offered(hz);
+    }
+
+    /* The union of the table, nothing more */
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        const struct audio_format *fmt = audio_format_for_alt(alt);
+
+        for (unsigned r = 0; r < fmt->num_rates; r++) {
+            CHECKF(is_offered(fmt->rates[r]), "alt %u: %u Hz not in RANGE",
+                   alt, fmt->rates[r]);
+        }
+    }
+    for (unsigned i = 0; i < num_offered; i++) {
+        bool any = false;
+
+        for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+            any |= audio_format_has_rate(audio_format_for_alt(alt), offered[i]);
+        }
+        CHECKF(any, "RANGE offers %u Hz, no alt streams it", offered[i]);
+    }
+
+    /* Read-only controls and the rest of the entity */
+    CHECK(rate_request(REQ_SET, USB_AUDIO2_REQ_RANGE, SAM_FREQ, d, 14) < 0);
+    CHECK(rate_request(REQ_GET, USB_AUDIO2_REQ_CUR, USB_AUDIO2_CS_CLOCK_VALID, d, 1) == 1 &&
+          d[0] == 1);
+    CHECK(rate_request(REQ_SET, USB_AUDIO2_REQ_CUR, USB_AUDIO2_CS_CLOCK_VALID, d, 1) < 0);
+}
+#else
+static void find_offered(void)
+{
+    uint8_t alt = 0, iface = 0xFF;
+
+    for (uint16_t at = 0; at + 2 <= config_len && config[at] >= 2; at += config[at]) {
+        const uint8_t *c = config + at;
+
+        if (c[1] == USB_DT_INTERFACE) {
+            iface = c[2];
+            alt   = c[3];
+        }
+        if (iface != IFACE_AUDIO_STREAM || alt == 0) {
+            continue;
+        }
+
+        if (c[1] == USB_AUDIO_DT_CS_INTERFACE && c[2] == USB_AUDIO_SUBTYPE_AS_FORMAT_TYPE) {
+            const struct audio_format *fmt = audio_format_for_alt(alt);
+
+            CHECKF(c[7] == fmt->num_rates, "alt %u: %u rates, table has %u",
+                   alt, c[7], fmt->num_rates);
+            for (unsigned r = 0; r < c[7] && r < fmt->num_rates; r++) {
+                uint32_t hz = get_le(c + 8 + 3 * r, 3);
+
+                CHECKF(hz == fmt->rates[r], "alt %u rate %u: %u Hz, table %u",
+                       alt, r, hz, fmt->rates[r]);
+                add_offered(hz);
+            }
+        }
+        if (c[1] == USB_AUDIO_DT_CS_ENDPOINT && c[2] == USB_AUDIO_SUBTYPE_EP_GENERAL) {
+            CHECKF(c[3] & 1, "alt %u: no sampling frequency control", alt);
+        }
+    }
+    CHECK(num_offered > 0);
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* IDLE                                                                       */
+/* -------------------------------------------------------------------------- */
+
+static void check_idle(void)
+{
+    static const uint32_t never[] = { 0, 1000, 11025, 44100, 192000, 0xFFFFFF };
+
+    CHECKF(get_rate() == AUDIO_SAMPLE_RATE_HZ, "rate at power-up %u", get_rate());
+
+    for (unsigned i = 0; i < num_offered; i++) {
+        CHECKF(set_rate(offered[i], RATE_BYTES), "SET_CUR %u stalled", offered[i]);
+        CHECKF(get_rate() == offered[i], "GET_CUR %u after SET_CUR %u",
+               get_rate(), offered[i]);
+    }
+
+    uint32_t was = get_rate();
+
+    for (unsigned i = 0; i < sizeof(never) / sizeof(never[0]); i++) {
+        if (!is_offered(never[i])) {
+            CHECKF(!set_rate(never[i], RATE_BYTES), "SET_CUR %u taken", never[i]);
+        }
+    }
+    CHECK(!set_rate(offered[0], RATE_BYTES - 1));
+    CHECKF(get_rate() == was, "rate %u after refused requests, was %u", get_rate(), was);
+
+    /* A host asking for less gets the low bytes */
+    uint8_t d[2];
+    CHECK(rate_request(REQ_GET, GET_CUR, SAM_FREQ, d, 2) == 2 && get_le(d, 2) == (was & 0xFFFF));
+}
+
+/* -------------------------------------------------------------------------- */
+/* STREAMING                                                                  */
+/* -------------------------------------------------------------------------- */
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    uint32_t n;
+
+    if (pkt->ep != EP_AUDIO_IN || frames_run < STREAM_SETTLE || !frame_bytes) {
+        return;
+    }
+    n = pkt->len / frame_bytes;
+    pkt_min = n < pkt_min ? n : pkt_min;
+    pkt_max = n > pkt_max ? n : pkt_max;
+    pkts++;
+}
+
+/* Runs frames and checks the packets carry hz */
+static void stream_check(uint8_t alt, uint32_t hz, const char *how)
+{
+    frame_bytes = audio_stream_cfg()->frame_bytes;
+    pkt_min = UINT32_MAX;
+    pkt_max = 0;
+    pkts    = 0;
+
+    for (frames_run = 0; frames_run < STREAM_FRAMES; frames_run++) {
+        host_usb_frame(NULL);
+    }
+
+    CHECKF(audio_stream_cfg()->rate_hz == hz, "alt %u %s %u Hz: streaming at %u",
+           alt, how, hz, audio_stream_cfg()->rate_hz);
+    CHECKF(pkts > STREAM_FRAMES - STREAM_SETTLE - 2 &&
+           pkt_min + 1 >= hz / 1000 && pkt_max <= hz / 1000 + 1,
+           "alt %u %s %u Hz: %u packets of %u..%u samples", alt, how, hz,
+           pkts, pkt_min, pkt_max);
+    CHECKF(get_rate() == hz, "alt %u %s %u Hz: GET_CUR %u", alt, how, hz, get_rate());
+}
+
+static void check_streaming(uint8_t alt)
+{
+    const struct audio_format *fmt = audio_format_for_alt(alt);
+
+    for (unsigned r = 0; r < fmt->num_rates; r++) {
+        uint32_t hz = fmt->rates[r];
+
+        /* Chosen before the alt */
+        CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+        CHECK(set_rate(hz, RATE_BYTES));
+        CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, alt));
+        stream_check(alt, hz, "set idle");
+
+        /* Switched to while running */
+        uint32_t next = fmt->rates[(r + 1) % fmt->num_rates];
+        CHECK(set_rate(next, RATE_BYTES));
+        stream_check(alt, next, "switched to");
+
+        /* Someone else's rate is refused, the stream carries on */
+        for (unsigned i = 0; i < num_offered; i++) {
+            if (!audio_format_has_rate(fmt, offered[i])) {
+                CHECKF(!set_rate(offered[i], RATE_BYTES), "alt %u took %u Hz",
+                       alt, offered[i]);
+                stream_check(alt, next, "after refusing");
+                break;
+            }
+        }
+    }
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+}
+
+int main(void)
+{
+    host_board_init();
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+
+    fetch_config();
+    find_offered();
+    if (num_offered) {
+        check_idle();
+        for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+            check_streaming(alt);
+        }
+    }
+    return host_test_result("clock");
+}
@@ -0,0 +1,132 @@
+/*
+ * Rate converter for the voice alts (pcm_decim.h).
+ *
+ * pcm_decim_process() runs against pcm_decim_process_ref() on random
+ * blocks full of full-scale extremes, in place on an interleaved block as
+ * the capture path uses it, and must agree sample for sample. A sine
+ * sweep through the fast path then holds each output rate to the response
+ * pcm_decim.h promises: within 0.01 dB to 0.4375 * fout, at least 70 dB
+ * down from 0.5625 * fout to the 24 kHz input Nyquist (aliases included).
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pcm_decim.h"
+#include "host_test.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define RANDOM_BLOCKS   4000
+#define SWEEP_BLOCKS    100
+#define SETTLE_BLOCKS   10
+#define SWEEP_AMP       16384.0
+
+#define PASS_EDGE       0.4375
+#define STOP_EDGE       0.5625
+#define PASS_RIPPLE_DB  0.01
+#define STOP_DB         -70.0
+
+static const uint32_t out_rates[] = { 16000, 24000, 32000 };
+static const uint32_t block_sizes[] = { PCM_DECIM_MAX_IN, 24, 6 };
+
+/* Two channels, converted in place on channel 0; channel 1 must survive */
+static void check_exact(uint32_t out_hz, uint32_t n)
+{
+    static struct pcm_decim opt, ref;
+    int16_t  a[2 * PCM_DECIM_MAX_IN], b[2 * PCM_DECIM_MAX_IN];
+    uint32_t rng = out_hz + n, diffs = 0, counts = 0;
+
+    CHECK(pcm_decim_init(&opt, out_hz));
+    CHECK(pcm_decim_init(&ref, out_hz));
+
+    for (uint32_t blk = 0; blk < RANDOM_BLOCKS; blk++) {
+        for (uint32_t i = 0; i < 2 * n; i++) {
+            rng = rng * 1664525u + 1013904223u;
+            switch (rng >> 30) {
+            case 0:  a[i] = INT16_MAX; break;
+            case 1:  a[i] = INT16_MIN; break;
+            default: a[i] = (int16_t)(rng >> 8); break;
+            }
+            b[i] = a[i];
+        }
+
+        uint32_t n_opt = pcm_decim_process(&opt, a, a, n, 2);
+        uint32_t n_ref = pcm_decim_process_ref(&ref, b, b, n, 2);
+
+        counts += n_opt != n_ref || n_opt != n * out_hz / PCM_DECIM_IN_HZ;
+        for (uint32_t i = 0; i < 2 * n; i++) {
+            if (a[i] != b[i] && !diffs++) {
+                fprintf(stderr, "%u Hz/%u: block %u sample %u: %d, ref %d\n",
+                        out_hz, n, blk, i, a[i], b[i]);
+            }
+        }
+    }
+
+    CHECKF(counts == 0, "%u Hz/%u: %u blocks with a wrong output count", out_hz, n, counts);
+    CHECKF(diffs == 0, "%u Hz/%u: %u samples differ", out_hz, n, diffs);
+}
+
+/* Output power of a SWEEP_AMP sine at f, relative to the input, in dB */
+static double response_db(uint32_t out_hz, double f)
+{
+    static struct pcm_decim st;
+    int16_t  in[PCM_DECIM_MAX_IN], out[PCM_DECIM_MAX_IN];
+    double   phase = 0, sum = 0;
+    uint32_t count = 0;
+
+    pcm_decim_init(&st, out_hz);
+    for (uint32_t blk = 0; blk < SWEEP_BLOCKS; blk++) {
+        for (uint32_t i = 0; i < PCM_DECIM_MAX_IN; i++) {
+            in[i] = (int16_t)lrint(SWEEP_AMP * sin(phase));
+            phase += 2 * M_PI * f / PCM_DECIM_IN_HZ;
+        }
+
+        uint32_t n = pcm_decim_process(&st, in, out, PCM_DECIM_MAX_IN, 1);
+
+        for (uint32_t i = 0; blk >= SETTLE_BLOCKS && i < n; i++) {
+            sum += (double)out[i] * out[i];
+            count++;
+        }
+    }
+    return 10 * log10(sum / count / (SWEEP_AMP * SWEEP_AMP / 2) + 1e-30);
+}
+
+static void check_response(uint32_t out_hz)
+{
+    double ripple = 0, stop = -200, stop_f = 0;
+
+    for (double f = 50; f <= PASS_EDGE * out_hz; f += 50) {
+        ripple = fmax(ripple, fabs(response_db(out_hz, f)));
+    }
+    for (double f = STOP_EDGE * out_hz; f < PCM_DECIM_IN_HZ / 2; f += 25) {
+        double db = response_db(out_hz, f);
+
+        if (db > stop) {
+            stop   = db;
+            stop_f = f;
+        }
+    }
+
+    CHECKF(ripple <= PASS_RIPPLE_DB, "%u Hz: passband ripple %.4f dB", out_hz, ripple);
+    CHECKF(stop <= STOP_DB, "%u Hz: only %.1f dB down at %.0f Hz", out_hz, stop, stop_f);
+}
+
+int main(void)
+{
+    struct pcm_decim st;
+
+    CHECK(!pcm_decim_init(&st, 48000));
+    CHECK(!pcm_decim_init(&st, 8000));
+
+    for (size_t r = 0; r < sizeof(out_rates) / sizeof(out_rates[0]); r++) {
+        for (size_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++) {
+            check_exact(out_rates[r], block_sizes[i]);
+        }
+        check_response(out_rates[r]);
+    }
+    return host_test_result("decim");
+}
@@ -0,0 +1,459 @@
+/*
+ * Descriptor walk over the real usb_descriptors.c, as the host sees it.
+ *
+ *   test_desc [config [rate]]
+ *
+ * config receives the configuration descriptor, rate the highest streamed
+ * rate as text, for desc_check -r on it.
+ *
+ * Enumerates the board, fetches the device, string and configuration
+ * descriptors through GET_DESCRIPTOR and checks every length: each
+ * descriptor fits, wTotalLength matches what was sent, bNumInterfaces and
+ * each alt's bNumEndpoints match what follows it, and iso endpoints stay
+ * within the full-speed limit. Then selects every alt of every interface
+ * (plus one past the last, which must stall) and for the streaming alts
+ * runs frames until packets come out, checking each one against the alt's
+ * wMaxPacketSize and frame size.
+ *
+ * The Feature Unit must offer mute and volume on the master channel and
+ * on each logical channel 1..n. Every one of them takes SET_CUR and reads
+ * it back, channel n + 1 stalls, and on a stream each channel's level
+ * must move by its own gain times the master's, a muted channel going
+ * silent while the others keep theirs.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libopencm3/usb/usbstd.h>
+
+#include "audio_format.h"
+#include "audio_gain.h"
+#include "audio_stream.h"
+#include "usb_audio_uac2.h"
+#include "usb_descriptors.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define REQ_IN_DEVICE     (USB_REQ_TYPE_IN | USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_DEVICE)
+#define REQ_IN_INTERFACE  (USB_REQ_TYPE_IN | USB_REQ_TYPE_STANDARD | USB_REQ_TYPE_INTERFACE)
+
+#define REQ_SET  (USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE)
+#define REQ_GET  (REQ_SET | USB_REQ_TYPE_IN)
+
+#if AUDIO_UAC2
+#define SET_CUR  USB_AUDIO2_REQ_CUR
+#define GET_CUR  USB_AUDIO2_REQ_CUR
+#define FU_CONTROLS \
+    (USB_AUDIO2_FU_MUTE_CONTROL(USB_AUDIO2_CTRL_RW) | \
+     USB_AUDIO2_FU_VOLUME_CONTROL(USB_AUDIO2_CTRL_RW))
+#else
+#define SET_CUR  USB_AUDIO_REQ_SET_CUR
+#define GET_CUR  USB_AUDIO_REQ_GET_CUR
+#define FU_CONTROLS  (USB_AUDIO_FU_MUTE | USB_AUDIO_FU_VOLUME)
+#endif
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define STREAM_FRAMES  32
+#define LEVEL_SETTLE   20
+#define LEVEL_FRAMES   200
+#define LEVEL_TOL      0.01
+
+static uint8_t  config[1024];
+static uint16_t config_len;
+
+static uint16_t le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+/* -------------------------------------------------------------------------- */
+/* DESCRIPTORS                                                                */
+/* -------------------------------------------------------------------------- */
+
+static void check_device(void)
+{
+    uint8_t d[64];
+    int n = host_usb_control(REQ_IN_DEVICE, USB_REQ_GET_DESCRIPTOR,
+                             USB_DT_DEVICE << 8, 0, d, sizeof(d));
+
+    CHECK(n == USB_DT_DEVICE_SIZE);
+    CHECK(d[0] == USB_DT_DEVICE_SIZE && d[1] == USB_DT_DEVICE);
+    CHECK(d[7] == 64);          /* bMaxPacketSize0 */
+    CHECK(d[17] == 1);          /* bNumConfigurations */
+
+    for (uint8_t i = 0; i <= 3; i++) {
+        n = host_usb_control(REQ_IN_DEVICE, USB_REQ_GET_DESCRIPTOR,
+                             USB_DT_STRING << 8 | i, 0x0409, d, sizeof(d));
+        CHECKF(n >= 2 && d[0] == n && d[1] == USB_DT_STRING && !(n & 1),
+               "string %u", i);
+    }
+}
+
+static void fetch_config(void)
+{
+    int n = host_usb_control(REQ_IN_DEVICE, USB_REQ_GET_DESCRIPTOR,
+                             USB_DT_CONFIGURATION << 8, 0, config,
+                             USB_DT_CONFIGURATION_SIZE);
+
+    CHECK(n == USB_DT_CONFIGURATION_SIZE);
+    config_len = le16(config + 2);
+    CHECKF(config_len <= sizeof(config), "wTotalLength %u", config_len);
+    if (config_len > sizeof(config)) {
+        config_len = 0;
+        return;
+    }
+
+    /* Ask for more than there is: the device stops at wTotalLength */
+    n = host_usb_control(REQ_IN_DEVICE, USB_REQ_GET_DESCRIPTOR,
+                         USB_DT_CONFIGURATION << 8, 0, config, sizeof(config));
+    CHECKF(n == config_len, "sent %d of wTotalLength %u", n, config_len);
+}
+
+static void walk_config(void)
+{
+    uint32_t ifaces = 0, alts = 0;
+    int32_t  eps_left = 0;
+    uint16_t at = 0;
+
+    CHECK(config[0] == USB_DT_CONFIGURATION_SIZE && config[1] == USB_DT_CONFIGURATION);
+
+    while (at < config_len) {
+        const uint8_t *d = config + at;
+
+        if (d[0] < 2 || at + d[0] > config_len) {
+            CHECKF(0, "descriptor at %u: bLength %u overruns %u",
+                   at, d[0], config_len);
+            return;
+        }
+
+        switch (d[1]) {
+        case USB_DT_INTERFACE:
+            CHECKF(d[0] == USB_DT_INTERFACE_SIZE, "interface at %u", at);
+            CHECKF(eps_left == 0, "interface at %u: %d endpoints missing",
+                   at, eps_left);
+            if (d[3] == 0) {
+                CHECKF(d[2] == ifaces, "interface %u out of order", d[2]);
+                ifaces++;
+            }
+            CHECKF(d[2] + 1u == ifaces, "alt of interface %u", d[2]);
+            eps_left = d[4];
+            alts++;
+            break;
+
+        case USB_DT_ENDPOINT:
+            CHECKF(d[0] == USB_DT_ENDPOINT_SIZE || d[0] == 9,
+                   "endpoint at %u", at);
+            CHECKF(eps_left-- > 0, "endpoint %02x beyond bNumEndpoints", d[2]);
+            if ((d[3] & USB_ENDPOINT_ATTR_TYPE) == USB_ENDPOINT_ATTR_ISOCHRONOUS) {
+                CHECKF(le16(d + 4) <= AUDIO_FS_ISO_MAX_PACKET,
+                       "endpoint %02x wMaxPacketSize %u", d[2], le16(d + 4));
+            }
+            break;
+
+        case USB_DT_INTERFACE_ASSOCIATION:
+            CHECK(d[0] == USB_DT_INTERFACE_ASSOCIATION_SIZE);
+            break;
+        }
+        at += d[0];
+    }
+
+    CHECKF(eps_left == 0, "last alt: %d endpoints missing", eps_left);
+    CHECKF(ifaces == config[4], "%u interfaces, bNumInterfaces %u",
+           ifaces, config[4]);
+
+    uint32_t want = 0;
+    for (int i = 0; i < config_descriptor.bNumInterfaces; i++) {
+        want += config_descriptor.interface[i].num_altsetting;
+    }
+    CHECKF(alts == want, "%u alts sent, %u in the tables", alts, want);
+}
+
+/* -------------------------------------------------------------------------- */
+/* ALTERNATE SETTINGS                                                         */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t packets;
+static uint16_t pkt_max;
+static uint16_t pkt_frame;
+static uint32_t pkt_bad;
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    if (pkt->ep != EP_AUDIO_IN) {
+        return;
+    }
+    packets++;
+    if (pkt->len > pkt_max || (pkt_frame && pkt->len % pkt_frame)) {
+        if (!pkt_bad++) {
+            fprintf(stderr, "packet of %u bytes: max %u, frame %u\n",
+                    pkt->len, pkt_max, pkt_frame);
+        }
+    }
+}
+
+static void check_stream(const struct usb_interface_descriptor *alt)
+{
+    pkt_max = 0;
+    for (int k = 0; k < alt->bNumEndpoints; k++) {
+        if (alt->endpoint[k].bEndpointAddress == EP_AUDIO_IN) {
+            pkt_max = alt->endpoint[k].wMaxPacketSize;
+        }
+    }
+    CHECKF(pkt_max > 0, "alt %u has no audio IN endpoint", alt->bAlternateSetting);
+
+    packets = 0;
+    pkt_bad = 0;
+    pkt_frame = audio_stream_cfg()->frame_bytes;
+    host_board_run(STREAM_FRAMES);
+
+    CHECKF(packets >= STREAM_FRAMES / 2, "alt %u: %u packets in %u frames",
+           alt->bAlternateSetting, packets, STREAM_FRAMES);
+    CHECKF(pkt_bad == 0, "alt %u: %u bad packets", alt->bAlternateSetting, pkt_bad);
+}
+
+/* -------------------------------------------------------------------------- */
+/* FEATURE UNIT                                                               */
+/* -------------------------------------------------------------------------- */
+
+/* Mean |sample| of each channel on the wire, top 16 bits */
+static double   level_sum[AUDIO_NUM_CHANNELS];
+static uint32_t level_n;
+static uint16_t level_sub;
+
+static int32_t sine(uint32_t ch, uint64_t n)
+{
+    (void)ch;
+    return (int32_t)lround(0x200000 * sin(2 * M_PI * 1000.0 * (double)n / 48000.0));
+}
+
+static void on_level(const struct host_usb_packet *pkt)
+{
+    if (pkt->ep != EP_AUDIO_IN) {
+        return;
+    }
+    for (uint32_t i = 0; i + level_sub <= pkt->len; i += level_sub) {
+        const uint8_t *p = pkt->data + i + level_sub - 2;
+
+        level_sum[(i / level_sub) % AUDIO_NUM_CHANNELS] += abs((int16_t)(p[0] | p[1] << 8));
+    }
+    level_n += pkt->len / (level_sub * AUDIO_NUM_CHANNELS);
+}
+
+static void measure(double *level)
+{
+    host_board_run(LEVEL_SETTLE);
+    memset(level_sum, 0, sizeof(level_sum));
+    level_n = 0;
+    host_board_run(LEVEL_FRAMES);
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        level[ch] = level_n ? level_sum[ch] / level_n : 0;
+    }
+}
+
+static int fu_control(uint8_t type, uint8_t request, uint8_t cs, uint8_t cn,
+                      void *data, uint16_t len)
+{
+    return host_usb_control(type, request, (uint16_t)(cs << 8 | cn),
+                            AUDIO_FEATURE_UNIT_ID << 8 | IFACE_AUDIO_CONTROL, data, len);
+}
+
+static bool set_volume(uint8_t cn, int16_t v)
+{
+    uint8_t d[2] = { (uint8_t)v, (uint8_t)((uint16_t)v >> 8) };
+
+    return fu_control(REQ_SET, SET_CUR, USB_AUDIO_FU_CS_VOLUME, cn, d, 2) == 2;
+}
+
+static bool set_mute(uint8_t cn, bool mute)
+{
+    uint8_t d = mute;
+
+    return fu_control(REQ_SET, SET_CUR, USB_AUDIO_FU_CS_MUTE, cn, &d, 1) == 1;
+}
+
+/* bmaControls(0..n): mute and volume on every channel */
+static void check_fu_descriptor(void)
+{
+    const uint8_t *fu = NULL;
+
+    for (uint16_t at = 0; at + 4 <= config_len && config[at] >= 2; at += config[at]) {
+        if (config[at + 1] == USB_DT_CS_INTERFACE &&
+            config[at + 2] == USB_AUDIO_SUBTYPE_AC_FEATURE_UNIT &&
+            config[at + 3] == AUDIO_FEATURE_UNIT_ID) {
+            fu = config + at;
+        }
+    }
+    CHECK(fu != NULL);
+    if (!fu) {
+        return;
+    }
+
+    for (uint8_t cn = 0; cn <= AUDIO_NUM_CHANNELS; cn++) {
+#if AUDIO_UAC2
+        uint32_t bma = (uint32_t)le16(fu + 5 + 4 * cn) | (uint32_t)le16(fu + 7 + 4 * cn) << 16;
+#else
+        uint32_t bma = fu[6 + fu[5] * cn];
+#endif
+        CHECKF((bma & FU_CONTROLS) == FU_CONTROLS, "FU bmaControls(%u) 0x%x", cn, bma);
+    }
+}
+
+/* Each channel's controls read back what was set; past the last, stall */
+static void check_fu_requests(void)
+{
+    for (uint8_t cn = 0; cn <= AUDIO_NUM_CHANNELS + 1; cn++) {
+        bool    ok   = cn <= AUDIO_NUM_CHANNELS;
+        int16_t want = (int16_t)(-256 * (cn + 1));
+        uint8_t cur[2] = { 0 };
+
+        CHECKF(set_volume(cn, want) == ok, "FU volume channel %u: SET_CUR %s", cn,
+               ok ? "stalled" : "taken");
+        CHECKF((fu_control(REQ_GET, GET_CUR, USB_AUDIO_FU_CS_VOLUME, cn, cur, 2) == 2) == ok,
+               "FU volume channel %u: GET_CUR %s", cn, ok ? "stalled" : "answered");
+        CHECKF(!ok || (int16_t)le16(cur) == want, "FU volume channel %u: %d, set %d", cn,
+               (int16_t)le16(cur), want);
+
+        CHECKF(set_mute(cn, true) == ok, "FU mute channel %u: SET_CUR %s", cn,
+               ok ? "stalled" : "taken");
+        CHECKF((fu_control(REQ_GET, GET_CUR, USB_AUDIO_FU_CS_MUTE, cn, cur, 1) == 1) == ok,
+               "FU mute channel %u: GET_CUR %s", cn, ok ? "stalled" : "answered");
+        CHECKF(!ok || cur[0] == 1, "FU mute channel %u: %u, set 1", cn, cur[0]);
+
+        if (ok) {
+            CHECK(set_mute(cn, false) && set_volume(cn, 0));
+        }
+    }
+}
+
+/* Channel k at -2k dB under a -6 dB master, the last one muted */
+static void check_fu_levels(void)
+{
+    double before[AUDIO_NUM_CHANNELS], after[AUDIO_NUM_CHANNELS];
+    const int16_t master = -6 * 256;
+
+    host_capture_set_source(sine);
+    host_usb_on_packet(on_level);
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 1));
+    level_sub = audio_stream_cfg()->subframe_bytes;
+    measure(before);
+
+    CHECK(set_volume(0, master));
+    for (uint8_t cn = 1; cn <= AUDIO_NUM_CHANNELS; cn++) {
+        CHECK(set_volume(cn, (int16_t)(-2 * 256 * cn)));
+    }
+    if (AUDIO_NUM_CHANNELS > 1) {
+        CHECK(set_mute(AUDIO_NUM_CHANNELS, true));
+    }
+    measure(after);
+
+    for (uint8_t cn = 1; cn <= AUDIO_NUM_CHANNELS; cn++) {
+        bool   muted = AUDIO_NUM_CHANNELS > 1 && cn == AUDIO_NUM_CHANNELS;
+        double want  = muted ? 0 : audio_gain_from_volume(master) / 65536.0 *
+                                   audio_gain_from_volume((int16_t)(-2 * 256 * cn)) / 65536.0;
+        double got   = before[cn - 1] > 0 ? after[cn - 1] / before[cn - 1] : -1;
+
+        printf("  FU channel %u: level x%.4f, want x%.4f\n", cn, got, want);
+        CHECKF(fabs(got - want) <= LEVEL_TOL * (want > 0 ? want : 1) && before[cn - 1] > 1000,
+               "FU channel %u: level %.1f -> %.1f, x%.4f, want x%.4f", cn,
+               before[cn - 1], after[cn - 1], got, want);
+    }
+
+    for (uint8_t cn = 0; cn <= AUDIO_NUM_CHANNELS; cn++) {
+        CHECK(set_mute(cn, false) && set_volume(cn, 0));
+    }
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    host_usb_on_packet(NULL);
+    host_capture_set_source(NULL);
+}
+
+static void check_altsettings(void)
+{
+    host_usb_on_packet(on_packet);
+
+    for (uint16_t i = 0; i < config_descriptor.bNumInterfaces; i++) {
+        const struct usb_interface *intf = &config_descriptor.interface[i];
+
+        for (uint16_t a = 0; a < intf->num_altsetting; a++) {
+            uint8_t cur = 0xFF;
+
+            CHECKF(host_board_set_interface(i, a), "SET_INTERFACE %u/%u", i, a);
+            CHECK(host_usb_control(REQ_IN_INTERFACE, USB_REQ_GET_INTERFACE,
+                                   0, i, &cur, 1) == 1);
+            CHECKF(cur == a, "GET_INTERFACE %u: %u, set %u", i, cur, a);
+
+            if (i == IFACE_AUDIO_STREAM && a > 0) {
+                check_stream(&intf->altsetting[a]);
+            }
+        }
+        CHECKF(!host_board_set_interface(i, intf->num_altsetting),
+               "SET_INTERFACE %u/%u past the last alt", i, intf->num_altsetting);
+        CHECK(host_board_set_interface(i, 0));
+    }
+
+    host_usb_on_packet(NULL);
+}
+
+static uint32_t max_rate(void)
+{
+    uint32_t max = 0;
+
+    for (uint32_t f = 0; f < AUDIO_NUM_FORMATS; f++) {
+        for (uint32_t r = 0; r < audio_formats[f].num_rates; r++) {
+            if (audio_formats[f].rates[r] > max) {
+                max = audio_formats[f].rates[r];
+            }
+        }
+    }
+    return max;
+}
+
+static bool write_file(const char *path, const void *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    bool ok = f && fwrite(data, 1, len, f) == len;
+
+    if (f && fclose(f)) {
+        ok = false;
+    }
+    if (!ok) {
+        perror(path);
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    host_board_init();
+    CHECK(host_board_enumerate());
+
+    check_device();
+    fetch_config();
+    walk_config();
+    check_altsettings();
+    check_fu_descriptor();
+    check_fu_requests();
+    check_fu_levels();
+
+    if (argc > 1 && !write_file(argv[1], config, config_len)) {
+        host_test_failures++;
+    }
+    if (argc > 2) {
+        char rate[16];
+        int  n = snprintf(rate, sizeof(rate), "%u\n", max_rate());
+
+        if (!write_file(argv[2], rate, (size_t)n)) {
+            host_test_failures++;
+        }
+    }
+
+    return host_test_result("desc");
+}
@@ -0,0 +1,335 @@
+/*
+ * Front-end DSP chain (dsp_chain.h) against a double-precision model.
+ *
+ * The model has the chain's structure (RBJ biquad, block-peak envelopes
+ * with per-block one-pole smoothing, gains ramped across each block, the
+ * AGC held while the gate is closed) in doubles throughout. Every format
+ * row and rate runs each stage alone and the whole chain over a mic with
+ * a DC offset, a tone in loud bursts and quiet gaps well below the gate's
+ * close level, and a little noise. The output must stay within the
+ * tolerance dsp_chain.h states: 1 LSB at 16 bits, 64 LSB at 24 bits. The
+ * signal must also drive the model's gate shut and open again and the
+ * AGC both ways, or the comparison would prove little.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_format.h"
+#include "dsp_chain.h"
+#include "host_test.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+#ifndef M_SQRT1_2
+#define M_SQRT1_2  0.70710678118654752440
+#endif
+
+#define Q23_FULL       8388607.0
+#define LOUD_MS        500
+#define QUIET_MS       1500
+#define BLOCKS         (2 * (LOUD_MS + QUIET_MS))
+#define MAX_SAMPLES    (AUDIO_MAX_SAMPLES_PER_FRAME * AUDIO_NUM_CHANNELS)
+
+/*
+ * The gate's open / close is a hard decision on an envelope the chain
+ * keeps in truncating fixed point, up to half a sample off the model's.
+ * With the default 150 ms release the envelope creeps past the close
+ * level a few tens of samples per block and the two can close a block
+ * apart; runs with the gate on use a short release so every crossing is
+ * decisive. The rest run on the defaults.
+ */
+#define GATE_RELEASE_MS  10
+
+static struct dsp_chain_config gate_config;
+
+static const uint32_t masks[] = {
+    DSP_STAGE_BIT(DSP_STAGE_HPF),
+    DSP_STAGE_BIT(DSP_STAGE_GATE),
+    DSP_STAGE_BIT(DSP_STAGE_AGC),
+    DSP_STAGE_BIT(DSP_STAGE_GATE) | DSP_STAGE_BIT(DSP_STAGE_AGC),
+    DSP_CHAIN_ALL_STAGES,
+};
+
+/* -------------------------------------------------------------------------- */
+/* MODEL                                                                      */
+/* -------------------------------------------------------------------------- */
+
+static struct {
+    double b0, b1, b2, a1, a2;
+    double x1[AUDIO_NUM_CHANNELS], x2[AUDIO_NUM_CHANNELS];
+    double y1[AUDIO_NUM_CHANNELS], y2[AUDIO_NUM_CHANNELS];
+} hpf;
+
+static struct {
+    double open, close, floor, attack, release;
+    double env, gain;
+    bool   is_open;
+    uint32_t closes, opens;
+} gate;
+
+static struct {
+    double target, min, max, attack, release;
+    double env, gain;
+    double gain_lo, gain_hi;
+} agc;
+
+static double from_db(double db)
+{
+    return pow(10.0, db / 20.0);
+}
+
+static double per_block(double ms)
+{
+    return 1.0 - exp(-1.0 / ms);
+}
+
+static void model_start(const struct dsp_chain_config *c, uint32_t rate)
+{
+    double w0 = 2.0 * M_PI * c->hpf_hz / rate;
+    double alpha = sin(w0) / (2.0 * M_SQRT1_2);
+    double a0 = 1.0 + alpha;
+
+    memset(&hpf, 0, sizeof(hpf));
+    hpf.b0 = (1.0 + cos(w0)) / 2.0 / a0;
+    hpf.b1 = -2.0 * hpf.b0;
+    hpf.b2 = hpf.b0;
+    hpf.a1 = -2.0 * cos(w0) / a0;
+    hpf.a2 = (1.0 - alpha) / a0;
+
+    /* Whole-sample thresholds, as the chain has them */
+    memset(&gate, 0, sizeof(gate));
+    gate.open    = floor(from_db(c->gate_open_db) * Q23_FULL + 0.5);
+    gate.close   = floor(from_db(c->gate_close_db) * Q23_FULL + 0.5);
+    gate.floor   = from_db(c->gate_floor_db);
+    gate.attack  = per_block(c->gate_attack_ms);
+    gate.release = per_block(c->gate_release_ms);
+    gate.gain    = 1.0;
+    gate.is_open = true;
+
+    memset(&agc, 0, sizeof(agc));
+    agc.target  = from_db(c->agc_target_db) * Q23_FULL;
+    agc.min     = from_db(c->agc_min_gain_db);
+    agc.max     = from_db(c->agc_max_gain_db);
+    agc.attack  = per_block(c->agc_attack_ms);
+    agc.release = per_block(c->agc_release_ms);
+    agc.gain    = 1.0;
+    agc.gain_lo = agc.gain_hi = 1.0;
+}
+
+static double peak(const double *x, uint32_t n)
+{
+    double p = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        p = fabs(x[i]) > p ? fabs(x[i]) : p;
+    }
+    return p;
+}
+
+/* Gain from g0 to g1 across the block, the last frame on g1 */
+static void ramp(double *x, uint32_t frames, double g0, double g1)
+{
+    double d = (g1 - g0) / frames;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            x[i * AUDIO_NUM_CHANNELS + ch] *= g0 + d * (i + 1);
+        }
+    }
+}
+
+static void model_block(double *x, uint32_t frames, uint32_t mask)
+{
+    uint32_t n = frames * AUDIO_NUM_CHANNELS;
+
+    if (mask & DSP_STAGE_BIT(DSP_STAGE_HPF)) {
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t ch = i % AUDIO_NUM_CHANNELS;
+            double y = hpf.b0 * x[i] + hpf.b1 * hpf.x1[ch] + hpf.b2 * hpf.x2[ch] -
+                       hpf.a1 * hpf.y1[ch] - hpf.a2 * hpf.y2[ch];
+
+            hpf.x2[ch] = hpf.x1[ch];
+            hpf.x1[ch] = x[i];
+            hpf.y2[ch] = hpf.y1[ch];
+            hpf.y1[ch] = y;
+            x[i] = y;
+        }
+    }
+
+    if (mask & DSP_STAGE_BIT(DSP_STAGE_GATE)) {
+        double p = peak(x, n);
+
+        gate.env += (p - gate.env) * (p > gate.env ? gate.attack : gate.release);
+        if (gate.is_open && gate.env < gate.close) {
+            gate.is_open = false;
+            gate.closes++;
+        } else if (!gate.is_open && gate.env > gate.open) {
+            gate.is_open = true;
+            gate.opens++;
+        }
+
+        double t = gate.is_open ? 1.0 : gate.floor;
+        double g = gate.gain + (t - gate.gain) * (gate.is_open ? gate.attack : gate.release);
+
+        ramp(x, frames, gate.gain, g);
+        gate.gain = g;
+    }
+
+    if (mask & DSP_STAGE_BIT(DSP_STAGE_AGC)) {
+        double p = peak(x, n), g = agc.gain;
+
+        agc.env += (p - agc.env) * (p > agc.env ? agc.attack : agc.release);
+        if (!((mask & DSP_STAGE_BIT(DSP_STAGE_GATE)) && !gate.is_open)) {
+            double want = agc.env > 0 ? agc.target / agc.env : agc.max;
+
+            want = want > agc.max ? agc.max : want < agc.min ? agc.min : want;
+            g += (want - g) * (want < g ? agc.attack : agc.release);
+        }
+
+        ramp(x, frames, agc.gain, g);
+        agc.gain = g;
+        agc.gain_lo = g < agc.gain_lo ? g : agc.gain_lo;
+        agc.gain_hi = g > agc.gain_hi ? g : agc.gain_hi;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* WIRE FORMAT                                                                */
+/* -------------------------------------------------------------------------- */
+
+static void put(uint8_t *pcm, uint32_t i, uint8_t bytes, int32_t v)
+{
+    uint32_t u = bytes == 4 ? (uint32_t)v << 8 : (uint32_t)v;
+
+    for (uint8_t b = 0; b < bytes; b++) {
+        pcm[i * bytes + b] = (uint8_t)(u >> (8 * b));
+    }
+}
+
+static int32_t get(const uint8_t *pcm, uint32_t i, uint8_t bytes)
+{
+    const uint8_t *p = pcm + i * bytes;
+
+    switch (bytes) {
+    case 2:
+        return (int16_t)(p[0] | p[1] << 8);
+    case 3:
+        return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 |
+                         (uint32_t)p[2] << 24) >> 8;
+    default:
+        return (int32_t)((uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+                         (uint32_t)p[3] << 24) >> 8;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* TEST                                                                       */
+/* -------------------------------------------------------------------------- */
+
+static void run(const struct audio_format *fmt, uint32_t rate, uint32_t mask)
+{
+    static uint8_t pcm[MAX_SAMPLES * 4] __attribute__((aligned(4)));
+    static double  x[MAX_SAMPLES];
+    struct audio_stream_cfg cfg;
+    uint32_t rng = 1;
+    uint64_t t = 0;
+    double   worst = 0;
+
+    audio_format_make_cfg(fmt, rate, &cfg);
+
+    uint8_t  bytes = cfg.subframe_bytes;
+    double   lsb   = cfg.bits == 16 ? 256.0 : 1.0;     /* Q23 per output LSB */
+    double   tol   = cfg.bits == 16 ? 1.0 : 64.0;
+    double   dc    = mask & DSP_STAGE_BIT(DSP_STAGE_HPF) ? 0.02 : 0.0;
+    uint32_t f     = cfg.samples_per_frame;
+
+    const struct dsp_chain_config *c = mask & DSP_STAGE_BIT(DSP_STAGE_GATE) ?
+                                       &gate_config : &dsp_chain_default_config;
+
+    dsp_chain_configure(c);
+    dsp_chain_set_enabled(mask);
+    dsp_chain_start(&cfg);
+    model_start(c, rate);
+
+    for (uint32_t blk = 0; blk < BLOCKS; blk++) {
+        bool loud = blk % (LOUD_MS + QUIET_MS) < LOUD_MS;
+
+        for (uint32_t i = 0; i < f; i++, t++) {
+            for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+                uint32_t k = i * AUDIO_NUM_CHANNELS + ch;
+                double v;
+
+                rng = rng * 1664525u + 1013904223u;
+                v = dc + (loud ? 0.3 : 0.0001) * sin(2 * M_PI * 440.0 * t / rate + ch) +
+                    0.00005 * ((double)rng / 4294967296.0 - 0.5);
+
+                int32_t q = (int32_t)lrint(v * Q23_FULL / lsb);
+
+                put(pcm, k, bytes, q);
+                x[k] = q * lsb;
+            }
+        }
+
+        dsp_chain_process(pcm, f, &cfg);
+        model_block(x, f, mask);
+
+        for (uint32_t k = 0; k < f * AUDIO_NUM_CHANNELS; k++) {
+            double hi = Q23_FULL / lsb, r = x[k] / lsb;
+            double e;
+
+            r = r > hi ? hi : r < -hi - 1 ? -hi - 1 : r;
+            e = fabs(get(pcm, k, bytes) - r);
+            worst = e > worst ? e : worst;
+        }
+    }
+
+    CHECKF(worst <= tol, "mask %u %u-bit %u Hz: off by %.2f LSB (%.0f allowed)",
+           mask, cfg.bits, rate, worst, tol);
+    if (mask & DSP_STAGE_BIT(DSP_STAGE_GATE)) {
+        CHECKF(gate.closes > 0 && gate.opens > 0, "mask %u: gate closed %u, opened %u",
+               mask, gate.closes, gate.opens);
+    }
+    if (mask & DSP_STAGE_BIT(DSP_STAGE_AGC)) {
+        CHECKF(agc.gain_lo < 1.0 && agc.gain_hi > 1.0, "mask %u: AGC gain %.2f..%.2f",
+               mask, agc.gain_lo, agc.gain_hi);
+    }
+}
+
+/*
+ * The built-in coefficients streams start from must be what the defaults
+ * derive to, or they drift apart when a design parameter changes
+ */
+static void check_default_coefs(void)
+{
+    CHECKF(dsp_chain_coefs_default(), "built-in coefficients not in use out of reset");
+    dsp_chain_configure(&dsp_chain_default_config);
+    CHECKF(dsp_chain_coefs_default(),
+           "dsp_chain_configure(defaults) differs from the built-in coefficients");
+    dsp_chain_configure(&gate_config);
+    CHECK(!dsp_chain_coefs_default());
+}
+
+int main(void)
+{
+    gate_config = dsp_chain_default_config;
+    gate_config.gate_release_ms = GATE_RELEASE_MS;
+    check_default_coefs();
+
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        const struct audio_format *fmt = audio_format_for_alt(alt);
+
+        for (uint32_t r = 0; r < fmt->num_rates; r++) {
+            for (size_t m = 0; m < sizeof(masks) / sizeof(masks[0]); m++) {
+                run(fmt, fmt->rates[r], masks[m]);
+            }
+        }
+    }
+    dsp_chain_configure(&dsp_chain_default_config);
+    dsp_chain_set_enabled(DSP_CHAIN_DEFAULT_MASK);
+    return host_test_result("dsp");
+}
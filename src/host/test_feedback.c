@@ -0,0 +1,275 @@
+/*
+ * Speaker rate feedback (fb_ctrl.h) closing the loop with a host.
+ *
+ * Each scenario runs its own clocks: the host's SOFs, the TIM2 crystal
+ * both sides are timestamped on and the DAC, with jitter on the DMA
+ * interrupt. The host sends packets as Linux does, from a Q16.16
+ * accumulator that reads the feedback every few frames some frames late;
+ * the buffer is what it sent less what the DAC has played. After the
+ * start-up the fill must sit on the set point and stay well clear of
+ * running dry or over, and the measurement must match the true rate.
+ *
+ * A separate case leaves an audio-side update in progress across a SOF
+ * (the SOF preempting the DMA ISR) and checks the window just closes a
+ * frame later with the measurement unharmed.
+ *
+ * Headset builds also run the whole speaker path on the board: OUT
+ * packets sized from the feedback endpoint's reports into audio_playback
+ * and the synthetic DAC at a few clock offsets, with no underrun, overrun
+ * or silence past priming allowed.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "audio_playback.h"
+#include "fb_ctrl.h"
+#include "sof_timer.h"
+#include "usb_descriptors.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define NOMINAL       48
+#define BLOCK         48
+#define TARGET        120
+#define RUN_S         600.0
+#define SETTLE_S      20.0      /* from the start and from a step */
+
+/* Settled: mean fill, its spread, and the margin to either end */
+#define FILL_MEAN_TOL  0.5
+#define FILL_SD_MAX    1.0
+#define FILL_SWING     6
+
+/*
+ * Smoothed measurement against the true rate, 10.14 LSBs: about 40 ppm,
+ * most of it 20 us of DMA jitter at the ends of a 128 ms window
+ */
+#define MEAS_TOL_Q14   32
+
+struct scenario {
+    const char *name;
+    double host_ppm;        /* SOF clock against true time */
+    double xtal_ppm;        /* TIM2 */
+    double dac_ppm;         /* audio clock */
+    double host_swing_ppm;  /* sinusoidal host drift, 10 min period */
+    double host_step_ppm;   /* added half way */
+    double jitter_us;       /* DMA interrupt latency, up to */
+    uint32_t fb_every;      /* host reads the feedback every n frames */
+    uint32_t fb_late;       /* and sees the value n frames old */
+};
+
+static const struct scenario scenarios[] = {
+    { "nominal clocks",               0,    0,    0,   0,   0,  2,  1, 2 },
+    { "host -150 ppm",             -150,   20,    0,   0,   0,  5,  1, 2 },
+    { "host +500 ppm",              500, -100,    0,   0,   0,  5,  8, 4 },
+    { "DAC +80 ppm off the crystal", -500,  30,  110,   0,   0,  5,  8, 4 },
+    { "host drifting +-300 ppm",      0,   10,  -30, 300,   0,  5,  4, 3 },
+    { "host stepping +250 ppm",    -100,  -30,  -30,   0, 250, 20, 16, 8 },
+};
+
+static uint32_t rng = 1;
+
+static double jitter(double max_s)
+{
+    rng = rng * 1664525u + 1013904223u;
+    return max_s * (rng >> 8) / 16777216.0;
+}
+
+static uint32_t tim2(double t, double xtal_ppm)
+{
+    return (uint32_t)(uint64_t)floor(t * SOF_TIMER_HZ * (1 + xtal_ppm * 1e-6));
+}
+
+static void run(const struct scenario *s)
+{
+    struct fb_ctrl fb;
+    double   rate = NOMINAL * 1000.0 * (1 + s->dac_ppm * 1e-6);
+    double   t_sof = 0, t_dma = BLOCK / rate;
+    uint32_t history[64], freq_q16 = NOMINAL << 16, phase = 0;
+    uint64_t sent = TARGET, frame = 0;
+    double   sum = 0, sum2 = 0, meas_err = 0, n = 0;
+    int64_t  lo = INT64_MAX, hi = INT64_MIN;
+
+    fb_ctrl_init(&fb, NOMINAL, TARGET);
+    for (uint32_t i = 0; i < 64; i++) {
+        history[i] = NOMINAL << 14;
+    }
+
+    while (t_sof < RUN_S) {
+        if (t_dma < t_sof) {
+            fb_ctrl_audio(&fb, tim2(t_dma + jitter(s->jitter_us * 1e-6), s->xtal_ppm), BLOCK);
+            t_dma += BLOCK / rate;
+            continue;
+        }
+
+        double host_ppm = s->host_ppm + s->host_swing_ppm * sin(2 * M_PI * t_sof / 600) +
+                          (t_sof > RUN_S / 2 ? s->host_step_ppm : 0);
+        int64_t fill = (int64_t)sent - (int64_t)floor(t_sof * rate);
+        uint32_t v = fb_ctrl_sof(&fb, tim2(t_sof, s->xtal_ppm), fill > 0 ? (uint32_t)fill : 0);
+
+        history[frame & 63] = v;
+        if (t_sof > SETTLE_S && fabs(t_sof - RUN_S / 2 - SETTLE_S / 2) > SETTLE_S / 2) {
+            /* True samples per host frame, in 10.14 */
+            double want = rate * 1e-3 * (1 + host_ppm * 1e-6) * 16384;
+
+            sum  += (double)fill;
+            sum2 += (double)fill * fill;
+            n++;
+            lo = fill < lo ? fill : lo;
+            hi = fill > hi ? fill : hi;
+            meas_err = fmax(meas_err, fabs(fb.meas_q14 - want));
+        }
+
+        /* Linux: Q16.16 samples per frame, refreshed from a late report */
+        if (frame % s->fb_every == 0 && frame > s->fb_late) {
+            freq_q16 = history[(frame - s->fb_late) & 63] << 2;
+        }
+        phase += freq_q16;
+        sent  += phase >> 16;
+        phase &= 0xFFFF;
+
+        frame++;
+        t_sof += 1e-3 * (1 + host_ppm * 1e-6);
+    }
+
+    double mean = sum / n, sd = sqrt(sum2 / n - mean * mean);
+
+    printf("  %-28s fill %7.2f sd %.2f %lld..%lld, measured within %.1f\n",
+           s->name, mean, sd, (long long)lo, (long long)hi, meas_err);
+    CHECKF(fabs(mean - TARGET) <= FILL_MEAN_TOL && sd <= FILL_SD_MAX,
+           "%s: fill %.2f sd %.2f", s->name, mean, sd);
+    CHECKF(lo >= TARGET - FILL_SWING && hi <= TARGET + FILL_SWING,
+           "%s: fill %lld..%lld", s->name, (long long)lo, (long long)hi);
+    CHECKF(meas_err <= MEAS_TOL_Q14, "%s: measurement off by %.1f", s->name, meas_err);
+}
+
+/*
+ * Audio at +100 ppm against exact SOFs. An update is left open from just
+ * before the third window is due to close until two SOFs later.
+ */
+static void preempted_update(void)
+{
+    struct fb_ctrl fb;
+    double   a = 0;
+    uint32_t due = 3 * FB_CTRL_WINDOW, held = 0, closed = UINT32_MAX;
+
+    fb_ctrl_init(&fb, NOMINAL, TARGET);
+    for (uint32_t k = 0; k < 1000; k++) {
+        while (a < (k + 1) * 96000.0) {
+            fb_ctrl_audio(&fb, (uint32_t)a, BLOCK);
+            a += 96000.0 / 1.0001;
+        }
+        if (k == due - 1 || k == due + 2) {
+            fb.aud_seq++;
+        }
+        fb_ctrl_sof(&fb, (uint32_t)((k + 1) * 96000.0), TARGET);
+        if (k == due + 1) {
+            held = fb.frames;
+        }
+        if (k == due + 2) {
+            closed = fb.frames;
+        }
+    }
+
+    double want = NOMINAL * 1.0001 * 16384;
+
+    CHECKF(held == FB_CTRL_WINDOW + 1 && closed == 0,
+           "window held to %u frames, then %u", held, closed);
+    CHECKF(fabs(fb.meas_q14 - want) <= 2, "measured %u, want %.0f", fb.meas_q14, want);
+}
+
+#if AUDIO_HEADSET
+
+#define BOARD_FRAMES  10000
+#define BOARD_SETTLE  3000
+
+static const double dac_ppms[] = { -300, 0, 450 };
+
+static uint32_t reported_q14;
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    if (pkt->ep == EP_SPK_FB && pkt->len == AUDIO_FEEDBACK_SIZE) {
+        reported_q14 = pkt->data[0] | pkt->data[1] << 8 | (uint32_t)pkt->data[2] << 16;
+    }
+}
+
+static void board_run(double ppm)
+{
+    static const uint8_t silence[AUDIO_SPK_MAX_PACKET_SIZE];
+    struct audio_playback_stats s0, ss;
+    uint32_t freq_q16 = NOMINAL << 16, phase = 0, lo = UINT32_MAX, hi = 0;
+
+    host_playback_set_ppm(ppm);
+    CHECK(host_board_set_interface(IFACE_AUDIO_SPEAKER, 0));
+    CHECK(host_board_set_interface(IFACE_AUDIO_SPEAKER, 1));
+    audio_playback_get_stats(&s0);
+    reported_q14 = 0;
+
+    for (uint32_t f = 0; f < BOARD_FRAMES; f++) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+
+        if (reported_q14) {
+            freq_q16 = reported_q14 << 2;
+        }
+        phase += freq_q16;
+        fr.out     = silence;
+        fr.out_len = (uint16_t)((phase >> 16) * AUDIO_SPK_FRAME_BYTES);
+        fr.out_ep  = EP_SPK_OUT;
+        phase &= 0xFFFF;
+        host_usb_frame(&fr);
+
+        if (f >= BOARD_SETTLE) {
+            uint32_t fill = audio_playback_fill_samples();
+
+            lo = fill < lo ? fill : lo;
+            hi = fill > hi ? fill : hi;
+        }
+    }
+    audio_playback_get_stats(&ss);
+
+    double want = NOMINAL * (1 + ppm * 1e-6) * 16384;
+
+    printf("  DAC %+4.0f ppm: fill %u..%u, feedback %.5f\n", ppm, lo, hi,
+           ss.feedback_q14 / 16384.0);
+    CHECKF(ss.underruns == s0.underruns && ss.overruns == s0.overruns,
+           "DAC %+.0f ppm: %u underruns, %u overruns", ppm,
+           ss.underruns - s0.underruns, ss.overruns - s0.overruns);
+    CHECKF(ss.silent - s0.silent <= AUDIO_PLAYBACK_TARGET_BLOCKS_X2 / 2 + 1,
+           "DAC %+.0f ppm: %u silent blocks", ppm, ss.silent - s0.silent);
+    CHECKF(lo >= TARGET - 2 * FILL_SWING && hi <= TARGET + 2 * FILL_SWING,
+           "DAC %+.0f ppm: fill %u..%u", ppm, lo, hi);
+    CHECKF(fabs(ss.feedback_q14 - want) <= MEAS_TOL_Q14,
+           "DAC %+.0f ppm: feedback %u, want %.0f", ppm, ss.feedback_q14, want);
+}
+
+static void board(void)
+{
+    host_board_init();
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+
+    for (size_t i = 0; i < sizeof(dac_ppms) / sizeof(dac_ppms[0]); i++) {
+        board_run(dac_ppms[i]);
+    }
+    CHECK(host_board_set_interface(IFACE_AUDIO_SPEAKER, 0));
+}
+
+#endif
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        run(&scenarios[i]);
+    }
+    preempted_update();
+#if AUDIO_HEADSET
+    board();
+#endif
+    return host_test_result("feedback");
+}
@@ -0,0 +1,266 @@
+/*
+ * Feature Unit gain (audio_gain.h) against a scalar model.
+ *
+ * For each container (16-bit, packed 24-bit, 24-in-32) and block sizes
+ * including odd ones, audio_gain_apply() must match the model bit for bit
+ * over steady gains and ramps: each frame scaled by its own step of the
+ * ramp, (s * g) >> 16 rounded down and saturated to the container. Then
+ * the same with every channel at a different gain and ramping its own way,
+ * one channel muted or at unity among others. The edge cases are spelled
+ * out too: full-scale samples at +12 dB clip to the rails, the most
+ * negative sample stays put at unity, mute gives zeros, a channel's
+ * target leaves the others alone, and the volume mapping clamps, rounds
+ * and handles silence.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "audio_gain.h"
+#include "usb_audio_uac1.h"
+#include "host_test.h"
+
+#define MAX_FRAMES  97
+#define MAX_BYTES   (MAX_FRAMES * AUDIO_NUM_CHANNELS * 4)
+
+static const uint8_t  containers[] = { 2, 3, 4 };
+static const uint32_t block_sizes[] = { 48, 47, 16, 1, MAX_FRAMES };
+
+static uint32_t rng = 1;
+
+static uint32_t next_rand(void)
+{
+    rng = rng * 1664525u + 1013904223u;
+    return rng;
+}
+
+static struct audio_stream_cfg make_cfg(uint8_t bytes, uint32_t frames)
+{
+    struct audio_stream_cfg cfg = {
+        .rate_hz           = frames * 1000,
+        .subframe_bytes    = bytes,
+        .bits              = bytes == 2 ? 16 : 24,
+        .samples_per_frame = (uint16_t)frames,
+        .frame_bytes       = (uint16_t)(AUDIO_NUM_CHANNELS * bytes),
+        .capture_hz        = frames * 1000,
+    };
+    return cfg;
+}
+
+/* Sample value in the container's own scale (16 or 24 bits) */
+static int32_t get(const uint8_t *p, uint8_t bytes)
+{
+    switch (bytes) {
+    case 2:
+        return (int16_t)(p[0] | p[1] << 8);
+    case 3:
+        return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 |
+                         (uint32_t)p[2] << 24) >> 8;
+    default:
+        return (int32_t)((uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+                         (uint32_t)p[3] << 24) >> 8;
+    }
+}
+
+static void put(uint8_t *p, uint8_t bytes, int32_t v)
+{
+    uint32_t u = (uint32_t)v;
+
+    if (bytes == 4) {
+        u <<= 8;
+    }
+    for (uint8_t i = 0; i < bytes; i++) {
+        p[i] = (uint8_t)(u >> (8 * i));
+    }
+}
+
+static int32_t model(int32_t s, int32_t g, uint8_t bytes)
+{
+    int32_t max = bytes == 2 ? INT16_MAX : (1 << 23) - 1;
+    int64_t y   = ((int64_t)s * g) >> 16;
+
+    return y > max ? max : y < -max - 1 ? -max - 1 : (int32_t)y;
+}
+
+/* Every channel at gain_q16, settled */
+static void settle(struct audio_gain *g, int32_t gain_q16)
+{
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        g->cur_q16[ch] = gain_q16;
+    }
+    audio_gain_set(g, gain_q16);
+}
+
+/* One block from cur[ch] to target[ch], checked against the model */
+static void run_block(uint8_t bytes, uint32_t frames, const int32_t *cur,
+                      const int32_t *target, const int32_t *fill, const char *what)
+{
+    static uint8_t pcm[MAX_BYTES] __attribute__((aligned(4)));
+    static uint8_t in[MAX_BYTES];
+    struct audio_stream_cfg cfg = make_cfg(bytes, frames);
+    struct audio_gain g;
+    int32_t  max = bytes == 2 ? INT16_MAX : (1 << 23) - 1;
+    uint32_t bad = 0;
+
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        g.cur_q16[ch] = cur[ch];
+        audio_gain_set_channel(&g, ch, target[ch]);
+    }
+
+    for (uint32_t i = 0; i < frames * AUDIO_NUM_CHANNELS; i++) {
+        int32_t s = fill ? fill[i % 2] : (int32_t)(next_rand() % (2u * max + 2)) - max - 1;
+
+        put(in + i * bytes, bytes, s);
+    }
+    memcpy(pcm, in, frames * cfg.frame_bytes);
+
+    audio_gain_apply(&g, pcm, frames, &cfg);
+
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            int32_t  d    = (target[ch] - cur[ch]) / (int32_t)frames;
+            int32_t  gi   = cur[ch] + d * (int32_t)(i + 1);
+            uint32_t at   = (i * AUDIO_NUM_CHANNELS + ch) * bytes;
+            int32_t  want = model(get(in + at, bytes), gi, bytes);
+            int32_t  got  = get(pcm + at, bytes);
+
+            if (got != want && !bad++) {
+                fprintf(stderr, "%s %u-byte/%u: frame %u ch %u: %d, want %d\n",
+                        what, bytes, frames, i, ch, got, want);
+            }
+        }
+    }
+    CHECKF(bad == 0, "%s %u-byte/%u frames: %u samples off", what, bytes, frames, bad);
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        CHECKF(g.cur_q16[ch] == target[ch], "%s: ch %u ends at %d, target %d", what, ch,
+               g.cur_q16[ch], target[ch]);
+    }
+}
+
+/* The same gain on every channel */
+static void run_block_all(uint8_t bytes, uint32_t frames, int32_t cur,
+                          int32_t target, const int32_t *fill, const char *what)
+{
+    int32_t c[AUDIO_NUM_CHANNELS], t[AUDIO_NUM_CHANNELS];
+
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        c[ch] = cur;
+        t[ch] = target;
+    }
+    run_block(bytes, frames, c, t, fill, what);
+}
+
+static const int32_t gains[] = {
+    0, 261, 32768, AUDIO_GAIN_UNITY, AUDIO_GAIN_UNITY + 1, 260904,
+};
+
+#define NUM_GAINS  (sizeof(gains) / sizeof(gains[0]))
+
+static void check_kernels(void)
+{
+    static const int32_t rails16[2] = { INT16_MAX, INT16_MIN };
+    static const int32_t rails24[2] = { (1 << 23) - 1, -(1 << 23) };
+
+    for (size_t c = 0; c < sizeof(containers); c++) {
+        uint8_t bytes = containers[c];
+        const int32_t *rails = bytes == 2 ? rails16 : rails24;
+
+        for (size_t b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+            uint32_t n = block_sizes[b];
+
+            for (size_t i = 0; i < NUM_GAINS; i++) {
+                run_block_all(bytes, n, gains[i], gains[i], NULL, "steady");
+                run_block_all(bytes, n, gains[i], gains[i], rails, "steady rails");
+                for (size_t j = 0; j < NUM_GAINS; j++) {
+                    if (i != j) {
+                        run_block_all(bytes, n, gains[i], gains[j], NULL, "ramp");
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Channel ch at gains[(i + ch) % n]: each one steady or ramping its own way */
+static void check_channels(void)
+{
+    int32_t cur[AUDIO_NUM_CHANNELS], target[AUDIO_NUM_CHANNELS];
+
+    for (size_t c = 0; c < sizeof(containers); c++) {
+        for (size_t b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+            for (size_t i = 0; i < NUM_GAINS; i++) {
+                for (size_t j = 0; j < NUM_GAINS; j++) {
+                    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+                        cur[ch]    = gains[(i + ch) % NUM_GAINS];
+                        target[ch] = gains[(j + 2 * ch) % NUM_GAINS];
+                    }
+                    run_block(containers[c], block_sizes[b], cur, target, NULL,
+                              "per channel");
+                }
+            }
+        }
+    }
+}
+
+/* The behaviour at the rails, spelled out rather than modelled */
+static void check_edges(void)
+{
+    uint8_t pcm[4 * AUDIO_NUM_CHANNELS * 4] __attribute__((aligned(4)));
+    struct audio_stream_cfg cfg = make_cfg(2, 2);
+    struct audio_gain g = AUDIO_GAIN_INIT;
+
+    /* +12 dB on both 16-bit rails clips to them */
+    for (uint32_t i = 0; i < 2 * AUDIO_NUM_CHANNELS; i++) {
+        put(pcm + 2 * i, 2, i % 2 ? INT16_MIN : INT16_MAX);
+    }
+    settle(&g, audio_gain_from_volume(AUDIO_GAIN_VOL_MAX));
+    audio_gain_apply(&g, pcm, 2, &cfg);
+    for (uint32_t i = 0; i < 2 * AUDIO_NUM_CHANNELS; i++) {
+        CHECK(get(pcm + 2 * i, 2) == (i % 2 ? INT16_MIN : INT16_MAX));
+    }
+
+    /* Unity leaves -32768 alone; mute zeroes everything */
+    put(pcm, 2, INT16_MIN);
+    g = (struct audio_gain)AUDIO_GAIN_INIT;
+    audio_gain_apply(&g, pcm, 1, &cfg);
+    CHECK(get(pcm, 2) == INT16_MIN);
+
+    memset(pcm, 0x5A, sizeof(pcm));
+    settle(&g, 0);
+    audio_gain_apply(&g, pcm, 2, &cfg);
+    for (uint32_t i = 0; i < 2 * cfg.frame_bytes; i++) {
+        CHECK(pcm[i] == 0);
+    }
+
+    /* A channel's target moves that channel only; past the last, none */
+    settle(&g, AUDIO_GAIN_UNITY);
+    audio_gain_set_channel(&g, AUDIO_NUM_CHANNELS - 1, 0);
+    audio_gain_set_channel(&g, AUDIO_NUM_CHANNELS, 0);
+    for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+        CHECK(g.target_q16[ch] == (ch == AUDIO_NUM_CHANNELS - 1 ? 0 : AUDIO_GAIN_UNITY));
+    }
+
+    /* Volume mapping */
+    CHECK(audio_gain_from_volume(USB_AUDIO_VOLUME_SILENCE) == 0);
+    CHECK(audio_gain_from_volume(0) == AUDIO_GAIN_UNITY);
+    CHECK(audio_gain_from_volume(127) == AUDIO_GAIN_UNITY);
+    CHECK(audio_gain_from_volume(128) == 73533);
+    CHECK(audio_gain_from_volume(-128) == 58409);
+    CHECK(audio_gain_from_volume(AUDIO_GAIN_VOL_MAX) == 260904);
+    CHECK(audio_gain_from_volume(INT16_MAX) == 260904);
+    CHECK(audio_gain_from_volume(AUDIO_GAIN_VOL_MIN) == 261);
+    CHECK(audio_gain_from_volume(USB_AUDIO_VOLUME_SILENCE + 1) == 261);
+    CHECK(audio_gain_volume_clamp(AUDIO_GAIN_VOL_MAX + 1) == AUDIO_GAIN_VOL_MAX);
+    CHECK(audio_gain_volume_clamp(AUDIO_GAIN_VOL_MIN - 1) == AUDIO_GAIN_VOL_MIN);
+    CHECK(audio_gain_volume_clamp(-383) == -256);
+    CHECK(audio_gain_volume_clamp(-385) == -512);
+}
+
+int main(void)
+{
+    check_kernels();
+    check_channels();
+    check_edges();
+    return host_test_result("gain");
+}
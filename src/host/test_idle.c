@@ -0,0 +1,112 @@
+/*
+ * Main-loop idle time and SOF-to-packet latency, as the profile blob
+ * reports them (prof_blob.h, task_queue.h).
+ *
+ * The host streams alt 1 with the device's loop kept busy (the USB
+ * interrupt held off, or in USB_POLLED builds the poll not reached) for
+ * the first steps of every frame, resets the profiler and reads a blob
+ * back through PROF_READ. Simulated code takes no time, so the loop is
+ * idle for every step it waits out but the held ones, and the next
+ * packet is armed once the host has taken this one: at the token, or at
+ * the end of a hold that runs past it. The idle window must cover the
+ * frames run, the idle share and the SOF_LATENCY stage must match the
+ * hold, and a packet must have been written every frame. Run in every
+ * variant, this compares the interrupt and the polled builds.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <libopencm3/usb/usbstd.h>
+
+#include "prof_blob.h"
+#include "usb_descriptors.h"
+#include "usb_vendor.h"
+#include "host_board.h"
+#include "host_test.h"
+
+/* As main.c */
+#ifndef USB_POLLED
+#define USB_POLLED 0
+#endif
+
+#define REQ_VENDOR_IN   (USB_REQ_TYPE_IN | USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_DEVICE)
+#define REQ_VENDOR_OUT  (USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_DEVICE)
+
+#define SETTLE_FRAMES   100
+#define RUN_FRAMES      1000
+#define STEP_TICKS      (HOST_HW_TICKS_PER_MS / HOST_USB_STEPS)
+
+/* Steps of each frame the loop is kept busy for, before and past the token */
+static const uint32_t holds[] = { 0, 30, 60, 90 };
+
+static uint8_t blob[PROF_BLOB_SIZE];
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static const uint8_t *stage(enum prof_stage s)
+{
+    return blob + PROF_BLOB_HEADER_SIZE + s * PROF_BLOB_STAGE_SIZE;
+}
+
+static void run(uint32_t hold)
+{
+    CHECK(host_usb_control(REQ_VENDOR_OUT, VENDOR_REQ_PROF_RESET, 0, 0, NULL, 0) == 0);
+    for (uint32_t f = 0; f < RUN_FRAMES; f++) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+
+        fr.hold = hold;
+        host_usb_frame(&fr);
+    }
+    if (host_usb_control(REQ_VENDOR_IN, VENDOR_REQ_PROF_READ, 0, 0, blob,
+                         sizeof(blob)) != (int)sizeof(blob)) {
+        CHECKF(false, "hold %u: PROF_READ stalled", hold);
+        return;
+    }
+
+    uint32_t window  = get32(blob + 20);
+    uint32_t idle    = get32(blob + 24);
+    uint32_t packets = get32(stage(PROF_STAGE_PACKET_WRITE));
+    uint32_t lat_min = get32(stage(PROF_STAGE_SOF_LATENCY) + 8);
+    uint32_t lat_max = get32(stage(PROF_STAGE_SOF_LATENCY) + 12);
+
+    /* The waits between steps the loop ran at, the one into the next frame too */
+    uint32_t waits = hold ? HOST_USB_STEPS - hold - 1 : HOST_USB_STEPS;
+    double   share = 100.0 * idle / window;
+    double   want  = 100.0 * waits / HOST_USB_STEPS;
+    uint32_t armed = hold > HOST_USB_STEPS / 2 ? hold : HOST_USB_STEPS / 2;
+
+    printf("  %s, hold %2u steps: idle %5.1f%% of %.1f ms, SOF to packet %.1f..%.1f us, "
+           "%u packets\n", USB_POLLED ? "polled" : "interrupt", hold, share,
+           window / (double)HOST_HW_TICKS_PER_MS, lat_min * 1e3 / HOST_HW_TICKS_PER_MS,
+           lat_max * 1e3 / HOST_HW_TICKS_PER_MS, packets);
+    CHECKF(window >= RUN_FRAMES * HOST_HW_TICKS_PER_MS &&
+           window <= (RUN_FRAMES + 1) * HOST_HW_TICKS_PER_MS,
+           "hold %u: idle window %u cycles for %u frames", hold, window, RUN_FRAMES);
+    CHECKF(share > want - 0.5 && share < want + 0.5,
+           "hold %u: idle %.2f%%, want %.2f%%", hold, share, want);
+    CHECKF(lat_min >= armed * STEP_TICKS && lat_max <= (armed + 1) * STEP_TICKS,
+           "hold %u: SOF to packet %u..%u ticks, want %u..%u", hold, lat_min, lat_max,
+           armed * STEP_TICKS, (armed + 1) * STEP_TICKS);
+    CHECKF(packets >= RUN_FRAMES - 1 && packets <= RUN_FRAMES + 1,
+           "hold %u: %u packets written in %u frames", hold, packets, RUN_FRAMES);
+}
+
+int main(void)
+{
+    host_board_init();
+    CHECK(host_board_enumerate());
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 1));
+    host_board_run(SETTLE_FRAMES);
+
+    for (size_t i = 0; i < sizeof(holds) / sizeof(holds[0]); i++) {
+        run(holds[i]);
+    }
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    return host_test_result("idle");
+}
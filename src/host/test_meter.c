@@ -0,0 +1,266 @@
+/*
+ * Level meters and spectrum (audio_meter.h) against a double reference.
+ *
+ * Blocks are fed as the capture ISR would and analysed as the SOF task
+ * would, one audio_meter_run() per block. Each time a snapshot shows a
+ * new transform, its band levels are compared with a double-precision
+ * Hann-windowed DFT of the same 256 samples; each time a level window
+ * completes, peak and rms are compared with the window's samples.
+ * Signals are tones from 0 to -60 dBFS, white noise and a three-tone mix,
+ * in every format and rate the build streams.
+ *
+ * Band error allowed, by distance below the loudest band of the same
+ * transform: 0.1 dB within 20 dB, 0.5 dB to 40 dB, 3 dB to 60 dB; beyond
+ * that the bands sit on the FFT's rounding floor (meter_blob.h) and are
+ * not checked. Peak and rms: 0.01 dB.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_format.h"
+#include "audio_meter.h"
+#include "host_test.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define BLOCKS      700
+#define WINDOW_MS   50
+#define Q23_FULL    8388608.0
+
+enum signal { SIG_TONE, SIG_NOISE, SIG_MIX };
+
+struct signal_case {
+    const char  *name;
+    enum signal  kind;
+    double       db;
+    double       hz;
+};
+
+static const struct signal_case signals[] = {
+    { "tone 0 dB",    SIG_TONE,    0.0,  1000.0 },
+    { "tone -20 dB",  SIG_TONE,  -20.0,  3100.0 },
+    { "tone -60 dB",  SIG_TONE,  -60.0,   440.0 },
+    { "noise -10 dB", SIG_NOISE, -10.0,      0.0 },
+    { "mix",          SIG_MIX,    -1.0,   700.0 },
+};
+
+/* Allowed band error by 20 dB step below the loudest band */
+static const double band_tol[] = { 0.1, 0.5, 3.0 };
+
+/* The run's samples as the meter sees them (Q23), interleaved */
+static int32_t *sig;
+
+/*
+ * Channel the meter transforms next. It starts over at 0 when the block
+ * format changes and otherwise carries on round robin from the last run.
+ */
+static uint32_t next_ch;
+static struct audio_stream_cfg last_cfg;
+
+static uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static double level_db(const uint8_t *p)
+{
+    return (int16_t)(p[0] | p[1] << 8) / 256.0;
+}
+
+static void make_signal(const struct signal_case *s, uint32_t rate, uint8_t bytes,
+                        uint32_t frames)
+{
+    double   amp = pow(10.0, s->db / 20.0) * (Q23_FULL - 1);
+    uint64_t x   = 88172645463325252ull;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            double f = s->hz * (1.0 + 0.37 * ch), v;
+
+            switch (s->kind) {
+            case SIG_TONE:
+                v = amp * sin(2 * M_PI * f * i / rate + ch);
+                break;
+            case SIG_NOISE:
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                v = amp * ((double)(x >> 11) / 9007199254740992.0 * 2 - 1);
+                break;
+            default:
+                v = amp * (0.5 * sin(2 * M_PI * f * i / rate) +
+                           0.01 * sin(2 * M_PI * f * 3.3 * i / rate) +
+                           0.001 * sin(2 * M_PI * f * 9.7 * i / rate));
+                break;
+            }
+
+            long q = lrint(v);
+
+            q = q > 8388607 ? 8388607 : q < -8388608 ? -8388608 : q;
+            /* 16-bit blocks carry the top bits only */
+            sig[i * AUDIO_NUM_CHANNELS + ch] = bytes == 2 ? (int32_t)(q >> 8) * 256 : (int32_t)q;
+        }
+    }
+}
+
+static void put_block(uint8_t *blk, uint32_t first, uint32_t frames, uint8_t bytes)
+{
+    for (uint32_t i = 0; i < frames * AUDIO_NUM_CHANNELS; i++) {
+        int32_t  s = sig[first * AUDIO_NUM_CHANNELS + i];
+        uint32_t u = bytes == 2 ? (uint32_t)(s >> 8) : bytes == 3 ? (uint32_t)s : (uint32_t)s << 8;
+
+        for (uint8_t b = 0; b < bytes; b++) {
+            blk[i * bytes + b] = (uint8_t)(u >> (8 * b));
+        }
+    }
+}
+
+/* Hann-windowed power of bins [lo, hi) relative to a full-scale sine, dB */
+static double ref_band(uint32_t ch, uint32_t start, uint32_t lo, uint32_t hi)
+{
+    double p = 0;
+
+    for (uint32_t k = lo; k < hi && k < METER_FFT_SIZE / 2; k++) {
+        double re = 0, im = 0;
+
+        for (uint32_t n = 0; n < METER_FFT_SIZE; n++) {
+            double w = 0.5 - 0.5 * cos(2 * M_PI * n / METER_FFT_SIZE);
+            double x = sig[(start + n) * AUDIO_NUM_CHANNELS + ch] / Q23_FULL * w;
+
+            re += x * cos(2 * M_PI * k * n / METER_FFT_SIZE);
+            im -= x * sin(2 * M_PI * k * n / METER_FFT_SIZE);
+        }
+        p += re * re + im * im;
+    }
+
+    double full = 1.5 * pow(METER_FFT_SIZE / 4.0, 2);
+    return p > 0 ? 10 * log10(p / full) : -1e9;
+}
+
+static void run(const struct signal_case *s, const struct audio_format *fmt, uint32_t rate)
+{
+    static uint8_t blk[AUDIO_MAX_SAMPLES_PER_FRAME * AUDIO_NUM_CHANNELS * 4];
+    static uint8_t blob[METER_BLOB_SIZE];
+    struct audio_stream_cfg cfg;
+    uint32_t start = 0, checked = 0;
+    double   band_err[3] = { 0 }, peak_err = 0, rms_err = 0;
+
+    audio_format_make_cfg(fmt, rate, &cfg);
+    if (memcmp(&cfg, &last_cfg, sizeof(cfg)) != 0) {
+        next_ch  = 0;
+        last_cfg = cfg;
+    }
+
+    uint8_t  bytes = cfg.subframe_bytes;
+    uint32_t spf   = cfg.samples_per_frame;
+
+    make_signal(s, rate, bytes, BLOCKS * spf);
+    CHECK(audio_meter_configure(AUDIO_METER_ALL, WINDOW_MS));
+
+    /* Counters run on across configures: note where this run starts */
+    audio_meter_snapshot(blob, sizeof(blob));
+
+    uint32_t spectra = le32(blob + 20), windows0 = le32(blob + 16);
+    uint32_t windows = windows0, drops = le32(blob + 24);
+
+    for (uint32_t k = 0; k < BLOCKS; k++) {
+        put_block(blk, k * spf, spf, bytes);
+        audio_meter_block(blk, &cfg);
+        audio_meter_run();
+        audio_meter_snapshot(blob, sizeof(blob));
+
+        const uint8_t *edges = blob + METER_BLOB_HEADER_SIZE;
+        const uint8_t *chans = edges + METER_BLOB_EDGES_SIZE;
+
+        /* A new transform: its samples start where the last one finished */
+        if (le32(blob + 20) != spectra) {
+            uint32_t ch = next_ch;
+            const uint8_t *c = chans + ch * METER_BLOB_CHANNEL_SIZE;
+            double ref[METER_NUM_BANDS], top = -1e9;
+
+            spectra = le32(blob + 20);
+            for (uint32_t b = 0; b < METER_NUM_BANDS; b++) {
+                ref[b] = ref_band(ch, start, edges[b], edges[b + 1]);
+                top = ref[b] > top ? ref[b] : top;
+            }
+            for (uint32_t b = 0; b < METER_NUM_BANDS; b++) {
+                unsigned step = (unsigned)((top - ref[b]) / 20);
+                double   e = fabs(level_db(c + 4 + 2 * b) - ref[b]);
+
+                if (step < 3 && e > band_err[step]) {
+                    band_err[step] = e;
+                }
+            }
+            next_ch = (next_ch + 1) % AUDIO_NUM_CHANNELS;
+            start = (k + 1) * spf;
+            checked++;
+        }
+
+        /* A level window ends with this block */
+        if (le32(blob + 16) != windows) {
+            uint32_t first = (k + 1 - WINDOW_MS) * spf, last = (k + 1) * spf;
+
+            windows = le32(blob + 16);
+            for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+                const uint8_t *c = chans + ch * METER_BLOB_CHANNEL_SIZE;
+                double pk = 0, ss = 0;
+
+                for (uint32_t i = first; i < last; i++) {
+                    double v = sig[i * AUDIO_NUM_CHANNELS + ch];
+
+                    pk = fabs(v) > pk ? fabs(v) : pk;
+                    ss += v * v;
+                }
+
+                double pk_db  = 20 * log10(pk / Q23_FULL);
+                double rms_db = 10 * log10(ss / (last - first) / (Q23_FULL * Q23_FULL));
+
+                peak_err = fmax(peak_err, fabs(level_db(c) - pk_db));
+                rms_err  = fmax(rms_err, fabs(level_db(c + 2) - rms_db));
+            }
+        }
+    }
+
+    CHECKF(le32(blob + 24) == drops, "%s %u-byte %u Hz: %u blocks dropped",
+           s->name, bytes, rate, le32(blob + 24) - drops);
+    CHECKF(checked >= BLOCKS / 32 && windows - windows0 == BLOCKS / WINDOW_MS,
+           "%s %u-byte %u Hz: %u transforms, %u windows", s->name, bytes, rate,
+           checked, windows - windows0);
+    for (unsigned i = 0; i < 3; i++) {
+        CHECKF(band_err[i] <= band_tol[i], "%s %u-byte %u Hz: bands %u-%u dB down off by %.3f dB",
+               s->name, bytes, rate, 20 * i, 20 * i + 20, band_err[i]);
+    }
+    CHECKF(peak_err <= 0.01 && rms_err <= 0.01, "%s %u-byte %u Hz: peak off %.4f dB, rms %.4f dB",
+           s->name, bytes, rate, peak_err, rms_err);
+
+    CHECK(audio_meter_configure(0, 0));
+    audio_meter_run();
+}
+
+int main(void)
+{
+    sig = malloc(sizeof(*sig) * BLOCKS * AUDIO_MAX_SAMPLES_PER_FRAME * AUDIO_NUM_CHANNELS);
+    if (!sig) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+        for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+            const struct audio_format *fmt = audio_format_for_alt(alt);
+
+            for (uint32_t r = 0; r < fmt->num_rates; r++) {
+                run(&signals[i], fmt, fmt->rates[r]);
+            }
+        }
+    }
+
+    free(sig);
+    return host_test_result("meter");
+}
@@ -0,0 +1,278 @@
+/*
+ * Stream power states and time to first packet (stream_power.h).
+ *
+ * The host walks the mic interface through the state machine: alt 0
+ * after enumeration, each alt selected from idle after idle stretches of
+ * different lengths and with the host's token early, mid or late in the
+ * frame, alt to alt while streaming, suspend and resume while streaming
+ * and while idle, and a bus reset mid-stream. After each step the state,
+ * the core clock level, the capture DMA and PLLI2S and the USB PHY clock
+ * gate must be what stream_power.h says; idle and suspended, nothing may
+ * reach the host.
+ *
+ * Every start must reach STREAMING with the first packet of captured
+ * audio on the wire within STREAM_POWER_FIRST_PACKET_FRAMES of the alt
+ * being selected (or the bus resuming), as the host times it and as
+ * stream_power's own first-packet statistics report it, with no start
+ * counted as slow.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "audio_format.h"
+#include "stream_power.h"
+#include "usb_descriptors.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define IDLE_FRAMES     20
+#define FIRST_TICKS     (STREAM_POWER_FIRST_PACKET_FRAMES * HOST_HW_TICKS_PER_MS)
+
+static const uint32_t idle_stretches[] = { 1, 7, 33 };
+static const uint32_t token_steps[]    = { 2, HOST_USB_STEPS / 2, HOST_USB_STEPS - 4 };
+
+/* What reaches the host on the mic endpoint */
+static struct {
+    uint32_t packets;       /* any length, silence included */
+    uint64_t t_audio;       /* host_hw_now() at the first captured audio, 0 none */
+} in;
+
+/* Low 16 bits of the capture index: never an all-zero packet */
+static int32_t counter(uint32_t ch, uint64_t n)
+{
+    (void)ch;
+    return (int32_t)(((uint32_t)n & 0xFFFFu) << 8) - 0x800000;
+}
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    if (pkt->ep != EP_AUDIO_IN) {
+        return;
+    }
+    in.packets++;
+    for (uint16_t i = 0; !in.t_audio && i < pkt->len; i++) {
+        if (pkt->data[i]) {
+            in.t_audio = pkt->t;
+        }
+    }
+}
+
+static void frames(uint32_t n, uint32_t token)
+{
+    while (n--) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+
+        fr.token = token;
+        host_usb_frame(&fr);
+    }
+}
+
+/* No SOFs and no tokens while the bus is suspended */
+static void suspended_frames(uint32_t n)
+{
+    while (n--) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+
+        fr.token    = HOST_USB_NO_TOKEN;
+        fr.sof_lost = true;
+        host_usb_frame(&fr);
+    }
+}
+
+/* Clocks down, capture stopped, nothing on the wire */
+static void check_quiet(const char *what, enum stream_state want, bool phy_off)
+{
+    struct host_power_stats ps;
+    struct host_capture_stats cs;
+
+    host_power_get_stats(&ps);
+    host_capture_get_stats(&cs);
+    CHECKF(stream_power_state() == want, "%s: state %d, want %d", what,
+           stream_power_state(), want);
+    CHECKF(ps.level == POWER_LOW && ps.usb_suspended == phy_off,
+           "%s: level %d, PHY clock %s", what, ps.level, ps.usb_suspended ? "off" : "on");
+    CHECKF(!cs.running && cs.gated, "%s: capture %s, PLLI2S %s", what,
+           cs.running ? "running" : "stopped", cs.gated ? "off" : "on");
+}
+
+/*
+ * From a start at t0 (host_hw_now()): ARMED with the clocks up at once,
+ * then STREAMING with captured audio on the wire in time
+ */
+static void check_start(const char *what, uint32_t token, uint64_t t0)
+{
+    struct host_power_stats ps;
+    struct host_capture_stats cs;
+    struct stream_power_stats s0, ss;
+    uint32_t f = 0;
+
+    host_power_get_stats(&ps);
+    host_capture_get_stats(&cs);
+    stream_power_get_stats(&s0);
+    CHECKF(stream_power_state() == STREAM_ARMED && ps.level == POWER_FULL &&
+           !ps.usb_suspended && cs.running && !cs.gated,
+           "%s: state %d, level %d, capture %s", what, stream_power_state(), ps.level,
+           cs.running ? "running" : "stopped");
+
+    in.t_audio = 0;
+    while (stream_power_state() == STREAM_ARMED && f++ < 2 * STREAM_POWER_FIRST_PACKET_FRAMES) {
+        frames(1, token);
+    }
+    stream_power_get_stats(&ss);
+
+    uint64_t host_ticks = in.t_audio ? in.t_audio - t0 : UINT64_MAX;
+
+    CHECKF(stream_power_state() == STREAM_STREAMING && host_ticks <= FIRST_TICKS,
+           "%s: state %d, first audio after %.2f ms", what, stream_power_state(),
+           host_ticks / (double)HOST_HW_TICKS_PER_MS);
+    CHECKF(ss.first_packet_last <= FIRST_TICKS && ss.slow_starts == s0.slow_starts,
+           "%s: first packet after %.2f ms by its own count, %u slow", what,
+           ss.first_packet_last / (double)HOST_HW_TICKS_PER_MS,
+           ss.slow_starts - s0.slow_starts);
+}
+
+static bool select_alt(uint8_t alt)
+{
+    return host_board_set_interface(IFACE_AUDIO_STREAM, alt);
+}
+
+/* Each alt from idle, with the token at different points of the frame */
+static void from_idle(void)
+{
+    char what[64];
+
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        for (size_t i = 0; i < sizeof(idle_stretches) / sizeof(idle_stretches[0]); i++) {
+            for (size_t t = 0; t < sizeof(token_steps) / sizeof(token_steps[0]); t++) {
+                uint32_t p0 = in.packets;
+
+                snprintf(what, sizeof(what), "alt %u after %u idle, token at %u", alt,
+                         idle_stretches[i], token_steps[t]);
+                CHECK(select_alt(0));
+                frames(idle_stretches[i], token_steps[t]);
+                check_quiet(what, STREAM_IDLE, false);
+                CHECKF(in.packets == p0, "%s: %u packets while idle", what, in.packets - p0);
+
+                uint64_t t0 = host_hw_now();
+
+                CHECK(select_alt(alt));
+                check_start(what, token_steps[t], t0);
+                frames(IDLE_FRAMES, token_steps[t]);
+            }
+        }
+    }
+}
+
+/* Alt to alt while streaming: a restart with no clock gating between */
+static void alt_to_alt(void)
+{
+    char what[64];
+
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        uint8_t next = alt % AUDIO_NUM_FORMATS + 1;
+        struct host_power_stats p0, p1;
+        struct host_capture_stats c0, c1;
+
+        snprintf(what, sizeof(what), "alt %u to %u", alt, next);
+        CHECK(select_alt(alt));
+        frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+        host_power_get_stats(&p0);
+        host_capture_get_stats(&c0);
+
+        uint64_t t0 = host_hw_now();
+
+        CHECK(select_alt(next));
+        check_start(what, HOST_USB_STEPS / 2, t0);
+        host_power_get_stats(&p1);
+        host_capture_get_stats(&c1);
+        CHECKF(p1.changes == p0.changes && c1.sleeps == c0.sleeps,
+               "%s: %u level changes, %u capture sleeps", what, p1.changes - p0.changes,
+               c1.sleeps - c0.sleeps);
+    }
+}
+
+static void suspend_resume(void)
+{
+    struct stream_power_stats s0, ss;
+    uint32_t p0;
+
+    /* Streaming: the alt is kept and streaming restarts on resume */
+    CHECK(select_alt(1));
+    frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+    stream_power_get_stats(&s0);
+    host_usb_bus_suspend();
+    p0 = in.packets;
+    suspended_frames(IDLE_FRAMES);
+    check_quiet("suspended while streaming", STREAM_SUSPENDED, true);
+    CHECKF(in.packets == p0, "suspended: %u packets", in.packets - p0);
+
+    uint64_t t0 = host_hw_now();
+
+    host_usb_bus_resume();
+    check_start("resumed", HOST_USB_STEPS / 2, t0);
+    stream_power_get_stats(&ss);
+    CHECKF(ss.suspends == s0.suspends + 1 && ss.starts == s0.starts + 1,
+           "suspend and resume: %u suspends, %u starts", ss.suspends - s0.suspends,
+           ss.starts - s0.starts);
+
+    /* Idle: back to idle */
+    CHECK(select_alt(0));
+    frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+    host_usb_bus_suspend();
+    suspended_frames(IDLE_FRAMES);
+    check_quiet("suspended while idle", STREAM_SUSPENDED, true);
+    host_usb_bus_resume();
+    frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+    check_quiet("resumed idle", STREAM_IDLE, false);
+
+    /* A bus reset drops the alt, suspended or not */
+    CHECK(select_alt(1));
+    frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+    host_usb_bus_reset();
+    check_quiet("bus reset while streaming", STREAM_IDLE, false);
+    CHECK(host_board_enumerate());
+    CHECK(select_alt(1));
+    host_usb_bus_suspend();
+    host_usb_bus_reset();
+    check_quiet("bus reset while suspended", STREAM_IDLE, false);
+    CHECK(host_board_enumerate());
+}
+
+#if AUDIO_HEADSET
+/* The speaker holds the clocks up with the mic idle */
+static void speaker(void)
+{
+    struct host_power_stats ps;
+
+    CHECK(select_alt(0));
+    CHECK(host_board_set_interface(IFACE_AUDIO_SPEAKER, 1));
+    frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+    host_power_get_stats(&ps);
+    CHECKF(stream_power_state() == STREAM_IDLE && ps.level == POWER_FULL,
+           "speaker on, mic idle: state %d, level %d", stream_power_state(), ps.level);
+    CHECK(host_board_set_interface(IFACE_AUDIO_SPEAKER, 0));
+    frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+    check_quiet("speaker off, mic idle", STREAM_IDLE, false);
+}
+#endif
+
+int main(void)
+{
+    host_board_init();
+    host_capture_set_source(counter);
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+
+    frames(IDLE_FRAMES, HOST_USB_STEPS / 2);
+    check_quiet("enumerated", STREAM_IDLE, false);
+
+    from_idle();
+    alt_to_alt();
+    suspend_resume();
+#if AUDIO_HEADSET
+    speaker();
+#endif
+    return host_test_result("power");
+}
@@ -0,0 +1,264 @@
+/*
+ * prof_decode against canned profile blobs (prof_blob.h).
+ *
+ *   test_prof <prof_decode> <scratch file>
+ *
+ * Each case lays out a blob field by field, independently of profiler.c,
+ * runs the decoder on it and compares everything it prints with the text
+ * expected: v3 at full speed and at a divided HCLK, v2 and v1 blobs, one
+ * from newer firmware with more stages, and the malformed blobs it must
+ * refuse.
+ * A last case round-trips a prof_snapshot() so the firmware and the canned
+ * layout cannot drift apart unnoticed.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "prof_blob.h"
+#include "profiler.h"
+#include "host_test.h"
+
+struct canned_stage {
+    uint32_t count, last, min, max;
+    uint64_t sum;
+    uint32_t hist[PROF_HIST_BUCKETS];
+};
+
+struct canned {
+    const char *name;
+    uint32_t magic;
+    uint16_t version;
+    uint8_t  n_stages;
+    uint8_t  n_buckets;
+    uint32_t clock_div;
+    uint32_t cut;                          /* bytes dropped off the end */
+    const char *want;                      /* stdout + stderr */
+    int      want_status;
+};
+
+static const char *decoder;
+static const char *scratch;
+
+static uint8_t blob[4096];
+
+/* Idle window every v3 case carries: 95% of 960000 cycles */
+#define IDLE_WINDOW  960000u
+#define IDLE_CYCLES  912000u
+
+/* Stages every case carries; the rest of the table is idle */
+static const struct canned_stage busy[PROF_NUM_STAGES] = {
+    [PROF_STAGE_SOF] = {
+        .count = 1000, .last = 849, .min = 800, .max = 849, .sum = 824500,
+        .hist = { [10] = 1000 },
+    },
+    [PROF_STAGE_CAPTURE_ISR] = {
+        .count = 4, .last = 1, .min = 0, .max = 3, .sum = 6,
+        .hist = { [0] = 1, [1] = 1, [2] = 2 },
+    },
+    [PROF_STAGE_DSP] = {
+        .count = 1, .last = 40000, .min = 40000, .max = 40000, .sum = 40000,
+        .hist = { [PROF_HIST_BUCKETS - 1] = 1 },
+    },
+    [PROF_STAGE_SOF_LATENCY] = {
+        .count = 1000, .last = 3399, .min = 3000, .max = 3399,
+        .sum = 3199500ull + (1ull << 32),
+        .hist = { [11] = 600, [12] = 400 },
+    },
+};
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint32_t lay_out(const struct canned *c)
+{
+    uint32_t header = c->version == 1 ? 16 : c->version == 2 ? 20 : PROF_BLOB_HEADER_SIZE;
+    uint8_t *p = blob + header;
+
+    memset(blob, 0, sizeof(blob));
+    put32(blob, c->magic);
+    blob[4] = (uint8_t)c->version;
+    blob[5] = (uint8_t)(c->version >> 8);
+    blob[6] = c->n_stages;
+    blob[7] = c->n_buckets;
+    put32(blob + 8, PROF_CLOCK_HZ);
+    put32(blob + 12, 123456789);
+    if (c->version != 1) {
+        put32(blob + 16, c->clock_div);
+    }
+    if (c->version >= 3) {
+        put32(blob + 20, IDLE_WINDOW);
+        put32(blob + 24, IDLE_CYCLES);
+    }
+
+    for (uint32_t i = 0; i < c->n_stages; i++) {
+        const struct canned_stage *s = i < PROF_NUM_STAGES ? &busy[i] : &busy[0];
+
+        put32(p + 0, s->count);
+        put32(p + 4, s->last);
+        put32(p + 8, s->count ? s->min : UINT32_MAX);
+        put32(p + 12, s->max);
+        put32(p + 16, (uint32_t)s->sum);
+        put32(p + 20, (uint32_t)(s->sum >> 32));
+        for (uint32_t b = 0; b < c->n_buckets; b++) {
+            put32(p + 24 + 4 * b, b < PROF_HIST_BUCKETS ? s->hist[b] : 0);
+        }
+        p += 24 + 4 * c->n_buckets;
+    }
+    return (uint32_t)(p - blob) - c->cut;
+}
+
+/* Runs the decoder on len bytes of blob; its output in out, exit status returned */
+static int decode(uint32_t len, char *out, size_t cap)
+{
+    char cmd[512];
+    FILE *f = fopen(scratch, "wb");
+
+    if (!f || fwrite(blob, 1, len, f) != len || fclose(f)) {
+        perror(scratch);
+        return -1;
+    }
+
+    snprintf(cmd, sizeof(cmd), "%s %s 2>&1", decoder, scratch);
+    if (!(f = popen(cmd, "r"))) {
+        perror(cmd);
+        return -1;
+    }
+    out[fread(out, 1, cap - 1, f)] = '\0';
+
+    int status = pclose(f);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+#define STAGE_TABLE \
+    "stage              count      min      avg      max     last  (cycles)\n" \
+    "sof                 1000      800      824      849      849  max 8.84 us\n" \
+    "    < 1024           1000\n" \
+    "capture_isr            4        0        2        3        1  max 0.03 us\n" \
+    "    < 1                 1\n" \
+    "    < 2                 1\n" \
+    "    < 4                 2\n" \
+    "dsp                    1    40000    40000    40000    40000  max 416.67 us\n" \
+    "    >=16384             1\n" \
+    "packet_write           -\n" \
+    "sof_latency         1000     3000  4298167     3399     3399  max 35.41 us, jitter 4.16 us\n" \
+    "    < 2048            600\n" \
+    "    < 4096            400\n"
+
+#define IDLE_TAIL \
+    "test_source            -\n" \
+    "tap_feed               -\n" \
+    "meter                  -\n" \
+    "decim                  -\n" \
+    "playback_isr           -\n"
+
+static const struct canned cases[] = {
+    {
+        "v3", PROF_BLOB_MAGIC, 3, PROF_NUM_STAGES, PROF_HIST_BUCKETS, 1, 0,
+        "profile v3, 96000000 Hz, t=123456789\n"
+        "idle 95.0% of 10.00 ms\n" STAGE_TABLE IDLE_TAIL, 0,
+    },
+    {
+        "v3 at HCLK / 4", PROF_BLOB_MAGIC, 3, PROF_NUM_STAGES, PROF_HIST_BUCKETS, 4, 0,
+        "profile v3, 96000000 Hz, t=123456789 at HCLK / 4 (24000000 Hz)\n"
+        "idle 95.0% of 40.00 ms\n" STAGE_TABLE IDLE_TAIL, 0,
+    },
+    {
+        "v2", PROF_BLOB_MAGIC, 2, PROF_NUM_STAGES, PROF_HIST_BUCKETS, 1, 0,
+        "profile v2, 96000000 Hz, t=123456789\n" STAGE_TABLE IDLE_TAIL, 0,
+    },
+    {
+        "v1", PROF_BLOB_MAGIC, 1, 5, PROF_HIST_BUCKETS, 1, 0,
+        "profile v1, 96000000 Hz, t=123456789\n" STAGE_TABLE, 0,
+    },
+    {
+        "newer firmware", PROF_BLOB_MAGIC, 3, PROF_NUM_STAGES + 2, PROF_HIST_BUCKETS, 1, 0,
+        "profile v3, 96000000 Hz, t=123456789\n"
+        "idle 95.0% of 10.00 ms\n" STAGE_TABLE IDLE_TAIL, 0,
+    },
+    {
+        "truncated", PROF_BLOB_MAGIC, 3, PROF_NUM_STAGES, PROF_HIST_BUCKETS, 1, 1,
+        "prof_decode: truncated\n", 1,
+    },
+    {
+        "bad magic", 0x31465251u, 3, PROF_NUM_STAGES, PROF_HIST_BUCKETS, 1, 0,
+        "prof_decode: bad magic\n", 1,
+    },
+    {
+        "v4", PROF_BLOB_MAGIC, 4, PROF_NUM_STAGES, PROF_HIST_BUCKETS, 1, 0,
+        "prof_decode: unsupported version\n", 1,
+    },
+    {
+        "8 buckets", PROF_BLOB_MAGIC, 3, PROF_NUM_STAGES, 8, 1, 0,
+        "prof_decode: unexpected bucket count\n", 1,
+    },
+};
+
+static void check_canned(void)
+{
+    static char out[8192];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const struct canned *c = &cases[i];
+        int status = decode(lay_out(c), out, sizeof(out));
+
+        CHECKF(status == c->want_status, "%s: exit %d, want %d",
+               c->name, status, c->want_status);
+        CHECKF(strcmp(out, c->want) == 0, "%s: printed\n%s\nwant\n%s",
+               c->name, out, c->want);
+    }
+
+    /* A blob cut inside the header */
+    blob[0] = 0;
+    CHECK(decode(10, out, sizeof(out)) == 1 &&
+          strcmp(out, "prof_decode: short header\n") == 0);
+}
+
+/* The firmware's own snapshot, decoded: same layout as the canned ones */
+static void check_snapshot(void)
+{
+    static const struct task_idle_stats idle = { IDLE_WINDOW, IDLE_CYCLES };
+    static char out[8192];
+
+    prof_reset();
+    for (uint32_t i = 0; i < 1000; i++) {
+        prof_record(PROF_STAGE_SOF, 800 + i % 50);
+    }
+    prof_record(PROF_STAGE_DSP, 40000);
+
+    uint32_t len = prof_snapshot(blob, sizeof(blob), 42, &idle);
+
+    CHECK(len == PROF_BLOB_SIZE);
+    CHECK(decode(len, out, sizeof(out)) == 0);
+    CHECKF(strstr(out, "profile v3, 96000000 Hz, t=42\nidle 95.0% of 10.00 ms\n") == out,
+           "%s", out);
+    CHECKF(strstr(out, "sof                 1000      800      824      849      849"),
+           "%s", out);
+    CHECKF(strstr(out, "    < 1024           1000\n"), "%s", out);
+    CHECKF(strstr(out, "dsp                    1    40000    40000    40000    40000"),
+           "%s", out);
+    CHECKF(strstr(out, "    >=16384             1\n"), "%s", out);
+    CHECKF(strstr(out, "packet_write           -\n"), "%s", out);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: test_prof <prof_decode> <scratch file>\n");
+        return 2;
+    }
+    decoder = argv[1];
+    scratch = argv[2];
+
+    check_canned();
+    check_snapshot();
+    return host_test_result("prof");
+}
@@ -0,0 +1,163 @@
+/*
+ * Rate matching against mic clock drift (rate_ctrl.h), end to end.
+ *
+ *   test_rate [hours]
+ *
+ * The board streams a 48 kHz alt (the first rate of alt 1 if none has it)
+ * with the mic clock off by -500, 0 and +500 ppm against the host's SOF,
+ * for RATE_FRAMES frames each or the given number of simulated hours
+ * (make -f host.mk soak). The USB interrupt is held off for a different
+ * part of every frame and the host's token moves about, so the SOF
+ * interrupt and the packet decisions run with jitter.
+ *
+ * Over the whole run the capture ring must never overrun or underrun and
+ * the fill (ring plus the DMA half in progress, as the controller sees
+ * it) must never climb more than RATE_FILL_BAND past the set point and
+ * the packet armed ahead; once settled it must stay inside a band of
+ * RATE_FILL_BAND samples.
+ * Every packet must carry nominal +-1 samples, none after priming may be
+ * silence, and the samples sent must track the mic's actual rate to
+ * within that band.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio_capture.h"
+#include "audio_format.h"
+#include "audio_ring.h"
+#include "audio_stream.h"
+#include "usb_descriptors.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define RATE_FRAMES     20000
+#define RATE_SETTLE     2000
+#define RATE_FILL_BAND  8
+#define HOLD_STEPS      45          /* at most, clear of the latest token */
+#define TOKEN_MIN       (HOST_USB_STEPS / 2)
+
+static const double drifts_ppm[] = { -500, 0, 500 };
+
+static uint8_t  alt;
+static uint32_t rate;
+static uint16_t frame_bytes;
+
+static uint64_t samples_sent;
+static uint32_t bad_sizes;
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    uint32_t n = pkt->len / frame_bytes;
+    uint32_t nominal = rate / 1000;
+
+    if (pkt->ep != EP_AUDIO_IN) {
+        return;
+    }
+    samples_sent += n;
+    if ((n < nominal - 1 || n > nominal + 1) && !bad_sizes++) {
+        fprintf(stderr, "frame %u: %u samples\n", pkt->frame, n);
+    }
+}
+
+static void pick_alt(void)
+{
+    for (uint8_t a = 1; a <= AUDIO_NUM_FORMATS; a++) {
+        if (audio_format_has_rate(audio_format_for_alt(a), 48000)) {
+            alt  = a;
+            rate = 48000;
+            return;
+        }
+    }
+    alt  = 1;
+    rate = audio_format_for_alt(1)->rates[0];
+}
+
+static void run(double ppm, uint64_t run_frames)
+{
+    struct audio_stream_stats s0, ss;
+    struct audio_ring_stats rs;
+    uint32_t fill_min = UINT32_MAX, fill_max = 0, fill_peak = 0, rng = 1;
+    uint64_t sent_at_settle = 0;
+
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    host_capture_set_ppm(ppm);
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, alt));
+    frame_bytes = audio_stream_cfg()->frame_bytes;
+
+    /* The set point, plus the packet armed a frame ahead still in the ring */
+    uint32_t ceiling = rate / 1000 * (AUDIO_STREAM_TARGET_BLOCKS_X2 + 2) / 2 + RATE_FILL_BAND;
+
+    samples_sent = 0;
+    bad_sizes    = 0;
+
+    for (uint64_t f = 0; f < run_frames; f++) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+
+        rng = rng * 1664525u + 1013904223u;
+        fr.hold  = (rng >> 8) % HOLD_STEPS;
+        fr.token = TOKEN_MIN + (rng >> 20) % (HOST_USB_STEPS - 4 - TOKEN_MIN);
+        host_usb_frame(&fr);
+
+        uint32_t fill = audio_capture_fill_samples();
+
+        fill_peak = fill > fill_peak ? fill : fill_peak;
+        if (f == RATE_SETTLE) {
+            audio_stream_get_stats(&s0, 0);
+            sent_at_settle = samples_sent;
+            bad_sizes = 0;
+        }
+        if (f >= RATE_SETTLE) {
+            fill_min = fill < fill_min ? fill : fill_min;
+            fill_max = fill > fill_max ? fill : fill_max;
+        }
+    }
+    audio_stream_get_stats(&ss, 0);
+    audio_ring_get_stats(audio_capture_ring(), &rs);
+
+    double frames = (double)(run_frames - RATE_SETTLE - 1);
+    double want   = frames * rate / 1000.0 * (1.0 + ppm * 1e-6);
+    double sent   = (double)(samples_sent - sent_at_settle);
+
+    printf("  %+5.0f ppm, %.1f min: fill %u..%u samples (peak %u), sent %.0f for %.1f\n",
+           ppm, run_frames / 6e4, fill_min, fill_max, fill_peak, sent, want);
+
+    CHECKF(rs.overruns == 0 && rs.underruns == 0, "%+.0f ppm: ring %u overruns, %u underruns",
+           ppm, rs.overruns, rs.underruns);
+    CHECKF(fill_peak <= ceiling, "%+.0f ppm: fill reached %u, at most %u",
+           ppm, fill_peak, ceiling);
+
+    CHECKF(fill_max - fill_min <= RATE_FILL_BAND, "%+.0f ppm: fill %u..%u",
+           ppm, fill_min, fill_max);
+    CHECKF(sent > want - RATE_FILL_BAND && sent < want + RATE_FILL_BAND,
+           "%+.0f ppm: sent %.0f samples, mic made %.1f", ppm, sent, want);
+    CHECKF(bad_sizes == 0, "%+.0f ppm: %u packets off nominal +-1", ppm, bad_sizes);
+    CHECKF(ss.silent == s0.silent, "%+.0f ppm: %u silent packets",
+           ppm, ss.silent - s0.silent);
+    CHECKF(ss.missed == s0.missed && ss.dropped == s0.dropped,
+           "%+.0f ppm: %u missed, %u dropped", ppm,
+           ss.missed - s0.missed, ss.dropped - s0.dropped);
+}
+
+int main(int argc, char **argv)
+{
+    double   hours  = argc > 1 ? atof(argv[1]) : 0;
+    uint64_t frames = hours > 0 ? (uint64_t)(hours * 3.6e6) : RATE_FRAMES;
+
+    if (frames <= RATE_SETTLE) {
+        fprintf(stderr, "usage: test_rate [hours]\n");
+        return 2;
+    }
+
+    host_board_init();
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+    pick_alt();
+
+    for (size_t i = 0; i < sizeof(drifts_ppm) / sizeof(drifts_ppm[0]); i++) {
+        run(drifts_ppm[i], frames);
+    }
+    return host_test_result("rate");
+}
@@ -0,0 +1,177 @@
+/*
+ * Recovery of iso IN packets that miss their frame (audio_stream.h).
+ *
+ * Each scenario streams every alt at an offset mic clock and injects the
+ * same fault every FAULT_EVERY frames once the stream has settled: a lost
+ * SOF interrupt, a frame the host sends no token in, the USB interrupt
+ * held off for a whole frame (the next packet is armed after its SOF), a
+ * host that stays away for AUDIO_STREAM_MAX_TRIES frames (the packet is
+ * given up), or several at once. Each fault must move the counters by
+ * exactly what it costs, and nothing else may move.
+ *
+ * The capture source is a counter, so rows that stream the I2S samples
+ * as captured also check what reaches the host: no sample twice, and no
+ * sample missing but the ones the stream counts as dropped.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "audio_format.h"
+#include "audio_stream.h"
+#include "usb_descriptors.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define SETTLE_FRAMES  300
+#define FAULT_EVERY    150          /* the rate controller drains a sample a frame */
+#define FAULTS         20
+#define MIC_PPM        150.0
+
+struct scenario {
+    const char *name;
+    bool        sof_lost;
+    bool        held;           /* interrupts held off for the whole frame */
+    uint32_t    away;           /* frames without a token */
+    /* Counter moves per fault */
+    uint32_t    missed, late, recovered, sof_gaps;
+    bool        dropped;        /* one packet's samples given up */
+};
+
+static const struct scenario scenarios[] = {
+    { "clean",                 false, false, 0,                      0, 0, 0, 0, false },
+    { "SOF lost",              true,  false, 0,                      0, 0, 0, 1, false },
+    { "no token",              false, false, 1,                      1, 0, 1, 0, false },
+    { "interrupts held",       false, true,  0,                      0, 1, 0, 1, false },
+    { "host away",             false, false, AUDIO_STREAM_MAX_TRIES, AUDIO_STREAM_MAX_TRIES,
+                                                                        0, 0, 0, true  },
+    { "held, SOF lost, no token", true, true, 1,                     1, 1, 1, 1, false },
+};
+
+/* What the host took of the capture stream */
+static struct {
+    uint32_t frame_bytes, subframe_bytes;
+    bool     exact;
+    bool     started;
+    uint16_t next;              /* counter the next sample should carry */
+    uint32_t skipped, repeated;
+} in;
+
+/* Low 16 bits of the capture index, high byte of the 24-bit sample */
+static int32_t counter(uint32_t ch, uint64_t n)
+{
+    (void)ch;
+    return (int32_t)(((uint32_t)n & 0xFFFFu) << 8) - 0x800000;
+}
+
+static bool all_zero(const uint8_t *p, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        if (p[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    if (pkt->ep != EP_AUDIO_IN || !in.exact || !pkt->len || all_zero(pkt->data, pkt->len)) {
+        return;
+    }
+    for (uint32_t i = 0; i < pkt->len; i += in.frame_bytes) {
+        const uint8_t *p = pkt->data + i + in.subframe_bytes - 2;
+        uint16_t v = (uint16_t)((p[0] | p[1] << 8) ^ 0x8000);
+        uint16_t gap = (uint16_t)(v - in.next);
+
+        if (in.started && gap >= 0x8000) {
+            in.repeated++;
+        } else if (in.started) {
+            in.skipped += gap;
+        }
+        in.started = true;
+        in.next    = (uint16_t)(v + 1);
+    }
+}
+
+static void run(const struct scenario *s, const struct audio_format *fmt)
+{
+    struct audio_stream_stats s0, ss;
+    uint32_t away = 0;
+
+    in.exact = false;
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, fmt->alt));
+
+    /* The rate SET_INTERFACE starts streaming at */
+    const struct audio_stream_cfg *cfg = audio_stream_cfg();
+
+    in.frame_bytes    = cfg->frame_bytes;
+    in.subframe_bytes = cfg->subframe_bytes;
+    in.exact          = !AUDIO_MIC_PDM && cfg->capture_hz == cfg->rate_hz;
+    in.started        = false;
+    host_board_run(SETTLE_FRAMES);
+
+    in.skipped  = 0;
+    in.repeated = 0;
+    audio_stream_get_stats(&s0, 0);
+
+    for (uint32_t f = 1; f <= FAULTS * FAULT_EVERY; f++) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+        bool fault = s != &scenarios[0] && f % FAULT_EVERY == FAULT_EVERY / 2;
+
+        if (fault) {
+            fr.sof_lost = s->sof_lost;
+            fr.hold     = s->held ? UINT32_MAX : 0;
+            away        = s->away;
+        }
+        if (away) {
+            fr.token = HOST_USB_NO_TOKEN;
+            away--;
+        }
+        host_usb_frame(&fr);
+    }
+    audio_stream_get_stats(&ss, 0);
+
+    uint32_t missed    = ss.missed - s0.missed;
+    uint32_t late      = ss.late - s0.late;
+    uint32_t recovered = ss.recovered - s0.recovered;
+    uint32_t sof_gaps  = ss.sof_gaps - s0.sof_gaps;
+    uint32_t dropped   = ss.dropped - s0.dropped;
+    uint32_t silent    = ss.silent - s0.silent;
+
+    printf("  alt %u %-24s missed %3u late %3u re-sent %3u SOF gaps %3u dropped %4u\n",
+           fmt->alt, s->name, missed, late, recovered, sof_gaps, dropped);
+    CHECKF(missed == FAULTS * s->missed && late == FAULTS * s->late &&
+           recovered == FAULTS * s->recovered && sof_gaps == FAULTS * s->sof_gaps,
+           "alt %u, %s: %u missed, %u late, %u re-sent, %u SOF gaps",
+           fmt->alt, s->name, missed, late, recovered, sof_gaps);
+    CHECKF(s->dropped ? dropped >= FAULTS * (cfg->samples_per_frame - 1u) &&
+                        dropped <= FAULTS * (cfg->samples_per_frame + 1u)
+                      : dropped == 0,
+           "alt %u, %s: %u samples dropped", fmt->alt, s->name, dropped);
+    CHECKF(silent == 0 && ss.busy == s0.busy && ss.flush_timeouts == s0.flush_timeouts,
+           "alt %u, %s: %u silent, %u busy, %u flush timeouts", fmt->alt, s->name,
+           silent, ss.busy - s0.busy, ss.flush_timeouts - s0.flush_timeouts);
+    CHECKF(!in.exact || (in.repeated == 0 && in.skipped == dropped),
+           "alt %u, %s: host saw %u samples repeated, %u skipped, %u dropped",
+           fmt->alt, s->name, in.repeated, in.skipped, dropped);
+}
+
+int main(void)
+{
+    host_board_init();
+    host_capture_set_source(counter);
+    host_capture_set_ppm(MIC_PPM);
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+            run(&scenarios[i], audio_format_for_alt(alt));
+        }
+    }
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    return host_test_result("recover");
+}
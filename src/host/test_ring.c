@@ -0,0 +1,128 @@
+/*
+ * SPSC ring stress (audio_ring.h), two threads, built with TSan by check.
+ *
+ * A producer thread writes a byte sequence in chunks of varying length as
+ * fast as the ring takes them; the consumer drains it through every
+ * consumer call in turn (read, read_words, peek + skip, peek_words + skip,
+ * each after has()) in lengths of its own. Every byte must arrive once
+ * and in order, and TSan must find no race on the head / tail hand-over.
+ * A small ring keeps both sides wrapping and meeting each other; a side
+ * that finds it full or empty yields, so one core is enough.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "audio_ring.h"
+#include "host_test.h"
+
+#define STREAM_BYTES  (4u << 20)
+#define MAX_CHUNK     61
+
+AUDIO_RING_STORAGE(ring_storage, 256);
+static struct audio_ring ring;
+
+static uint8_t seq_byte(uint32_t i)
+{
+    return (uint8_t)(i ^ (i >> 8) ^ (i >> 16));
+}
+
+static void *producer(void *arg)
+{
+    uint8_t  chunk[MAX_CHUNK];
+    uint32_t sent = 0, len = 1;
+
+    (void)arg;
+
+    while (sent < STREAM_BYTES) {
+        if (len > STREAM_BYTES - sent) {
+            len = STREAM_BYTES - sent;
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            chunk[i] = seq_byte(sent + i);
+        }
+        if (audio_ring_write(&ring, chunk, len)) {
+            sent += len;
+            len = len % MAX_CHUNK + 1;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* Consumer: one call of kind k for len bytes into buf, false if short */
+static bool take(uint32_t k, uint8_t *buf, uint32_t len)
+{
+    uint32_t words[(MAX_CHUNK + 3) / 4];
+
+    if (!audio_ring_has(&ring, len)) {
+        return false;
+    }
+
+    switch (k % 4) {
+    case 0:
+        return audio_ring_read(&ring, buf, len);
+    case 1:
+        if (!audio_ring_read_words(&ring, words, len)) {
+            return false;
+        }
+        break;
+    case 2:
+        return audio_ring_peek(&ring, buf, len) && audio_ring_skip(&ring, len);
+    default:
+        if (!audio_ring_peek_words(&ring, words, len) ||
+            !audio_ring_skip(&ring, len)) {
+            return false;
+        }
+        break;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)(words[i / 4] >> (8 * (i % 4)));
+    }
+    return true;
+}
+
+int main(void)
+{
+    pthread_t thread;
+    uint8_t   buf[MAX_CHUNK];
+    uint32_t  got = 0, len = 7, k = 0, bad = 0;
+
+    audio_ring_init(&ring, ring_storage, sizeof(ring_storage));
+    CHECK(pthread_create(&thread, NULL, producer, NULL) == 0);
+
+    while (got < STREAM_BYTES) {
+        if (len > STREAM_BYTES - got) {
+            len = STREAM_BYTES - got;
+        }
+        if (!take(k, buf, len)) {
+            sched_yield();
+            continue;
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            if (buf[i] != seq_byte(got + i) && !bad++) {
+                fprintf(stderr, "byte %u: 0x%02x, want 0x%02x (call %u)\n",
+                        got + i, buf[i], seq_byte(got + i), k % 4);
+            }
+        }
+        got += len;
+        k++;
+        len = (len * 5 + 3) % MAX_CHUNK + 1;
+    }
+
+    CHECK(pthread_join(thread, NULL) == 0);
+    CHECKF(bad == 0, "%u bytes out of sequence", bad);
+
+    struct audio_ring_stats st;
+    audio_ring_get_stats(&ring, &st);
+    CHECKF(st.fill == 0, "%u bytes left", st.fill);
+    CHECK(st.high_water <= sizeof(ring_storage));
+    CHECK(st.overruns > 0 && st.underruns > 0);
+
+    return host_test_result("ring");
+}
@@ -0,0 +1,517 @@
+/*
+ * Test sources (test_source.h) and the stream_check tool that checks
+ * captures of them.
+ *
+ *   test_signal <stream_check> <scratch file>
+ *
+ * The sources are filled block by block as the capture ISR would, in
+ * 16-bit, packed 24-bit and 24-in-32 containers at several rates:
+ *
+ *   SINE     the frequency, measured from the phase drift over a second,
+ *            within the NCO's step of the one asked for; the level at
+ *            -1 dBFS; harmonics 2..10 and the residual of a fitted sine
+ *            (THD, THD+N) below the floor of the LUT's Q15 entries, or of
+ *            the 16-bit container
+ *   RAMP     every step, block boundaries included, the nominal one or a
+ *            wrap, and as many wraps as periods
+ *   COUNTER  ch 0 counting through the 16-bit wrap, ch 1 the block number,
+ *            ch n ch 0 + n; both start again from 0 on a restart
+ *
+ * Then stream_check runs on canned captures of them, raw and WAV: clean,
+ * with a block dropped and one repeated, with a sequence number and a
+ * channel corrupted. Its summary line must count exactly what was
+ * injected, its exit status say whether anything was, and its frequency
+ * and THD+N must agree with this test's on a clean sine, the THD+N
+ * falling apart on one with a block missing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "test_source.h"
+#include "host_test.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define MAX_RATE      96000
+#define SECOND_BLOCKS 1000
+#define COUNT_BLOCKS  1400          /* 67200 frames at 48 kHz: past the 16-bit wrap */
+#define MAX_FRAMES    MAX_RATE      /* a second at the highest rate */
+#define MAX_HARMONIC  10
+
+#define SINE_DBFS     (-1.0)
+#define SINE_DB_TOL   0.02
+#define FREQ_TOL      0.0001        /* Hz, measured over one second */
+#define THD_MAX_16    (-90.0)       /* dB */
+#define THD_MAX_24    (-95.0)       /* the LUT's Q15 entries: -99 dB and below */
+#define THDN_MAX_16   (-90.0)
+#define THDN_MAX_24   (-95.0)
+#define THDN_AGREE    0.5           /* dB, stream_check against this test */
+#define THDN_BROKEN   (-60.0)       /* a dropped block must do worse */
+
+struct container {
+    uint8_t  bytes;
+    uint32_t rate;
+};
+
+static const struct container containers[] = {
+    { 2, 48000 }, { 3, 48000 }, { 4, 96000 }, { 2, 16000 }, { 3, 32000 },
+};
+
+static const uint32_t freqs[] = { 1000, 997, 5001 };
+
+static const char *checker;
+static const char *scratch;
+
+static uint8_t pcm[MAX_FRAMES * AUDIO_NUM_CHANNELS * 4];
+static uint8_t edited[sizeof(pcm) + 44];
+static double  wave[MAX_RATE];
+
+static struct audio_stream_cfg make_cfg(uint8_t bytes, uint32_t rate)
+{
+    struct audio_stream_cfg cfg = {
+        .rate_hz           = rate,
+        .subframe_bytes    = bytes,
+        .bits              = bytes == 2 ? 16 : 24,
+        .samples_per_frame = (uint16_t)(rate / 1000),
+        .frame_bytes       = (uint16_t)(AUDIO_NUM_CHANNELS * bytes),
+        .capture_hz        = rate,
+    };
+    return cfg;
+}
+
+/* Sample value in the container's own scale (16 or 24 bits) */
+static int32_t get(const uint8_t *p, uint8_t bytes)
+{
+    switch (bytes) {
+    case 2:
+        return (int16_t)(p[0] | p[1] << 8);
+    case 3:
+        return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 |
+                         (uint32_t)p[2] << 24) >> 8;
+    default:
+        return (int32_t)((uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+                         (uint32_t)p[3] << 24) >> 8;
+    }
+}
+
+static int32_t sample(const struct audio_stream_cfg *cfg, uint32_t frame, uint32_t ch)
+{
+    return get(pcm + frame * cfg->frame_bytes + ch * cfg->subframe_bytes,
+               cfg->subframe_bytes);
+}
+
+/* blocks of mode from a restart, as the capture ISR fills them */
+static uint32_t capture(enum test_source_mode mode, uint32_t freq,
+                        const struct audio_stream_cfg *cfg, uint32_t blocks)
+{
+    uint32_t frames = blocks * cfg->samples_per_frame;
+
+    CHECK(frames <= MAX_FRAMES);
+    CHECK(test_source_select(mode, freq));
+    test_source_restart();
+    for (uint32_t b = 0; b < blocks; b++) {
+        CHECK(test_source_fill(pcm + b * cfg->samples_per_frame * cfg->frame_bytes,
+                               cfg->samples_per_frame, cfg));
+    }
+    CHECK(test_source_select(TEST_SRC_OFF, 0));
+    return frames;
+}
+
+/* What the NCO actually runs at for freq */
+static double nco_hz(uint32_t freq, uint32_t rate)
+{
+    uint32_t step = (uint32_t)(((uint64_t)freq << 32) / rate);
+
+    return step * (double)rate / 4294967296.0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* SINE                                                                       */
+/* -------------------------------------------------------------------------- */
+
+/* Power of x at freq over n samples holding whole periods, as a sine's A^2 */
+static double tone_power(const double *x, uint32_t n, double freq, double rate)
+{
+    double c = 0, s = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        c += x[i] * cos(2 * M_PI * freq * i / rate);
+        s += x[i] * sin(2 * M_PI * freq * i / rate);
+    }
+    return 4 * (c * c + s * s) / ((double)n * n);
+}
+
+/* Least-squares a cos + b sin at freq over x[from, from + n) */
+static void fit(const double *x, uint32_t from, uint32_t n, double freq, double rate,
+                double *a, double *b)
+{
+    double scc = 0, sss = 0, scs = 0, sxc = 0, sxs = 0;
+
+    for (uint32_t i = from; i < from + n; i++) {
+        double c = cos(2 * M_PI * freq * i / rate), s = sin(2 * M_PI * freq * i / rate);
+
+        scc += c * c;
+        sss += s * s;
+        scs += c * s;
+        sxc += x[i] * c;
+        sxs += x[i] * s;
+    }
+
+    double det = scc * sss - scs * scs;
+
+    *a = (sxc * sss - sxs * scs) / det;
+    *b = (sxs * scc - sxc * scs) / det;
+}
+
+/* Mean-square residual of a least-squares sine at freq */
+static double fit_residual(const double *x, uint32_t n, double freq, double rate)
+{
+    double a, b, res = 0;
+
+    fit(x, 0, n, freq, rate, &a, &b);
+    for (uint32_t i = 0; i < n; i++) {
+        double e = x[i] - a * cos(2 * M_PI * freq * i / rate) -
+                   b * sin(2 * M_PI * freq * i / rate);
+        res += e * e;
+    }
+    return res / n;
+}
+
+/* freq plus the phase drift of fits at it from the first to the last tenth */
+static double measure_hz(const double *x, uint32_t n, double freq, double rate)
+{
+    uint32_t m = n / 10;
+    double a1, b1, a2, b2;
+
+    fit(x, 0, m, freq, rate, &a1, &b1);
+    fit(x, n - m, m, freq, rate, &a2, &b2);
+
+    double d = remainder(atan2(b2, a2) - atan2(b1, a1), 2 * M_PI);
+
+    return freq - d * rate / (2 * M_PI * (n - m));
+}
+
+/* THD+N of the last sine the test wrote, by stream_check */
+static double checker_thdn;
+
+static void check_sines(void)
+{
+    for (size_t c = 0; c < sizeof(containers) / sizeof(containers[0]); c++) {
+        struct audio_stream_cfg cfg = make_cfg(containers[c].bytes, containers[c].rate);
+        double full = cfg.bits == 16 ? 32768.0 : 8388608.0;
+
+        for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+            uint32_t n    = capture(TEST_SRC_SINE, freqs[f], &cfg, SECOND_BLOCKS);
+            double   want = nco_hz(freqs[f], cfg.rate_hz);
+            uint32_t bad  = 0;
+
+            for (uint32_t i = 0; i < n; i++) {
+                wave[i] = sample(&cfg, i, 0);
+                for (uint32_t ch = 1; ch < AUDIO_NUM_CHANNELS; ch++) {
+                    bad += sample(&cfg, i, ch) != sample(&cfg, i, 0);
+                }
+            }
+
+            double hz    = measure_hz(wave, n, freqs[f], cfg.rate_hz);
+            double fund  = tone_power(wave, n, want, cfg.rate_hz);
+            double harm  = 0;
+
+            for (unsigned h = 2; h <= MAX_HARMONIC && h * want < cfg.rate_hz / 2.0; h++) {
+                harm += tone_power(wave, n, h * want, cfg.rate_hz);
+            }
+
+            double level = 10 * log10(fund / (full * full));
+            double thd   = 10 * log10(harm / fund + 1e-30);
+            double thdn  = 10 * log10(fit_residual(wave, n, want, cfg.rate_hz) / (fund / 2));
+
+            printf("  sine %u-byte %5u Hz %4u Hz: %.4f Hz, %.3f dBFS, THD %.1f dB, "
+                   "THD+N %.1f dB\n", cfg.subframe_bytes, cfg.rate_hz, freqs[f], hz,
+                   level, thd, thdn);
+            CHECKF(fabs(hz - want) < FREQ_TOL, "%u-byte %u Hz: %.6f Hz, NCO at %.6f",
+                   cfg.subframe_bytes, cfg.rate_hz, hz, want);
+            CHECKF(fabs(level - SINE_DBFS) < SINE_DB_TOL, "%u-byte %u Hz %u Hz: %.3f dBFS",
+                   cfg.subframe_bytes, cfg.rate_hz, freqs[f], level);
+            CHECKF(thd < (cfg.bits == 16 ? THD_MAX_16 : THD_MAX_24) &&
+                   thdn < (cfg.bits == 16 ? THDN_MAX_16 : THDN_MAX_24),
+                   "%u-byte %u Hz %u Hz: THD %.1f dB, THD+N %.1f dB", cfg.subframe_bytes,
+                   cfg.rate_hz, freqs[f], thd, thdn);
+            CHECKF(bad == 0, "%u-byte %u Hz: %u samples differ from ch 0",
+                   cfg.subframe_bytes, cfg.rate_hz, bad);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* RAMP AND COUNTER                                                           */
+/* -------------------------------------------------------------------------- */
+
+static void check_ramps(void)
+{
+    for (size_t c = 0; c < sizeof(containers) / sizeof(containers[0]); c++) {
+        struct audio_stream_cfg cfg = make_cfg(containers[c].bytes, containers[c].rate);
+        uint32_t mask = (1u << cfg.bits) - 1;
+
+        for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+            uint32_t n     = capture(TEST_SRC_RAMP, freqs[f], &cfg, SECOND_BLOCKS);
+            double   nom   = ldexp(nco_hz(freqs[f], cfg.rate_hz) / cfg.rate_hz, (int)cfg.bits);
+            uint32_t wraps = 0, bad = 0;
+
+            for (uint32_t i = 1; i < n; i++) {
+                for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+                    uint32_t prev = (uint32_t)sample(&cfg, i - 1, ch) & mask;
+                    uint32_t cur  = (uint32_t)sample(&cfg, i, ch) & mask;
+                    uint32_t d    = (cur - prev) & mask;
+
+                    if (fabs(d - nom) >= 1.0 && !bad++) {
+                        fprintf(stderr, "%u-byte %u Hz %u Hz: frame %u ch %u steps %u, "
+                                "nominal %.2f\n", cfg.subframe_bytes, cfg.rate_hz,
+                                freqs[f], i, ch, d, nom);
+                    }
+                    wraps += ch == 0 && cur < prev;
+                }
+            }
+            CHECKF(bad == 0, "%u-byte %u Hz %u Hz: %u steps off", cfg.subframe_bytes,
+                   cfg.rate_hz, freqs[f], bad);
+            CHECKF(wraps + 1 >= freqs[f] && wraps <= freqs[f],
+                   "%u-byte %u Hz %u Hz: %u wraps in a second", cfg.subframe_bytes,
+                   cfg.rate_hz, freqs[f], wraps);
+        }
+    }
+}
+
+static void check_counter(void)
+{
+    struct audio_stream_cfg cfg = make_cfg(2, 48000);
+
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t n   = capture(TEST_SRC_COUNTER, 0, &cfg, COUNT_BLOCKS);
+        uint32_t bad = 0;
+
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+                uint32_t want = ch == 0 ? i : ch == 1 ? i / cfg.samples_per_frame : i + ch;
+                uint32_t got  = (uint32_t)sample(&cfg, i, ch) & 0xFFFF;
+
+                if (got != (want & 0xFFFF) && !bad++) {
+                    fprintf(stderr, "counter pass %d: frame %u ch %u: %u, want %u\n",
+                            pass, i, ch, got, want & 0xFFFF);
+                }
+            }
+        }
+        CHECKF(bad == 0, "counter pass %d: %u samples off", pass, bad);
+    }
+
+    /* Off fills nothing; a mode or frequency out of range is refused */
+    CHECK(!test_source_fill(pcm, cfg.samples_per_frame, &cfg));
+    CHECK(!test_source_select(TEST_SRC_NUM_MODES, 0));
+    CHECK(!test_source_select(TEST_SRC_SINE, 1u << 24));
+}
+
+/* -------------------------------------------------------------------------- */
+/* STREAM_CHECK                                                               */
+/* -------------------------------------------------------------------------- */
+
+static void put16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+/* The capture's frames with [drop, drop + n_drop) left out and
+ * [rep, rep + n_rep) sent twice; an optional 44-byte WAV header */
+static uint32_t edit(const struct audio_stream_cfg *cfg, uint32_t frames, bool wav,
+                     uint32_t drop, uint32_t n_drop, uint32_t rep, uint32_t n_rep)
+{
+    uint32_t fb  = cfg->frame_bytes;
+    uint32_t len = wav ? 44 : 0;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        if (i >= drop && i < drop + n_drop) {
+            continue;
+        }
+        memcpy(edited + len, pcm + i * fb, fb);
+        len += fb;
+        if (i + 1 == rep + n_rep && n_rep) {
+            memcpy(edited + len, pcm + rep * fb, n_rep * fb);
+            len += n_rep * fb;
+        }
+    }
+
+    if (wav) {
+        uint32_t bits = cfg->subframe_bytes * 8;
+
+        memcpy(edited, "RIFF", 4);
+        put32(edited + 4, len - 8);
+        memcpy(edited + 8, "WAVEfmt ", 8);
+        put32(edited + 16, 16);
+        put16(edited + 20, 1);
+        put16(edited + 22, AUDIO_NUM_CHANNELS);
+        put32(edited + 24, cfg->rate_hz);
+        put32(edited + 28, cfg->rate_hz * fb);
+        put16(edited + 32, fb);
+        put16(edited + 34, bits);
+        memcpy(edited + 36, "data", 4);
+        put32(edited + 40, len - 44);
+    }
+    return len;
+}
+
+/* stream_check over edited[0..len): its exit status, stdout in out */
+static int run_checker(uint32_t len, const char *args, char *out, size_t cap)
+{
+    char cmd[512];
+    FILE *f = fopen(scratch, "wb");
+
+    if (!f || fwrite(edited, 1, len, f) != len || fclose(f)) {
+        perror(scratch);
+        return -1;
+    }
+
+    snprintf(cmd, sizeof(cmd), "%s %s %s", checker, args, scratch);
+    if (!(f = popen(cmd, "r"))) {
+        perror(cmd);
+        return -1;
+    }
+    out[fread(out, 1, cap - 1, f)] = '\0';
+
+    int status = pclose(f);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* Run it and look for want in its summary; status as expected */
+static void expect(uint32_t len, const char *args, const char *what, const char *want,
+                   int want_status)
+{
+    static char out[1 << 16];
+    int status = run_checker(len, args, out, sizeof(out));
+
+    CHECKF(status == want_status && strstr(out, want),
+           "%s: exit %d (want %d), want \"%s\" in:\n%s", what, status, want_status, want,
+           out);
+}
+
+static void check_counter_files(void)
+{
+    struct audio_stream_cfg cfg = make_cfg(2, 48000);
+    uint32_t n   = capture(TEST_SRC_COUNTER, 0, &cfg, 200);
+    uint32_t spf = cfg.samples_per_frame;
+    char raw[64], want[160];
+
+    snprintf(raw, sizeof(raw), "-m counter -r 48000 -c %u -b 16", AUDIO_NUM_CHANNELS);
+
+    snprintf(want, sizeof(want), "counter: %u frames, 0 gaps (0 samples lost), 0 repeats, "
+             "0 sequence errors, 0 channel errors\n", n);
+    expect(edit(&cfg, n, false, 0, 0, 0, 0), raw, "counter raw clean", want, 0);
+    expect(edit(&cfg, n, true, 0, 0, 0, 0), "-m counter", "counter WAV clean", want, 0);
+
+    /* One block dropped, a later one sent twice */
+    snprintf(want, sizeof(want), "counter: %u frames, 1 gaps (%u samples lost), 1 repeats, "
+             "0 sequence errors, 0 channel errors\n", n, spf);
+    expect(edit(&cfg, n, false, 50 * spf, spf, 120 * spf, spf), raw,
+           "counter raw, block dropped and repeated", want, 1);
+    expect(edit(&cfg, n, true, 50 * spf, spf, 120 * spf, spf), "-m counter",
+           "counter WAV, block dropped and repeated", want, 1);
+
+    /* A block number off by 5 (in and out again), one channel off by one */
+    if (AUDIO_NUM_CHANNELS > 2) {
+        for (uint32_t i = 0; i < spf; i++) {
+            uint8_t *p = pcm + ((80 * spf + i) * cfg.frame_bytes + 2);
+
+            put16(p, (uint32_t)get(p, 2) + 5);
+        }
+        uint8_t *p = pcm + (150 * spf * cfg.frame_bytes + 4);
+        put16(p, (uint32_t)get(p, 2) + 1);
+
+        snprintf(want, sizeof(want), "counter: %u frames, 0 gaps (0 samples lost), "
+                 "0 repeats, 2 sequence errors, 1 channel errors\n", n);
+        expect(edit(&cfg, n, false, 0, 0, 0, 0), raw, "counter, sequence and channel",
+               want, 1);
+    }
+}
+
+static void check_ramp_files(void)
+{
+    struct audio_stream_cfg cfg = make_cfg(4, 96000);
+    uint32_t n = capture(TEST_SRC_RAMP, 1000, &cfg, 200);
+    char raw[80], want[80];
+
+    snprintf(raw, sizeof(raw), "-m ramp -f 1000 -r 96000 -c %u -b 32", AUDIO_NUM_CHANNELS);
+
+    snprintf(want, sizeof(want), "ramp: %u frames, 0 discontinuities\n", n);
+    expect(edit(&cfg, n, false, 0, 0, 0, 0), raw, "ramp raw clean", want, 0);
+    expect(edit(&cfg, n, true, 0, 0, 0, 0), "-m ramp -f 1000", "ramp WAV clean", want, 0);
+
+    /* 10 frames dropped, 5 repeated: one step off per channel each */
+    snprintf(want, sizeof(want), "ramp: %u frames, %u discontinuities\n", n - 10 + 5,
+             2 * AUDIO_NUM_CHANNELS);
+    expect(edit(&cfg, n, false, 3001, 10, 9007, 5), raw, "ramp raw, gap and repeat",
+           want, 1);
+    expect(edit(&cfg, n, true, 3001, 10, 9007, 5), "-m ramp -f 1000",
+           "ramp WAV, gap and repeat", want, 1);
+}
+
+static void check_sine_files(void)
+{
+    static char out[1 << 12];
+    struct audio_stream_cfg cfg = make_cfg(3, 48000);
+    uint32_t n = capture(TEST_SRC_SINE, 997, &cfg, SECOND_BLOCKS);
+    double   want = nco_hz(997, cfg.rate_hz);
+    double   hz, thd, thdn;
+
+    for (uint32_t i = 0; i < n; i++) {
+        wave[i] = sample(&cfg, i, 0);
+    }
+    double own = 10 * log10(fit_residual(wave, n, want, cfg.rate_hz) /
+                            (tone_power(wave, n, want, cfg.rate_hz) / 2));
+
+    CHECK(run_checker(edit(&cfg, n, true, 0, 0, 0, 0), "-m sine -f 997", out,
+                      sizeof(out)) == 0);
+    CHECKF(sscanf(out, "sine: %*u frames at %lf Hz, level %*f dBFS, THD %lf dB, THD+N %lf dB",
+                  &hz, &thd, &thdn) == 3 && fabs(hz - want) < FREQ_TOL &&
+           fabs(thdn - own) < THDN_AGREE && thd < THD_MAX_24,
+           "sine WAV clean: THD+N %.1f dB here, stream_check:\n%s", own, out);
+    checker_thdn = thdn;
+
+    /* A block missing: the fit can only get worse */
+    CHECK(run_checker(edit(&cfg, n, true, 500 * 48, 48, 0, 0), "-m sine -f 997", out,
+                      sizeof(out)) == 0);
+    CHECKF(sscanf(out, "sine: %*u frames at %*f Hz, level %*f dBFS, THD %lf dB, THD+N %lf dB",
+                  &thd, &thdn) == 2 && thdn > THDN_BROKEN,
+           "sine WAV, block dropped: THD+N %.1f dB from stream_check:\n%s", thdn, out);
+    printf("  stream_check sine THD+N: %.1f dB clean, %.1f dB with a block dropped\n",
+           checker_thdn, thdn);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: test_signal <stream_check> <scratch file>\n");
+        return 2;
+    }
+    checker = argv[1];
+    scratch = argv[2];
+
+    check_sines();
+    check_ramps();
+    check_counter();
+    check_counter_files();
+    check_ramp_files();
+    check_sine_files();
+    return host_test_result("signal");
+}
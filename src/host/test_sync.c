@@ -0,0 +1,422 @@
+/*
+ * Frame to sample mapping for aligning several devices (sync_map.h).
+ *
+ * One board plays the part of each device in an array in turn: its own
+ * mic clock offset, started after its own idle stretch, so the TIM2
+ * count, the frame number and the phase of the DMA against the SOFs all
+ * differ. The USB interrupt is held off for a varying part of each frame,
+ * which the latched SOF tick must hide, and the capture DMA interrupt is
+ * taken up to DMA_LATENCY late, which the DMA position must. Every frame
+ * the host reads the sync blob with SYNC_READ as sync_decode's user would
+ * and it is set against the synthetic DMA's true sample index at that SOF.
+ *
+ * Every alt runs at each of its rates. Each device must lock within
+ * LOCK_MS. Once locked, its error carries a bias from the DMA position's
+ * granularity: the position is read in whole half-words, so it falls
+ * short by what grain_bias() works out for the interrupt latencies. The
+ * devices' mean must be within BIAS_TOL of that, so a shift common to
+ * every device shows; what aligning two devices leaves is the
+ * difference, so every device must stay within ALIGN_TOL of the bias the
+ * devices share.
+ *
+ * Rows that stream the I2S samples as captured carry a counter, and
+ * every packet the host takes while the offset is valid must start on
+ * the capture sample it names. Converted rows (rate conversion, PDM)
+ * carry a sawtooth instead: near the middle of its ramp a packet's
+ * levels give the input sample its first sample came from, which must be
+ * its output index times the decimation ratio less the decimators' group
+ * delay, within DELAY_TOL and on average within DELAY_MEAN_TOL.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <libopencm3/usb/usbstd.h>
+
+#include "audio_capture.h"
+#include "audio_format.h"
+#include "audio_stream.h"
+#include "pdm_decim.h"
+#include "sof_timer.h"
+#include "sync_blob.h"
+#include "usb_audio_uac2.h"
+#include "usb_descriptors.h"
+#include "usb_vendor.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define DEVICE_FRAMES  2500
+#define LOCK_MS        1500
+#define ALIGN_TOL      0.04         /* samples, so pairs within 0.08 */
+#define BIAS_TOL       0.01
+#define DELAY_TOL      (AUDIO_MIC_PDM ? 0.3 : 0.05)    /* input samples */
+#define DELAY_MEAN_TOL (AUDIO_MIC_PDM ? 0.1 : 0.01)
+#define HOLD_STEPS     40           /* at most, clear of the host's token */
+#define DMA_LATENCY    (20 * SOF_TIMER_HZ / 1000000)     /* 20 us: a few I2S slots */
+
+#define REQ_VENDOR_IN  (USB_REQ_TYPE_IN | USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_DEVICE)
+
+#if AUDIO_UAC2
+#define REQ_SET        (USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE)
+#define SET_CUR        USB_AUDIO2_REQ_CUR
+#define SAM_FREQ       USB_AUDIO2_CS_SAM_FREQ
+#define RATE_INDEX     (AUDIO_CLOCK_SOURCE_ID << 8 | IFACE_AUDIO_CONTROL)
+#define RATE_BYTES     4
+#else
+#define REQ_SET        (USB_REQ_TYPE_CLASS | USB_REQ_TYPE_ENDPOINT)
+#define SET_CUR        USB_AUDIO_REQ_SET_CUR
+#define SAM_FREQ       USB_AUDIO_EP_CS_SAMPLING_FREQ
+#define RATE_INDEX     EP_AUDIO_IN
+#define RATE_BYTES     3
+#endif
+
+/*
+ * Sawtooth for converted rows: SAW_STEP (16-bit LSBs) a sample over
+ * SAW_PERIOD input samples, through 0 mid-period. A decimator's output
+ * swings through every level across a wrap too, so only packets inside
+ * SAW_WINDOW of 0 that climb at the ramp's own slope count; their mean
+ * level averages out the noise of the PDM modulator.
+ */
+#define SAW_PERIOD     1024
+#define SAW_STEP       64
+#define SAW_WINDOW     16384
+
+struct device {
+    double   ppm;
+    uint32_t idle_frames;           /* before the alt is selected */
+};
+
+static const struct device devices[] = {
+    {  -80.0, 137 },
+    {  -20.0,  11 },
+    {    0.0, 503 },
+    {   35.0, 402 },
+    {  100.0,  77 },
+};
+
+#define NUM_DEVICES  (sizeof(devices) / sizeof(devices[0]))
+
+struct blob {
+    uint16_t flags;
+    uint32_t frame, epoch, rate_hz;
+    int32_t  offset;
+    double   pos;
+};
+
+/* Channel 0 of a packet: first and last level, and the mean */
+struct ramp {
+    int16_t  first, last;
+    uint16_t samples;
+    double   mean;
+};
+
+/* This frame's IN packets: wire count before each and its first counter */
+static struct {
+    uint32_t frame_bytes, subframe_bytes;
+    uint32_t wire;
+    uint32_t n;
+    uint32_t wire_at[4];
+    uint16_t first[4];
+    struct ramp ramp[4];
+} in;
+
+/* Low 16 bits of the capture index, high byte of the 24-bit sample */
+static int32_t counter(uint32_t ch, uint64_t n)
+{
+    (void)ch;
+    return (int32_t)(((uint32_t)n & 0xFFFFu) << 8) - 0x800000;
+}
+
+static int32_t saw(uint32_t ch, uint64_t n)
+{
+    (void)ch;
+    return ((int32_t)(n % SAW_PERIOD) * SAW_STEP - 32768) * 256;
+}
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    if (pkt->ep != EP_AUDIO_IN || !in.frame_bytes) {
+        return;
+    }
+    if (pkt->len && in.n < 4) {
+        const uint8_t *p = pkt->data + in.subframe_bytes - 2;
+
+        in.wire_at[in.n] = in.wire;
+        struct ramp *r = &in.ramp[in.n];
+        double sum = 0;
+
+        r->samples = (uint16_t)(pkt->len / in.frame_bytes);
+        for (uint32_t i = 0; i < r->samples; i++, p += in.frame_bytes) {
+            r->last = (int16_t)(p[0] | p[1] << 8);
+            r->first = i ? r->first : r->last;
+            sum += r->last;
+        }
+        r->mean = sum / r->samples;
+        p = pkt->data + in.subframe_bytes - 2;
+        in.first[in.n++] = (uint16_t)((p[0] | p[1] << 8) ^ 0x8000);
+    }
+    in.wire += pkt->len / in.frame_bytes;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static bool set_rate(uint32_t hz)
+{
+    uint8_t d[RATE_BYTES];
+
+    for (unsigned i = 0; i < RATE_BYTES; i++, hz >>= 8) {
+        d[i] = (uint8_t)hz;
+    }
+    return host_usb_control(REQ_SET, SET_CUR, SAM_FREQ << 8, RATE_INDEX, d,
+                            RATE_BYTES) == RATE_BYTES;
+}
+
+/*
+ * Group delay of each converter, in input samples back from output index
+ * c times the ratio: half its FIR, less how far the last input an output
+ * takes lies past c times the ratio (1 for 2/3 and 1/2, 2 for 1/3)
+ */
+static const struct {
+    uint32_t rate_hz;
+    double   delay;
+} pcm_delays[] = {
+    { 32000, (108 - 1) / 4.0 - 1 },     /* 96 kHz prototype */
+    { 24000, (84 - 1) / 2.0 - 1 },
+    { 16000, (112 - 1) / 2.0 - 2 },
+};
+
+/*
+ * PDM: the FIR's at 96 kHz, the CIC's at 384 kHz and the boxcar's in
+ * bits; output c ends on the last bit of input c, whose level is held
+ * across it, so half a sample comes off
+ */
+#define PDM_DELAY  ((PDM_FIR_TAPS - 1) / 4.0 + PDM_CIC_ORDER * 3 / 16.0 + \
+                    3.5 / PDM_DECIM_RATIO - 0.5)
+
+static double group_delay(const struct audio_stream_cfg *cfg)
+{
+    double d = AUDIO_MIC_PDM ? PDM_DELAY : 0;
+
+    for (size_t i = 0; cfg->rate_hz != cfg->capture_hz &&
+                       i < sizeof(pcm_delays) / sizeof(pcm_delays[0]); i++) {
+        if (pcm_delays[i].rate_hz == cfg->rate_hz) {
+            d += pcm_delays[i].delay;
+        }
+    }
+    return d;
+}
+
+/*
+ * Mean error of the DMA position, in output samples: it is read in whole
+ * half-words, a uniform 0..DMA_LATENCY after the half ended
+ */
+static double grain_bias(const struct audio_stream_cfg *cfg)
+{
+    double span = (double)DMA_LATENCY * cfg->capture_hz * AUDIO_CAPTURE_HWORDS_PER_FRAME /
+                  SOF_TIMER_HZ;
+    double r    = span - floor(span);
+    double lost = (floor(span) / 2 + r * r / 2) / span;
+
+    return -lost * cfg->rate_hz / ((double)AUDIO_CAPTURE_HWORDS_PER_FRAME * cfg->capture_hz);
+}
+
+static bool read_blob(struct blob *b)
+{
+    uint8_t raw[SYNC_BLOB_SIZE];
+
+    if (host_usb_control(REQ_VENDOR_IN, VENDOR_REQ_SYNC_READ, 0, 0, raw,
+                         sizeof(raw)) != SYNC_BLOB_SIZE ||
+        le32(raw) != SYNC_BLOB_MAGIC) {
+        return false;
+    }
+    b->flags   = (uint16_t)(raw[6] | raw[7] << 8);
+    b->frame   = le32(raw + 8);
+    b->epoch   = le32(raw + 12);
+    b->rate_hz = le32(raw + 16);
+    b->offset  = (int32_t)le32(raw + 20);
+    b->pos     = ((uint64_t)le32(raw + 28) << 32 | le32(raw + 24)) / 4294967296.0;
+    return true;
+}
+
+/* Locked error of one device: mean and extremes, in samples */
+struct result {
+    double mean, lo, hi;
+    uint32_t locked;
+};
+
+/*
+ * Input sample a converted packet's first sample came from: the
+ * sawtooth's phase from its levels, unwrapped to the period of want. NAN
+ * if the packet is off the middle of the ramp or the decimators are
+ * still filling.
+ */
+static double saw_input(const struct audio_stream_cfg *cfg, double want, const struct ramp *r)
+{
+    double ratio = (double)cfg->capture_hz / cfg->rate_hz;
+    double rise  = (double)SAW_STEP * ratio * (r->samples - 1);
+
+    if (want < SAW_PERIOD || r->first <= -SAW_WINDOW || r->last >= SAW_WINDOW ||
+        r->last - r->first < rise / 2 || r->last - r->first > rise * 2) {
+        return NAN;
+    }
+    double phase = SAW_PERIOD / 2 + r->mean / SAW_STEP - ratio * (r->samples - 1) / 2;
+
+    return want + remainder(phase - want, SAW_PERIOD);
+}
+
+static void run_device(const struct audio_format *fmt, uint32_t hz, const struct device *d,
+                       struct result *res)
+{
+    struct host_capture_stats hs;
+    struct blob b;
+    uint32_t lock_at = 0, mapped = 0, wrong = 0, epoch = UINT32_MAX, bad_reads = 0;
+    double   sum = 0, delay_sum = 0, delay_lo = INFINITY, delay_hi = -INFINITY;
+    bool     exact = !AUDIO_MIC_PDM && (!fmt->capture_hz || fmt->capture_hz == hz);
+
+    in.frame_bytes = 0;
+    host_capture_set_ppm(d->ppm);
+    host_capture_set_source(exact ? counter : saw);
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    host_board_run(d->idle_frames);
+    CHECK(set_rate(hz));
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, fmt->alt));
+
+    const struct audio_stream_cfg *cfg = audio_stream_cfg();
+    double delay = group_delay(cfg);
+
+    CHECKF(cfg->rate_hz == hz, "alt %u at %u Hz: streaming at %u", fmt->alt, hz,
+           cfg->rate_hz);
+    in.frame_bytes    = cfg->frame_bytes;
+    in.subframe_bytes = cfg->subframe_bytes;
+    in.wire = 0;
+    *res = (struct result){ 0, INFINITY, -INFINITY, 0 };
+
+    for (uint32_t f = 0; f < DEVICE_FRAMES; f++) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+
+        fr.hold = f * 37 % HOLD_STEPS;
+        in.n = 0;
+        host_usb_frame(&fr);
+
+        uint32_t hf = host_usb_frame_count() - 1;
+
+        if (!read_blob(&b) || (b.flags & SYNC_FLAG_TRACKING && (b.frame & 0x7FF) != (hf & 0x7FF))) {
+            bad_reads++;
+            continue;
+        }
+
+        /*
+         * Packets of an unchanged epoch start where the offset says. The
+         * priming silence armed before the first ring packet maps before
+         * capture sample 0 and is left out.
+         */
+        for (uint32_t i = 0; (b.flags & SYNC_FLAG_MAPPED) && b.epoch == epoch && i < in.n; i++) {
+            int64_t c = (int64_t)in.wire_at[i] + b.offset;
+
+            if (c < 0) {
+                continue;
+            }
+            if (exact) {
+                mapped++;
+                wrong += in.first[i] != (uint16_t)c;
+                continue;
+            }
+            double want = (double)c * cfg->capture_hz / cfg->rate_hz - delay;
+            double err  = saw_input(cfg, want, &in.ramp[i]) - want;
+
+            if (isnan(err)) {
+                continue;
+            }
+
+            mapped++;
+            wrong     += fabs(err) > DELAY_TOL;
+            delay_sum += err;
+            delay_lo   = fmin(delay_lo, err);
+            delay_hi   = fmax(delay_hi, err);
+        }
+        epoch = b.epoch;
+
+        if (!(b.flags & SYNC_FLAG_LOCKED)) {
+            CHECKF(!lock_at, "alt %u at %u Hz, %+.0f ppm: lock lost at frame %u",
+                   fmt->alt, hz, d->ppm, f);
+            continue;
+        }
+        if (!lock_at) {
+            lock_at = f;
+        }
+
+        host_capture_get_stats(&hs);
+
+        double truth = (double)((uint64_t)hf * HOST_HW_TICKS_PER_MS - hs.t_start) *
+                       b.rate_hz * (1 + d->ppm * 1e-6) / SOF_TIMER_HZ;
+        double err = b.pos - truth;
+
+        sum += err;
+        res->lo = fmin(res->lo, err);
+        res->hi = fmax(res->hi, err);
+        res->locked++;
+    }
+    res->mean = res->locked ? sum / res->locked : 0;
+
+    printf("  alt %u %5u Hz %+5.0f ppm: locked after %u ms, error %+.4f..%+.4f, "
+           "%u packets mapped", fmt->alt, hz, d->ppm, lock_at, res->lo, res->hi, mapped);
+    if (!exact && mapped) {
+        printf(", %+.3f..%+.3f input samples off a delay of %.2f", delay_lo, delay_hi, delay);
+    }
+    printf("\n");
+    CHECKF(bad_reads == 0, "alt %u at %u Hz, %+.0f ppm: %u bad reads", fmt->alt, hz, d->ppm,
+           bad_reads);
+    CHECKF(lock_at && lock_at <= LOCK_MS, "alt %u at %u Hz, %+.0f ppm: locked at frame %u",
+           fmt->alt, hz, d->ppm, lock_at);
+    CHECKF(mapped > (exact ? DEVICE_FRAMES / 2 : DEVICE_FRAMES / 4) && wrong == 0,
+           "alt %u at %u Hz, %+.0f ppm: %u of %u packets off their mapping", fmt->alt, hz,
+           d->ppm, wrong, mapped);
+    CHECKF(exact || !mapped || fabs(delay_sum / mapped) <= DELAY_MEAN_TOL,
+           "alt %u at %u Hz, %+.0f ppm: packets %+.3f input samples off a group delay of %.2f",
+           fmt->alt, hz, d->ppm, mapped ? delay_sum / mapped : 0, delay);
+}
+
+static void run_array(const struct audio_format *fmt, uint32_t hz)
+{
+    struct result res[NUM_DEVICES];
+    double bias = 0;
+
+    for (size_t i = 0; i < NUM_DEVICES; i++) {
+        run_device(fmt, hz, &devices[i], &res[i]);
+        bias += res[i].mean / NUM_DEVICES;
+    }
+
+    double grain = grain_bias(audio_stream_cfg());
+
+    CHECKF(fabs(bias - grain) <= BIAS_TOL, "alt %u at %u Hz: shared bias %+.4f, want %+.4f",
+           fmt->alt, hz, bias, grain);
+    for (size_t i = 0; i < NUM_DEVICES; i++) {
+        CHECKF(res[i].locked && res[i].lo >= bias - ALIGN_TOL && res[i].hi <= bias + ALIGN_TOL,
+               "alt %u at %u Hz, %+.0f ppm: error %+.4f..%+.4f against a shared %+.4f",
+               fmt->alt, hz, devices[i].ppm, res[i].lo, res[i].hi, bias);
+    }
+}
+
+int main(void)
+{
+    host_board_init();
+    host_capture_set_latency(DMA_LATENCY);
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        const struct audio_format *fmt = audio_format_for_alt(alt);
+
+        for (unsigned r = 0; r < fmt->num_rates; r++) {
+            run_array(fmt, fmt->rates[r]);
+        }
+    }
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    return host_test_result("sync");
+}
@@ -0,0 +1,250 @@
+/*
+ * The diagnostic tap's bulk endpoint alongside the iso stream
+ * (usb_tap.h, audio_tap.h, bus model in host_usb.h).
+ *
+ * Every alt streams with the tap off, then on each stage in turn with
+ * telemetry, and the host parses what EP_TAP_IN delivers as it goes. The
+ * iso stream must not notice: one packet taken every frame in its
+ * periodic slot at the token step, nothing missed, late, re-sent or
+ * silent, and the SOF to packet latency the tap-off run had. The tap may
+ * only use the bus time the periodic slots leave, ending before the
+ * end-of-frame check.
+ *
+ * The tap stream must parse with no lost sync, its sequence gaps must add
+ * up to the records the firmware counts as dropped, and each run must
+ * carry the stage asked for and its telemetry. A run that dropped records
+ * must have taken at least TAP_MIN_SHARE of the max-size packets the bus
+ * time left holds and moved at least TAP_MIN_BYTES_PER_MS; the throughput
+ * is printed for each.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libopencm3/usb/usbstd.h>
+
+#include "audio_format.h"
+#include "audio_stream.h"
+#include "audio_tap.h"
+#include "tap_stream.h"
+#include "usb_descriptors.h"
+#include "usb_tap.h"
+#include "usb_vendor.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define REQ_VENDOR_OUT  (USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_DEVICE)
+
+#define SETTLE_FRAMES   200
+#define RUN_FRAMES      1000
+#define TELEMETRY_MS    10
+#define TOKEN_STEP      (HOST_USB_STEPS / 2)
+#define TOKEN_TICKS     (TOKEN_STEP * HOST_HW_TICKS_PER_MS / HOST_USB_STEPS)
+
+/* Bus time up to the end-of-frame check */
+#define FRAME_END       ((HOST_USB_STEPS - 2) * HOST_USB_STEP_BYTES)
+
+/* A run the tap could not keep up in: of the packets that fit, and at least */
+#define TAP_MIN_SHARE         0.9
+#define TAP_MIN_BYTES_PER_MS  256
+
+static const uint8_t stages[] = {
+    0, TAP_REC_RAW, TAP_REC_CONVERTED, TAP_REC_DSP, TAP_REC_OUTPUT,
+};
+
+static const char *const stage_names[] = {
+    [0]                 = "off",
+    [TAP_REC_RAW]       = "raw",
+    [TAP_REC_CONVERTED] = "converted",
+    [TAP_REC_DSP]       = "dsp",
+    [TAP_REC_OUTPUT]    = "output",
+};
+
+/* What the host saw in the run */
+static struct {
+    bool     on;
+    uint32_t frame0;
+    uint32_t periodic;              /* host_usb_periodic_bytes() */
+    uint8_t  iso[RUN_FRAMES];       /* packets per frame */
+    uint32_t iso_off_slot;          /* not in the periodic slot at the token */
+    uint32_t bulk_packets, bulk_bytes;
+    uint32_t bulk_outside;          /* packets outside the time left */
+} run_in;
+
+/* The tap stream, parsed across runs */
+static struct {
+    uint8_t  buf[AUDIO_TAP_RING_BYTES + USB_TAP_BATCH_BYTES];
+    uint32_t len;
+    bool     started;
+    uint16_t next_seq;
+    uint32_t lost, resyncs;
+    uint32_t records[256];          /* by type */
+} tap;
+
+/* Every byte of every sample moves from one frame to the next */
+static int32_t busy_source(uint32_t ch, uint64_t n)
+{
+    uint32_t x = (uint32_t)n * 2654435761u + ch * 40503u;
+
+    return (int32_t)((x ^ x >> 13) & 0xFFFFFF) - 0x800000;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+/* Whole records off the front of the buffer; a bad header skips a byte */
+static void tap_parse(void)
+{
+    uint32_t at = 0;
+
+    while (tap.len - at >= TAP_HEADER_SIZE) {
+        const uint8_t *h = tap.buf + at;
+        uint16_t n = get16(h + 6);
+
+        if (get16(h) != TAP_SYNC) {
+            tap.resyncs++;
+            at++;
+            continue;
+        }
+        if (tap.len - at < TAP_HEADER_SIZE + (uint32_t)n) {
+            break;
+        }
+        if (tap.started) {
+            tap.lost += (uint16_t)(get16(h + 4) - tap.next_seq);
+        }
+        tap.started  = true;
+        tap.next_seq = (uint16_t)(get16(h + 4) + 1);
+        tap.records[h[2]]++;
+        at += TAP_HEADER_SIZE + n;
+    }
+    memmove(tap.buf, tap.buf + at, tap.len - at);
+    tap.len -= at;
+}
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    uint32_t f = pkt->frame - run_in.frame0;
+
+    if (pkt->ep == EP_AUDIO_IN && run_in.on && f < RUN_FRAMES) {
+        run_in.iso[f]++;
+        run_in.iso_off_slot += pkt->t % HOST_HW_TICKS_PER_MS != TOKEN_TICKS ||
+                               pkt->bus + pkt->len + HOST_USB_ISO_OVERHEAD >
+                               run_in.periodic;
+    }
+    if (pkt->ep != EP_TAP_IN) {
+        return;
+    }
+    if (run_in.on) {
+        run_in.bulk_packets++;
+        run_in.bulk_bytes   += pkt->len;
+        run_in.bulk_outside += pkt->bus < run_in.periodic ||
+                               pkt->bus + pkt->len + HOST_USB_BULK_OVERHEAD > FRAME_END;
+    }
+    if (tap.len + pkt->len > sizeof(tap.buf)) {
+        CHECKF(false, "tap: %u bytes unparsed", tap.len);
+        tap.len = 0;
+    }
+    memcpy(tap.buf + tap.len, pkt->data, pkt->len);
+    tap.len += pkt->len;
+    tap_parse();
+}
+
+/* alt with stage tapped; returns the SOF to packet latency it ran at */
+static uint32_t run(uint8_t alt, uint8_t stage, uint32_t latency_off)
+{
+    struct audio_stream_stats s0, ss;
+    uint32_t drops0, records0[256];
+    uint16_t telemetry = stage ? TELEMETRY_MS : 0;
+
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    CHECK(host_usb_control(REQ_VENDOR_OUT, VENDOR_REQ_TAP_SELECT, stage, telemetry,
+                           NULL, 0) == 0);
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, alt));
+    host_board_run(SETTLE_FRAMES);
+
+    memset(&run_in, 0, sizeof(run_in));
+    memcpy(records0, tap.records, sizeof(records0));
+    run_in.frame0   = host_usb_frame_count();
+    run_in.periodic = host_usb_periodic_bytes();
+    run_in.on       = true;
+    drops0 = audio_tap_drops();
+    audio_stream_get_stats(&s0, 1);
+
+    host_board_run(RUN_FRAMES);
+    run_in.on = false;
+    audio_stream_get_stats(&ss, 0);
+
+    const char *name  = stage_names[stage];
+    uint32_t drops    = audio_tap_drops() - drops0;
+    uint32_t left     = FRAME_END - run_in.periodic;
+    uint32_t fit      = left / (USB_TAP_PACKET_SIZE + HOST_USB_BULK_OVERHEAD);
+    double   rate     = (double)run_in.bulk_bytes / RUN_FRAMES;
+    double   packets  = (double)run_in.bulk_packets / RUN_FRAMES;
+    uint32_t not_once = 0;
+
+    for (uint32_t f = 0; f < RUN_FRAMES; f++) {
+        not_once += run_in.iso[f] != 1;
+    }
+
+    printf("  alt %u tap %-9s: %5.1f B/ms in %4.1f of %2u packets/ms the bus has left, "
+           "%4u records dropped\n", alt, name, rate, packets, fit, drops);
+
+    /* The iso stream as with the tap off */
+    CHECKF(not_once == 0 && run_in.iso_off_slot == 0,
+           "alt %u tap %s: %u frames without exactly one iso packet, %u off the slot",
+           alt, name, not_once, run_in.iso_off_slot);
+    CHECKF(ss.missed == s0.missed && ss.late == s0.late && ss.recovered == s0.recovered &&
+           ss.silent == s0.silent && ss.busy == s0.busy && ss.sof_gaps == s0.sof_gaps,
+           "alt %u tap %s: %u missed, %u late, %u re-sent, %u silent, %u busy", alt, name,
+           ss.missed - s0.missed, ss.late - s0.late, ss.recovered - s0.recovered,
+           ss.silent - s0.silent, ss.busy - s0.busy);
+    CHECKF(!stage || ss.sof_latency_max == latency_off,
+           "alt %u tap %s: SOF to packet %u ticks, %u with the tap off", alt, name,
+           ss.sof_latency_max, latency_off);
+
+    /* The tap in the time left, carrying what was asked for */
+    CHECKF(run_in.bulk_outside == 0, "alt %u tap %s: %u bulk packets outside the %u "
+           "byte times left", alt, name, run_in.bulk_outside, left);
+    CHECKF(stage ? tap.records[stage] > records0[stage] &&
+                   tap.records[TAP_REC_TELEMETRY] > records0[TAP_REC_TELEMETRY]
+                 : run_in.bulk_packets == 0,
+           "alt %u tap %s: %u stage records, %u telemetry, %u bulk packets", alt, name,
+           tap.records[stage] - records0[stage],
+           tap.records[TAP_REC_TELEMETRY] - records0[TAP_REC_TELEMETRY],
+           run_in.bulk_packets);
+    CHECKF(drops == 0 || (packets >= TAP_MIN_SHARE * fit && rate >= TAP_MIN_BYTES_PER_MS),
+           "alt %u tap %s: %u records dropped at %.1f B/ms, %.1f of %u packets/ms", alt,
+           name, drops, rate, packets, fit);
+    return ss.sof_latency_max;
+}
+
+int main(void)
+{
+    host_board_init();
+    host_capture_set_source(busy_source);
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        uint32_t latency = 0;
+
+        for (size_t i = 0; i < sizeof(stages); i++) {
+            uint32_t l = run(alt, stages[i], latency);
+
+            latency = stages[i] ? latency : l;
+        }
+    }
+
+    /* Drain, then every record dropped shows as a sequence gap, and only those */
+    CHECK(host_usb_control(REQ_VENDOR_OUT, VENDOR_REQ_TAP_SELECT, 0, 0, NULL, 0) == 0);
+    host_board_run(SETTLE_FRAMES);
+    CHECKF(tap.resyncs == 0 && tap.len == 0 && tap.lost == audio_tap_drops(),
+           "tap stream: %u resyncs, %u bytes left over, %u records lost, %u dropped",
+           tap.resyncs, tap.len, tap.lost, audio_tap_drops());
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    return host_test_result("tap");
+}
@@ -0,0 +1,110 @@
+/*
+ * Bytes on the wire from the capture IN endpoint, for comparing builds.
+ *
+ *   test_wire <dump>
+ *
+ * Streams every alt at a drifting mic clock, with lost SOFs, frames the
+ * host sends no token in (the packet is flushed and re-armed from the
+ * ring) and interrupts held to the end of a frame, and writes every IN
+ * packet the host takes to dump (frame, length, payload). check runs it
+ * from the zero-copy build and from an AUDIO_STREAM_STAGED=1 build of
+ * audio_stream.c and compares the two dumps byte for byte.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "audio_format.h"
+#include "audio_stream.h"
+#include "usb_descriptors.h"
+#include "host_board.h"
+#include "host_test.h"
+
+#define WIRE_FRAMES    3000
+#define WIRE_PPM       300.0
+#define SOF_LOST_EVERY 97
+#define NO_TOKEN_EVERY 61
+#define HOLD_EVERY     89
+
+static FILE    *dump;
+static uint32_t packets, payload_bytes;
+
+/* Every byte of every sample moves from one frame to the next */
+static int32_t busy_source(uint32_t ch, uint64_t n)
+{
+    uint32_t x = (uint32_t)n * 2654435761u + ch * 40503u;
+
+    return (int32_t)((x ^ x >> 13) & 0xFFFFFF) - 0x800000;
+}
+
+static void on_packet(const struct host_usb_packet *pkt)
+{
+    uint8_t hdr[6] = {
+        (uint8_t)pkt->frame, (uint8_t)(pkt->frame >> 8),
+        (uint8_t)(pkt->frame >> 16), (uint8_t)(pkt->frame >> 24),
+        (uint8_t)pkt->len, (uint8_t)(pkt->len >> 8),
+    };
+
+    if (pkt->ep != EP_AUDIO_IN) {
+        return;
+    }
+    fwrite(hdr, 1, sizeof(hdr), dump);
+    fwrite(pkt->data, 1, pkt->len, dump);
+    packets++;
+    payload_bytes += pkt->len;
+}
+
+static void run(uint8_t alt)
+{
+    struct audio_stream_stats s0, ss;
+    uint32_t p0 = packets;
+
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, 0));
+    CHECK(host_board_set_interface(IFACE_AUDIO_STREAM, alt));
+    audio_stream_get_stats(&s0, 0);
+
+    for (uint32_t f = 1; f <= WIRE_FRAMES; f++) {
+        struct host_usb_frame fr = HOST_USB_FRAME_DEFAULT;
+
+        fr.sof_lost = f % SOF_LOST_EVERY == 0;
+        if (f % NO_TOKEN_EVERY == 0) {
+            fr.token = HOST_USB_NO_TOKEN;
+        }
+        if (f % HOLD_EVERY == 0) {
+            fr.hold = HOST_USB_STEPS - 3;
+        }
+        host_usb_frame(&fr);
+    }
+    audio_stream_get_stats(&ss, 0);
+
+    /* The dump is only worth comparing if the awkward paths ran */
+    CHECKF(packets - p0 > WIRE_FRAMES / 2, "alt %u: %u packets", alt, packets - p0);
+    CHECKF(ss.packets - ss.silent > s0.packets - s0.silent + WIRE_FRAMES / 2,
+           "alt %u: %u audio packets", alt,
+           (ss.packets - ss.silent) - (s0.packets - s0.silent));
+    CHECKF(ss.missed > s0.missed && ss.recovered > s0.recovered,
+           "alt %u: %u missed, %u re-sent", alt,
+           ss.missed - s0.missed, ss.recovered - s0.recovered);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 || !(dump = fopen(argv[1], "wb"))) {
+        fprintf(stderr, "usage: test_wire <dump>\n");
+        return 2;
+    }
+
+    host_board_init();
+    host_capture_set_source(busy_source);
+    host_capture_set_ppm(WIRE_PPM);
+    CHECK(host_board_enumerate());
+    host_usb_on_packet(on_packet);
+
+    for (uint8_t alt = 1; alt <= AUDIO_NUM_FORMATS; alt++) {
+        run(alt);
+    }
+
+    CHECK(fclose(dump) == 0);
+    printf("  %u packets, %u bytes\n", packets, payload_bytes);
+    return host_test_result("wire");
+}
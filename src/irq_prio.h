@@ -0,0 +1,21 @@
+#pragma once
+
+/*
+ * NVIC priority layout (STM32F4 implements the upper 4 bits; lower value
+ * preempts higher).
+ *
+ *   USB (OTG_FS)   0x40  SOF packet write and control requests; the SOF
+ *                        path is a ring read plus FIFO write, so it is
+ *                        bounded to a few microseconds.
+ *   Capture DMA    0x80  one half-buffer conversion per ms; may be held
+ *                        off by USB for up to a frame without losing data.
+ *   Playback DMA   0x80  headset speaker: one half-buffer copy per ms,
+ *                        a frame of slack like capture. Equal priority,
+ *                        so the two never preempt each other.
+ *   Background     thread mode, cooperative task queue (task_queue.h);
+ *                  DSP, housekeeping and the tap bulk feeder (usb_tap.h),
+ *                  preempted by everything above.
+ */
+#define IRQ_PRIO_USB          0x40
+#define IRQ_PRIO_CAPTURE_DMA  0x80
+#define IRQ_PRIO_PLAYBACK_DMA 0x80
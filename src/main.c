@@ -1,21 +1,32 @@
+#include <stdbool.h>
+
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/dwc/otg_fs.h>
 
 #include "usb_descriptors.h"
+#include "audio_stream.h"
+#include "stream_power.h"
+#include "power_hal.h"
+#include "irq_prio.h"
+#include "task_queue.h"
+#include "sof_timer.h"
+#include "cycle_counter.h"
+
+/*
+ * Build with -DUSB_POLLED=1 to run the stack from a busy usbd_poll() loop
+ * instead of the OTG_FS interrupt; kept to compare latency and idle time.
+ */
+#ifndef USB_POLLED
+#define USB_POLLED 0
+#endif
 
 /* Global USB device handle (only used here) */
 static usbd_device *usbdev;
-static uint8_t control_buffer[128];
-
-/* -------------------------------------------------------------------------- */
-/* CLOCK SETUP                                                                */
-/* -------------------------------------------------------------------------- */
-static void clock_setup(void)
-{
-    /* 25 MHz HSE → 96 MHz SYSCLK, USB at 48 MHz */
-    rcc_clock_setup_pll(&rcc_hse_25mhz_3v3[RCC_CLOCK_3V3_96MHZ]);
-}
+static uint8_t control_buffer[USB_CONTROL_BUFFER_BYTES];
 
 /* -------------------------------------------------------------------------- */
 /* GPIO: USB pins + fake VBUS + LED                                           */
@@ -36,9 +47,6 @@ static void gpio_setup(void)
     /* LED on PC13 (optional) */
     gpio_mode_setup(GPIOC, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO13);
     gpio_set(GPIOC, GPIO13);
-
-    gpio_mode_setup(GPIOA, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO0);
-    gpio_clear(GPIOA, GPIO0);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -58,8 +66,49 @@ static void usb_setup(void)
                        sizeof(control_buffer));
 
     usbd_register_set_config_callback(usbdev, usb_set_config);
+    usbd_register_suspend_callback(usbdev, usb_suspend);
+    usbd_register_resume_callback(usbdev, usb_resume);
+    usbd_register_reset_callback(usbdev, usb_reset);
+
+#if !USB_POLLED
+    nvic_set_priority(NVIC_OTG_FS_IRQ, IRQ_PRIO_USB);
+    nvic_enable_irq(NVIC_OTG_FS_IRQ);
+#endif
+}
+
+/* Incomplete iso IN: usbd_poll() ignores it and it stays pending */
+static void usb_iso_incomplete(void)
+{
+    if (OTG_FS_GINTSTS & OTG_GINTSTS_IISOIXFR) {
+        OTG_FS_GINTSTS = OTG_GINTSTS_IISOIXFR;
+        audio_stream_incomplete();
+    }
 }
 
+#if !USB_POLLED
+void otg_fs_isr(void);
+
+void otg_fs_isr(void)
+{
+    usb_iso_incomplete();
+    usbd_poll(usbdev);
+}
+#else
+/* A poll that found no unmasked event (and no SOF) counts as idle time */
+static void usb_poll_accounted(void)
+{
+    uint32_t t0   = cycles_now();
+    bool     idle = !(OTG_FS_GINTSTS & (OTG_FS_GINTMSK | OTG_GINTSTS_SOF));
+
+    usb_iso_incomplete();
+    usbd_poll(usbdev);
+
+    if (idle) {
+        task_idle_account(cycles_now() - t0);
+    }
+}
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* HARD FAULT HANDLER (blinks LED)                                            */
 /* -------------------------------------------------------------------------- */
@@ -80,14 +129,24 @@ void hard_fault_handler(void)
 /* -------------------------------------------------------------------------- */
 int main(void)
 {
-    clock_setup();
+    power_hal_init();
     gpio_setup();
 
+    dwt_enable_cycle_counter();
+    sof_timer_init();
+
     usb_set_unique_serial();
+    stream_power_init();
     usb_setup();
 
     while (1) {
-        usbd_poll(usbdev);
+#if USB_POLLED
+        usb_poll_accounted();
+        task_run_pending();
+#else
+        task_run_pending();
+        task_idle_wait();
+#endif
     }
 
     return 0;
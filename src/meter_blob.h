@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Meter blob: wire format of a level meter / spectrum snapshot, shared by
+ * the firmware (audio_meter.c) and the host decoder (meter_decode.c).
+ *
+ * Little-endian; levels are int16 in 1/256 dB (the UAC volume unit),
+ * METER_DB_FLOOR for digital silence:
+ *
+ *   header  magic "MTR1" (u32), version (u16), n_channels (u8),
+ *           n_bands (u8), rate_hz (u32), fft_size (u16), window_ms (u16),
+ *           level_windows (u32), spectra (u32), drops (u32)
+ *   edges   u8[n_bands + 1] FFT bin edges, band b = [edge[b], edge[b+1]),
+ *           zero-padded to a multiple of 4
+ *   channel peak, rms, band[n_bands]   (int16) x n_channels
+ *
+ * peak and rms are over the last complete window of window_ms, in dBFS
+ * (0 dB = a full-scale square wave, so a full-scale sine reads -3.01 dB
+ * rms). Band levels are the Hann-windowed power in the band relative to a
+ * full-scale sine, so a full-scale tone well inside a band reads 0 dB
+ * there. Bands more than ~65 dB below the loudest band of the same
+ * transform sit on its rounding noise or go to METER_DB_FLOOR. Levels
+ * below -128 dB read as METER_DB_FLOOR + 1.
+ *
+ * level_windows and spectra count completed windows and transforms (all
+ * channels); drops counts 1 ms blocks the analysis could not keep up with.
+ */
+
+#define METER_BLOB_MAGIC     0x3152544Du     /* "MTR1" */
+#define METER_BLOB_VERSION   1
+
+#define METER_DB_FLOOR       INT16_MIN
+
+#define METER_FFT_SIZE       256
+#define METER_NUM_BANDS      16
+#define METER_MAX_CHANNELS   8
+
+#define METER_BLOB_HEADER_SIZE   28
+#define METER_BLOB_EDGES_SIZE    ((METER_NUM_BANDS + 1 + 3) & ~3)
+#define METER_BLOB_CHANNEL_SIZE  ((2 + METER_NUM_BANDS) * 2)
+#define METER_BLOB_SIZE \
+    (METER_BLOB_HEADER_SIZE + METER_BLOB_EDGES_SIZE + \
+     METER_MAX_CHANNELS * METER_BLOB_CHANNEL_SIZE)
@@ -0,0 +1,120 @@
+/*
+ * Host decoder for meter blobs (meter_blob.h).
+ *
+ *   meter_decode [file]    reads a blob from file or stdin
+ *
+ * Enable the analysis, then fetch a blob, e.g. from Python/pyusb:
+ *   dev.ctrl_transfer(0x40, 0x07, 3, 100)          # levels + spectrum, 100 ms
+ *   dev.ctrl_transfer(0xC0, 0x06, 0, 0, 1024)
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "meter_blob.h"
+
+static uint32_t get16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+static void print_db(int16_t v)
+{
+    if (v == METER_DB_FLOOR) {
+        printf(" %7s", "-inf");
+    } else {
+        printf(" %7.1f", v / 256.0);
+    }
+}
+
+/* Returns 0 on success, or a message describing the first problem */
+static const char *meter_print(const uint8_t *p, size_t len)
+{
+    if (len < METER_BLOB_HEADER_SIZE) {
+        return "short header";
+    }
+    if (get32(p) != METER_BLOB_MAGIC) {
+        return "bad magic";
+    }
+    if (get16(p + 4) != METER_BLOB_VERSION) {
+        return "unsupported version";
+    }
+
+    unsigned n_ch     = p[6];
+    unsigned n_bands  = p[7];
+    uint32_t rate     = get32(p + 8);
+    unsigned fft_size = get16(p + 12);
+    size_t   edges_sz = (n_bands + 1 + 3) & ~3u;
+    size_t   ch_sz    = (2 + n_bands) * 2;
+
+    if (len < METER_BLOB_HEADER_SIZE + edges_sz + n_ch * ch_sz) {
+        return "truncated";
+    }
+
+    printf("meters v%u, %u Hz, %u ch, window %u ms, %u-point FFT\n",
+           (unsigned)get16(p + 4), (unsigned)rate, n_ch,
+           (unsigned)get16(p + 14), fft_size);
+    printf("  %u level windows, %u spectra, %u blocks dropped\n",
+           (unsigned)get32(p + 16), (unsigned)get32(p + 20),
+           (unsigned)get32(p + 24));
+    if (n_ch == 0) {
+        return 0;
+    }
+
+    const uint8_t *edges = p + METER_BLOB_HEADER_SIZE;
+    const uint8_t *c     = edges + edges_sz;
+    double bin_hz = fft_size ? (double)rate / fft_size : 0;
+
+    printf("\n%-13s", "dBFS");
+    for (unsigned ch = 0; ch < n_ch; ch++) {
+        printf("   ch%-3u", ch);
+    }
+    printf("\n%-13s", "peak");
+    for (unsigned ch = 0; ch < n_ch; ch++) {
+        print_db((int16_t)get16(c + ch * ch_sz));
+    }
+    printf("\n%-13s", "rms");
+    for (unsigned ch = 0; ch < n_ch; ch++) {
+        print_db((int16_t)get16(c + ch * ch_sz + 2));
+    }
+    printf("\n");
+
+    for (unsigned b = 0; b < n_bands; b++) {
+        printf("%5.0f-%5.0f Hz", edges[b] * bin_hz, edges[b + 1] * bin_hz);
+        for (unsigned ch = 0; ch < n_ch; ch++) {
+            print_db((int16_t)get16(c + ch * ch_sz + 4 + 2 * b));
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t blob[4096];
+    FILE *f = stdin;
+
+    if (argc > 1 && !(f = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    size_t len = fread(blob, 1, sizeof(blob), f);
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    const char *err = meter_print(blob, len);
+    if (err) {
+        fprintf(stderr, "meter_decode: %s\n", err);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include <string.h>
+
+#include "pcm_decim.h"
+#include "dsp_intrinsics.h"
+
+struct pcm_decim_filter {
+    uint32_t out_hz;
+    uint8_t  up;                /* L: 1, or 2 for 48 -> 32 kHz */
+    uint8_t  down;              /* M */
+    uint16_t taps;              /* stored taps; prototype is twice this */
+    const int16_t *coef;
+};
+
+/* -------------------------------------------------------------------------- */
+/* TABLES                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Kaiser (beta 6.76), Q15, unity DC gain. Passband edge 0.4375 * fout,
+ * stopband from 0.5625 * fout. Each table is half of a symmetric
+ * prototype, see pcm_decim.h.
+ */
+
+/* 48 -> 16 kHz, 112 taps: 0.007 dB ripple to 7 kHz, -71 dB from 9 kHz */
+static const int16_t coef_16k[56] __attribute__((aligned(4))) = {
+        1,     1,    -1,    -4,    -3,     3,     8,     5,
+       -6,   -14,    -9,    10,    24,    14,   -16,   -37,
+      -21,    24,    55,    31,   -35,   -80,   -45,    50,
+      111,    62,   -69,  -152,   -84,    93,   205,   113,
+     -124,  -272,  -149,   164,   360,   198,  -217,  -477,
+     -263,   290,   641,   356,  -396,  -888,  -501,   570,
+     1313,   769,  -920, -2271, -1472,  2073,  6938, 10428,
+};
+
+/* 48 -> 24 kHz, 84 taps: 0.004 dB ripple to 10.5 kHz, -71 dB from 13.5 kHz */
+static const int16_t coef_24k[42] __attribute__((aligned(4))) = {
+        1,     2,    -3,    -5,     7,     9,   -11,   -15,
+       18,    23,   -28,   -34,    41,    48,   -57,   -67,
+       79,    92,  -106,  -122,   140,   160,  -183,  -208,
+      236,   268,  -304,  -344,   390,   442,  -503,  -574,
+      658,   760,  -887, -1051,  1269,  1580, -2061, -2917,
+     4897, 14743,
+};
+
+/*
+ * 48 -> 32 kHz via 96 kHz, 108-tap prototype with gain 2: 0.004 dB ripple
+ * to 14 kHz, -70 dB from 18 kHz. Even taps (phase 0) only.
+ */
+static const int16_t coef_32k[54] __attribute__((aligned(4))) = {
+       -1,    -3,    11,    -9,   -13,    38,   -27,   -36,
+       96,   -62,   -80,   203,  -127,  -157,   387,  -236,
+     -287,   698,  -423,  -515,  1263,  -784,  -995,  2616,
+    -1835, -2941, 13874, 20856,  4144, -4535,  1532,  1134,
+    -1760,   702,   570,  -934,   384,   317,  -521,   214,
+      175,  -283,   114,    90,  -142,    55,    42,   -62,
+       23,    16,   -22,     7,     4,    -4,
+};
+
+static const struct pcm_decim_filter filters[] = {
+    { 16000, 1, 3, 56, coef_16k },
+    { 24000, 1, 2, 42, coef_24k },
+    { 32000, 2, 3, 54, coef_32k },
+};
+
+#define NUM_FILTERS  (sizeof(filters) / sizeof(filters[0]))
+
+/* -------------------------------------------------------------------------- */
+/* COMMON                                                                     */
+/* -------------------------------------------------------------------------- */
+
+bool pcm_decim_init(struct pcm_decim *st, uint32_t out_hz)
+{
+    memset(st, 0, sizeof(*st));
+
+    for (uint32_t i = 0; i < NUM_FILTERS; i++) {
+        if (filters[i].out_hz == out_hz) {
+            st->f = &filters[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Gather one channel behind the history; returns the accepted length */
+static uint32_t load_block(struct pcm_decim *st, const int16_t *in,
+                           uint32_t n_in, uint32_t stride)
+{
+    int16_t *x = &st->buf[PCM_DECIM_HISTORY];
+
+    if (n_in > PCM_DECIM_MAX_IN) {
+        n_in = PCM_DECIM_MAX_IN;
+    }
+    for (uint32_t j = 0; j < n_in; j++) {
+        x[j] = in[j * stride];
+    }
+    return n_in;
+}
+
+static void history_shift(struct pcm_decim *st, uint32_t n_in)
+{
+    memmove(&st->buf[0], &st->buf[n_in],
+            PCM_DECIM_HISTORY * sizeof(st->buf[0]));
+}
+
+static inline int16_t round_q15(int64_t acc)
+{
+    return (int16_t)dsp_sat16((int32_t)(acc >> 15));
+}
+
+/* -------------------------------------------------------------------------- */
+/* OPTIMIZED PATH                                                             */
+/* -------------------------------------------------------------------------- */
+
+/* c[0] * x[0] + c[1] * x[-1] + ... : the pair at x[-2j-1] is back to front */
+static inline int64_t dot_fwd(const int16_t *c, const int16_t *x,
+                              uint32_t n, int64_t acc)
+{
+    for (uint32_t j = 0; j < n; j += 2) {
+        acc = dsp_smlaldx(dsp_load_q15x2(&x[-(int32_t)j - 1]),
+                          dsp_load_q15x2(&c[j]), acc);
+    }
+    return acc;
+}
+
+/* c[0] * x[0] + c[1] * x[1] + ... */
+static inline int64_t dot_rev(const int16_t *c, const int16_t *x,
+                              uint32_t n, int64_t acc)
+{
+    for (uint32_t j = 0; j < n; j += 2) {
+        acc = dsp_smlald(dsp_load_q15x2(&x[j]), dsp_load_q15x2(&c[j]), acc);
+    }
+    return acc;
+}
+
+uint32_t pcm_decim_process(struct pcm_decim *st, const int16_t *in,
+                           int16_t *out, uint32_t n_in, uint32_t stride)
+{
+    const struct pcm_decim_filter *f = st->f;
+    const int16_t *x = &st->buf[PCM_DECIM_HISTORY];
+    uint32_t K = f->taps;
+
+    n_in = load_block(st, in, n_in, stride);
+    uint32_t n_out = n_in * f->up / f->down;
+
+    if (f->up == 1) {
+        /* Newest input of each group of M; fold the two halves */
+        for (uint32_t m = 0; m < n_out; m++) {
+            const int16_t *xi = &x[f->down * m + f->down - 1];
+            int64_t acc = dot_fwd(f->coef, xi, K, 1 << 14);
+            acc = dot_rev(f->coef, xi - (2 * K - 1), K, acc);
+            out[m * stride] = round_q15(acc);
+        }
+    } else {
+        /*
+         * Output m sits at 3m + 2 on the zero-stuffed 96 kHz grid; even
+         * positions take phase 0, odd ones phase 1 = phase 0 reversed.
+         */
+        for (uint32_t m = 0; m < n_out; m++) {
+            uint32_t u = f->down * m + f->down - 1;
+            int64_t acc;
+            if ((u & 1) == 0) {
+                acc = dot_fwd(f->coef, &x[u / 2], K, 1 << 14);
+            } else {
+                acc = dot_rev(f->coef, &x[u / 2] - (K - 1), K, 1 << 14);
+            }
+            out[m * stride] = round_q15(acc);
+        }
+    }
+
+    history_shift(st, n_in);
+    return n_out;
+}
+
+/* -------------------------------------------------------------------------- */
+/* REFERENCE PATH                                                             */
+/* -------------------------------------------------------------------------- */
+
+/* Tap k of the full prototype, rebuilt from the stored half */
+static int32_t proto_tap(const struct pcm_decim_filter *f, uint32_t k)
+{
+    uint32_t N = 2u * f->taps;
+
+    if (f->up == 1) {
+        return f->coef[k < f->taps ? k : N - 1 - k];
+    }
+    /* Odd taps of the prototype are the even ones reversed */
+    return (k & 1) ? f->coef[f->taps - 1 - k / 2] : f->coef[k / 2];
+}
+
+uint32_t pcm_decim_process_ref(struct pcm_decim *st, const int16_t *in,
+                               int16_t *out, uint32_t n_in, uint32_t stride)
+{
+    const struct pcm_decim_filter *f = st->f;
+    const int16_t *x = &st->buf[PCM_DECIM_HISTORY];
+    uint32_t N = 2u * f->taps;
+
+    n_in = load_block(st, in, n_in, stride);
+    uint32_t n_out = n_in * f->up / f->down;
+
+    /* Direct form on the zero-stuffed grid, skipping only the zeros */
+    for (uint32_t m = 0; m < n_out; m++) {
+        int32_t u = (int32_t)(f->down * m + f->down - 1);
+        int64_t acc = 1 << 14;
+
+        for (uint32_t k = 0; k < N; k++) {
+            int32_t v = u - (int32_t)k;
+            if (v % f->up == 0) {
+                acc += (int64_t)x[v / (int32_t)f->up] * proto_tap(f, k);
+            }
+        }
+        out[m * stride] = round_q15(acc);
+    }
+
+    history_shift(st, n_in);
+    return n_out;
+}
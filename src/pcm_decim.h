@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Polyphase FIR sample-rate converter for the reduced-rate voice alts:
+ * 48 kHz 16-bit PCM in, one channel per instance, block at a time.
+ *
+ *   48 -> 32 kHz   L/M = 2/3, 108-tap prototype, 54 taps per phase
+ *   48 -> 24 kHz   M = 2,      84 taps
+ *   48 -> 16 kHz   M = 3,     112 taps
+ *
+ * Kaiser designs, passband to 0.4375 * fout (7 kHz at 16 kHz) within
+ * 0.01 dB, >= 70 dB rejection from 0.5625 * fout, so anything aliasing
+ * lands above the passband. Only outputs are computed: decimation skips
+ * the dropped samples, and for 2/3 the two phases of the prototype are
+ * used alternately without zero-stuffing.
+ *
+ * The prototypes are symmetric, so half of each is stored: for 1/M the
+ * first half, folded over the second; for 2/3 phase 0, which read
+ * backwards is phase 1. Both halves of a dot product run as SMLALD /
+ * SMLALDX on sample pairs (one packed load per two taps) into a 64-bit
+ * accumulator, so no input can overflow it.
+ */
+
+/* Input rate the converter runs from */
+#define PCM_DECIM_IN_HZ       48000
+
+/* Largest block accepted per call, in input samples (1 ms) */
+#define PCM_DECIM_MAX_IN      (PCM_DECIM_IN_HZ / 1000)
+
+/* History kept between blocks: the longest filter span */
+#define PCM_DECIM_HISTORY     112
+
+struct pcm_decim_filter;
+
+struct pcm_decim {
+    const struct pcm_decim_filter *f;
+
+    /* History followed by the current block */
+    int16_t buf[PCM_DECIM_HISTORY + PCM_DECIM_MAX_IN]
+        __attribute__((aligned(4)));
+};
+
+/* false if out_hz is not a supported output rate */
+bool pcm_decim_init(struct pcm_decim *st, uint32_t out_hz);
+
+/*
+ * n_in samples (a multiple of 6, at most PCM_DECIM_MAX_IN) from in[0],
+ * in[stride], ...; writes the outputs to out[0], out[stride], ... and
+ * returns their count. in and out may be the same interleaved block: all
+ * of one channel's input is taken before any of its output is written.
+ */
+uint32_t pcm_decim_process(struct pcm_decim *st, const int16_t *in,
+                           int16_t *out, uint32_t n_in, uint32_t stride);
+
+/* Portable reference: full-length scalar FIR; bit-exact with above */
+uint32_t pcm_decim_process_ref(struct pcm_decim *st, const int16_t *in,
+                               int16_t *out, uint32_t n_in, uint32_t stride);
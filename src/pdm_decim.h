@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * PDM -> PCM decimator, 3.072 MHz 1-bit -> 48 kHz 16-bit (R = 64).
+ *
+ *   bytes  --popcount-->  384 kHz  (boxcar, R = 8)
+ *          --CIC4 R=4-->   96 kHz
+ *          --FIR 48, R=2-> 48 kHz
+ *
+ * Input is the raw SPI/I2S half-word stream, MSB = first bit on the wire.
+ * Each output sample consumes 4 half-words (64 PDM bits).
+ */
+
+#define PDM_DECIM_RATIO         64
+#define PDM_HWORDS_PER_OUTPUT   (PDM_DECIM_RATIO / 16)
+
+#define PDM_CIC_ORDER           4
+#define PDM_FIR_TAPS            48
+
+/* Largest block accepted per call, in output samples */
+#define PDM_DECIM_MAX_OUT       48
+
+struct pdm_decim {
+    uint32_t integ[PDM_CIC_ORDER];
+    uint32_t comb[PDM_CIC_ORDER];
+
+    /* FIR history (PDM_FIR_TAPS) followed by the 96 kHz block */
+    int16_t fir_buf[PDM_FIR_TAPS + 2 * PDM_DECIM_MAX_OUT]
+        __attribute__((aligned(4)));
+};
+
+void pdm_decim_init(struct pdm_decim *st);
+
+/* LUT bit counting + SMLAD FIR (packed-16 when built for the M4) */
+void pdm_decim_process(struct pdm_decim *st, const uint16_t *pdm,
+                       int16_t *out, uint32_t n_out);
+
+/* Portable reference: per-bit counting, scalar FIR; bit-exact with above */
+void pdm_decim_process_ref(struct pdm_decim *st, const uint16_t *pdm,
+                           int16_t *out, uint32_t n_out);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hardware seam for the headset speaker path (audio_playback.h).
+ *
+ * The firmware implementation (playback_hal_stm32.c) drives SPI3/I2S3 as
+ * master transmitter with DMA1 Stream 5 in circular mode, clocked from
+ * the same PLLI2S setting as the mics. A host build provides its own and
+ * calls audio_playback_dma_event() in place of the half/full-transfer
+ * interrupts.
+ */
+
+/*
+ * Start circular playback of buf, count half-words (two halves); false
+ * if the I2S clock did not come up
+ */
+bool playback_hal_start(volatile uint16_t *buf, uint32_t count);
+
+/* Stop the I2S peripheral and its DMA stream */
+void playback_hal_stop(void);
+
+/* Half-words sent so far in the current pass over buf */
+uint32_t playback_hal_position(void);
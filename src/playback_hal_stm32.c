@@ -0,0 +1,141 @@
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+
+#include "playback_hal.h"
+#include "capture_hal.h"
+#include "audio_playback.h"
+#include "sof_timer.h"
+#include "irq_prio.h"
+#include "cycle_counter.h"
+#include "profiler.h"
+
+/*
+ * SPI3/I2S3 master transmit, I2S Philips, 16-bit frames, to an I2S DAC /
+ * class-D amp (MAX98357A / PCM5102A class, no MCLK). SPI3_TX is DMA1
+ * Stream 5, Ch 0.
+ *
+ * Pins (AF6): PA15 = WS, PB3 = CK, PB5 = SD
+ *
+ * These are capture lane 1's pins, which is why headset builds take at
+ * most one mic pair. PLLI2S is shared with the mics and always runs the
+ * 48 kHz setting here, so both directions sit on the same audio clock.
+ */
+
+#define PLAYBACK_SPI         SPI3
+#define PLAYBACK_DMA         DMA1
+#define PLAYBACK_DMA_STREAM  DMA_STREAM5
+#define PLAYBACK_DMA_IRQ     NVIC_DMA1_STREAM5_IRQ
+
+/* Fs = 76.8 MHz / (32 * (2 * 25 + 0)) = 48 kHz exactly, 16-bit frames */
+#define PLAYBACK_I2S_DIV     25
+#define PLAYBACK_I2S_ODD     0
+
+static uint32_t dma_count;
+
+static void i2s_gpio_setup(void)
+{
+    rcc_periph_clock_enable(RCC_GPIOA);
+    rcc_periph_clock_enable(RCC_GPIOB);
+
+    gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO15);
+    gpio_set_af(GPIOA, GPIO_AF6, GPIO15);
+    gpio_mode_setup(GPIOB, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO3 | GPIO5);
+    gpio_set_af(GPIOB, GPIO_AF6, GPIO3 | GPIO5);
+}
+
+static void i2s_dma_setup(volatile uint16_t *buf, uint32_t count)
+{
+    rcc_periph_clock_enable(RCC_DMA1);
+
+    dma_stream_reset(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+    dma_channel_select(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_SxCR_CHSEL_0);
+    dma_set_transfer_mode(PLAYBACK_DMA, PLAYBACK_DMA_STREAM,
+                          DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+    dma_set_priority(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_SxCR_PL_VERY_HIGH);
+    dma_set_peripheral_size(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_SxCR_PSIZE_16BIT);
+    dma_set_memory_size(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_SxCR_MSIZE_16BIT);
+    dma_enable_memory_increment_mode(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+    dma_enable_circular_mode(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+
+    dma_set_peripheral_address(PLAYBACK_DMA, PLAYBACK_DMA_STREAM,
+                               (uint32_t)&SPI_DR(PLAYBACK_SPI));
+    dma_set_memory_address(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, (uint32_t)buf);
+    dma_set_number_of_data(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, (uint16_t)count);
+
+    dma_enable_half_transfer_interrupt(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+    dma_enable_transfer_complete_interrupt(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+    dma_enable_stream(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+}
+
+/* -------------------------------------------------------------------------- */
+/* HAL API                                                                    */
+/* -------------------------------------------------------------------------- */
+
+bool playback_hal_start(volatile uint16_t *buf, uint32_t count)
+{
+    dma_count = count;
+
+    playback_hal_stop();
+    if (!capture_hal_clock(AUDIO_SPK_RATE_HZ)) {
+        return false;
+    }
+    i2s_gpio_setup();
+
+    rcc_periph_clock_enable(RCC_SPI3);
+    rcc_periph_reset_pulse(RST_SPI3);
+
+    SPI_I2SPR(PLAYBACK_SPI) = PLAYBACK_I2S_DIV |
+                              (PLAYBACK_I2S_ODD ? SPI_I2SPR_ODD : 0);
+    SPI_I2SCFGR(PLAYBACK_SPI) = SPI_I2SCFGR_I2SMOD |
+        (SPI_I2SCFGR_I2SCFG_MASTER_TRANSMIT << SPI_I2SCFGR_I2SCFG_LSB) |
+        (SPI_I2SCFGR_I2SSTD_I2S_PHILIPS << SPI_I2SCFGR_I2SSTD_LSB) |
+        (SPI_I2SCFGR_DATLEN_16BIT << SPI_I2SCFGR_DATLEN_LSB);
+
+    SPI_CR2(PLAYBACK_SPI) |= SPI_CR2_TXDMAEN;
+    i2s_dma_setup(buf, count);
+
+    nvic_set_priority(PLAYBACK_DMA_IRQ, IRQ_PRIO_PLAYBACK_DMA);
+    nvic_enable_irq(PLAYBACK_DMA_IRQ);
+
+    SPI_I2SCFGR(PLAYBACK_SPI) |= SPI_I2SCFGR_I2SE;
+    return true;
+}
+
+void playback_hal_stop(void)
+{
+    SPI_I2SCFGR(PLAYBACK_SPI) &= ~SPI_I2SCFGR_I2SE;
+    dma_disable_stream(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+    SPI_CR2(PLAYBACK_SPI) &= ~SPI_CR2_TXDMAEN;
+    nvic_disable_irq(PLAYBACK_DMA_IRQ);
+}
+
+uint32_t playback_hal_position(void)
+{
+    return dma_count - DMA_SxNDTR(PLAYBACK_DMA, PLAYBACK_DMA_STREAM);
+}
+
+/* -------------------------------------------------------------------------- */
+/* DMA ISR: half-transfer = first half sent, transfer-complete = second       */
+/* -------------------------------------------------------------------------- */
+void dma1_stream5_isr(void);
+
+void dma1_stream5_isr(void)
+{
+    uint32_t t  = sof_timer_now();
+    uint32_t t0 = cycles_now();
+
+    if (dma_get_interrupt_flag(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_HTIF)) {
+        dma_clear_interrupt_flags(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_HTIF);
+        audio_playback_dma_event(0, t);
+    }
+
+    if (dma_get_interrupt_flag(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_TCIF)) {
+        dma_clear_interrupt_flags(PLAYBACK_DMA, PLAYBACK_DMA_STREAM, DMA_TCIF);
+        audio_playback_dma_event(1, t);
+    }
+
+    prof_record(PROF_STAGE_PLAYBACK_ISR, cycles_now() - t0);
+}
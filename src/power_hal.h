@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * Hardware seam for core clock and USB PHY power (stream_power.h).
+ *
+ * The firmware implementation (power_hal_stm32.c) keeps the main PLL
+ * running throughout, since it also makes the OTG_FS 48 MHz clock, and
+ * scales the AHB prescaler instead: no relock, so going back to full
+ * speed takes effect on the next bus cycle.
+ */
+
+enum power_level {
+    POWER_FULL,      /* 96 MHz core, TIM2 at SOF_TIMER_HZ */
+    POWER_LOW,       /* AHB / 4: 24 MHz, above the OTG_FS minimum of 14.2 */
+};
+
+/* Bring up HSE and the main PLL at POWER_FULL; first thing in main() */
+void power_hal_init(void);
+
+/*
+ * Set the core and bus clocks. At POWER_LOW, TIM2 and the cycle counter
+ * run at a quarter of their nominal rate: nothing that timestamps
+ * (capture, playback, sync) may be running, and the profiler is told the
+ * divider to scale its samples by (prof_set_clock_div()).
+ */
+void power_hal_set(enum power_level level);
+
+/* Stop the USB PHY clock across a bus suspend, and restart it on resume */
+void power_hal_usb_suspend(bool suspended);
@@ -0,0 +1,54 @@
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/usb/dwc/otg_fs.h>
+
+#include "power_hal.h"
+#include "profiler.h"
+
+/*
+ * 25 MHz HSE -> 96 MHz SYSCLK, USB at 48 MHz, APB1 at 48 MHz (TIM2 at
+ * 96 MHz). POWER_LOW only divides HCLK; the APB prescalers, and with
+ * them the flash wait states chosen for 96 MHz, stay as they are.
+ */
+static const struct rcc_clock_scale *const clock_full =
+    &rcc_hse_25mhz_3v3[RCC_CLOCK_3V3_96MHZ];
+
+#define LOW_DIV  4
+
+static enum power_level level_cur = POWER_FULL;
+
+void power_hal_init(void)
+{
+    rcc_clock_setup_pll(clock_full);
+    level_cur = POWER_FULL;
+}
+
+void power_hal_set(enum power_level level)
+{
+    if (level == level_cur) {
+        return;
+    }
+
+    if (level == POWER_LOW) {
+        rcc_set_hpre(RCC_CFGR_HPRE_DIV4);
+        rcc_ahb_frequency  = clock_full->ahb_frequency / LOW_DIV;
+        rcc_apb1_frequency = clock_full->apb1_frequency / LOW_DIV;
+        rcc_apb2_frequency = clock_full->apb2_frequency / LOW_DIV;
+        prof_set_clock_div(LOW_DIV);
+    } else {
+        rcc_set_hpre(clock_full->hpre);
+        rcc_ahb_frequency  = clock_full->ahb_frequency;
+        rcc_apb1_frequency = clock_full->apb1_frequency;
+        rcc_apb2_frequency = clock_full->apb2_frequency;
+        prof_set_clock_div(1);
+    }
+    level_cur = level;
+}
+
+void power_hal_usb_suspend(bool suspended)
+{
+    if (suspended) {
+        OTG_FS_PCGCCTL |= OTG_PCGCCTL_STPPCLK;
+    } else {
+        OTG_FS_PCGCCTL &= ~OTG_PCGCCTL_STPPCLK;
+    }
+}
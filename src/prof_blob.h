@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Profile blob: wire format of a profiler snapshot, shared by the
+ * firmware (profiler.c) and the host decoder (prof_decode.c).
+ *
+ * All fields little-endian uint32 unless noted:
+ *
+ *   header  magic "PRF1", version (u16), n_stages (u8), n_buckets (u8),
+ *           clock_hz, timestamp (cycles at snapshot), clock_div,
+ *           idle_window, idle_cycles
+ *   stage   count, last, min, max, sum_lo, sum_hi, hist[n_buckets]
+ *           x n_stages, in enum prof_stage order
+ *
+ * Stage values are in clock_hz ticks whatever the core clock was when
+ * they were recorded (profiler.h). clock_div is the HCLK divider at the
+ * snapshot (power_hal.h): the raw timestamp counts at clock_hz /
+ * clock_div. idle_window is the raw cycles since the previous snapshot
+ * (or PROF_RESET) and idle_cycles how many of them the main loop spent
+ * idle (task_queue.h): in WFI, or in polls that found nothing in polled
+ * builds. Version 2 blobs have no idle fields and a 20-byte header,
+ * version 1 no clock_div either and a 16-byte header.
+ *
+ * hist[b] counts samples with b significant bits (0, 1, 2..3, 4..7, ...);
+ * the last bucket also takes everything larger. min is 0xFFFFFFFF while
+ * count is 0.
+ */
+
+#define PROF_BLOB_MAGIC      0x31465250u     /* "PRF1" */
+#define PROF_BLOB_VERSION    3
+
+#define PROF_HIST_BUCKETS    16
+
+enum prof_stage {
+    PROF_STAGE_SOF = 0,      /* SOF handling, whole audio_stream_sof() */
+    PROF_STAGE_CAPTURE_ISR,  /* DMA half/full-transfer ISR */
+    PROF_STAGE_DSP,          /* in-block DSP (front-end chain + gain) */
+    PROF_STAGE_PACKET_WRITE, /* arm IN endpoint + fill TX FIFO */
+    PROF_STAGE_SOF_LATENCY,  /* last hardware SOF -> packet armed */
+    PROF_STAGE_TEST_SOURCE,  /* test signal generation, replaces capture */
+    PROF_STAGE_TAP_FEED,     /* vendor tap: arm bulk IN + fill TX FIFO */
+    PROF_STAGE_METER,        /* meters + one spectrum slice, thread mode */
+    PROF_STAGE_DECIM,        /* 48 kHz -> voice-rate conversion, per block */
+    PROF_STAGE_PLAYBACK_ISR, /* headset speaker DMA ISR, one block refill */
+    PROF_NUM_STAGES
+};
+
+#define PROF_BLOB_HEADER_SIZE  28
+#define PROF_BLOB_STAGE_SIZE   (6 * 4 + PROF_HIST_BUCKETS * 4)
+#define PROF_BLOB_SIZE \
+    (PROF_BLOB_HEADER_SIZE + PROF_NUM_STAGES * PROF_BLOB_STAGE_SIZE)
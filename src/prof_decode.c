@@ -0,0 +1,192 @@
+/*
+ * Host decoder for profile blobs (prof_blob.h).
+ *
+ *   prof_decode [file]     reads a blob from file or stdin
+ *
+ * Fetch the blob with a vendor IN request, e.g. from Python/pyusb:
+ *   dev.ctrl_transfer(0xC0, 0x01, 0, 0, 1024)
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "prof_blob.h"
+
+static const char *const stage_names[PROF_NUM_STAGES] = {
+    [PROF_STAGE_SOF]          = "sof",
+    [PROF_STAGE_CAPTURE_ISR]  = "capture_isr",
+    [PROF_STAGE_DSP]          = "dsp",
+    [PROF_STAGE_PACKET_WRITE] = "packet_write",
+    [PROF_STAGE_SOF_LATENCY]  = "sof_latency",
+    [PROF_STAGE_TEST_SOURCE]  = "test_source",
+    [PROF_STAGE_TAP_FEED]     = "tap_feed",
+    [PROF_STAGE_METER]        = "meter",
+    [PROF_STAGE_DECIM]        = "decim",
+    [PROF_STAGE_PLAYBACK_ISR] = "playback_isr",
+};
+
+struct prof_dump_stage {
+    uint32_t count;
+    uint32_t last;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[PROF_HIST_BUCKETS];
+};
+
+struct prof_dump {
+    uint16_t version;
+    uint32_t clock_hz;
+    uint32_t timestamp;
+    uint32_t clock_div;          /* HCLK divider at the snapshot, 1 before v2 */
+    uint32_t idle_window;        /* raw cycles, 0 before v3 */
+    uint32_t idle_cycles;
+    unsigned n_stages;
+    struct prof_dump_stage stage[PROF_NUM_STAGES];
+};
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Returns 0 on success, or a message describing the first problem */
+static const char *prof_parse(const uint8_t *p, size_t len,
+                              struct prof_dump *d)
+{
+    size_t header = PROF_BLOB_HEADER_SIZE;
+
+    if (len < 16) {
+        return "short header";
+    }
+    if (get32(p) != PROF_BLOB_MAGIC) {
+        return "bad magic";
+    }
+
+    d->version   = (uint16_t)(p[4] | (p[5] << 8));
+    d->n_stages  = p[6];
+    d->clock_hz  = get32(p + 8);
+    d->timestamp = get32(p + 12);
+    d->clock_div = 1;
+
+    if (d->version == 1) {
+        header = 16;
+    } else if (d->version == 2) {
+        header = 20;
+    } else if (d->version != PROF_BLOB_VERSION) {
+        return "unsupported version";
+    }
+    if (len < header) {
+        return "short header";
+    }
+    if (d->version >= 2) {
+        d->clock_div = get32(p + 16);
+    }
+    if (d->version >= 3) {
+        d->idle_window = get32(p + 20);
+        d->idle_cycles = get32(p + 24);
+    }
+    if (p[7] != PROF_HIST_BUCKETS) {
+        return "unexpected bucket count";
+    }
+    if (d->n_stages > PROF_NUM_STAGES) {
+        d->n_stages = PROF_NUM_STAGES;     /* newer firmware: known stages only */
+    }
+    if (len < header + (size_t)p[6] * PROF_BLOB_STAGE_SIZE) {
+        return "truncated";
+    }
+
+    p += header;
+    for (unsigned i = 0; i < d->n_stages; i++) {
+        struct prof_dump_stage *s = &d->stage[i];
+
+        s->count = get32(p + 0);
+        s->last  = get32(p + 4);
+        s->min   = get32(p + 8);
+        s->max   = get32(p + 12);
+        s->sum   = get32(p + 16) | ((uint64_t)get32(p + 20) << 32);
+        for (unsigned b = 0; b < PROF_HIST_BUCKETS; b++) {
+            s->hist[b] = get32(p + 24 + 4 * b);
+        }
+        p += PROF_BLOB_STAGE_SIZE;
+    }
+
+    return 0;
+}
+
+static void prof_print(const struct prof_dump *d)
+{
+    double us = 1e6 / d->clock_hz;
+
+    printf("profile v%u, %u Hz, t=%u",
+           (unsigned)d->version, (unsigned)d->clock_hz, (unsigned)d->timestamp);
+    if (d->clock_div > 1) {
+        /* Stage values are already scaled; only the timestamp is not */
+        printf(" at HCLK / %u (%u Hz)", (unsigned)d->clock_div,
+               (unsigned)(d->clock_hz / d->clock_div));
+    }
+    printf("\n");
+    if (d->idle_window) {
+        /* Raw cycles, at clock_hz / clock_div if the divider held throughout */
+        printf("idle %.1f%% of %.2f ms\n", 100.0 * d->idle_cycles / d->idle_window,
+               d->idle_window * 1e3 * d->clock_div / d->clock_hz);
+    }
+    printf("%-13s %10s %8s %8s %8s %8s  (cycles)\n",
+           "stage", "count", "min", "avg", "max", "last");
+
+    for (unsigned i = 0; i < d->n_stages; i++) {
+        const struct prof_dump_stage *s = &d->stage[i];
+
+        if (!s->count) {
+            printf("%-13s %10s\n", stage_names[i], "-");
+            continue;
+        }
+
+        double avg = (double)s->sum / s->count;
+        printf("%-13s %10u %8u %8.0f %8u %8u  max %.2f us",
+               stage_names[i], (unsigned)s->count, (unsigned)s->min, avg,
+               (unsigned)s->max, (unsigned)s->last, s->max * us);
+        if (i == PROF_STAGE_SOF_LATENCY) {
+            printf(", jitter %.2f us", (s->max - s->min) * us);
+        }
+        printf("\n");
+
+        for (unsigned b = 0; b < PROF_HIST_BUCKETS; b++) {
+            if (s->hist[b]) {
+                printf("    %s%-8u %10u\n", b == PROF_HIST_BUCKETS - 1 ? ">=" : "< ",
+                       b == PROF_HIST_BUCKETS - 1 ? 1u << (b - 1) : 1u << b,
+                       (unsigned)s->hist[b]);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t blob[4096];
+    FILE *f = stdin;
+
+    if (argc > 1 && !(f = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    size_t len = fread(blob, 1, sizeof(blob), f);
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    struct prof_dump d;
+    memset(&d, 0, sizeof(d));
+
+    const char *err = prof_parse(blob, len, &d);
+    if (err) {
+        fprintf(stderr, "prof_decode: %s\n", err);
+        return 1;
+    }
+
+    prof_print(&d);
+    return 0;
+}
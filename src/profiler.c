@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include "profiler.h"
+
+struct prof_stats {
+    uint32_t count;
+    uint32_t last;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[PROF_HIST_BUCKETS];
+};
+
+static struct prof_stats stages[PROF_NUM_STAGES];
+
+/* Values are recorded at PROF_CLOCK_HZ / clock_div */
+static uint32_t clock_div = 1;
+
+/* One bit per stage; set by prof_reset(), cleared by the stage's writer */
+static uint32_t reset_pending = (1u << PROF_NUM_STAGES) - 1;
+
+_Static_assert(PROF_NUM_STAGES <= 32, "reset_pending is one word");
+
+/* Significant bits of v, capped at the last bucket */
+static uint32_t bucket_of(uint32_t v)
+{
+    uint32_t b = v ? 32 - (uint32_t)__builtin_clz(v) : 0;
+
+    return b < PROF_HIST_BUCKETS ? b : PROF_HIST_BUCKETS - 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* WRITER SIDE                                                                */
+/* -------------------------------------------------------------------------- */
+
+void prof_record(enum prof_stage stage, uint32_t value)
+{
+    struct prof_stats *s = &stages[stage];
+    uint32_t bit = 1u << stage;
+
+    value *= __atomic_load_n(&clock_div, __ATOMIC_RELAXED);
+
+    if (__atomic_load_n(&reset_pending, __ATOMIC_RELAXED) & bit) {
+        memset(s, 0, sizeof(*s));
+        s->min = UINT32_MAX;
+        __atomic_fetch_and(&reset_pending, ~bit, __ATOMIC_RELAXED);
+    }
+
+    s->count++;
+    s->last = value;
+    s->sum += value;
+    if (value < s->min) {
+        s->min = value;
+    }
+    if (value > s->max) {
+        s->max = value;
+    }
+    s->hist[bucket_of(value)]++;
+}
+
+void prof_set_clock_div(uint32_t div)
+{
+    __atomic_store_n(&clock_div, div, __ATOMIC_RELAXED);
+}
+
+void prof_reset(void)
+{
+    __atomic_fetch_or(&reset_pending, (1u << PROF_NUM_STAGES) - 1,
+                      __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+/* SNAPSHOT                                                                   */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+uint32_t prof_snapshot(uint8_t *dst, uint32_t cap, uint32_t timestamp,
+                       const struct task_idle_stats *idle)
+{
+    uint32_t pending = __atomic_load_n(&reset_pending, __ATOMIC_RELAXED);
+    uint8_t *p = dst;
+
+    if (cap < PROF_BLOB_SIZE) {
+        return 0;
+    }
+
+    p = put32(p, PROF_BLOB_MAGIC);
+    *p++ = (uint8_t)(PROF_BLOB_VERSION & 0xFF);
+    *p++ = (uint8_t)(PROF_BLOB_VERSION >> 8);
+    *p++ = PROF_NUM_STAGES;
+    *p++ = PROF_HIST_BUCKETS;
+    p = put32(p, PROF_CLOCK_HZ);
+    p = put32(p, timestamp);
+    p = put32(p, __atomic_load_n(&clock_div, __ATOMIC_RELAXED));
+    p = put32(p, idle->window_cycles);
+    p = put32(p, idle->idle_cycles);
+
+    for (unsigned i = 0; i < PROF_NUM_STAGES; i++) {
+        struct prof_stats s = stages[i];
+
+        /* Not yet cleared by its writer: report it empty */
+        if (pending & (1u << i)) {
+            memset(&s, 0, sizeof(s));
+            s.min = UINT32_MAX;
+        }
+
+        p = put32(p, s.count);
+        p = put32(p, s.last);
+        p = put32(p, s.min);
+        p = put32(p, s.max);
+        p = put32(p, (uint32_t)s.sum);
+        p = put32(p, (uint32_t)(s.sum >> 32));
+        for (unsigned b = 0; b < PROF_HIST_BUCKETS; b++) {
+            p = put32(p, s.hist[b]);
+        }
+    }
+
+    return (uint32_t)(p - dst);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "prof_blob.h"
+#include "task_queue.h"
+
+/*
+ * Built-in cycle profiler.
+ *
+ * Each stage keeps count / last / min / max / sum and a log2 histogram of
+ * the values recorded for it (core cycles from DWT CYCCNT, or TIM2 ticks
+ * for PROF_STAGE_SOF_LATENCY; both run at 96 MHz). At POWER_LOW both run
+ * at a fraction of that, and values are scaled back up as they are
+ * recorded, so every sample is in PROF_CLOCK_HZ ticks. Every stage has a
+ * single writer context, so recording needs no locking. A reset is only
+ * requested here and carried out by that writer on its next record.
+ *
+ * Snapshots are taken from the USB interrupt and may catch a lower
+ * priority writer mid-update; a stage can then be off by one sample.
+ */
+
+#define PROF_CLOCK_HZ  96000000u
+
+/* Writer side: add one value to a stage */
+void prof_record(enum prof_stage stage, uint32_t value);
+
+/* HCLK divider now in effect, 1 at full speed; from power_hal_set() */
+void prof_set_clock_div(uint32_t div);
+
+/* Ask every stage to clear itself at its next record */
+void prof_reset(void);
+
+/*
+ * Serialise all stages and the main loop's idle time over idle's window
+ * as a profile blob; returns bytes written
+ */
+uint32_t prof_snapshot(uint8_t *dst, uint32_t cap, uint32_t timestamp,
+                       const struct task_idle_stats *idle);
@@ -0,0 +1,39 @@
+#include "rate_ctrl.h"
+
+#define Q16_ONE  (1 << 16)
+
+void rate_ctrl_init(struct rate_ctrl *rc, uint32_t nominal, uint32_t target)
+{
+    rc->nominal    = nominal;
+    rc->target_q16 = (int32_t)(target << 16);
+    rc->filt_q16   = rc->target_q16;
+    rc->acc_q16    = 0;
+}
+
+uint32_t rate_ctrl_next(struct rate_ctrl *rc, uint32_t fill)
+{
+    int32_t fill_q16 = (int32_t)(fill << 16);
+
+    rc->filt_q16 += (fill_q16 - rc->filt_q16) / (1 << RATE_CTRL_FILT_SHIFT);
+
+    int32_t corr = (rc->filt_q16 - rc->target_q16) / (1 << RATE_CTRL_GAIN_SHIFT);
+    if (corr > Q16_ONE) {
+        corr = Q16_ONE;
+    } else if (corr < -Q16_ONE) {
+        corr = -Q16_ONE;
+    }
+
+    rc->acc_q16 += corr;
+
+    if (rc->acc_q16 >= Q16_ONE) {
+        rc->acc_q16 -= Q16_ONE;
+        return rc->nominal + 1;
+    }
+
+    if (rc->acc_q16 <= -Q16_ONE) {
+        rc->acc_q16 += Q16_ONE;
+        return rc->nominal - 1;
+    }
+
+    return rc->nominal;
+}
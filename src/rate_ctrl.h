@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Asynchronous IN rate matching.
+ *
+ * The audio clock (PLLI2S from the crystal) and the host SOF clock drift
+ * apart, so each packet carries nominal, nominal + 1 or nominal - 1
+ * samples. The decision comes from a smoothed capture-buffer fill level:
+ *
+ *   filt += (fill - filt) / 2^RATE_CTRL_FILT_SHIFT
+ *   acc  += (filt - target) / 2^RATE_CTRL_GAIN_SHIFT    (clamped to +-1)
+ *   |acc| >= 1 sample  ->  send one extra / one fewer sample
+ *
+ * The buffer itself integrates the rate error, so this proportional loop
+ * settles at a constant fill offset of drift / gain: +-500 ppm at 48 kHz
+ * is 0.024 samples/frame, i.e. about 1.5 samples of offset.
+ *
+ * All values are Q16 samples.
+ */
+
+#define RATE_CTRL_FILT_SHIFT   4
+#define RATE_CTRL_GAIN_SHIFT   6
+
+struct rate_ctrl {
+    uint32_t nominal;     /* samples per frame at the nominal rate */
+    int32_t  target_q16;  /* fill set point */
+    int32_t  filt_q16;    /* smoothed fill */
+    int32_t  acc_q16;     /* fractional correction accumulator */
+};
+
+void rate_ctrl_init(struct rate_ctrl *rc, uint32_t nominal, uint32_t target);
+
+/* fill = samples buffered at this SOF; returns samples for this packet */
+uint32_t rate_ctrl_next(struct rate_ctrl *rc, uint32_t fill);
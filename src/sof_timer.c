@@ -0,0 +1,37 @@
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/usb/dwc/otg_fs.h>
+
+#include "sof_timer.h"
+
+void sof_timer_init(void)
+{
+    rcc_periph_clock_enable(RCC_TIM2);
+
+    /* APB1 = 48 MHz with /2 prescaler, so timer clock = 2x = 96 MHz */
+    timer_set_prescaler(TIM2, 0);
+    timer_set_period(TIM2, 0xFFFFFFFF);
+
+    /* ITR1 <- OTG_FS SOF, IC1 <- TRC */
+    timer_set_option(TIM2, TIM2_OR_ITR1_RMP_OTG_FS_SOF);
+    timer_slave_set_trigger(TIM2, TIM_SMCR_TS_ITR1);
+    timer_ic_set_input(TIM2, TIM_IC1, TIM_IC_IN_TRC);
+    timer_ic_enable(TIM2, TIM_IC1);
+
+    timer_enable_counter(TIM2);
+}
+
+uint32_t sof_timer_now(void)
+{
+    return TIM_CNT(TIM2);
+}
+
+uint32_t sof_timer_last_sof(void)
+{
+    return TIM_CCR1(TIM2);
+}
+
+uint32_t sof_timer_frame(void)
+{
+    return ((OTG_FS_DSTS & OTG_DSTS_FNSOF_MASK) >> 8) & 0x7FF;
+}
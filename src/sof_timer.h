@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * TIM2 as a free-running 32-bit core-clock timebase (96 MHz), with
+ * input capture on ITR1 remapped to the OTG_FS SOF pulse. CCR1 holds
+ * the hardware timestamp of the most recent SOF, independent of when
+ * software gets around to handling it.
+ */
+
+#define SOF_TIMER_HZ  96000000u
+
+void sof_timer_init(void);
+
+/* Current TIM2 count */
+uint32_t sof_timer_now(void);
+
+/* TIM2 count latched at the last SOF */
+uint32_t sof_timer_last_sof(void);
+
+/* 11-bit USB frame number of the last SOF */
+uint32_t sof_timer_frame(void);
+
+/* Ticks since the last SOF */
+static inline uint32_t sof_timer_since_sof(void)
+{
+    return sof_timer_now() - sof_timer_last_sof();
+}
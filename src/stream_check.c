@@ -0,0 +1,404 @@
+/*
+ * Host-side stream integrity check for test-source captures
+ * (test_source.h).
+ *
+ *   stream_check -m counter|ramp|sine [-r rate] [-c channels] [-b bits]
+ *                [-f freq] file
+ *
+ * file is a WAV (format taken from its header) or raw little-endian PCM
+ * described by -r/-c/-b (default 48000 / 1 / 16). 32 bits means the UAC2
+ * 24-in-32 container and is checked at 24-bit resolution.
+ *
+ *   counter  gaps and repeats on ch 0, sequence steps on ch 1, other
+ *            channels checked against ch 0 + n
+ *   ramp     discontinuities: any step other than the nominal one or a wrap
+ *   sine     frequency, THD (harmonics 2..10) and THD+N over the whole
+ *            capture, at the frequency measured rather than the one asked
+ *            for (an NCO's step is not exact)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define MAX_CHANNELS  8
+#define MAX_HARMONIC  10
+
+struct capture {
+    uint32_t rate;
+    unsigned channels;
+    unsigned bits;
+    size_t   frames;
+    int32_t *samples;      /* interleaved, sign-extended */
+};
+
+static uint32_t get16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+/* -------------------------------------------------------------------------- */
+/* INPUT                                                                      */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf = NULL;
+    size_t cap = 0;
+
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    *len = 0;
+    for (;;) {
+        if (*len == cap) {
+            cap = cap ? 2 * cap : 1 << 20;
+            buf = realloc(buf, cap);
+            if (!buf) {
+                fclose(f);
+                return NULL;
+            }
+        }
+        size_t n = fread(buf + *len, 1, cap - *len, f);
+        if (!n) {
+            break;
+        }
+        *len += n;
+    }
+
+    fclose(f);
+    return buf;
+}
+
+/* Locate the data chunk of a RIFF/WAVE file and take its format */
+static const uint8_t *wav_data(const uint8_t *p, size_t len,
+                               struct capture *cap, size_t *data_len)
+{
+    if (len < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4)) {
+        return NULL;
+    }
+
+    size_t off = 12;
+    while (off + 8 <= len) {
+        uint32_t size = get32(p + off + 4);
+        const uint8_t *body = p + off + 8;
+
+        if (!memcmp(p + off, "fmt ", 4) && size >= 16) {
+            cap->channels = get16(body + 2);
+            cap->rate     = get32(body + 4);
+            cap->bits     = get16(body + 14);
+        } else if (!memcmp(p + off, "data", 4)) {
+            *data_len = size <= len - off - 8 ? size : len - off - 8;
+            return body;
+        }
+        off += 8 + size + (size & 1);
+    }
+    return NULL;
+}
+
+static int decode(const uint8_t *p, size_t len, struct capture *cap)
+{
+    unsigned bytes = cap->bits / 8;
+
+    if (bytes < 2 || bytes > 4 || !cap->channels ||
+        cap->channels > MAX_CHANNELS) {
+        fprintf(stderr, "unsupported format: %u ch, %u bit\n",
+                cap->channels, cap->bits);
+        return -1;
+    }
+
+    cap->frames  = len / (bytes * cap->channels);
+    cap->samples = malloc(cap->frames * cap->channels * sizeof(int32_t) + 1);
+    if (!cap->samples) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < cap->frames * cap->channels; i++, p += bytes) {
+        uint32_t v = bytes == 2 ? get16(p) << 16 :
+                     bytes == 3 ? (get16(p) << 8) | ((uint32_t)p[2] << 24) :
+                     get32(p);
+        cap->samples[i] = (int32_t)v >> (bytes == 4 ? 8 : 32 - cap->bits);
+    }
+
+    if (bytes == 4) {
+        cap->bits = 24;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* CHECKS                                                                     */
+/* -------------------------------------------------------------------------- */
+
+static int check_counter(const struct capture *cap)
+{
+    uint32_t mask = (1u << cap->bits) - 1;
+    size_t gaps = 0, repeats = 0, lost = 0, seq_errors = 0, chan_errors = 0;
+
+    for (size_t i = 1; i < cap->frames; i++) {
+        const int32_t *prev = &cap->samples[(i - 1) * cap->channels];
+        const int32_t *cur  = &cap->samples[i * cap->channels];
+        uint32_t d = ((uint32_t)cur[0] - (uint32_t)prev[0]) & mask;
+
+        if (d == 0 || d > mask / 2) {
+            repeats++;
+            printf("  repeat at frame %zu (%u after %u)\n", i,
+                   (unsigned)(cur[0] & mask), (unsigned)(prev[0] & mask));
+        } else if (d != 1) {
+            gaps++;
+            lost += d - 1;
+            printf("  gap at frame %zu: %u samples missing\n", i, (unsigned)(d - 1));
+        }
+
+        if (cap->channels > 1) {
+            uint32_t ds = ((uint32_t)cur[1] - (uint32_t)prev[1]) & mask;
+            if (ds > 1 && d == 1) {
+                seq_errors++;
+            }
+        }
+        for (unsigned ch = 2; ch < cap->channels; ch++) {
+            if ((((uint32_t)cur[ch] - (uint32_t)cur[0]) & mask) != ch) {
+                chan_errors++;
+            }
+        }
+    }
+
+    printf("counter: %zu frames, %zu gaps (%zu samples lost), %zu repeats, "
+           "%zu sequence errors, %zu channel errors\n",
+           cap->frames, gaps, lost, repeats, seq_errors, chan_errors);
+    return (gaps || repeats || seq_errors || chan_errors) ? 1 : 0;
+}
+
+static int check_ramp(const struct capture *cap, double freq)
+{
+    double full  = ldexp(1.0, (int)cap->bits);
+    double nom   = full * freq / cap->rate;
+    size_t disc  = 0;
+
+    for (size_t i = 1; i < cap->frames; i++) {
+        for (unsigned ch = 0; ch < cap->channels; ch++) {
+            double d = (double)cap->samples[i * cap->channels + ch] -
+                       cap->samples[(i - 1) * cap->channels + ch];
+
+            if (d < 0) {
+                d += full;          /* sawtooth wrap */
+            }
+            if (fabs(d - nom) > 1.0) {
+                disc++;
+                if (disc <= 20) {
+                    printf("  discontinuity at frame %zu ch %u: step %.0f, "
+                           "expected %.1f\n", i, ch, d, nom);
+                }
+            }
+        }
+    }
+
+    printf("ramp: %zu frames, %zu discontinuities\n", cap->frames, disc);
+    return disc ? 1 : 0;
+}
+
+/* Power at freq over x[0..n), Goertzel on a windowed block */
+static double tone_power(const double *x, size_t n, double freq, double rate)
+{
+    double w = 2.0 * M_PI * freq / rate;
+    double c = 2.0 * cos(w);
+    double s1 = 0.0, s2 = 0.0;
+
+    for (size_t i = 0; i < n; i++) {
+        double s0 = x[i] + c * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    return s1 * s1 + s2 * s2 - c * s1 * s2;
+}
+
+/* Least-squares a cos(w i) + b sin(w i) over ch 0 of frames [from, from + n) */
+static void fit_sine(const struct capture *cap, size_t from, size_t n, double w,
+                     double mean, double *a, double *b)
+{
+    double scc = 0, sss = 0, scs = 0, sxc = 0, sxs = 0;
+
+    for (size_t i = from; i < from + n; i++) {
+        double c = cos(w * i), sn = sin(w * i);
+        double v = cap->samples[i * cap->channels] - mean;
+
+        scc += c * c;
+        sss += sn * sn;
+        scs += c * sn;
+        sxc += v * c;
+        sxs += v * sn;
+    }
+
+    double det = scc * sss - scs * scs;
+    *a = (sxc * sss - sxs * scs) / det;
+    *b = (sxs * scc - sxc * scs) / det;
+}
+
+/*
+ * The phase of a fit at w drifts by the frequency error: fit the first and
+ * the last quarter and take w plus the drift per sample
+ */
+static double measure_w(const struct capture *cap, double w, double mean)
+{
+    size_t q = cap->frames / 4;
+    double a1, b1, a2, b2;
+
+    fit_sine(cap, 0, q, w, mean, &a1, &b1);
+    fit_sine(cap, cap->frames - q, q, w, mean, &a2, &b2);
+
+    double d = atan2(b2, a2) - atan2(b1, a1);
+
+    while (d > M_PI) {
+        d -= 2 * M_PI;
+    }
+    while (d < -M_PI) {
+        d += 2 * M_PI;
+    }
+    return w - d / (double)(cap->frames - q);
+}
+
+static int check_sine(const struct capture *cap, double freq)
+{
+    size_t n = cap->frames;
+    double *x = malloc(n * sizeof(double) + 1);
+    double mean = 0.0;
+
+    if (!x || n < 1024) {
+        fprintf(stderr, "sine: need at least 1024 frames\n");
+        free(x);
+        return 2;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        mean += cap->samples[i * cap->channels];
+    }
+    mean /= n;
+
+    /*
+     * Least-squares fit of a sine at the measured frequency: the residual
+     * is noise plus distortion plus anything a dropped or repeated block
+     * leaves behind.
+     */
+    double w = measure_w(cap, 2.0 * M_PI * freq / cap->rate, mean);
+    double a, b;
+    double residual = 0.0;
+
+    freq = w * cap->rate / (2.0 * M_PI);
+    fit_sine(cap, 0, n, w, mean, &a, &b);
+
+    /* 4-term Blackman-Harris for the harmonics: sidelobes below -92 dB */
+    for (size_t i = 0; i < n; i++) {
+        double t = 2.0 * M_PI * i / (n - 1);
+        double win = 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) -
+                     0.01168 * cos(3 * t);
+        double v = cap->samples[i * cap->channels] - mean;
+        double e = v - a * cos(w * i) - b * sin(w * i);
+
+        residual += e * e;
+        x[i] = v * win;
+    }
+
+    double fund = tone_power(x, n, freq, cap->rate);
+    double harm = 0.0;
+    for (unsigned h = 2; h <= MAX_HARMONIC && h * freq < cap->rate / 2.0; h++) {
+        harm += tone_power(x, n, h * freq, cap->rate);
+    }
+
+    double amp2    = a * a + b * b;
+    double thd_db  = 10.0 * log10(harm / fund + 1e-30);
+    double thdn_db = 10.0 * log10((residual / n) / (amp2 / 2.0) + 1e-30);
+
+    printf("sine: %zu frames at %.4f Hz, level %.2f dBFS, THD %.1f dB, "
+           "THD+N %.1f dB\n", n, freq,
+           10.0 * log10(amp2 / ldexp(1.0, 2 * ((int)cap->bits - 1))),
+           thd_db, thdn_db);
+
+    free(x);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* MAIN                                                                       */
+/* -------------------------------------------------------------------------- */
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: stream_check -m counter|ramp|sine [-r rate] "
+                    "[-c channels] [-b bits] [-f freq] file\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct capture cap = { 48000, 1, 16, 0, NULL };
+    const char *mode = NULL, *path = NULL;
+    double freq = 1000.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] && !argv[i][2] && i + 1 < argc) {
+            const char *v = argv[++i];
+
+            switch (argv[i - 1][1]) {
+            case 'm': mode = v; break;
+            case 'r': cap.rate = (uint32_t)atoi(v); break;
+            case 'c': cap.channels = (unsigned)atoi(v); break;
+            case 'b': cap.bits = (unsigned)atoi(v); break;
+            case 'f': freq = atof(v); break;
+            default:  usage(); return 2;
+            }
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (!mode || !path) {
+        usage();
+        return 2;
+    }
+
+    size_t len, data_len;
+    uint8_t *file = read_file(path, &len);
+    if (!file) {
+        return 2;
+    }
+
+    const uint8_t *data = wav_data(file, len, &cap, &data_len);
+    if (!data) {
+        data     = file;
+        data_len = len;
+    }
+
+    if (decode(data, data_len, &cap) < 0) {
+        free(file);
+        return 2;
+    }
+    free(file);
+
+    int rc;
+    if (!strcmp(mode, "counter")) {
+        rc = check_counter(&cap);
+    } else if (!strcmp(mode, "ramp")) {
+        rc = check_ramp(&cap, freq);
+    } else if (!strcmp(mode, "sine")) {
+        rc = check_sine(&cap, freq);
+    } else {
+        usage();
+        rc = 2;
+    }
+
+    free(cap.samples);
+    return rc;
+}
@@ -0,0 +1,162 @@
+#include <stddef.h>
+
+#include "stream_power.h"
+#include "capture_hal.h"
+#include "power_hal.h"
+#include "sof_timer.h"
+
+static enum stream_state state = STREAM_IDLE;
+static bool speaker;
+
+/* Audio clocks up since the last sleep: out of reset they are gated */
+static bool awake;
+
+/* The selected alt, kept across a suspend */
+static const struct audio_format *fmt_sel;
+static uint32_t rate_sel;
+
+static struct stream_power_stats stats;
+
+/* Clocks for the current state: up before anything starts, down after */
+static void power_update(void)
+{
+    if (state == STREAM_ARMED || state == STREAM_STREAMING || speaker) {
+        power_hal_set(POWER_FULL);
+        awake = true;
+        return;
+    }
+
+    if (awake) {
+        capture_hal_sleep();
+        awake = false;
+    }
+    power_hal_set(POWER_LOW);
+}
+
+static void stream_arm(void)
+{
+    state = STREAM_ARMED;
+    power_update();
+
+    stats.starts++;
+    audio_stream_start(fmt_sel, rate_sel);
+}
+
+static void stream_idle(enum stream_state next)
+{
+    if (state == STREAM_ARMED || state == STREAM_STREAMING) {
+        audio_stream_stop();
+    }
+    state = next;
+    power_update();
+}
+
+/* -------------------------------------------------------------------------- */
+/* EVENTS                                                                     */
+/* -------------------------------------------------------------------------- */
+
+void stream_power_init(void)
+{
+    fmt_sel = NULL;
+    speaker = false;
+    awake   = false;
+    state   = STREAM_IDLE;
+    power_update();
+}
+
+void stream_power_select(const struct audio_format *fmt, uint32_t rate_hz)
+{
+    fmt_sel  = fmt;
+    rate_sel = rate_hz;
+
+    if (state == STREAM_SUSPENDED) {
+        return;
+    }
+    if (!fmt) {
+        stream_idle(STREAM_IDLE);
+        return;
+    }
+
+    /* Alt to alt: restart without gating anything in between */
+    if (state != STREAM_IDLE) {
+        audio_stream_stop();
+    }
+    stream_arm();
+}
+
+void stream_power_speaker(bool on)
+{
+    speaker = on;
+
+    if (state != STREAM_SUSPENDED) {
+        power_update();
+    }
+}
+
+void stream_power_live(uint32_t ticks)
+{
+    if (state != STREAM_ARMED) {
+        return;
+    }
+
+    stats.first_packet_last = ticks;
+    if (ticks > stats.first_packet_max) {
+        stats.first_packet_max = ticks;
+    }
+    if (ticks > STREAM_POWER_FIRST_PACKET_FRAMES * (SOF_TIMER_HZ / 1000u)) {
+        stats.slow_starts++;
+    }
+    state = STREAM_STREAMING;
+}
+
+void stream_power_suspend(void)
+{
+    if (state == STREAM_SUSPENDED) {
+        return;
+    }
+
+    /* SET_CUR may have moved the rate since the alt was selected */
+    if (fmt_sel) {
+        rate_sel = audio_stream_cfg()->rate_hz;
+    }
+    speaker = false;
+    stats.suspends++;
+    stream_idle(STREAM_SUSPENDED);
+    power_hal_usb_suspend(true);
+}
+
+void stream_power_resume(void)
+{
+    if (state != STREAM_SUSPENDED) {
+        return;
+    }
+
+    power_hal_usb_suspend(false);
+
+    if (fmt_sel) {
+        stream_arm();
+    } else {
+        state = STREAM_IDLE;
+    }
+}
+
+void stream_power_reset(void)
+{
+    if (state == STREAM_SUSPENDED) {
+        power_hal_usb_suspend(false);
+    }
+
+    fmt_sel = NULL;
+    speaker = false;
+    stream_idle(STREAM_IDLE);
+}
+
+enum stream_state stream_power_state(void)
+{
+    return state;
+}
+
+void stream_power_get_stats(struct stream_power_stats *st)
+{
+    *st = stats;
+}
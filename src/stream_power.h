@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_format.h"
+#include "audio_stream.h"
+
+/*
+ * Stream power states, driven by the mic interface's alternate setting
+ * and USB suspend / resume:
+ *
+ *   IDLE       alt 0: capture stopped, its SPI/DMA clocks and PLLI2S
+ *              gated (capture_hal_sleep()), core at POWER_LOW
+ *   ARMED      alt selected: core at POWER_FULL, capture started; silence
+ *              goes out while the ring primes
+ *   STREAMING  the host has taken the first packet of captured audio
+ *   SUSPENDED  bus suspend: as IDLE plus the USB PHY clock stopped; the
+ *              alt is remembered and streaming restarts on resume, since
+ *              the host does not select it again
+ *
+ *   IDLE --alt N--> ARMED --first packet--> STREAMING
+ *   ARMED / STREAMING --alt 0--> IDLE,  --alt M--> ARMED
+ *   any --suspend--> SUSPENDED --resume--> ARMED (alt N) or IDLE
+ *   any --bus reset--> IDLE
+ *
+ * The headset speaker keeps the core at POWER_FULL and the audio clocks
+ * running whatever the mic state.
+ *
+ * POWER_FULL is restored before the stream is started, so everything
+ * timed against TIM2 from there on (first packet, SOF latency, the sync
+ * mapping) sees it at SOF_TIMER_HZ. The profiler scales samples taken at
+ * POWER_LOW (profiler.h).
+ *
+ * Nothing in the way of ARMED needs a relock of the main PLL: only the
+ * AHB prescaler changes (power_hal.h), and PLLI2S locks in well under a
+ * frame. From the alt being selected (or a new sampling rate restarting
+ * the stream), the first packet of captured audio waits for the ring to
+ * prime to the set point, AUDIO_STREAM_TARGET_BLOCKS_X2 / 2 ms of
+ * capture, then up to a frame for the next packet decision and a frame
+ * for the packet armed ahead, plus the PLLI2S lock and where in the
+ * frame the host's token lands. STREAM_POWER_FIRST_PACKET_FRAMES rounds
+ * that up; starts beyond it are counted. Silence packets keep the
+ * endpoint busy from the frame after the first SOF.
+ *
+ * All calls come from the USB interrupt (or the polled loop).
+ */
+
+#define STREAM_POWER_FIRST_PACKET_FRAMES  \
+    ((AUDIO_STREAM_TARGET_BLOCKS_X2 + 1) / 2 + 3)
+
+enum stream_state {
+    STREAM_IDLE,
+    STREAM_ARMED,
+    STREAM_STREAMING,
+    STREAM_SUSPENDED,
+};
+
+/* After usb setup: IDLE, audio clocks gated, core at POWER_LOW */
+void stream_power_init(void);
+
+/* Mic alt selected: fmt at rate_hz, or NULL for alt 0 */
+void stream_power_select(const struct audio_format *fmt, uint32_t rate_hz);
+
+/* Headset speaker: on before playback starts, off after it stops */
+void stream_power_speaker(bool on);
+
+/*
+ * From audio_stream: the host took the first packet of captured audio,
+ * ticks (TIM2) after the stream was started or last restarted
+ */
+void stream_power_live(uint32_t ticks);
+
+/*
+ * Bus suspend / resume / reset. Stop the speaker before suspending and
+ * restart it after resuming.
+ */
+void stream_power_suspend(void);
+void stream_power_resume(void);
+void stream_power_reset(void);
+
+enum stream_state stream_power_state(void);
+
+struct stream_power_stats {
+    uint32_t starts;              /* IDLE/SUSPENDED/alt change -> ARMED */
+    uint32_t suspends;
+    uint32_t first_packet_last;   /* (re)start -> first audio taken, TIM2 ticks */
+    uint32_t first_packet_max;
+    uint32_t slow_starts;         /* beyond STREAM_POWER_FIRST_PACKET_FRAMES */
+};
+
+void stream_power_get_stats(struct stream_power_stats *st);
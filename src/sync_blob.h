@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Sync blob: wire format of the SOF -> sample mapping (sync_map.h),
+ * shared by the firmware (sync_map.c) and the host decoder
+ * (sync_decode.c).
+ *
+ * Little-endian:
+ *
+ *   magic "SYN1" (u32), version (u16), flags (u16),
+ *   frame (u32), epoch (u32), rate_hz (u32), offset (i32),
+ *   pos_q32 (u64), spf_q32 (u64)
+ *
+ * frame is the USB frame number of the SOF the mapping was taken at,
+ * extended past its 11 bits by counting wraps since the stream started;
+ * only its low 11 bits are shared with the host's frame counter.
+ *
+ * pos_q32 is the capture sample index at that SOF, 32.32 fixed point,
+ * counting samples at rate_hz from the start of the stream; spf_q32 is
+ * the measured samples per 1 ms frame, 32.32. Between blobs
+ *
+ *   capture index at frame f = pos + (f - frame) * spf
+ *
+ * offset maps the capture index onto the IN stream: wire sample w (the
+ * w-th sample the host has received since the alt was selected) is
+ * capture sample w + offset. It only holds while the epoch is unchanged;
+ * the epoch moves on every restart, underrun, priming and capture
+ * overrun, each of which drops or inserts samples on one side.
+ *
+ * Fixed delays of the signal path (mic, decimator group delay) are not
+ * included: identical devices share them.
+ *
+ * No field is in timer ticks, and the mapping is only tracked while a
+ * stream runs, always at POWER_FULL (stream_power.h): the core clock
+ * divider does not enter into it.
+ */
+
+#define SYNC_BLOB_MAGIC    0x314E5953u     /* "SYN1" */
+#define SYNC_BLOB_VERSION  1
+
+#define SYNC_FLAG_STREAMING  0x0001    /* a stream is running */
+#define SYNC_FLAG_TRACKING   0x0002    /* pos/spf are valid */
+#define SYNC_FLAG_LOCKED     0x0004    /* tracker has settled */
+#define SYNC_FLAG_MAPPED     0x0008    /* offset is valid */
+
+#define SYNC_BLOB_SIZE  40
@@ -0,0 +1,140 @@
+/*
+ * Host decoder for sync blobs (sync_blob.h).
+ *
+ *   sync_decode file...    one blob per device
+ *
+ * With several devices on one host the blobs share the USB frame
+ * counter, so each device's mapping can be carried to the first
+ * device's frame and compared. Read them within a second of each other:
+ * only the low 11 bits of the frame number are common. Fetch a blob
+ * e.g. from Python/pyusb:
+ *   dev.ctrl_transfer(0xC0, 0x08, 0, 0, 40)
+ *
+ * The last column is where device 0's wire sample 0 falls in each
+ * device's own IN stream: add it to a device 0 sample index to get the
+ * simultaneous sample on that device.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sync_blob.h"
+
+#define MAX_DEVICES  16
+
+struct sync_rec {
+    uint32_t flags, frame, epoch, rate_hz;
+    int32_t  offset;
+    double   pos;        /* capture samples at frame */
+    double   spf;        /* samples per frame */
+};
+
+static uint32_t get16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+/* Returns 0 on success, or a message describing the first problem */
+static const char *sync_parse(const uint8_t *p, size_t len, struct sync_rec *r)
+{
+    if (len < SYNC_BLOB_SIZE) {
+        return "short blob";
+    }
+    if (get32(p) != SYNC_BLOB_MAGIC) {
+        return "bad magic";
+    }
+    if (get16(p + 4) != SYNC_BLOB_VERSION) {
+        return "unsupported version";
+    }
+
+    r->flags   = get16(p + 6);
+    r->frame   = get32(p + 8);
+    r->epoch   = get32(p + 12);
+    r->rate_hz = get32(p + 16);
+    r->offset  = (int32_t)get32(p + 20);
+    r->pos     = get64(p + 24) / 4294967296.0;
+    r->spf     = get64(p + 32) / 4294967296.0;
+    return 0;
+}
+
+/* Frames from a to b on the shared 11-bit counter, -1024..1023 */
+static int frame_diff(uint32_t a, uint32_t b)
+{
+    return (int)((b - a + 1024) & 0x7FF) - 1024;
+}
+
+int main(int argc, char **argv)
+{
+    static struct sync_rec rec[MAX_DEVICES];
+    int n = argc - 1;
+
+    if (n < 1 || n > MAX_DEVICES) {
+        fprintf(stderr, "usage: sync_decode file... (up to %d)\n", MAX_DEVICES);
+        return 1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint8_t blob[SYNC_BLOB_SIZE];
+        FILE *f = fopen(argv[i + 1], "rb");
+
+        if (!f) {
+            perror(argv[i + 1]);
+            return 1;
+        }
+        size_t len = fread(blob, 1, sizeof(blob), f);
+        fclose(f);
+
+        const char *err = sync_parse(blob, len, &rec[i]);
+        if (err) {
+            fprintf(stderr, "sync_decode: %s: %s\n", argv[i + 1], err);
+            return 1;
+        }
+    }
+
+    printf("dev  frame  epoch  rate   flags         samples/frame  "
+           "capture@F0       wire@F0          dev0 wire 0 at\n");
+
+    const struct sync_rec *r0 = &rec[0];
+    double w0 = 0;
+
+    for (int i = 0; i < n; i++) {
+        const struct sync_rec *r = &rec[i];
+        double c = r->pos + frame_diff(r->frame, r0->frame) * r->spf;
+        double w = c - r->offset;
+        int usable = (r->flags & SYNC_FLAG_TRACKING) &&
+                     (r->flags & SYNC_FLAG_MAPPED) &&
+                     r->rate_hz == r0->rate_hz;
+
+        if (i == 0) {
+            w0 = w;
+        }
+
+        printf("%3d  %5u  %5u  %5u  %c%c%c%c  %16.10f  %15.4f  %15.4f",
+               i, (unsigned)(r->frame & 0x7FF), (unsigned)r->epoch,
+               (unsigned)r->rate_hz,
+               r->flags & SYNC_FLAG_STREAMING ? 'S' : '-',
+               r->flags & SYNC_FLAG_TRACKING  ? 'T' : '-',
+               r->flags & SYNC_FLAG_LOCKED    ? 'L' : '-',
+               r->flags & SYNC_FLAG_MAPPED    ? 'M' : '-',
+               r->spf, c, w);
+        if (usable && (r0->flags & SYNC_FLAG_MAPPED)) {
+            printf("  %+15.4f\n", w - w0);
+        } else {
+            printf("  %15s\n", "n/a");
+        }
+    }
+
+    printf("\nflags: S streaming, T tracking, L locked, M wire offset valid\n");
+    return 0;
+}
@@ -0,0 +1,308 @@
+#include "sync_map.h"
+#include "audio_capture.h"
+
+#define LOAD_ACQ(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LOAD_RLX(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STORE_REL(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define STORE_RLX(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+/* -------------------------------------------------------------------------- */
+/* STATE                                                                      */
+/* -------------------------------------------------------------------------- */
+
+/* Capture side, written by the DMA ISR only */
+static uint32_t cap_seq;         /* odd while an event is in progress */
+static uint32_t cap_t;           /* TIM2 tick of the latest event */
+static uint32_t cap_part;        /* DMA half-words past the completed half */
+static uint32_t cap_total;       /* stream samples up to that half */
+static uint32_t cap_drops;       /* blocks the ring had no room for */
+
+/* SOF side; the rates are set while neither ISR can run */
+static uint32_t rate_hz;
+static uint32_t capture_hz;
+static uint64_t nominal_q32;
+static uint8_t  streaming;
+
+static uint8_t  tracking;        /* pos/spf hold a measurement */
+static uint32_t updates;         /* tracker updates since (re)start */
+static uint32_t frame;           /* extended frame number of the last SOF */
+static uint32_t frame_upd;       /* ... and of the last tracker update */
+static uint64_t pos_q32;         /* sample index at frame */
+static uint64_t spf_q32;
+
+static uint8_t  mapped;
+static int32_t  offset;
+static uint32_t drops_seen;
+static uint32_t hold_until;      /* no offset until wire passes this */
+static uint8_t  holding;
+static uint32_t epoch;
+
+/* -------------------------------------------------------------------------- */
+/* CAPTURE SIDE (DMA ISR)                                                     */
+/* -------------------------------------------------------------------------- */
+
+void sync_map_capture_begin(uint32_t t, uint32_t part_hw)
+{
+    uint32_t seq = LOAD_RLX(&cap_seq);
+
+    STORE_RLX(&cap_seq, seq + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    STORE_RLX(&cap_t, t);
+    STORE_RLX(&cap_part, part_hw);
+}
+
+void sync_map_capture_end(uint32_t total, bool stored)
+{
+    uint32_t seq = LOAD_RLX(&cap_seq);
+
+    STORE_RLX(&cap_total, total);
+    if (!stored) {
+        STORE_RLX(&cap_drops, LOAD_RLX(&cap_drops) + 1);
+    }
+
+    STORE_REL(&cap_seq, seq + 1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* SOF SIDE (USB ISR)                                                         */
+/* -------------------------------------------------------------------------- */
+
+struct cap_snap {
+    uint32_t t, part, total, drops;
+};
+
+/* Consistent capture event, false if the DMA ISR is mid-update */
+static bool capture_snapshot(struct cap_snap *s)
+{
+    uint32_t seq = LOAD_ACQ(&cap_seq);
+
+    if (seq & 1) {
+        return false;
+    }
+    s->t     = LOAD_RLX(&cap_t);
+    s->part  = LOAD_RLX(&cap_part);
+    s->total = LOAD_RLX(&cap_total);
+    s->drops = LOAD_RLX(&cap_drops);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return LOAD_RLX(&cap_seq) == seq;
+}
+
+/* Ticks -> stream samples, 32.32; whole and fraction apart to fit 64 bits */
+static uint64_t ticks_q32(uint32_t ticks)
+{
+    uint64_t n = (uint64_t)ticks * rate_hz;
+
+    return ((n / SOF_TIMER_HZ) << 32) + ((n % SOF_TIMER_HZ) << 32) / SOF_TIMER_HZ;
+}
+
+/* Sample index at the SOF tick, 32.32 */
+static bool measure(const struct cap_snap *s, uint32_t t_sof, uint64_t *meas)
+{
+    int32_t  dt   = (int32_t)(t_sof - s->t);
+    uint32_t age  = dt < 0 ? (uint32_t)-dt : (uint32_t)dt;
+    uint64_t part = ((uint64_t)s->part << 32) * rate_hz /
+                    ((uint64_t)AUDIO_CAPTURE_HWORDS_PER_FRAME * capture_hz);
+
+    if (age > SYNC_MAP_MAX_AGE_TICKS) {
+        return false;
+    }
+
+    *meas = ((uint64_t)s->total << 32) + part;
+    if (dt < 0) {
+        *meas -= ticks_q32(age);
+    } else {
+        *meas += ticks_q32(age);
+    }
+    return true;
+}
+
+static void track_restart(uint64_t meas)
+{
+    pos_q32   = meas;
+    spf_q32   = nominal_q32;
+    frame_upd = frame;
+    updates   = 0;
+    tracking  = 1;
+}
+
+static void track(uint64_t meas)
+{
+    uint32_t a, b;
+
+    if (!tracking) {
+        track_restart(meas);
+        return;
+    }
+
+    uint64_t pred = pos_q32 + spf_q32 * (frame - frame_upd);
+    int64_t  e    = (int64_t)(meas - pred);
+    int64_t  jump = (int64_t)SYNC_MAP_JUMP_SAMPLES << 32;
+
+    if (e > jump || e < -jump) {
+        epoch++;
+        track_restart(meas);
+        return;
+    }
+
+    if (updates < SYNC_MAP_ACQ_FRAMES) {
+        a = 2;
+        b = 5;
+    } else if (updates < SYNC_MAP_TRACK_FRAMES) {
+        a = 4;
+        b = 9;
+    } else {
+        a = SYNC_MAP_ALPHA_SHIFT;
+        b = SYNC_MAP_BETA_SHIFT;
+    }
+
+    pos_q32   = pred + (uint64_t)(e / ((int64_t)1 << a));
+    spf_q32  += (uint64_t)(e / ((int64_t)1 << b));
+    frame_upd = frame;
+    if (updates < UINT32_MAX) {
+        updates++;
+    }
+}
+
+/* Capture index of the packet's first sample against the wire count */
+static void map(uint32_t first, uint32_t wire)
+{
+    int32_t off = (int32_t)(first - wire);
+
+    if (holding) {
+        if ((int32_t)(wire - hold_until) < 0) {
+            return;
+        }
+        holding = 0;
+    }
+
+    if (mapped && off == offset) {
+        return;
+    }
+    if (mapped) {
+        epoch++;
+    }
+    offset = off;
+    mapped = 1;
+}
+
+void sync_map_sof(uint32_t t_sof, uint32_t frame11)
+{
+    struct cap_snap s;
+    uint64_t meas;
+
+    if (!streaming) {
+        return;
+    }
+    frame += (frame11 - frame) & 0x7FF;
+
+    if (capture_snapshot(&s) && s.total && measure(&s, t_sof, &meas)) {
+        track(meas);
+    }
+}
+
+void sync_map_packet(uint32_t ring, uint32_t wire)
+{
+    struct cap_snap s;
+
+    if (!streaming || !capture_snapshot(&s)) {
+        return;
+    }
+
+    if (s.drops != drops_seen) {
+        /* The ring holds samples from before the gap */
+        drops_seen = s.drops;
+        hold_until = wire + ring;
+        holding    = 1;
+        mapped     = 0;
+        epoch++;
+    }
+
+    map(s.total - ring, wire);
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONTROL                                                                    */
+/* -------------------------------------------------------------------------- */
+
+void sync_map_start(const struct audio_stream_cfg *cfg)
+{
+    rate_hz     = cfg->rate_hz;
+    capture_hz  = cfg->capture_hz;
+    nominal_q32 = ((uint64_t)rate_hz << 32) / 1000;
+
+    STORE_RLX(&cap_total, 0);
+    drops_seen = LOAD_RLX(&cap_drops);
+    tracking   = 0;
+    mapped     = 0;
+    holding    = 0;
+    pos_q32    = 0;
+    spf_q32    = nominal_q32;
+    epoch++;
+    streaming  = 1;
+}
+
+void sync_map_stop(void)
+{
+    streaming = 0;
+    tracking  = 0;
+    mapped    = 0;
+}
+
+static uint8_t *put16(uint8_t *p, uint32_t v)
+{
+    *p++ = (uint8_t)v;
+    *p++ = (uint8_t)(v >> 8);
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p = put16(p, v);
+    return put16(p, v >> 16);
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t v)
+{
+    p = put32(p, (uint32_t)v);
+    return put32(p, (uint32_t)(v >> 32));
+}
+
+uint32_t sync_map_snapshot(uint8_t *dst, uint32_t cap)
+{
+    uint8_t *p = dst;
+    uint32_t flags = 0;
+
+    if (cap < SYNC_BLOB_SIZE) {
+        return 0;
+    }
+
+    if (streaming) {
+        flags |= SYNC_FLAG_STREAMING;
+    }
+    if (tracking) {
+        flags |= SYNC_FLAG_TRACKING;
+        if (updates >= SYNC_MAP_TRACK_FRAMES) {
+            flags |= SYNC_FLAG_LOCKED;
+        }
+    }
+    if (mapped) {
+        flags |= SYNC_FLAG_MAPPED;
+    }
+
+    /* Carried forward from the last update to the last SOF */
+    uint64_t pos = pos_q32 + spf_q32 * (frame - frame_upd);
+
+    p = put32(p, SYNC_BLOB_MAGIC);
+    p = put16(p, SYNC_BLOB_VERSION);
+    p = put16(p, flags);
+    p = put32(p, frame);
+    p = put32(p, epoch);
+    p = put32(p, rate_hz);
+    p = put32(p, (uint32_t)offset);
+    p = put64(p, pos);
+    p = put64(p, spf_q32);
+
+    return (uint32_t)(p - dst);
+}
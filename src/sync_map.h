@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_format.h"
+#include "sof_timer.h"
+#include "sync_blob.h"
+
+/*
+ * USB frame -> capture sample mapping, for aligning several devices
+ * streaming at once (array capture) without cross-correlating audio.
+ *
+ * Each capture DMA event latches its TIM2 tick and the DMA position
+ * (how far into the next half the stream had got when the interrupt was
+ * taken), and publishes the stream sample count at the end of the block.
+ * Together they pin a sample index to a tick. At each SOF the hardware
+ * SOF tick (sof_timer.h) is set against the latest such pair:
+ *
+ *   meas = samples at the event + part of a block since the DMA half
+ *          ended + (t_sof - t_event) * rate / SOF_TIMER_HZ
+ *
+ * which is the sample index at that SOF. TIM2 and the I2S clock run off
+ * the same crystal, so its error cancels out of the tick term.
+ *
+ * The raw measurement carries the DMA position's granularity (a quarter
+ * of a sample for I2S) and interrupt jitter; an alpha-beta tracker
+ * smooths it into a position and a samples-per-frame slope:
+ *
+ *   pred = pos + spf * frames since the last update
+ *   pos  = pred + (meas - pred) / 2^a
+ *   spf += (meas - pred) / 2^b
+ *
+ * a and b start wide open and step down to SYNC_MAP_ALPHA_SHIFT /
+ * SYNC_MAP_BETA_SHIFT (about critically damped at each step); from
+ * then on the tracker reports itself locked. An error beyond
+ * SYNC_MAP_JUMP_SAMPLES (capture stalled or restarted) restarts it.
+ *
+ * Every packet armed from the ring also records which capture sample it
+ * starts on, so the host can turn the wire
+ * sample count it has received into a capture index (sync_blob.h). That
+ * offset is fixed until something drops or inserts samples; each such
+ * event moves the epoch instead. After a capture overrun the ring still
+ * holds samples from before the gap, so the offset is withheld until
+ * those have been sent.
+ *
+ * sync_map_capture_*() run in the capture DMA ISR and the rest in the
+ * USB ISR, which preempts it: the capture side publishes under a
+ * sequence counter and a SOF or packet landing between the two calls
+ * just skips its measurement or mapping.
+ */
+
+#define SYNC_MAP_ACQ_FRAMES     64      /* at 1/4, 1/32 */
+#define SYNC_MAP_TRACK_FRAMES   1024    /* at 1/16, 1/512, then final */
+#define SYNC_MAP_ALPHA_SHIFT    6
+#define SYNC_MAP_BETA_SHIFT     13
+#define SYNC_MAP_JUMP_SAMPLES   8
+
+/* The tick term is dropped past this, the capture side has stalled */
+#define SYNC_MAP_MAX_AGE_TICKS  (4u * (SOF_TIMER_HZ / 1000u))
+
+/* Stream (re)started with cfg, before the first DMA event */
+void sync_map_start(const struct audio_stream_cfg *cfg);
+void sync_map_stop(void);
+
+/*
+ * Capture DMA ISR, on entry: t = sof_timer_now() when the interrupt was
+ * taken, part_hw = half-words the DMA had written past the half that
+ * just completed.
+ */
+void sync_map_capture_begin(uint32_t t, uint32_t part_hw);
+
+/*
+ * Capture DMA ISR, after the ring write: total = stream samples
+ * produced since start, stored = the block made it into the ring.
+ */
+void sync_map_capture_end(uint32_t total, bool stored);
+
+/* SOF: t_sof = sof_timer_last_sof(), frame = 11-bit frame number */
+void sync_map_sof(uint32_t t_sof, uint32_t frame);
+
+/*
+ * A packet of ring data has been armed: ring = samples in the capture
+ * ring, the packet's included, wire = samples the host has taken before
+ * it.
+ */
+void sync_map_packet(uint32_t ring, uint32_t wire);
+
+/* Write a sync blob (sync_blob.h); returns its length, 0 if cap is short */
+uint32_t sync_map_snapshot(uint8_t *dst, uint32_t cap);
@@ -0,0 +1,226 @@
+/*
+ * Host decoder for the diagnostic tap stream (tap_stream.h).
+ *
+ *   tap_decode [-o out.raw] [-l lane] [-q] [file]
+ *
+ * Reads the bulk endpoint's byte stream from file or stdin, checks the
+ * framing and record sequence, and prints the FORMAT and TELEMETRY
+ * records (-q: only the last telemetry). -o writes the tapped blocks of
+ * one lane (default 0) as raw PCM for stream_check, or raw DMA data for
+ * TAP_REC_RAW.
+ *
+ * Start the tap and read it, e.g. from Python/pyusb:
+ *   dev.ctrl_transfer(0x40, 0x05, 4, 100)     # OUTPUT stage, 100 ms
+ *   dev.read(0x82, 4096)                      # repeat, append to file
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tap_stream.h"
+
+static const char *const type_names[TAP_NUM_STAGES] = {
+    [TAP_REC_RAW]       = "raw",
+    [TAP_REC_CONVERTED] = "converted",
+    [TAP_REC_DSP]       = "dsp",
+    [TAP_REC_OUTPUT]    = "output",
+};
+
+static const char *const telem_names[TAP_TELEM_NUM_FIELDS] = {
+    [TAP_TELEM_BLOCKS]           = "blocks",
+    [TAP_TELEM_PACK_CYCLES_LAST] = "pack_cycles",
+    [TAP_TELEM_PACK_CYCLES_MAX]  = "pack_cycles_max",
+    [TAP_TELEM_OVER_BUDGET]      = "over_budget",
+    [TAP_TELEM_RING_FILL]        = "ring_fill",
+    [TAP_TELEM_RING_HIGH_WATER]  = "ring_high",
+    [TAP_TELEM_RING_LOW_WATER]   = "ring_low",
+    [TAP_TELEM_RING_OVERRUNS]    = "overruns",
+    [TAP_TELEM_RING_UNDERRUNS]   = "underruns",
+    [TAP_TELEM_PACKETS]          = "packets",
+    [TAP_TELEM_SILENT]           = "silent",
+    [TAP_TELEM_SOF_LATENCY_LAST] = "sof_latency",
+    [TAP_TELEM_SOF_LATENCY_MAX]  = "sof_latency_max",
+    [TAP_TELEM_TAP_DROPS]        = "tap_drops",
+    [TAP_TELEM_TAP_HIGH_WATER]   = "tap_high",
+    [TAP_TELEM_ISO_MISSED]       = "iso_missed",
+    [TAP_TELEM_ISO_LATE]         = "iso_late",
+    [TAP_TELEM_ISO_RECOVERED]    = "iso_recovered",
+    [TAP_TELEM_ISO_DROPPED]      = "iso_dropped",
+    [TAP_TELEM_SOF_GAPS]         = "sof_gaps",
+    [TAP_TELEM_FIRST_PACKET]     = "first_packet",
+    [TAP_TELEM_SLOW_STARTS]      = "slow_starts",
+    [TAP_TELEM_START_FAILURES]   = "start_failures",
+    [TAP_TELEM_ISO_BUSY]         = "iso_busy",
+    [TAP_TELEM_ISO_FLUSH_TIMEOUTS] = "iso_flush_timeouts",
+};
+
+struct decoder {
+    FILE    *out;
+    unsigned lane;
+    int      quiet;
+
+    int      have_seq;
+    uint16_t next_seq;
+    uint64_t records;
+    uint64_t lost;
+    uint64_t resyncs;
+    uint64_t skipped;       /* bytes dropped while resyncing */
+    uint64_t by_type[TAP_NUM_STAGES];
+    uint64_t out_bytes;
+
+    uint8_t  last_telem[TAP_TELEMETRY_SIZE];
+    unsigned last_telem_len;
+};
+
+static uint32_t get16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+static void print_telemetry(const uint8_t *p, unsigned len)
+{
+    unsigned n = len / 4;
+
+    if (n > TAP_TELEM_NUM_FIELDS) {
+        n = TAP_TELEM_NUM_FIELDS;      /* newer firmware: known fields only */
+    }
+    printf("telemetry:");
+    for (unsigned i = 0; i < n; i++) {
+        printf(" %s=%u", telem_names[i], (unsigned)get32(p + 4 * i));
+    }
+    printf("\n");
+}
+
+static void record(struct decoder *d, const uint8_t *h, const uint8_t *p)
+{
+    unsigned type = h[2];
+    unsigned lane = h[3];
+    uint16_t seq  = (uint16_t)get16(h + 4);
+    unsigned len  = get16(h + 6);
+
+    if (d->have_seq) {
+        d->lost += (uint16_t)(seq - d->next_seq);
+    }
+    d->have_seq = 1;
+    d->next_seq = (uint16_t)(seq + 1);
+    d->records++;
+
+    if (type == TAP_REC_FORMAT && len >= TAP_FORMAT_SIZE) {
+        unsigned st = p[7];
+        printf("format: %u Hz, %u ch, %u-bit in %u bytes, stage %s\n",
+               (unsigned)get32(p), p[4], p[6], p[5],
+               st < TAP_NUM_STAGES && type_names[st] ? type_names[st] : "?");
+    } else if (type == TAP_REC_TELEMETRY) {
+        if (!d->quiet) {
+            print_telemetry(p, len);
+        }
+        d->last_telem_len = len < sizeof(d->last_telem) ? len : sizeof(d->last_telem);
+        memcpy(d->last_telem, p, d->last_telem_len);
+    } else if (type < TAP_NUM_STAGES && type_names[type]) {
+        d->by_type[type]++;
+        if (d->out && lane == d->lane) {
+            d->out_bytes += fwrite(p, 1, len, d->out);
+        }
+    }
+}
+
+/* Consume whole records from buf; returns bytes used */
+static size_t parse(struct decoder *d, const uint8_t *buf, size_t n)
+{
+    size_t pos = 0;
+    int    in_sync = 1;
+
+    while (n - pos >= TAP_HEADER_SIZE) {
+        const uint8_t *h = buf + pos;
+
+        if (get16(h) != TAP_SYNC) {
+            if (in_sync) {
+                d->resyncs++;
+                in_sync = 0;
+            }
+            d->skipped++;
+            pos++;
+            continue;
+        }
+        in_sync = 1;
+
+        size_t len = get16(h + 6);
+        if (n - pos < TAP_HEADER_SIZE + len) {
+            break;
+        }
+        record(d, h, h + TAP_HEADER_SIZE);
+        pos += TAP_HEADER_SIZE + len;
+    }
+    return pos;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[1 << 17];
+    struct decoder d;
+    FILE  *f = stdin;
+    size_t have = 0;
+
+    memset(&d, 0, sizeof(d));
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            if (!(d.out = fopen(argv[++i], "wb"))) {
+                perror(argv[i]);
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            d.lane = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-q")) {
+            d.quiet = 1;
+        } else if (!(f = fopen(argv[i], "rb"))) {
+            perror(argv[i]);
+            return 2;
+        }
+    }
+
+    for (;;) {
+        size_t got = fread(buf + have, 1, sizeof(buf) - have, f);
+        have += got;
+
+        size_t used = parse(&d, buf, have);
+        memmove(buf, buf + used, have - used);
+        have -= used;
+
+        if (got == 0) {
+            break;
+        }
+    }
+
+    if (d.quiet && d.last_telem_len) {
+        print_telemetry(d.last_telem, d.last_telem_len);
+    }
+
+    printf("%llu records, %llu lost, %llu resyncs (%llu bytes skipped), "
+           "%zu trailing bytes\n",
+           (unsigned long long)d.records, (unsigned long long)d.lost,
+           (unsigned long long)d.resyncs, (unsigned long long)d.skipped, have);
+    for (unsigned t = 0; t < TAP_NUM_STAGES; t++) {
+        if (d.by_type[t]) {
+            printf("  %-9s %llu blocks\n", type_names[t],
+                   (unsigned long long)d.by_type[t]);
+        }
+    }
+    if (d.out) {
+        printf("  wrote %llu bytes of lane %u\n",
+               (unsigned long long)d.out_bytes, d.lane);
+        fclose(d.out);
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    return d.resyncs ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Tap stream: wire format of the vendor bulk endpoint, shared by the
+ * firmware (audio_tap.c) and the host decoder (tap_decode.c).
+ *
+ * A plain byte stream of records; USB transfer boundaries carry no
+ * meaning. Each record is an 8-byte header and len payload bytes, all
+ * little-endian:
+ *
+ *   sync (u16)  TAP_SYNC
+ *   type (u8)   enum tap_record_type
+ *   lane (u8)   I2S lane for TAP_REC_RAW, else 0
+ *   seq  (u16)  +1 per record produced, dropped ones included
+ *   len  (u16)  payload bytes
+ *
+ * Audio records hold one 1 ms block of the tapped stage. RAW is one
+ * lane's DMA half as captured (I2S slot half-words, or PDM bits), the
+ * others are wire-format PCM as described by the last FORMAT record:
+ *
+ *   FORMAT     rate_hz (u32), channels, subframe bytes, bits, stage (u8);
+ *              sent before the first block and whenever any of it changes
+ *   TELEMETRY  TAP_TELEM_NUM_FIELDS u32 counters, enum tap_telem_field
+ *              order; decoders take the fields they know
+ *
+ * The firmware drops records whole when its tap ring is full, so a seq
+ * gap counts lost records and the stream stays parseable.
+ */
+
+#define TAP_SYNC             0x5441u     /* "AT" */
+#define TAP_HEADER_SIZE      8
+#define TAP_FORMAT_SIZE      8
+
+enum tap_record_type {
+    TAP_REC_RAW = 1,         /* DMA half, per lane */
+    TAP_REC_CONVERTED,       /* after conversion (or the test source) */
+    TAP_REC_DSP,             /* after the front-end DSP chain */
+    TAP_REC_OUTPUT,          /* after the Feature Unit gain, as streamed */
+    TAP_REC_FORMAT    = 0x40,
+    TAP_REC_TELEMETRY = 0x80,
+};
+
+#define TAP_NUM_STAGES       (TAP_REC_OUTPUT + 1)
+
+enum tap_telem_field {
+    TAP_TELEM_BLOCKS = 0,            /* capture blocks produced */
+    TAP_TELEM_PACK_CYCLES_LAST,      /* capture ISR conversion, cycles */
+    TAP_TELEM_PACK_CYCLES_MAX,
+    TAP_TELEM_OVER_BUDGET,
+    TAP_TELEM_RING_FILL,             /* capture ring, bytes */
+    TAP_TELEM_RING_HIGH_WATER,
+    TAP_TELEM_RING_LOW_WATER,
+    TAP_TELEM_RING_OVERRUNS,
+    TAP_TELEM_RING_UNDERRUNS,
+    TAP_TELEM_PACKETS,               /* iso packets armed */
+    TAP_TELEM_SILENT,
+    TAP_TELEM_SOF_LATENCY_LAST,      /* TIM2 ticks */
+    TAP_TELEM_SOF_LATENCY_MAX,
+    TAP_TELEM_TAP_DROPS,             /* tap records dropped, ring full */
+    TAP_TELEM_TAP_HIGH_WATER,        /* tap ring, bytes */
+    TAP_TELEM_ISO_MISSED,            /* iso recovery, audio_stream.h */
+    TAP_TELEM_ISO_LATE,
+    TAP_TELEM_ISO_RECOVERED,
+    TAP_TELEM_ISO_DROPPED,
+    TAP_TELEM_SOF_GAPS,
+    TAP_TELEM_FIRST_PACKET,          /* start -> first audio, TIM2 ticks */
+    TAP_TELEM_SLOW_STARTS,
+    TAP_TELEM_START_FAILURES,        /* capture: I2S clock did not lock */
+    TAP_TELEM_ISO_BUSY,
+    TAP_TELEM_ISO_FLUSH_TIMEOUTS,
+    TAP_TELEM_NUM_FIELDS
+};
+
+#define TAP_TELEMETRY_SIZE   (TAP_TELEM_NUM_FIELDS * 4)
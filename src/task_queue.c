@@ -0,0 +1,74 @@
+#include <libopencm3/cm3/cortex.h>
+
+#include "task_queue.h"
+#include "cycle_counter.h"
+
+static task_fn tasks[TASK_MAX];
+static int n_tasks;
+static uint32_t pending;
+
+static uint32_t window_start;
+static uint32_t idle_cycles;
+
+int task_register(task_fn fn)
+{
+    if (n_tasks >= TASK_MAX) {
+        return -1;
+    }
+    tasks[n_tasks] = fn;
+    return n_tasks++;
+}
+
+void task_post(int id)
+{
+    __atomic_fetch_or(&pending, 1u << id, __ATOMIC_RELEASE);
+}
+
+void task_run_pending(void)
+{
+    uint32_t p = __atomic_exchange_n(&pending, 0, __ATOMIC_ACQUIRE);
+
+    while (p) {
+        int id = __builtin_ctz(p);
+        p &= p - 1;
+        tasks[id]();
+    }
+}
+
+void task_idle_wait(void)
+{
+    /*
+     * Check and sleep with interrupts masked: a post between the check
+     * and WFI still wakes the core (WFI ignores PRIMASK), and the handler
+     * runs once interrupts are re-enabled below.
+     */
+    cm_disable_interrupts();
+
+    if (!__atomic_load_n(&pending, __ATOMIC_ACQUIRE)) {
+        uint32_t t0 = cycles_now();
+#if defined(__arm__)
+        __asm__ volatile ("wfi");
+#endif
+        idle_cycles += cycles_now() - t0;
+    }
+
+    cm_enable_interrupts();
+}
+
+void task_idle_account(uint32_t cycles)
+{
+    idle_cycles += cycles;
+}
+
+void task_get_idle_stats(struct task_idle_stats *st, int reset)
+{
+    uint32_t now = cycles_now();
+
+    st->window_cycles = now - window_start;
+    st->idle_cycles   = idle_cycles;
+
+    if (reset) {
+        window_start = now;
+        idle_cycles  = 0;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Cooperative background task queue for thread mode.
+ *
+ * Interrupt handlers post tasks by id; the main loop runs whatever is
+ * pending, lowest id first, and sleeps in WFI when nothing is. Posting
+ * is a single atomic OR, safe from any priority.
+ */
+
+#define TASK_MAX  32
+
+typedef void (*task_fn)(void);
+
+/* Returns the task id, or -1 when the table is full */
+int task_register(task_fn fn);
+
+void task_post(int id);
+
+/* Run every pending task once */
+void task_run_pending(void);
+
+/* Sleep until the next interrupt unless a task is already pending */
+void task_idle_wait(void);
+
+/* Count cycles spent idle outside task_idle_wait() (polled builds) */
+void task_idle_account(uint32_t cycles);
+
+struct task_idle_stats {
+    uint32_t window_cycles;  /* cycles since the last reset */
+    uint32_t idle_cycles;    /* of which idle */
+};
+
+/*
+ * Idle time since the last reset, and optionally start a new window.
+ * Thread mode or the USB interrupt: the idle count only moves with
+ * interrupts masked, or from the polling loop itself in polled builds.
+ */
+void task_get_idle_stats(struct task_idle_stats *st, int reset);
@@ -0,0 +1,161 @@
+#include "test_source.h"
+
+#define SINE_LUT_BITS   10
+#define SINE_LUT_SIZE   (1 << SINE_LUT_BITS)
+#define SINE_FRAC_BITS  15
+
+/* -1 dBFS in Q15 */
+#define SINE_AMPLITUDE  29204
+
+/* cos/sin of 2 pi / SINE_LUT_SIZE, for building the table by rotation */
+#define LUT_STEP_COS    0.9999811752826011
+#define LUT_STEP_SIN    0.006135884649154475
+
+/* Requested mode << 24 | frequency: one word, so a change is atomic */
+#define REQ_MODE_SHIFT  24
+#define REQ_FREQ_MASK   ((1u << REQ_MODE_SHIFT) - 1)
+
+/* One guard entry so interpolation never wraps the index */
+static int16_t sine_lut[SINE_LUT_SIZE + 1];
+static bool    sine_lut_ready;
+
+static uint32_t request;
+
+/* Producer state */
+static uint32_t active_req;
+static uint32_t active_rate;
+static uint32_t phase;
+static uint32_t step;
+static uint32_t counter;
+static uint32_t seq;
+
+/* -------------------------------------------------------------------------- */
+/* SETUP                                                                      */
+/* -------------------------------------------------------------------------- */
+
+/* Once, outside the audio path: rotate a unit vector around the circle */
+static void sine_lut_build(void)
+{
+    double c = 1.0, s = 0.0;
+
+    for (unsigned i = 0; i <= SINE_LUT_SIZE; i++) {
+        double v = s * SINE_AMPLITUDE;
+
+        sine_lut[i] = (int16_t)(v < 0 ? v - 0.5 : v + 0.5);
+
+        double cn = c * LUT_STEP_COS - s * LUT_STEP_SIN;
+        s = s * LUT_STEP_COS + c * LUT_STEP_SIN;
+        c = cn;
+    }
+    sine_lut_ready = true;
+}
+
+bool test_source_select(enum test_source_mode mode, uint32_t freq_hz)
+{
+    if ((unsigned)mode >= TEST_SRC_NUM_MODES || freq_hz > REQ_FREQ_MASK) {
+        return false;
+    }
+    if (freq_hz == 0) {
+        freq_hz = TEST_SRC_DEFAULT_HZ;
+    }
+
+    __atomic_store_n(&request, ((uint32_t)mode << REQ_MODE_SHIFT) | freq_hz,
+                     __ATOMIC_RELAXED);
+    return true;
+}
+
+void test_source_restart(void)
+{
+    if (!sine_lut_ready) {
+        sine_lut_build();
+    }
+
+    active_req  = 0;
+    active_rate = 0;
+    phase       = 0;
+    counter     = 0;
+    seq         = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* GENERATORS                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/* Q23 sine at the current phase */
+static int32_t nco_sine(uint32_t ph)
+{
+    uint32_t i    = ph >> (32 - SINE_LUT_BITS);
+    int32_t  frac = (int32_t)((ph >> (32 - SINE_LUT_BITS - SINE_FRAC_BITS)) &
+                              ((1 << SINE_FRAC_BITS) - 1));
+    int32_t  a    = sine_lut[i];
+    int32_t  b    = sine_lut[i + 1];
+
+    return a * 256 + (((b - a) * frac) >> (SINE_FRAC_BITS - 8));
+}
+
+/* v is bits wide; a 24-in-32 container carries it left-justified */
+static uint8_t *put_sample(uint8_t *p, uint32_t v, uint32_t bytes)
+{
+    if (bytes == 4) {
+        *p++ = 0;
+    }
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    if (bytes >= 3) {
+        p[2] = (uint8_t)((v >> 16) & 0xFF);
+        return p + 3;
+    }
+    return p + 2;
+}
+
+bool test_source_fill(uint8_t *pcm, uint32_t frames,
+                      const struct audio_stream_cfg *cfg)
+{
+    uint32_t req   = __atomic_load_n(&request, __ATOMIC_RELAXED);
+    uint32_t mode  = req >> REQ_MODE_SHIFT;
+    uint32_t bytes = cfg->subframe_bytes;
+    uint32_t bits  = cfg->bits;
+
+    if (mode == TEST_SRC_OFF) {
+        return false;
+    }
+
+    if (req != active_req || cfg->rate_hz != active_rate) {
+        active_req  = req;
+        active_rate = cfg->rate_hz;
+        step = (uint32_t)(((uint64_t)(req & REQ_FREQ_MASK) << 32) / cfg->rate_hz);
+    }
+
+    for (uint32_t i = 0; i < frames; i++) {
+        uint32_t v;
+
+        switch (mode) {
+        case TEST_SRC_SINE:
+            v = (uint32_t)nco_sine(phase);
+            if (bits == 16) {
+                v = (uint32_t)((int32_t)v >> 8);
+            }
+            break;
+        case TEST_SRC_RAMP:
+            v = phase >> (32 - bits);
+            break;
+        default:
+            v = counter;
+            break;
+        }
+        phase += step;
+
+        for (uint32_t ch = 0; ch < AUDIO_NUM_CHANNELS; ch++) {
+            uint32_t out = v;
+
+            if (mode == TEST_SRC_COUNTER && ch > 0) {
+                out = (ch == 1) ? seq : counter + ch;
+            }
+            pcm = put_sample(pcm, out, bytes);
+        }
+        counter++;
+    }
+    seq++;
+
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_format.h"
+
+/*
+ * Deterministic test sources that replace the microphone.
+ *
+ * A source fills whole blocks from the capture DMA interrupt, so the
+ * stream keeps the real audio clock and goes through the ring, rate
+ * matching and packetizer like mic data. Gain and DSP are bypassed to
+ * keep the output bit-exact.
+ *
+ *   SINE     1024-entry LUT, 32-bit phase accumulator, linear
+ *            interpolation; -1 dBFS
+ *   RAMP     full-scale sawtooth from the same phase accumulator
+ *   COUNTER  ch 0: running sample counter; ch 1: block (1 ms) sequence
+ *            number; ch n >= 2: counter + n. Wraps at the sample width.
+ *
+ * The host side (stream_check.c) checks captures of each mode.
+ */
+
+enum test_source_mode {
+    TEST_SRC_OFF = 0,
+    TEST_SRC_SINE,
+    TEST_SRC_RAMP,
+    TEST_SRC_COUNTER,
+    TEST_SRC_NUM_MODES
+};
+
+#define TEST_SRC_DEFAULT_HZ  1000
+
+/* Control side: select a mode (freq_hz for SINE and RAMP, 0 = default) */
+bool test_source_select(enum test_source_mode mode, uint32_t freq_hz);
+
+/* Producer side: restart phase and counters (capture start) */
+void test_source_restart(void);
+
+/* Producer side: fill frames of wire-format PCM; false when OFF */
+bool test_source_fill(uint8_t *pcm, uint32_t frames,
+                      const struct audio_stream_cfg *cfg);
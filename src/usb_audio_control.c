@@ -0,0 +1,70 @@
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/usbstd.h>
+
+#include "usb_descriptors.h"
+#include "usb_audio_control.h"
+#include "audio_requests.h"
+
+static enum usbd_request_return_codes to_usbd(enum audio_req_result r)
+{
+    switch (r) {
+    case AUDIO_REQ_HANDLED: return USBD_REQ_HANDLED;
+    case AUDIO_REQ_STALL:   return USBD_REQ_NOTSUPP;
+    default:                return USBD_REQ_NEXT_CALLBACK;
+    }
+}
+
+static struct audio_req from_setup(const struct usb_setup_data *req)
+{
+    struct audio_req r = {
+        .bmRequestType = req->bmRequestType,
+        .bRequest      = req->bRequest,
+        .wValue        = req->wValue,
+    };
+    return r;
+}
+
+/* AudioControl interface: entity ID in the wIndex high byte */
+static enum usbd_request_return_codes
+audio_iface_control(usbd_device *dev, struct usb_setup_data *req,
+                    uint8_t **buf, uint16_t *len,
+                    usbd_control_complete_callback *complete)
+{
+    (void)dev;
+    (void)complete;
+
+    if ((req->wIndex & 0xFF) != IFACE_AUDIO_CONTROL) {
+        return USBD_REQ_NEXT_CALLBACK;
+    }
+
+    struct audio_req r = from_setup(req);
+    return to_usbd(audio_req_entity(&r, (uint8_t)(req->wIndex >> 8), *buf, len));
+}
+
+static enum usbd_request_return_codes
+audio_ep_control(usbd_device *dev, struct usb_setup_data *req,
+                 uint8_t **buf, uint16_t *len,
+                 usbd_control_complete_callback *complete)
+{
+    (void)dev;
+    (void)complete;
+
+    if ((req->wIndex & 0xFF) != EP_AUDIO_IN) {
+        return USBD_REQ_NEXT_CALLBACK;
+    }
+
+    struct audio_req r = from_setup(req);
+    return to_usbd(audio_req_endpoint(&r, *buf, len));
+}
+
+void audio_control_register(usbd_device *dev)
+{
+    usbd_register_control_callback(dev,
+                                   USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+                                   USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+                                   audio_iface_control);
+    usbd_register_control_callback(dev,
+                                   USB_REQ_TYPE_CLASS | USB_REQ_TYPE_ENDPOINT,
+                                   USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+                                   audio_ep_control);
+}
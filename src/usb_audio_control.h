@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <libopencm3/usb/usbd.h>
+
+/*
+ * Audio class control requests: routes class requests for the
+ * AudioControl interface and the streaming endpoint to
+ * audio_requests.h, which holds the UAC1 / UAC2 semantics.
+ *
+ * UAC1: SET_CUR / GET_CUR sampling frequency on EP_AUDIO_IN.
+ * UAC2: CUR / RANGE sampling frequency on the clock source.
+ * Both: Feature Unit mute and volume on the master channel and on each
+ * logical channel, applied as capture gain (see audio_gain.h).
+ */
+
+/* Register class request handlers; call from the set-config callback */
+void audio_control_register(usbd_device *dev);
@@ -4,7 +4,7 @@
 
 /*
  * Minimal USB Audio Class 1.0 (UAC1) definitions for
- * a simple mono microphone (Type I PCM).
+ * a simple microphone / mic array (Type I PCM).
  *
  * Project-local, avoids pulling in libopencm3's usb/audio.h
  * to prevent name clashes.
@@ -69,6 +69,10 @@
 #define USB_AUDIO_TERMINAL_IN_UNDEFINED   0x0200
 #define USB_AUDIO_TERMINAL_MICROPHONE     0x0201
 
+/* Spatial locations for wChannelConfig */
+#define USB_AUDIO_CHAN_LEFT_FRONT         (1 << 0)
+#define USB_AUDIO_CHAN_RIGHT_FRONT        (1 << 1)
+
 /* Output terminals (0x0300) */
 #define USB_AUDIO_TERMINAL_OUT_UNDEFINED  0x0300
 #define USB_AUDIO_TERMINAL_SPEAKER        0x0301
@@ -83,6 +87,45 @@
 #define USB_AUDIO_SUBTYPE_EP_UNDEFINED    0x00
 #define USB_AUDIO_SUBTYPE_EP_GENERAL      0x01
 
+/* CS endpoint bmAttributes */
+#define USB_AUDIO_EP_SAMPLING_FREQ        (1 << 0)
+#define USB_AUDIO_EP_PITCH                (1 << 1)
+#define USB_AUDIO_EP_MAX_PACKETS_ONLY     (1 << 7)
+
+/* -------------------------------------------------------------------------- */
+/* Class-specific descriptor sizes                                            */
+/* -------------------------------------------------------------------------- */
+#define USB_AUDIO_AC_HEADER_SIZE(n_ifaces)     (8 + (n_ifaces))
+#define USB_AUDIO_INPUT_TERMINAL_SIZE          12
+#define USB_AUDIO_OUTPUT_TERMINAL_SIZE         9
+#define USB_AUDIO_FEATURE_UNIT_SIZE(nch, csz)  (7 + ((nch) + 1) * (csz))
+#define USB_AUDIO_AS_GENERAL_SIZE              7
+#define USB_AUDIO_FORMAT_TYPE_I_SIZE(n_freqs)  (8 + 3 * (n_freqs))
+#define USB_AUDIO_CS_ENDPOINT_SIZE             7
+
+/* -------------------------------------------------------------------------- */
+/* Class-specific requests                                                    */
+/* -------------------------------------------------------------------------- */
+#define USB_AUDIO_REQ_SET_CUR             0x01
+#define USB_AUDIO_REQ_SET_MIN             0x02
+#define USB_AUDIO_REQ_SET_MAX             0x03
+#define USB_AUDIO_REQ_SET_RES             0x04
+#define USB_AUDIO_REQ_GET_CUR             0x81
+#define USB_AUDIO_REQ_GET_MIN             0x82
+#define USB_AUDIO_REQ_GET_MAX             0x83
+#define USB_AUDIO_REQ_GET_RES             0x84
+
+/* Feature Unit control selectors (wValue high byte, channel in low byte) */
+#define USB_AUDIO_FU_CS_MUTE              0x01
+#define USB_AUDIO_FU_CS_VOLUME            0x02
+
+/* Volume is signed 1/256 dB; this value means -infinity */
+#define USB_AUDIO_VOLUME_SILENCE          ((int16_t)0x8000)
+
+/* Endpoint control selectors (wValue high byte) */
+#define USB_AUDIO_EP_CS_SAMPLING_FREQ     0x01
+#define USB_AUDIO_EP_CS_PITCH             0x02
+
 /* -------------------------------------------------------------------------- */
 /* Device class code                                                          */
 /* -------------------------------------------------------------------------- */
@@ -99,16 +142,118 @@
 #define AUDIO_INPUT_TERM_ID    0x01  /* Microphone IT */
 #define AUDIO_FEATURE_UNIT_ID  0x02  /* Feature Unit   */
 #define AUDIO_OUTPUT_TERM_ID   0x03  /* USB Streaming OT */
+#define AUDIO_CLOCK_SOURCE_ID  0x04  /* UAC2 only: sampling clock */
+#define AUDIO_SPK_INPUT_TERM_ID   0x05  /* Headset: USB Streaming IT */
+#define AUDIO_SPK_OUTPUT_TERM_ID  0x06  /* Headset: Speaker OT */
 
 /* -------------------------------------------------------------------------- */
 /* Audio format parameters                                                    */
 /* -------------------------------------------------------------------------- */
 
-/* 48 kHz / mono / 16-bit mic */
-#define AUDIO_SAMPLE_RATE_HZ        48000
+/*
+ * Build with -DAUDIO_UAC2=1 for the USB Audio Class 2.0 personality
+ * (full speed, clock source entity, 24-in-32 containers); see
+ * usb_audio_uac2.h. UAC1 is the default.
+ */
+#ifndef AUDIO_UAC2
+#define AUDIO_UAC2 0
+#endif
+
+/* Build with -DAUDIO_MIC_PDM=1 for a PDM mic (I2S2 CK = PDM clock, SD = data) */
+#ifndef AUDIO_MIC_PDM
+#define AUDIO_MIC_PDM 0
+#endif
+
+/*
+ * Build with -DAUDIO_HEADSET=1 to add a stereo speaker: an isochronous
+ * OUT stream with an explicit feedback endpoint, played on I2S3
+ * (audio_playback.h). UAC1 and one mic pair at most: I2S3 is the second
+ * capture lane of the arrays.
+ */
+#ifndef AUDIO_HEADSET
+#define AUDIO_HEADSET 0
+#endif
+
+/*
+ * Channel count: 1 (mono mic) or a 2/4/8-mic array, -DAUDIO_NUM_CHANNELS=n.
+ * Mics are captured in L/R pairs, one I2S lane per pair.
+ */
+#ifndef AUDIO_NUM_CHANNELS
 #define AUDIO_NUM_CHANNELS          1
+#endif
+
+#if AUDIO_NUM_CHANNELS != 1 && AUDIO_NUM_CHANNELS != 2 && \
+    AUDIO_NUM_CHANNELS != 4 && AUDIO_NUM_CHANNELS != 8
+#error "AUDIO_NUM_CHANNELS must be 1, 2, 4 or 8"
+#endif
+
+#if AUDIO_MIC_PDM && AUDIO_NUM_CHANNELS != 1
+#error "PDM capture is mono only"
+#endif
+
+#if AUDIO_HEADSET && AUDIO_UAC2
+#error "the headset personality is UAC1 only"
+#endif
+
+#if AUDIO_HEADSET && AUDIO_NUM_CHANNELS > 2
+#error "the headset speaker needs I2S3, the second lane of a mic array"
+#endif
+
+/* Stereo pair as L/R; mono and arrays carry no loudspeaker positions */
+#if AUDIO_NUM_CHANNELS == 2
+#define AUDIO_CHANNEL_CONFIG  (USB_AUDIO_CHAN_LEFT_FRONT | USB_AUDIO_CHAN_RIGHT_FRONT)
+#else
+#define AUDIO_CHANNEL_CONFIG  0x0000
+#endif
+
+/* Default format: 48 kHz / 16-bit (see audio_format.h for all) */
+#define AUDIO_SAMPLE_RATE_HZ        48000
 #define AUDIO_BITS_PER_SAMPLE       16
 #define AUDIO_BYTES_PER_SAMPLE      (AUDIO_BITS_PER_SAMPLE / 8)
 
 /* Packet size for 1ms USB frames: Fs * channels * bytes_per_sample / 1000 */
 #define AUDIO_PACKET_SIZE  ((AUDIO_SAMPLE_RATE_HZ * AUDIO_NUM_CHANNELS * AUDIO_BYTES_PER_SAMPLE) / 1000)
+
+/*
+ * Largest format in the table, sizes every buffer on the audio path.
+ * Full-speed iso caps a packet at 1023 bytes, which rules out 96 kHz
+ * above 2 channels and 24-bit at 8 channels. UAC2 adds 24-in-32.
+ */
+#if AUDIO_UAC2
+#define AUDIO_WIDE_BYTES_PER_SAMPLE 4
+#else
+#define AUDIO_WIDE_BYTES_PER_SAMPLE 3
+#endif
+
+#if AUDIO_MIC_PDM || AUDIO_HEADSET || AUDIO_NUM_CHANNELS == 8
+#define AUDIO_MAX_SAMPLE_RATE_HZ    48000
+#define AUDIO_MAX_BYTES_PER_SAMPLE  2
+#elif AUDIO_NUM_CHANNELS == 4
+#define AUDIO_MAX_SAMPLE_RATE_HZ    48000
+#define AUDIO_MAX_BYTES_PER_SAMPLE  AUDIO_WIDE_BYTES_PER_SAMPLE
+#else
+#define AUDIO_MAX_SAMPLE_RATE_HZ    96000
+#define AUDIO_MAX_BYTES_PER_SAMPLE  AUDIO_WIDE_BYTES_PER_SAMPLE
+#endif
+
+/* Async rate matching sends nominal +-1 samples per frame */
+#define AUDIO_MAX_SAMPLES_PER_FRAME (AUDIO_MAX_SAMPLE_RATE_HZ / 1000)
+#define AUDIO_MAX_FRAME_BYTES       (AUDIO_NUM_CHANNELS * AUDIO_MAX_BYTES_PER_SAMPLE)
+#define AUDIO_MAX_PACKET_SIZE       ((AUDIO_MAX_SAMPLES_PER_FRAME + 1) * AUDIO_MAX_FRAME_BYTES)
+
+/*
+ * Headset speaker: 48 kHz / 16-bit stereo only, so the mics share its
+ * PLLI2S setting. Async: the host sends nominal, or one more sample when
+ * the feedback asks for it.
+ */
+#define AUDIO_SPK_CHANNELS          2
+#define AUDIO_SPK_RATE_HZ           48000
+#define AUDIO_SPK_BITS_PER_SAMPLE   16
+#define AUDIO_SPK_BYTES_PER_SAMPLE  (AUDIO_SPK_BITS_PER_SAMPLE / 8)
+#define AUDIO_SPK_CHANNEL_CONFIG    (USB_AUDIO_CHAN_LEFT_FRONT | USB_AUDIO_CHAN_RIGHT_FRONT)
+#define AUDIO_SPK_SAMPLES_PER_FRAME (AUDIO_SPK_RATE_HZ / 1000)
+#define AUDIO_SPK_FRAME_BYTES       (AUDIO_SPK_CHANNELS * AUDIO_SPK_BYTES_PER_SAMPLE)
+#define AUDIO_SPK_MAX_PACKET_SIZE   ((AUDIO_SPK_SAMPLES_PER_FRAME + 1) * AUDIO_SPK_FRAME_BYTES)
+
+/* Feedback endpoint payload: 10.14 samples per frame, 3 bytes at full speed */
+#define AUDIO_FEEDBACK_SIZE         3
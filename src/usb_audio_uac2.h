@@ -0,0 +1,75 @@
+#pragma once
+
+#include "usb_audio_uac1.h"
+
+/*
+ * USB Audio Class 2.0 (UAC2) additions for the full-speed personality
+ * (-DAUDIO_UAC2=1). Descriptor types, subclass codes and Type I / PCM
+ * codes carry over from UAC1; only what differs or is new lives here.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* Function / interface protocol                                              */
+/* -------------------------------------------------------------------------- */
+#define USB_AUDIO_FUNCTION_SUBCLASS_UNDEFINED  0x00
+#define USB_AUDIO_PROTOCOL_IP_2_00             0x20
+#define USB_AUDIO_BCD_VERSION_2_00             0x0200
+
+/* Audio Function Category (AC header bCategory) */
+#define USB_AUDIO_CATEGORY_MICROPHONE          0x03
+
+/* IAD on a composite-style device: Miscellaneous / Common / IAD */
+#define USB_CLASS_MISCELLANEOUS                0xEF
+#define USB_MISC_SUBCLASS_COMMON               0x02
+#define USB_MISC_PROTOCOL_IAD                  0x01
+
+/* -------------------------------------------------------------------------- */
+/* AudioControl descriptor subtypes (new in UAC2)                             */
+/* -------------------------------------------------------------------------- */
+#define USB_AUDIO2_SUBTYPE_AC_CLOCK_SOURCE     0x0A
+
+/* Clock Source bmAttributes */
+#define USB_AUDIO2_CLOCK_INTERNAL_PROGRAMMABLE 0x03
+
+/* -------------------------------------------------------------------------- */
+/* bmControls: two bits per control, 01 = read-only, 11 = host programmable   */
+/* -------------------------------------------------------------------------- */
+#define USB_AUDIO2_CTRL_RO                     0x1
+#define USB_AUDIO2_CTRL_RW                     0x3
+#define USB_AUDIO2_CTRL(n, access)             ((access) << (2 * (n)))
+
+/* Clock Source: frequency (0), validity (1) */
+#define USB_AUDIO2_CLOCK_FREQ_CONTROL(a)       USB_AUDIO2_CTRL(0, a)
+#define USB_AUDIO2_CLOCK_VALID_CONTROL(a)      USB_AUDIO2_CTRL(1, a)
+
+/* Feature Unit: mute (0), volume (1) */
+#define USB_AUDIO2_FU_MUTE_CONTROL(a)          USB_AUDIO2_CTRL(0, a)
+#define USB_AUDIO2_FU_VOLUME_CONTROL(a)        USB_AUDIO2_CTRL(1, a)
+
+/* AS General bmFormats for Type I */
+#define USB_AUDIO2_FORMAT_I_PCM                (1u << 0)
+
+/* -------------------------------------------------------------------------- */
+/* Class-specific descriptor sizes                                            */
+/* -------------------------------------------------------------------------- */
+#define USB_AUDIO2_AC_HEADER_SIZE              9
+#define USB_AUDIO2_CLOCK_SOURCE_SIZE           8
+#define USB_AUDIO2_INPUT_TERMINAL_SIZE         17
+#define USB_AUDIO2_OUTPUT_TERMINAL_SIZE        12
+#define USB_AUDIO2_FEATURE_UNIT_SIZE(nch)      (6 + ((nch) + 1) * 4)
+#define USB_AUDIO2_AS_GENERAL_SIZE             16
+#define USB_AUDIO2_FORMAT_TYPE_I_SIZE          6
+#define USB_AUDIO2_CS_ENDPOINT_SIZE            8
+
+/* -------------------------------------------------------------------------- */
+/* Class-specific requests: direction comes from bmRequestType                */
+/* -------------------------------------------------------------------------- */
+#define USB_AUDIO2_REQ_CUR                     0x01
+#define USB_AUDIO2_REQ_RANGE                   0x02
+
+/* Clock Source control selectors */
+#define USB_AUDIO2_CS_SAM_FREQ                 0x01
+#define USB_AUDIO2_CS_CLOCK_VALID              0x02
+
+/* RANGE parameter blocks: wNumSubRanges then (MIN, MAX, RES) triplets */
+#define USB_AUDIO2_RANGE_SIZE(n, width)        (2 + 3 * (n) * (width))
@@ -1,22 +1,38 @@
 #include <stddef.h>
 #include <stdbool.h>
-#include <math.h>
 
-#include <libopencm3/stm32/gpio.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/usbstd.h>
+#include <libopencm3/usb/dwc/otg_fs.h>
 
 
 #include <libopencm3/stm32/desig.h> // For getting device uniq id -> usb serial
 
-#include "usb_audio_uac1.h"
+#include "usb_audio_uac2.h"
+#include "audio_format.h"
 #include "usb_descriptors.h"
+#include "audio_stream.h"
+#include "usb_audio_control.h"
+#include "audio_requests.h"
+#include "usb_vendor.h"
+#include "usb_tap.h"
+#include "usb_speaker.h"
+#include "stream_power.h"
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
+static uint8_t audio_stream_cur_altsetting = 0;
+#if AUDIO_HEADSET
+static uint8_t audio_spk_cur_altsetting = 0;
 #endif
 
-static uint8_t audio_stream_cur_altsetting = 0;
+#define AUDIO_LE16(v)  ((v) & 0xFF), (((v) >> 8) & 0xFF)
+#define AUDIO_LE32(v)  AUDIO_LE16(v), AUDIO_LE16((v) >> 16)
+
+/* AC / AS interface protocol: UAC1 has none, UAC2 is IP_VERSION_02_00 */
+#if AUDIO_UAC2
+#define AUDIO_IF_PROTOCOL  USB_AUDIO_PROTOCOL_IP_2_00
+#else
+#define AUDIO_IF_PROTOCOL  0
+#endif
 
 /* -------------------------------------------------------------------------- */
 /* DEVICE DESCRIPTOR                                                          */
@@ -26,9 +42,15 @@ const struct usb_device_descriptor dev_descriptor = {
     .bLength            = USB_DT_DEVICE_SIZE,
     .bDescriptorType    = USB_DT_DEVICE,
     .bcdUSB             = 0x0200,
+#if AUDIO_UAC2
+    .bDeviceClass       = USB_CLASS_MISCELLANEOUS,  /* function in an IAD */
+    .bDeviceSubClass    = USB_MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol    = USB_MISC_PROTOCOL_IAD,
+#else
     .bDeviceClass       = 0,      /* class at interface level */
     .bDeviceSubClass    = 0,
     .bDeviceProtocol    = 0,
+#endif
     .bMaxPacketSize0    = 64,
     .idVendor           = 0x1209, /* pid.codes community VID */
     .idProduct          = 0x0002, /* your PID */
@@ -43,91 +65,258 @@ const struct usb_device_descriptor dev_descriptor = {
 /* AUDIO CONTROL (AC) CLASS-SPECIFIC BLOCK                                    */
 /* -------------------------------------------------------------------------- */
 
+/* Feature Unit controls: master (channel 0) and each logical channel */
+#define AUDIO_FU_BMA_1(...)  __VA_ARGS__
+#define AUDIO_FU_BMA_2(...)  __VA_ARGS__, __VA_ARGS__
+#define AUDIO_FU_BMA_4(...)  AUDIO_FU_BMA_2(__VA_ARGS__), AUDIO_FU_BMA_2(__VA_ARGS__)
+#define AUDIO_FU_BMA_8(...)  AUDIO_FU_BMA_4(__VA_ARGS__), AUDIO_FU_BMA_4(__VA_ARGS__)
+#define AUDIO_FU_BMA_CHANNELS(...) \
+    AUDIO_CAT(AUDIO_FU_BMA_, AUDIO_NUM_CHANNELS)(__VA_ARGS__)
+
+#if AUDIO_UAC2
+
+#define AUDIO_FU_MASTER_CONTROLS                         \
+    (USB_AUDIO2_FU_MUTE_CONTROL(USB_AUDIO2_CTRL_RW) |    \
+     USB_AUDIO2_FU_VOLUME_CONTROL(USB_AUDIO2_CTRL_RW))
+#define AUDIO_FU_CHANNEL_CONTROLS  AUDIO_FU_MASTER_CONTROLS
+
+#define AUDIO_AC_FU_SIZE \
+    USB_AUDIO2_FEATURE_UNIT_SIZE(AUDIO_NUM_CHANNELS)
+
+#define AUDIO_AC_TOTAL_SIZE                 \
+    (USB_AUDIO2_AC_HEADER_SIZE +            \
+     USB_AUDIO2_CLOCK_SOURCE_SIZE +         \
+     USB_AUDIO2_INPUT_TERMINAL_SIZE +       \
+     AUDIO_AC_FU_SIZE +                     \
+     USB_AUDIO2_OUTPUT_TERMINAL_SIZE)
+
+static const uint8_t audio_ac_cs[] = {
+    /* Class-specific AC Interface Header */
+    USB_AUDIO2_AC_HEADER_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_HEADER,
+    AUDIO_LE16(USB_AUDIO_BCD_VERSION_2_00),  /* bcdADC */
+    USB_AUDIO_CATEGORY_MICROPHONE,           /* bCategory */
+    AUDIO_LE16(AUDIO_AC_TOTAL_SIZE),         /* wTotalLength */
+    0x00,            /* bmControls: no latency control */
+
+    /* Clock Source: internal, rate set by the host, validity read-only */
+    USB_AUDIO2_CLOCK_SOURCE_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO2_SUBTYPE_AC_CLOCK_SOURCE,
+    AUDIO_CLOCK_SOURCE_ID,
+    USB_AUDIO2_CLOCK_INTERNAL_PROGRAMMABLE,
+    USB_AUDIO2_CLOCK_FREQ_CONTROL(USB_AUDIO2_CTRL_RW) |
+        USB_AUDIO2_CLOCK_VALID_CONTROL(USB_AUDIO2_CTRL_RO),
+    0x00,            /* bAssocTerminal */
+    0x00,            /* iClockSource */
+
+    /* Input Terminal (Microphone) */
+    USB_AUDIO2_INPUT_TERMINAL_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_INPUT_TERMINAL,
+    AUDIO_INPUT_TERM_ID,
+    AUDIO_LE16(USB_AUDIO_TERMINAL_MICROPHONE),
+    0x00,            /* bAssocTerminal */
+    AUDIO_CLOCK_SOURCE_ID,              /* bCSourceID */
+    AUDIO_NUM_CHANNELS,                 /* bNrChannels */
+    AUDIO_LE32(AUDIO_CHANNEL_CONFIG),   /* bmChannelConfig */
+    0x00,            /* iChannelNames */
+    AUDIO_LE16(0),   /* bmControls */
+    0x00,            /* iTerminal */
+
+    /* Feature Unit */
+    AUDIO_AC_FU_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_FEATURE_UNIT,
+    AUDIO_FEATURE_UNIT_ID,
+    AUDIO_INPUT_TERM_ID,
+    AUDIO_LE32(AUDIO_FU_MASTER_CONTROLS),                          /* bmaControls(0) */
+    AUDIO_FU_BMA_CHANNELS(AUDIO_LE32(AUDIO_FU_CHANNEL_CONTROLS)),  /* bmaControls(1..n) */
+    0x00,            /* iFeature */
+
+    /* Output Terminal (USB Streaming) */
+    USB_AUDIO2_OUTPUT_TERMINAL_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_OUTPUT_TERMINAL,
+    AUDIO_OUTPUT_TERM_ID,
+    AUDIO_LE16(USB_AUDIO_TERMINAL_STREAMING),
+    0x00,            /* bAssocTerminal */
+    AUDIO_FEATURE_UNIT_ID,
+    AUDIO_CLOCK_SOURCE_ID,              /* bCSourceID */
+    AUDIO_LE16(0),   /* bmControls */
+    0x00             /* iTerminal */
+};
+
+#else
+
+#define AUDIO_FU_MASTER_CONTROLS   (USB_AUDIO_FU_MUTE | USB_AUDIO_FU_VOLUME)
+#define AUDIO_FU_CHANNEL_CONTROLS  AUDIO_FU_MASTER_CONTROLS
+#define AUDIO_AC_FU_SIZE \
+    USB_AUDIO_FEATURE_UNIT_SIZE(AUDIO_NUM_CHANNELS, 1)
+
+/* Headset: a second streaming interface and the speaker chain */
+#define AUDIO_AC_NUM_STREAMS  (1 + AUDIO_HEADSET)
+
+#define AUDIO_AC_TOTAL_SIZE                               \
+    (USB_AUDIO_AC_HEADER_SIZE(AUDIO_AC_NUM_STREAMS) +     \
+     USB_AUDIO_INPUT_TERMINAL_SIZE +                      \
+     AUDIO_AC_FU_SIZE +                                   \
+     USB_AUDIO_OUTPUT_TERMINAL_SIZE +                     \
+     AUDIO_HEADSET * (USB_AUDIO_INPUT_TERMINAL_SIZE +     \
+                      USB_AUDIO_OUTPUT_TERMINAL_SIZE))
+
 static const uint8_t audio_ac_cs[] = {
     /* Class-specific AC Interface Header */
-    9,  USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_HEADER,
+    USB_AUDIO_AC_HEADER_SIZE(AUDIO_AC_NUM_STREAMS), USB_DT_CS_INTERFACE,
+    USB_AUDIO_SUBTYPE_AC_HEADER,
     (USB_AUDIO_BCD_VERSION_1_00 & 0xFF),
     (USB_AUDIO_BCD_VERSION_1_00 >> 8),
-    0x27, 0x00,      /* wTotalLength = 39 bytes */
-    0x01,            /* bInCollection = 1 streaming IF */
+    (AUDIO_AC_TOTAL_SIZE & 0xFF),
+    (AUDIO_AC_TOTAL_SIZE >> 8),     /* wTotalLength */
+    AUDIO_AC_NUM_STREAMS,           /* bInCollection */
     IFACE_AUDIO_STREAM,
+#if AUDIO_HEADSET
+    IFACE_AUDIO_SPEAKER,
+#endif
 
     /* Input Terminal (Microphone) */
-    12, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_INPUT_TERMINAL,
+    USB_AUDIO_INPUT_TERMINAL_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_INPUT_TERMINAL,
     AUDIO_INPUT_TERM_ID,
     (USB_AUDIO_TERMINAL_MICROPHONE & 0xFF),
     (USB_AUDIO_TERMINAL_MICROPHONE >> 8),
     0x00,            /* bAssocTerminal */
-    0x01,            /* bNrChannels = 1 */
-    0x00, 0x00,      /* wChannelConfig = mono */
+    AUDIO_NUM_CHANNELS,  /* bNrChannels */
+    (AUDIO_CHANNEL_CONFIG & 0xFF),
+    (AUDIO_CHANNEL_CONFIG >> 8),    /* wChannelConfig */
     0x00,            /* iChannelNames */
     0x00,            /* iTerminal */
 
-    /* Feature Unit (no controls exposed) */
-    9,  USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_FEATURE_UNIT,
+    /* Feature Unit */
+    AUDIO_AC_FU_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_FEATURE_UNIT,
     AUDIO_FEATURE_UNIT_ID,
     AUDIO_INPUT_TERM_ID,
     0x01,            /* bControlSize = 1 byte */
-    0x00,            /* bmaControls(0) */
-    0x00,            /* bmaControls(1) */
+    AUDIO_FU_MASTER_CONTROLS,                          /* bmaControls(0) */
+    AUDIO_FU_BMA_CHANNELS(AUDIO_FU_CHANNEL_CONTROLS),  /* bmaControls(1..n) */
     0x00,            /* iFeature */
 
     /* Output Terminal (USB Streaming) */
-    9,  USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_OUTPUT_TERMINAL,
+    USB_AUDIO_OUTPUT_TERMINAL_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_OUTPUT_TERMINAL,
     AUDIO_OUTPUT_TERM_ID,
     (USB_AUDIO_TERMINAL_STREAMING & 0xFF),
     (USB_AUDIO_TERMINAL_STREAMING >> 8),
     0x00,            /* bAssocTerminal */
     AUDIO_FEATURE_UNIT_ID,
-    0x00             /* iTerminal */
+    0x00,            /* iTerminal */
+#if AUDIO_HEADSET
+
+    /* Input Terminal (USB Streaming, speaker data from the host) */
+    USB_AUDIO_INPUT_TERMINAL_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_INPUT_TERMINAL,
+    AUDIO_SPK_INPUT_TERM_ID,
+    (USB_AUDIO_TERMINAL_STREAMING & 0xFF),
+    (USB_AUDIO_TERMINAL_STREAMING >> 8),
+    0x00,            /* bAssocTerminal */
+    AUDIO_SPK_CHANNELS,             /* bNrChannels */
+    (AUDIO_SPK_CHANNEL_CONFIG & 0xFF),
+    (AUDIO_SPK_CHANNEL_CONFIG >> 8), /* wChannelConfig */
+    0x00,            /* iChannelNames */
+    0x00,            /* iTerminal */
+
+    /* Output Terminal (Speaker) */
+    USB_AUDIO_OUTPUT_TERMINAL_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AC_OUTPUT_TERMINAL,
+    AUDIO_SPK_OUTPUT_TERM_ID,
+    (USB_AUDIO_TERMINAL_SPEAKER & 0xFF),
+    (USB_AUDIO_TERMINAL_SPEAKER >> 8),
+    0x00,            /* bAssocTerminal */
+    AUDIO_SPK_INPUT_TERM_ID,        /* bSourceID */
+    0x00,            /* iTerminal */
+#endif
 };
 
+#endif
+
+_Static_assert(sizeof(audio_ac_cs) == AUDIO_AC_TOTAL_SIZE,
+               "AC wTotalLength out of sync with descriptor");
+
 /* -------------------------------------------------------------------------- */
-/* AUDIO STREAMING (AS) ALT 1: GENERAL + FORMAT                               */
+/* AUDIO STREAMING (AS) ALT 1..N: GENERAL + FORMAT, from AUDIO_FORMAT_TABLE   */
 /* -------------------------------------------------------------------------- */
 
-static const uint8_t audio_as_alt1_cs[] = {
-    /* AS General */
-    7,  USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AS_GENERAL,
-    AUDIO_OUTPUT_TERM_ID,        /* bTerminalLink */
-    0x00,                        /* bDelay */
-    (USB_AUDIO_FORMAT_I_PCM & 0xFF),
-    (USB_AUDIO_FORMAT_I_PCM >> 8),
+#if AUDIO_UAC2
+
+/* Rates come from the clock source; the alt carries only the subslot */
+#define AUDIO_AS_CS(alt, bytes, bits, capture, ...)                         \
+static const uint8_t audio_as_alt##alt##_cs[] = {                           \
+    /* AS General */                                                        \
+    USB_AUDIO2_AS_GENERAL_SIZE, USB_DT_CS_INTERFACE,                        \
+    USB_AUDIO_SUBTYPE_AS_GENERAL,                                           \
+    AUDIO_OUTPUT_TERM_ID,        /* bTerminalLink */                        \
+    0x00,                        /* bmControls */                           \
+    USB_AUDIO_FORMAT_TYPE_I,                                                \
+    AUDIO_LE32(USB_AUDIO2_FORMAT_I_PCM),  /* bmFormats */                   \
+    AUDIO_NUM_CHANNELS,                                                     \
+    AUDIO_LE32(AUDIO_CHANNEL_CONFIG),     /* bmChannelConfig */             \
+    0x00,                        /* iChannelNames */                        \
+                                                                            \
+    /* Type I Format Descriptor */                                          \
+    USB_AUDIO2_FORMAT_TYPE_I_SIZE,                                          \
+    USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AS_FORMAT_TYPE,                  \
+    USB_AUDIO_FORMAT_TYPE_I,                                                \
+    (bytes),                     /* bSubslotSize */                         \
+    (bits),                      /* bBitResolution */                       \
+};
 
-    /* Type I Format Descriptor */
-    11, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AS_FORMAT_TYPE,
-    USB_AUDIO_FORMAT_TYPE_I,
-    AUDIO_NUM_CHANNELS,
-    AUDIO_BYTES_PER_SAMPLE,
-    AUDIO_BITS_PER_SAMPLE,
-    0x01,                        /* bSamFreqType = 1 discrete frequency */
-    (AUDIO_SAMPLE_RATE_HZ & 0xFF),
-    (AUDIO_SAMPLE_RATE_HZ >> 8) & 0xFF,
-    (AUDIO_SAMPLE_RATE_HZ >> 16) & 0xFF
+#else
+
+#define AUDIO_AS_CS(alt, bytes, bits, capture, ...)                         \
+static const uint8_t audio_as_alt##alt##_cs[] = {                           \
+    /* AS General */                                                        \
+    USB_AUDIO_AS_GENERAL_SIZE, USB_DT_CS_INTERFACE,                         \
+    USB_AUDIO_SUBTYPE_AS_GENERAL,                                           \
+    AUDIO_OUTPUT_TERM_ID,        /* bTerminalLink */                        \
+    0x00,                        /* bDelay */                               \
+    (USB_AUDIO_FORMAT_I_PCM & 0xFF),                                        \
+    (USB_AUDIO_FORMAT_I_PCM >> 8),                                          \
+                                                                            \
+    /* Type I Format Descriptor, discrete frequencies */                    \
+    USB_AUDIO_FORMAT_TYPE_I_SIZE(AUDIO_NARG(__VA_ARGS__)),                  \
+    USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AS_FORMAT_TYPE,                  \
+    USB_AUDIO_FORMAT_TYPE_I,                                                \
+    AUDIO_NUM_CHANNELS,                                                     \
+    (bytes),                     /* bSubframeSize */                        \
+    (bits),                      /* bBitResolution */                       \
+    AUDIO_NARG(__VA_ARGS__),     /* bSamFreqType */                         \
+    AUDIO_SAMFREQS(__VA_ARGS__)                                             \
 };
 
+#endif
+AUDIO_FORMAT_TABLE(AUDIO_AS_CS)
+
 /* -------------------------------------------------------------------------- */
 /* ISOCHRONOUS ENDPOINT (DATA EP + CS EP)                                     */
 /* -------------------------------------------------------------------------- */
 
+#if AUDIO_UAC2
 static const uint8_t audio_cs_ep[] = {
-    7,  USB_DT_CS_ENDPOINT, USB_AUDIO_SUBTYPE_EP_GENERAL,
-    0x00, /* bmAttributes: no pitch, no freq control */
+    USB_AUDIO2_CS_ENDPOINT_SIZE, USB_DT_CS_ENDPOINT, USB_AUDIO_SUBTYPE_EP_GENERAL,
+    0x00, /* bmAttributes */
+    0x00, /* bmControls: no pitch, no overrun/underrun */
     0x00, /* bLockDelayUnits */
     0x00, 0x00 /* wLockDelay */
 };
+#else
+static const uint8_t audio_cs_ep[] = {
+    USB_AUDIO_CS_ENDPOINT_SIZE, USB_DT_CS_ENDPOINT, USB_AUDIO_SUBTYPE_EP_GENERAL,
+    USB_AUDIO_EP_SAMPLING_FREQ,  /* bmAttributes: freq control, no pitch */
+    0x00, /* bLockDelayUnits */
+    0x00, 0x00 /* wLockDelay */
+};
+#endif
 
-static const struct usb_endpoint_descriptor audio_iso_ep[] = { {
-    .bLength          = USB_DT_ENDPOINT_SIZE,
-    .bDescriptorType  = USB_DT_ENDPOINT,
-    .bEndpointAddress = EP_AUDIO_IN,     /* 0x81 */
-    .bmAttributes     = USB_ENDPOINT_ATTR_ISOCHRONOUS |
-                        USB_ENDPOINT_ATTR_ADAPTIVE,    /* isoc async data */
-    .wMaxPacketSize   = AUDIO_PACKET_SIZE,             /* 96 bytes */
-    .bInterval        = 1,
-    .extra            = audio_cs_ep,
-    .extralen         = sizeof(audio_cs_ep),
+#define AUDIO_AS_EP(alt, bytes, bits, capture, ...)                         \
+static const struct usb_endpoint_descriptor audio_iso_ep_alt##alt[] = { {   \
+    .bLength          = USB_DT_ENDPOINT_SIZE,                               \
+    .bDescriptorType  = USB_DT_ENDPOINT,                                    \
+    .bEndpointAddress = EP_AUDIO_IN,                                        \
+    .bmAttributes     = USB_ENDPOINT_ATTR_ISOCHRONOUS |                     \
+                        USB_ENDPOINT_ATTR_ASYNC,                            \
+    .wMaxPacketSize   = AUDIO_FORMAT_MAX_PACKET(bytes, AUDIO_LAST(__VA_ARGS__)), \
+    .bInterval        = 1,                                                  \
+    .extra            = audio_cs_ep,                                        \
+    .extralen         = sizeof(audio_cs_ep),                                \
 } };
+AUDIO_FORMAT_TABLE(AUDIO_AS_EP)
 
 /* -------------------------------------------------------------------------- */
 /* INTERFACES                                                                 */
@@ -141,13 +330,29 @@ static const struct usb_interface_descriptor audio_ac_iface[] = { {
     .bNumEndpoints       = 0,
     .bInterfaceClass     = USB_CLASS_AUDIO,
     .bInterfaceSubClass  = USB_AUDIO_SUBCLASS_AUDIOCONTROL,
-    .bInterfaceProtocol  = 0,
+    .bInterfaceProtocol  = AUDIO_IF_PROTOCOL,
     .iInterface          = 0,
     .endpoint            = NULL,
     .extra               = audio_ac_cs,
     .extralen            = sizeof(audio_ac_cs),
 } };
 
+#define AUDIO_AS_IFACE(alt, bytes, bits, capture, ...)                      \
+    {                                                                       \
+        .bLength         = USB_DT_INTERFACE_SIZE,                           \
+        .bDescriptorType = USB_DT_INTERFACE,                                \
+        .bInterfaceNumber    = IFACE_AUDIO_STREAM,                          \
+        .bAlternateSetting   = alt,                                         \
+        .bNumEndpoints       = 1,                                           \
+        .bInterfaceClass     = USB_CLASS_AUDIO,                             \
+        .bInterfaceSubClass  = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,           \
+        .bInterfaceProtocol  = AUDIO_IF_PROTOCOL,                           \
+        .iInterface          = 0,                                           \
+        .endpoint            = audio_iso_ep_alt##alt,                       \
+        .extra               = audio_as_alt##alt##_cs,                      \
+        .extralen            = sizeof(audio_as_alt##alt##_cs),              \
+    },
+
 static const struct usb_interface_descriptor audio_as_iface[] = {
     {   /* Alt 0: zero bandwidth */
         .bLength         = USB_DT_INTERFACE_SIZE,
@@ -157,38 +362,167 @@ static const struct usb_interface_descriptor audio_as_iface[] = {
         .bNumEndpoints       = 0,
         .bInterfaceClass     = USB_CLASS_AUDIO,
         .bInterfaceSubClass  = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
-        .bInterfaceProtocol  = 0,
+        .bInterfaceProtocol  = AUDIO_IF_PROTOCOL,
+        .iInterface          = 0,
+        .endpoint            = NULL,
+        .extra               = NULL,
+        .extralen            = 0,
+    },
+    /* Alt 1..N: one per format table row */
+    AUDIO_FORMAT_TABLE(AUDIO_AS_IFACE)
+};
+
+#if AUDIO_HEADSET
+/* -------------------------------------------------------------------------- */
+/* SPEAKER AS INTERFACE: iso OUT + explicit feedback IN (usb_speaker.h)       */
+/* -------------------------------------------------------------------------- */
+
+static const uint8_t audio_spk_alt1_cs[] = {
+    /* AS General */
+    USB_AUDIO_AS_GENERAL_SIZE, USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AS_GENERAL,
+    AUDIO_SPK_INPUT_TERM_ID,        /* bTerminalLink */
+    0x00,                           /* bDelay */
+    (USB_AUDIO_FORMAT_I_PCM & 0xFF),
+    (USB_AUDIO_FORMAT_I_PCM >> 8),
+
+    /* Type I Format Descriptor, one frequency */
+    USB_AUDIO_FORMAT_TYPE_I_SIZE(1), USB_DT_CS_INTERFACE, USB_AUDIO_SUBTYPE_AS_FORMAT_TYPE,
+    USB_AUDIO_FORMAT_TYPE_I,
+    AUDIO_SPK_CHANNELS,
+    AUDIO_SPK_BYTES_PER_SAMPLE,     /* bSubframeSize */
+    AUDIO_SPK_BITS_PER_SAMPLE,      /* bBitResolution */
+    0x01,                           /* bSamFreqType */
+    AUDIO_SAMFREQ(AUDIO_SPK_RATE_HZ),
+};
+
+static const uint8_t audio_spk_cs_ep[] = {
+    USB_AUDIO_CS_ENDPOINT_SIZE, USB_DT_CS_ENDPOINT, USB_AUDIO_SUBTYPE_EP_GENERAL,
+    0x00, /* bmAttributes: fixed rate, no pitch */
+    0x00, /* bLockDelayUnits */
+    0x00, 0x00 /* wLockDelay */
+};
+
+/*
+ * Async data endpoint plus its feedback endpoint, which the host finds
+ * as the alt's second endpoint: libopencm3 only emits 7-byte endpoint
+ * descriptors, so there is no bSynchAddress / bRefresh to point at it.
+ */
+static const struct usb_endpoint_descriptor audio_spk_ep[] = { {
+    .bLength          = USB_DT_ENDPOINT_SIZE,
+    .bDescriptorType  = USB_DT_ENDPOINT,
+    .bEndpointAddress = EP_SPK_OUT,
+    .bmAttributes     = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
+    .wMaxPacketSize   = AUDIO_SPK_MAX_PACKET_SIZE,
+    .bInterval        = 1,
+    .extra            = audio_spk_cs_ep,
+    .extralen         = sizeof(audio_spk_cs_ep),
+}, {
+    .bLength          = USB_DT_ENDPOINT_SIZE,
+    .bDescriptorType  = USB_DT_ENDPOINT,
+    .bEndpointAddress = EP_SPK_FB,
+    .bmAttributes     = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_FEEDBACK,
+    .wMaxPacketSize   = AUDIO_FEEDBACK_SIZE,
+    .bInterval        = 1,
+} };
+
+static const struct usb_interface_descriptor audio_spk_iface[] = {
+    {   /* Alt 0: zero bandwidth */
+        .bLength         = USB_DT_INTERFACE_SIZE,
+        .bDescriptorType = USB_DT_INTERFACE,
+        .bInterfaceNumber    = IFACE_AUDIO_SPEAKER,
+        .bAlternateSetting   = 0,
+        .bNumEndpoints       = 0,
+        .bInterfaceClass     = USB_CLASS_AUDIO,
+        .bInterfaceSubClass  = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
+        .bInterfaceProtocol  = AUDIO_IF_PROTOCOL,
         .iInterface          = 0,
         .endpoint            = NULL,
         .extra               = NULL,
         .extralen            = 0,
     },
-    {   /* Alt 1: active streaming */
+    {   /* Alt 1: 48 kHz / 16-bit stereo */
         .bLength         = USB_DT_INTERFACE_SIZE,
         .bDescriptorType = USB_DT_INTERFACE,
-        .bInterfaceNumber    = IFACE_AUDIO_STREAM,
+        .bInterfaceNumber    = IFACE_AUDIO_SPEAKER,
         .bAlternateSetting   = 1,
-        .bNumEndpoints       = 1,
+        .bNumEndpoints       = 2,
         .bInterfaceClass     = USB_CLASS_AUDIO,
         .bInterfaceSubClass  = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
-        .bInterfaceProtocol  = 0,
+        .bInterfaceProtocol  = AUDIO_IF_PROTOCOL,
         .iInterface          = 0,
-        .endpoint            = audio_iso_ep,
-        .extra               = audio_as_alt1_cs,
-        .extralen            = sizeof(audio_as_alt1_cs),
-    }
+        .endpoint            = audio_spk_ep,
+        .extra               = audio_spk_alt1_cs,
+        .extralen            = sizeof(audio_spk_alt1_cs),
+    },
 };
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* VENDOR TAP INTERFACE (bulk IN, usb_tap.h)                                  */
+/* -------------------------------------------------------------------------- */
+
+static const struct usb_endpoint_descriptor tap_bulk_ep[] = { {
+    .bLength          = USB_DT_ENDPOINT_SIZE,
+    .bDescriptorType  = USB_DT_ENDPOINT,
+    .bEndpointAddress = EP_TAP_IN,
+    .bmAttributes     = USB_ENDPOINT_ATTR_BULK,
+    .wMaxPacketSize   = USB_TAP_PACKET_SIZE,
+    .bInterval        = 0,
+} };
+
+static const struct usb_interface_descriptor tap_iface[] = { {
+    .bLength         = USB_DT_INTERFACE_SIZE,
+    .bDescriptorType = USB_DT_INTERFACE,
+    .bInterfaceNumber    = IFACE_VENDOR_TAP,
+    .bAlternateSetting   = 0,
+    .bNumEndpoints       = 1,
+    .bInterfaceClass     = USB_CLASS_VENDOR,
+    .bInterfaceSubClass  = 0,
+    .bInterfaceProtocol  = 0,
+    .iInterface          = 0,
+    .endpoint            = tap_bulk_ep,
+    .extra               = NULL,
+    .extralen            = 0,
+} };
+
+#if AUDIO_UAC2
+/* Groups AC + AS into one audio function, required for UAC2 */
+static const struct usb_iface_assoc_descriptor audio_iad = {
+    .bLength           = USB_DT_INTERFACE_ASSOCIATION_SIZE,
+    .bDescriptorType   = USB_DT_INTERFACE_ASSOCIATION,
+    .bFirstInterface   = IFACE_AUDIO_CONTROL,
+    .bInterfaceCount   = 2,
+    .bFunctionClass    = USB_CLASS_AUDIO,
+    .bFunctionSubClass = USB_AUDIO_FUNCTION_SUBCLASS_UNDEFINED,
+    .bFunctionProtocol = USB_AUDIO_PROTOCOL_IP_2_00,
+    .iFunction         = 0,
+};
+#endif
 
 static const struct usb_interface interfaces[] = {
     {
         .num_altsetting = 1,
+#if AUDIO_UAC2
+        .iface_assoc    = &audio_iad,
+#endif
         .altsetting     = audio_ac_iface,
     },
     {
-        .num_altsetting = 2,
+        .num_altsetting = 1 + AUDIO_NUM_FORMATS,
         .altsetting     = audio_as_iface,
         .cur_altsetting = &audio_stream_cur_altsetting,   /* REQUIRED */
     },
+#if AUDIO_HEADSET
+    {
+        .num_altsetting = 2,
+        .altsetting     = audio_spk_iface,
+        .cur_altsetting = &audio_spk_cur_altsetting,
+    },
+#endif
+    {
+        .num_altsetting = 1,
+        .altsetting     = tap_iface,
+    },
 };
 
 /* -------------------------------------------------------------------------- */
@@ -199,7 +533,7 @@ const struct usb_config_descriptor config_descriptor = {
     .bLength             = USB_DT_CONFIGURATION_SIZE,
     .bDescriptorType     = USB_DT_CONFIGURATION,
     .wTotalLength        = 0,   /* filled in by library */
-    .bNumInterfaces      = 2,
+    .bNumInterfaces      = 3 + AUDIO_HEADSET,
     .bConfigurationValue = 1,
     .iConfiguration      = 0,
     .bmAttributes        = 0x80, /* bus powered */
@@ -218,7 +552,13 @@ static char usb_serial[25] = "STM32 Unique ID";
 
 const char *usb_strings[] = {
     "Your Manufacturer",
+#if AUDIO_UAC2
+    "STM32F411 UAC2 Microphone",
+#elif AUDIO_HEADSET
+    "STM32F411 UAC1 Headset",
+#else
     "STM32F411 UAC1 Microphone",
+#endif
     usb_serial,
 };
 
@@ -227,47 +567,49 @@ const char *usb_strings[] = {
 /* -------------------------------------------------------------------------- */
 
 static volatile bool usb_configured          = false;
-static volatile bool audio_streaming_enabled = false;
 static usbd_device *audio_dev                = NULL;
 
-/* SOF callback: generate a 1 kHz sine at 48 kHz mono 16-bit */
+/* SOF callback: one packet per frame while streaming, then background work */
 static void audio_sof_callback(void)
 {
-    if (!usb_configured || !audio_streaming_enabled || !audio_dev) {
+    if (!usb_configured || !audio_dev) {
         return;
     }
 
-    static uint16_t phase = 0;
-    static uint8_t  pcm[AUDIO_PACKET_SIZE];
-
-    gpio_set(GPIOA, GPIO0);
-    for (int i = 0; i < AUDIO_PACKET_SIZE / 2; i++) {
-        /* simple phase -> time in cycles */
-//g        float t = 2.0f * (float)M_PI * 1000.0f *
-//g                  (float)phase / (float)AUDIO_SAMPLE_RATE_HZ; /* 1 kHz */
-//g        float s = sinf(t) * 30000.0f;
-//g        int16_t sample = (int16_t)s;
-//g
-        int16_t sample = 4096;
-        pcm[2 * i + 0] = (uint8_t)(sample & 0xFF);
-        pcm[2 * i + 1] = (uint8_t)((sample >> 8) & 0xFF);
-
- //       phase++;
-        gpio_clear(GPIOA, GPIO0);
-
+    if (audio_stream_format()) {
+        audio_stream_sof(audio_dev);
     }
-
-    (void)usbd_ep_write_packet(audio_dev, EP_AUDIO_IN, pcm, AUDIO_PACKET_SIZE);
+#if AUDIO_HEADSET
+    usb_speaker_sof(audio_dev);
+#endif
+    usb_tap_sof();
+    usb_vendor_sof();
 }
 
-/* Altsetting callback: enable/disable streaming */
+/* Altsetting callback: alt 0 stops, alt N streams format row N */
 static void audio_set_interface(usbd_device *dev, uint16_t iface, uint16_t alt)
 {
     (void)dev;
 
-    if (iface == IFACE_AUDIO_STREAM) {
-        audio_streaming_enabled = (alt == 1);
+#if AUDIO_HEADSET
+    if (iface == IFACE_AUDIO_SPEAKER) {
+        /* Clocks up before playback starts, down after it stops */
+        if (alt) {
+            stream_power_speaker(true);
+        }
+        usb_speaker_set_alt(alt);
+        if (!alt) {
+            stream_power_speaker(false);
+        }
+        return;
     }
+#endif
+    if (iface != IFACE_AUDIO_STREAM) {
+        return;
+    }
+
+    stream_power_select(audio_format_for_alt((uint8_t)alt),
+                        audio_req_sampling_rate());
 }
 
 /* Convert a work to 8 hex chars */
@@ -295,6 +637,40 @@ void usb_set_unique_serial()
     usb_serial[24] = '\0';
 }
 
+/* -------------------------------------------------------------------------- */
+/* BUS SUSPEND / RESUME / RESET CALLBACKS                                     */
+/* -------------------------------------------------------------------------- */
+
+void usb_suspend(void)
+{
+#if AUDIO_HEADSET
+    usb_speaker_set_alt(0);
+#endif
+    stream_power_suspend();
+}
+
+/* The host keeps the alternate settings: pick both streams up again */
+void usb_resume(void)
+{
+    stream_power_resume();
+#if AUDIO_HEADSET
+    if (audio_spk_cur_altsetting) {
+        stream_power_speaker(true);
+        usb_speaker_set_alt(audio_spk_cur_altsetting);
+    }
+#endif
+}
+
+void usb_reset(void)
+{
+#if AUDIO_HEADSET
+    usb_speaker_set_alt(0);
+    audio_spk_cur_altsetting = 0;
+#endif
+    audio_stream_cur_altsetting = 0;
+    stream_power_reset();
+}
+
 /* -------------------------------------------------------------------------- */
 /* SET CONFIG CALLBACK                                                        */
 /* -------------------------------------------------------------------------- */
@@ -310,10 +686,25 @@ void usb_set_config(usbd_device *usbd_dev, uint16_t wValue)
     usbd_ep_setup(usbd_dev,
                   EP_AUDIO_IN,
                   USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
-                  AUDIO_PACKET_SIZE,
-                  NULL);
+                  AUDIO_MAX_PACKET_SIZE,
+                  audio_stream_in_done);
+
+#if AUDIO_HEADSET
+    usb_speaker_register(usbd_dev);
+#endif
+
+    /* After the iso endpoints: the tap FIFO takes what they leave */
+    usb_tap_register(usbd_dev);
 
     /* Register callbacks */
     usbd_register_set_altsetting_callback(usbd_dev, audio_set_interface);
+    audio_control_register(usbd_dev);
+    usb_vendor_register(usbd_dev);
     usbd_register_sof_callback(usbd_dev, audio_sof_callback);
+
+    /*
+     * The dwc driver leaves SOF masked; needed when running from the IRQ.
+     * It does not handle incomplete iso IN either: main.c does.
+     */
+    OTG_FS_GINTMSK |= OTG_GINTMSK_SOFM | OTG_GINTMSK_IISOIXFRM;
 }
@@ -2,14 +2,31 @@
 
 #include <libopencm3/usb/usbd.h>
 
-/* Interface numbers */
+#include "usb_audio_uac1.h"
+
+/* Interface numbers; the speaker only exists in AUDIO_HEADSET builds */
 enum {
     IFACE_AUDIO_CONTROL = 0,
     IFACE_AUDIO_STREAM  = 1,
+    IFACE_AUDIO_SPEAKER = 2,
+    IFACE_VENDOR_TAP    = 2 + AUDIO_HEADSET,
 };
 
-/* Endpoint address (iso IN) */
+/*
+ * Endpoint addresses: audio iso IN, diagnostic tap bulk IN, and for the
+ * headset the speaker iso OUT with its feedback iso IN
+ */
 #define EP_AUDIO_IN 0x81
+#define EP_TAP_IN   0x82
+#define EP_SPK_OUT  0x01
+#define EP_SPK_FB   0x83
+
+/*
+ * Control buffer main.c gives usbd_init(). libopencm3 builds descriptor
+ * replies in it without checking its size, so it has to hold the whole
+ * configuration descriptor (250 bytes for the headset).
+ */
+#define USB_CONTROL_BUFFER_BYTES  512
 
 /* Descriptors exposed to main.c */
 extern const struct usb_device_descriptor  dev_descriptor;
@@ -20,3 +37,8 @@ extern const char *usb_strings[];
 void usb_set_config(usbd_device *dev, uint16_t wValue);
 void usb_set_unique_serial(void);
 
+/* Bus suspend / resume / reset callbacks, registered by main.c */
+void usb_suspend(void);
+void usb_resume(void);
+void usb_reset(void);
+
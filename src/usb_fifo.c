@@ -0,0 +1,151 @@
+#include <string.h>
+
+#include <libopencm3/usb/dwc/otg_fs.h>
+
+#include "usb_fifo.h"
+
+#define FIFO_WINDOW_BYTES  0x1000
+
+/* DIEPTSIZx packet count, bits 28:19 (the EP0 macro covers only bit 19) */
+#define DIEPTSIZ_PKTCNT(n)    ((uint32_t)(n) << 19)
+#define DIEPTSIZ_PKTCNT_MASK  DIEPTSIZ_PKTCNT(0x3FF)
+#define DIEPCTL_MPSIZ_MASK    0x7FF
+
+/* Periodic IN: packets per frame, DIEPTSIZx bits 30:29 */
+#define DIEPTSIZ_MCNT(n)      ((uint32_t)(n) << 29)
+
+/* Iso frame parity and endpoint disable, not in libopencm3's headers */
+#define DIEPCTL_SEVNFRM       (1u << 28)
+#define DIEPCTL_SODDFRM       (1u << 29)
+#define DIEPINT_EPDISD        (1u << 1)
+#define DIEPINT_INEPNE        (1u << 6)
+#define GRSTCTL_TXFNUM(n)     ((uint32_t)(n) << 6)
+
+/* Each flush wait: a few us at 96 MHz; the core takes a few PHY clocks */
+#define FLUSH_SPINS           256
+
+_Static_assert(1023 <= FIFO_WINDOW_BYTES, "packet outgrows the FIFO window");
+
+/* Same arming sequence as the dwc driver's ep_write_packet */
+static void fifo_send(uint8_t ep, struct audio_ring *r, uint16_t len,
+                      uint32_t packets)
+{
+    OTG_FS_DIEPTSIZ(ep) = DIEPTSIZ_PKTCNT(packets) | len;
+    OTG_FS_DIEPCTL(ep) |= OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_CNAK;
+
+    (void)audio_ring_read_words(r, &OTG_FS_FIFO(ep), len);
+}
+
+/* Iso: one packet for frame's parity */
+static void iso_arm(uint8_t ep, uint16_t len, uint32_t frame)
+{
+    OTG_FS_DIEPTSIZ(ep) = DIEPTSIZ_MCNT(1) | DIEPTSIZ_PKTCNT(1) | len;
+    OTG_FS_DIEPCTL(ep) |= OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_CNAK |
+                          ((frame & 1) ? DIEPCTL_SODDFRM : DIEPCTL_SEVNFRM);
+}
+
+bool usb_fifo_busy(uint8_t ep)
+{
+    return (OTG_FS_DIEPTSIZ(ep & 0x7F) & DIEPTSIZ_PKTCNT_MASK) != 0;
+}
+
+int usb_fifo_peek_iso(uint8_t ep, struct audio_ring *r, uint16_t len,
+                      uint32_t frame)
+{
+    ep &= 0x7F;
+
+    if (usb_fifo_busy(ep)) {
+        return 0;
+    }
+    if (!audio_ring_has(r, len)) {
+        return USB_FIFO_UNDERRUN;
+    }
+
+    iso_arm(ep, len, frame);
+    (void)audio_ring_peek_words(r, &OTG_FS_FIFO(ep), len);
+    return len;
+}
+
+int usb_fifo_write_iso(uint8_t ep, const void *buf, uint16_t len,
+                       uint32_t frame)
+{
+    const uint8_t *p = buf;
+    volatile uint32_t *dst;
+
+    ep &= 0x7F;
+    dst = &OTG_FS_FIFO(ep);
+
+    if (usb_fifo_busy(ep)) {
+        return 0;
+    }
+
+    iso_arm(ep, len, frame);
+    for (uint32_t i = 0; i < len; i += 4) {
+        uint32_t w = 0;
+
+        memcpy(&w, p + i, len - i < 4 ? len - i : 4);
+        *dst++ = w;
+    }
+    return len;
+}
+
+/* Spin until (*reg & bit) == want, at most FLUSH_SPINS reads */
+static bool flush_wait(volatile uint32_t *reg, uint32_t bit, uint32_t want)
+{
+    for (uint32_t n = FLUSH_SPINS; n; n--) {
+        if ((*reg & bit) == want) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The reference manual's IN endpoint disable sequence, then the TX FIFO flush */
+bool usb_fifo_flush(uint8_t ep)
+{
+    ep &= 0x7F;
+
+    if (OTG_FS_DIEPCTL(ep) & OTG_DIEPCTL0_EPENA) {
+        OTG_FS_DIEPCTL(ep) |= OTG_DIEPCTL0_SNAK;
+        if (!flush_wait(&OTG_FS_DIEPINT(ep), DIEPINT_INEPNE, DIEPINT_INEPNE)) {
+            return false;
+        }
+
+        OTG_FS_DIEPCTL(ep) |= OTG_DIEPCTL0_SNAK | OTG_DIEPCTL0_EPDIS;
+        if (!flush_wait(&OTG_FS_DIEPINT(ep), DIEPINT_EPDISD, DIEPINT_EPDISD)) {
+            return false;
+        }
+        OTG_FS_DIEPINT(ep) = DIEPINT_INEPNE | DIEPINT_EPDISD;
+    }
+
+    OTG_FS_GRSTCTL = GRSTCTL_TXFNUM(ep) | OTG_GRSTCTL_TXFFLSH;
+    if (!flush_wait(&OTG_FS_GRSTCTL, OTG_GRSTCTL_TXFFLSH, 0)) {
+        return false;
+    }
+
+    OTG_FS_DIEPTSIZ(ep) = 0;
+    return true;
+}
+
+int usb_fifo_write_bulk(uint8_t ep, struct audio_ring *r, uint16_t len,
+                        uint16_t packet_size)
+{
+    ep &= 0x7F;
+
+    if (OTG_FS_DIEPTSIZ(ep) & DIEPTSIZ_PKTCNT_MASK) {
+        return 0;
+    }
+    if (!audio_ring_has(r, len)) {
+        return USB_FIFO_UNDERRUN;
+    }
+
+    fifo_send(ep, r, len, (len + packet_size - 1u) / packet_size);
+    return len;
+}
+
+void usb_fifo_set_packet_size(uint8_t ep, uint16_t packet_size)
+{
+    ep &= 0x7F;
+
+    OTG_FS_DIEPCTL(ep) = (OTG_FS_DIEPCTL(ep) & ~DIEPCTL_MPSIZ_MASK) | packet_size;
+}
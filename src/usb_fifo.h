@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_ring.h"
+
+/*
+ * Zero-copy IN writes for the OTG_FS core: iso audio packets and batched
+ * bulk transfers for the diagnostic tap.
+ *
+ * usbd_ep_write_packet() wants the whole packet in one contiguous buffer,
+ * so ring data had to be staged first and was copied twice. Here the
+ * endpoint is armed the same way and the payload goes from the capture
+ * ring to the TX FIFO in 32-bit words, wrap included.
+ *
+ * Any address in an endpoint's 4 KB FIFO window pushes to that FIFO, so
+ * the ring is handed an incrementing pointer into the window; a 1023-byte
+ * packet uses the first 1 KB of it.
+ */
+
+#define USB_FIFO_UNDERRUN  (-1)
+
+/*
+ * Isochronous IN. The core sends an armed iso packet only in a frame of
+ * the parity it was armed for (DIEPCTL SEVNFRM / SODDFRM); one that
+ * misses its frame stays queued, and nothing else can be armed behind it,
+ * until usb_fifo_flush() drops it. frame is the 11-bit number of the
+ * frame to send in; only its parity reaches the core.
+ */
+
+/*
+ * Arm len bytes from the head of r for frame, leaving them in r to be
+ * skipped once sent (or sent again after a flush). Returns len; 0 if the
+ * endpoint still holds a packet; or USB_FIFO_UNDERRUN if r holds less.
+ */
+int usb_fifo_peek_iso(uint8_t ep, struct audio_ring *r, uint16_t len,
+                      uint32_t frame);
+
+/* As above from a buffer (any alignment); 0 if the endpoint is busy */
+int usb_fifo_write_iso(uint8_t ep, const void *buf, uint16_t len,
+                       uint32_t frame);
+
+/* A packet is armed and not yet sent */
+bool usb_fifo_busy(uint8_t ep);
+
+/*
+ * Drop whatever the IN endpoint holds: NAK it, disable it and flush its
+ * TX FIFO, waiting a bounded time for each step; it can be armed again at
+ * once. False if a step timed out, leaving the endpoint as it stands (and
+ * still busy if it was).
+ */
+bool usb_fifo_flush(uint8_t ep);
+
+/*
+ * Bulk IN: send len bytes from r as one transfer of packet_size packets,
+ * the last one possibly short. Returns len; 0, with nothing consumed, while the
+ * previous transfer is still in flight; or USB_FIFO_UNDERRUN. The
+ * endpoint's TX FIFO must hold len bytes.
+ */
+int usb_fifo_write_bulk(uint8_t ep, struct audio_ring *r, uint16_t len,
+                        uint16_t packet_size);
+
+/*
+ * usbd_ep_setup() sizes an IN endpoint's TX FIFO by its max packet size.
+ * Set it up with the FIFO size wanted, then put the real packet size back
+ * with this.
+ */
+void usb_fifo_set_packet_size(uint8_t ep, uint16_t packet_size);
@@ -0,0 +1,76 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/usbstd.h>
+
+#include "usb_speaker.h"
+#include "usb_descriptors.h"
+#include "usb_fifo.h"
+#include "audio_playback.h"
+#include "sof_timer.h"
+
+/* The OTG TX FIFO takes no less than 16 words, whatever the packet size */
+#define USB_SPEAKER_FB_FIFO_BYTES  64
+
+static volatile bool playing;
+
+/* One OUT packet; the driver reads the RX FIFO in whole words */
+static uint8_t rx_buf[(AUDIO_SPK_MAX_PACKET_SIZE + 3) & ~3u]
+    __attribute__((aligned(4)));
+
+static void speaker_rx(usbd_device *dev, uint8_t ep)
+{
+    uint16_t len = usbd_ep_read_packet(dev, ep, rx_buf, sizeof(rx_buf));
+
+    if (playing) {
+        audio_playback_rx(rx_buf, len);
+    }
+}
+
+void usb_speaker_register(usbd_device *dev)
+{
+    usbd_ep_setup(dev, EP_SPK_OUT,
+                  USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
+                  AUDIO_SPK_MAX_PACKET_SIZE, speaker_rx);
+
+    usbd_ep_setup(dev, EP_SPK_FB,
+                  USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_FEEDBACK,
+                  USB_SPEAKER_FB_FIFO_BYTES, NULL);
+    usb_fifo_set_packet_size(EP_SPK_FB, AUDIO_FEEDBACK_SIZE);
+}
+
+void usb_speaker_set_alt(uint16_t alt)
+{
+    playing = false;
+    audio_playback_stop();
+
+    if (alt == 1) {
+        audio_playback_start();
+        playing = true;
+    }
+}
+
+void usb_speaker_sof(usbd_device *dev)
+{
+    (void)dev;
+
+    if (!playing) {
+        return;
+    }
+
+    uint32_t fb = audio_playback_sof(sof_timer_last_sof());
+    uint8_t pkt[AUDIO_FEEDBACK_SIZE] = {
+        (uint8_t)fb, (uint8_t)(fb >> 8), (uint8_t)(fb >> 16),
+    };
+
+    /*
+     * Last frame's value not taken: it is armed for the wrong parity now
+     * and would block the endpoint for good, so drop it for the fresh one.
+     * A flush that times out leaves it busy, and the next SOF tries again.
+     */
+    if (usb_fifo_busy(EP_SPK_FB)) {
+        (void)usb_fifo_flush(EP_SPK_FB);
+    }
+    (void)usb_fifo_write_iso(EP_SPK_FB, pkt, sizeof(pkt), sof_timer_frame());
+}
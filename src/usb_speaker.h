@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <libopencm3/usb/usbd.h>
+
+/*
+ * Headset speaker endpoints (AUDIO_HEADSET): the isochronous OUT data
+ * endpoint feeding audio_playback.h and its explicit feedback endpoint.
+ *
+ * Each OUT packet is read straight into a staging buffer from the USB
+ * interrupt and appended to the playback ring. Once per SOF the feedback
+ * endpoint is armed for that frame with the current 10.14 rate
+ * (fb_ctrl.h); the host polls it every frame (bInterval 1). A value the
+ * host did not take is flushed and replaced by the fresh one.
+ */
+
+/* Endpoint setup; call from the set-config callback before usb_tap_register() */
+void usb_speaker_register(usbd_device *dev);
+
+/* Speaker interface alternate setting: 0 stops, 1 plays */
+void usb_speaker_set_alt(uint16_t alt);
+
+/* Arm the feedback endpoint; call from the SOF callback */
+void usb_speaker_sof(usbd_device *dev);
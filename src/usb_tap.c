@@ -0,0 +1,63 @@
+#include <stddef.h>
+
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/usbstd.h>
+
+#include "usb_tap.h"
+#include "usb_descriptors.h"
+#include "usb_fifo.h"
+#include "audio_tap.h"
+#include "task_queue.h"
+#include "cycle_counter.h"
+#include "profiler.h"
+
+static int feed_task = -1;
+
+/* Thread mode: next batch from the tap ring, if the endpoint is free */
+static void tap_feed(void)
+{
+    struct audio_ring *r = audio_tap_ring();
+    uint32_t t0 = cycles_now();
+    uint32_t n  = audio_ring_fill(r);
+
+    if (n == 0) {
+        return;
+    }
+    if (n > USB_TAP_BATCH_BYTES) {
+        n = USB_TAP_BATCH_BYTES;
+    }
+
+    if (usb_fifo_write_bulk(EP_TAP_IN, r, (uint16_t)n, USB_TAP_PACKET_SIZE) > 0) {
+        prof_record(PROF_STAGE_TAP_FEED, cycles_now() - t0);
+    }
+}
+
+/* USB interrupt: a batch went out, queue the next one */
+static void tap_in_complete(usbd_device *dev, uint8_t ep)
+{
+    (void)dev;
+    (void)ep;
+
+    if (feed_task >= 0) {
+        task_post(feed_task);
+    }
+}
+
+void usb_tap_sof(void)
+{
+    if (feed_task >= 0 && audio_ring_fill(audio_tap_ring())) {
+        task_post(feed_task);
+    }
+}
+
+void usb_tap_register(usbd_device *dev)
+{
+    if (feed_task < 0) {
+        feed_task = task_register(tap_feed);
+    }
+
+    /* TX FIFO sized for a whole batch, then the real packet size */
+    usbd_ep_setup(dev, EP_TAP_IN, USB_ENDPOINT_ATTR_BULK,
+                  USB_TAP_BATCH_BYTES, tap_in_complete);
+    usb_fifo_set_packet_size(EP_TAP_IN, USB_TAP_PACKET_SIZE);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <libopencm3/usb/usbd.h>
+
+#include "audio_format.h"
+
+/*
+ * Vendor bulk IN endpoint carrying the diagnostic tap stream
+ * (audio_tap.h, wire format in tap_stream.h).
+ *
+ * The endpoint is fed from a thread-mode task, never from an interrupt:
+ * the USB interrupt only posts it (on transfer complete and after each
+ * SOF's audio packet), so tap traffic cannot delay the iso write. On the
+ * bus, the host schedules bulk after the periodic iso transfers, so the
+ * tap only gets the frame time audio leaves over.
+ *
+ * Data goes out in transfers of up to USB_TAP_BATCH_BYTES: full 64-byte
+ * packets and at most one short one, straight from the tap ring to the
+ * TX FIFO. The FIFO is sized for one batch, from what the iso endpoint
+ * leaves of the 1.25 KB shared FIFO RAM.
+ */
+
+#define USB_TAP_PACKET_SIZE  64
+
+#if AUDIO_MAX_PACKET_SIZE > 512
+#define USB_TAP_BATCH_BYTES  128
+#else
+#define USB_TAP_BATCH_BYTES  256
+#endif
+
+/* Endpoint and feeder setup; call from the set-config callback */
+void usb_tap_register(usbd_device *dev);
+
+/* Kick the feeder; call from the SOF callback after the audio packet */
+void usb_tap_sof(void);
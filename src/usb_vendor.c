@@ -0,0 +1,140 @@
+#include <stddef.h>
+
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/usbstd.h>
+
+#include "usb_vendor.h"
+#include "profiler.h"
+#include "cycle_counter.h"
+#include "test_source.h"
+#include "dsp_chain.h"
+#include "audio_tap.h"
+#include "audio_meter.h"
+#include "sync_map.h"
+#include "task_queue.h"
+
+/* Larger than the control buffer, so IN data is sent from here */
+static uint8_t prof_blob[PROF_BLOB_SIZE] __attribute__((aligned(4)));
+static uint8_t meter_blob[METER_BLOB_SIZE] __attribute__((aligned(4)));
+static uint8_t sync_blob[SYNC_BLOB_SIZE] __attribute__((aligned(4)));
+
+/* Thread-mode meter analysis, kicked once per SOF */
+static int meter_task = -1;
+
+static enum usbd_request_return_codes
+vendor_control(usbd_device *dev, struct usb_setup_data *req,
+               uint8_t **buf, uint16_t *len,
+               usbd_control_complete_callback *complete)
+{
+    (void)dev;
+    (void)complete;
+
+    switch (req->bRequest) {
+    case VENDOR_REQ_PROF_READ: {
+        if (!(req->bmRequestType & USB_REQ_TYPE_IN)) {
+            return USBD_REQ_NOTSUPP;
+        }
+
+        struct task_idle_stats idle;
+
+        task_get_idle_stats(&idle, 1);
+
+        uint32_t n = prof_snapshot(prof_blob, sizeof(prof_blob), cycles_now(), &idle);
+
+        *buf = prof_blob;
+        if (*len > n) {
+            *len = (uint16_t)n;
+        }
+        return USBD_REQ_HANDLED;
+    }
+
+    case VENDOR_REQ_PROF_RESET: {
+        struct task_idle_stats idle;
+
+        prof_reset();
+        task_get_idle_stats(&idle, 1);
+        *len = 0;
+        return USBD_REQ_HANDLED;
+    }
+
+    case VENDOR_REQ_TEST_SOURCE:
+        if (!test_source_select((enum test_source_mode)req->wValue, req->wIndex)) {
+            return USBD_REQ_NOTSUPP;
+        }
+        *len = 0;
+        return USBD_REQ_HANDLED;
+
+    case VENDOR_REQ_DSP_ENABLE:
+        if (req->wValue & ~DSP_CHAIN_ALL_STAGES) {
+            return USBD_REQ_NOTSUPP;
+        }
+        dsp_chain_set_enabled(req->wValue);
+        *len = 0;
+        return USBD_REQ_HANDLED;
+
+    case VENDOR_REQ_TAP_SELECT:
+        if (req->wValue > 0xFF ||
+            !audio_tap_select((uint8_t)req->wValue, req->wIndex)) {
+            return USBD_REQ_NOTSUPP;
+        }
+        *len = 0;
+        return USBD_REQ_HANDLED;
+
+    case VENDOR_REQ_METER_READ: {
+        if (!(req->bmRequestType & USB_REQ_TYPE_IN)) {
+            return USBD_REQ_NOTSUPP;
+        }
+
+        uint32_t n = audio_meter_snapshot(meter_blob, sizeof(meter_blob));
+
+        *buf = meter_blob;
+        if (*len > n) {
+            *len = (uint16_t)n;
+        }
+        return USBD_REQ_HANDLED;
+    }
+
+    case VENDOR_REQ_METER_CONFIG:
+        if (!audio_meter_configure(req->wValue, req->wIndex)) {
+            return USBD_REQ_NOTSUPP;
+        }
+        *len = 0;
+        return USBD_REQ_HANDLED;
+
+    case VENDOR_REQ_SYNC_READ: {
+        if (!(req->bmRequestType & USB_REQ_TYPE_IN)) {
+            return USBD_REQ_NOTSUPP;
+        }
+
+        uint32_t n = sync_map_snapshot(sync_blob, sizeof(sync_blob));
+
+        *buf = sync_blob;
+        if (*len > n) {
+            *len = (uint16_t)n;
+        }
+        return USBD_REQ_HANDLED;
+    }
+
+    default:
+        return USBD_REQ_NEXT_CALLBACK;
+    }
+}
+
+void usb_vendor_sof(void)
+{
+    if (meter_task >= 0 && audio_meter_pending()) {
+        task_post(meter_task);
+    }
+}
+
+void usb_vendor_register(usbd_device *dev)
+{
+    if (meter_task < 0) {
+        meter_task = task_register(audio_meter_run);
+    }
+
+    usbd_register_control_callback(dev,
+                                   USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_DEVICE,
+                                   USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+                                   vendor_control);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <libopencm3/usb/usbd.h>
+
+/*
+ * Vendor-specific control requests (bmRequestType vendor | device).
+ *
+ *   0xC0 PROF_READ   wLength >= PROF_BLOB_SIZE, returns a profile blob;
+ *                    starts a new idle window
+ *   0x40 PROF_RESET  no data, clears every profiler stage and the idle
+ *                    window
+ *   0x40 TEST_SOURCE no data, wValue = enum test_source_mode,
+ *                    wIndex = frequency in Hz (0 = default)
+ *   0x40 DSP_ENABLE  no data, wValue = DSP_STAGE_BIT mask (dsp_chain.h)
+ *   0x40 TAP_SELECT  no data, wValue = stage to stream on the tap
+ *                    endpoint (TAP_REC_RAW .. TAP_REC_OUTPUT, 0 = none),
+ *                    wIndex = telemetry period in ms (0 = none)
+ *   0xC0 METER_READ  wLength >= METER_BLOB_SIZE, returns a meter blob
+ *                    (meter_blob.h)
+ *   0x40 METER_CONFIG no data, wValue = AUDIO_METER_* analysis mask
+ *                    (audio_meter.h, 0 = off), wIndex = level window in
+ *                    ms (0 = default)
+ *   0xC0 SYNC_READ   wLength >= SYNC_BLOB_SIZE, returns the USB frame ->
+ *                    sample mapping (sync_blob.h)
+ */
+
+#define VENDOR_REQ_PROF_READ    0x01
+#define VENDOR_REQ_PROF_RESET   0x02
+#define VENDOR_REQ_TEST_SOURCE  0x03
+#define VENDOR_REQ_DSP_ENABLE   0x04
+#define VENDOR_REQ_TAP_SELECT   0x05
+#define VENDOR_REQ_METER_READ   0x06
+#define VENDOR_REQ_METER_CONFIG 0x07
+#define VENDOR_REQ_SYNC_READ    0x08
+
+/* Register vendor request handlers; call from the set-config callback */
+void usb_vendor_register(usbd_device *dev);
+
+/* Kick the meter analysis task; call from the SOF callback */
+void usb_vendor_sof(void);